@@ -0,0 +1,1040 @@
+#include "audioengine.h"
+
+#include <taglib/fileref.h>
+#include <taglib/tag.h>
+
+#include <cmath>
+#include <cstring>
+
+#include "helper.h"
+#include "samplekernels.h"
+#include "trackprobe.h"
+
+namespace {
+const int kDecodeFrames = 4096;      // frames decoded by one sf_readf_float
+const double kPrerollSeconds = 3.0;  // how much of next track to pre-decode
+const double kRingSeconds = 1.0;     // how much audio is buffered ahead
+const double kProbeSeconds = 0.01;   // length of latency test tone
+const double kProbeFrequency = 1000;  // Hz
+const float kProbeLevel = 0.5f;
+const float kProbeMinLevel = 0.02f;  // captured level which counts as tone
+const std::chrono::milliseconds kProbeTimeout(1000);  // wait for test tone
+const std::chrono::milliseconds kCaptureSettle(200);  // noise floor is read
+const std::chrono::milliseconds kDecoderPeriod(10);  // decoder wakeup period
+const size_t kHistoryFrames = 64;  // frames before seek position for resampler
+
+int64_t now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// gains of incoming and outgoing track at point t (0..1) of crossfade
+void crossfade_gains(AudioEngine::CrossfadeCurve curve, double t,
+                     float &in, float &out) {
+  t = std::min(1.0, std::max(0.0, t));
+  switch (curve) {
+    case AudioEngine::CROSSFADE_LINEAR:
+      in = t;
+      out = 1 - t;
+      break;
+    case AudioEngine::CROSSFADE_S_CURVE:
+      in = 0.5 - 0.5 * std::cos(M_PI * t);
+      out = 1 - in;
+      break;
+    case AudioEngine::CROSSFADE_EQUAL_POWER:
+    default:
+      in = std::sin(M_PI_2 * t);
+      out = std::cos(M_PI_2 * t);
+      break;
+  }
+}
+}  // namespace
+
+LocalTrack::~LocalTrack() {
+  if (m_file) sf_close(m_file);
+}
+
+bool LocalTrack::open(const std::string &filename, int channels) {
+  m_filename = filename;
+  if (m_mapped.open(filename))  // decode straight from page cache
+    m_file = m_mapped.open_sndfile(&m_info);
+  if (!m_file) {  // not mappable, e.g. pipe, use plain reads
+    m_mapped.close();
+    m_file = sf_open(filename.c_str(), SFM_READ, &m_info);
+  }
+  if (!m_file) {
+    Helper::get_instance().log("Error opening file " + filename + ": " +
+                               sf_strerror(nullptr));
+    return false;
+  }
+  if (m_info.samplerate <= 0 || m_info.channels <= 0) {
+    Helper::get_instance().log("Invalid audio format of " + filename);
+    return false;
+  }
+  m_device_channels = channels;
+  m_decode_buffer.resize(kDecodeFrames * m_info.channels);
+  m_duration = (double)m_info.frames / m_info.samplerate;
+  if (SeekIndex::is_needed(m_info))  // built on one of previous plays
+    set_seek_index(SeekIndex::load_cached(filename));
+
+  TagLib::FileRef ref(filename.c_str(), false);  // read title and artist
+  if (!ref.isNull() && ref.tag()) {
+    m_title = ref.tag()->title().to8Bit(true);
+    m_artist = ref.tag()->artist().to8Bit(true);
+  }
+  if (m_title.empty() && m_artist.empty()) m_title = filename;
+  return true;
+}
+
+void LocalTrack::open_decoded(const std::string &filename,
+                              std::shared_ptr<const DecodedAudio> audio) {
+  m_filename = filename;
+  m_title = audio->title;
+  m_artist = audio->artist;
+  m_info.samplerate = audio->rate;
+  m_info.channels = audio->channels;
+  m_info.frames = audio->get_frames();  // exact, whole track was decoded
+  m_device_channels = audio->channels;
+  m_duration = (double)m_info.frames / m_info.samplerate;
+  m_decoded = std::move(audio);
+}
+
+void LocalTrack::record(size_t limit) {
+  m_record_limit = limit;
+  m_recorded.clear();
+  size_t estimate = (size_t)m_info.frames * m_device_channels;
+  if (limit > 0 && estimate * sizeof(float) <= limit)
+    m_recorded.reserve(estimate + estimate / 64);  // length may be estimated
+}
+
+std::shared_ptr<DecodedAudio> LocalTrack::take_recorded() {
+  if (m_record_limit == 0 || !at_end() || m_recorded.empty()) return nullptr;
+  auto audio = std::make_shared<DecodedAudio>();
+  audio->title = m_title;
+  audio->artist = m_artist;
+  audio->rate = m_info.samplerate;
+  audio->channels = m_device_channels;
+  if (m_recorded.capacity() > m_recorded.size() + m_recorded.size() / 32)
+    m_recorded.shrink_to_fit();  // length in header was too big
+  audio->samples = std::move(m_recorded);
+  stop_recording();
+  return audio;
+}
+
+void LocalTrack::stop_recording() {
+  m_record_limit = 0;
+  std::vector<float>().swap(m_recorded);
+}
+
+bool LocalTrack::probe(const std::string &filename, std::string &title,
+                       std::string &artist, double &duration) {
+  return TrackProbe::probe(filename, title, artist, duration);
+}
+
+void LocalTrack::remix(const float *src, float *dst, size_t frames) const {
+  const int in = m_info.channels, out = m_device_channels;
+  if (in == out) {
+    std::memcpy(dst, src, frames * in * sizeof(float));
+    return;
+  }
+  for (size_t i = 0; i < frames; i++, src += in, dst += out) {
+    if (out == 1) {  // average all channels
+      float sum = 0;
+      for (int c = 0; c < in; c++) sum += src[c];
+      dst[0] = sum / in;
+    } else if (in == 1) {  // mono into front pair
+      dst[0] = dst[1] = src[0];
+      for (int c = 2; c < out; c++) dst[c] = 0;
+    } else if (out == 2) {  // surround into stereo, keep center
+      const float center = 0.7071f;
+      dst[0] = (src[0] + center * src[2]) / (1 + center);
+      dst[1] = (src[1] + center * src[2]) / (1 + center);
+    } else {  // same channels order, drop or silence the rest
+      for (int c = 0; c < out; c++) dst[c] = c < in ? src[c] : 0;
+    }
+  }
+}
+
+void LocalTrack::preroll(double seconds, const std::atomic_bool &cancel) {
+  if (m_decoded) return;  // already in memory
+  size_t needed = (size_t)(seconds * m_info.samplerate);
+  std::vector<float> preroll;
+  preroll.reserve((needed + kDecodeFrames) * m_device_channels);
+  std::vector<float> block(kDecodeFrames * m_device_channels);
+  size_t have = 0;
+  while (have < needed && !cancel) {
+    size_t got = read(block.data(), kDecodeFrames);
+    if (got == 0) break;
+    preroll.insert(preroll.end(), block.begin(),
+                   block.begin() + got * m_device_channels);
+    have += got;
+  }
+  m_preroll = std::move(preroll);
+  m_preroll_pos = 0;
+  m_position = 0;  // preroll is read again from its start
+}
+
+size_t LocalTrack::read(float *dst, size_t frames) {
+  size_t needed = frames * m_device_channels;  // in samples
+  if (m_decoded) {  // whole track is in memory
+    const std::vector<float> &samples = m_decoded->samples;
+    size_t start = std::min<size_t>(m_position * m_device_channels,
+                                    samples.size());
+    size_t count = std::min(needed, samples.size() - start);
+    std::memcpy(dst, samples.data() + start, count * sizeof(float));
+    if (count < needed) m_eof = true;
+    m_position += count / m_device_channels;
+    return count / m_device_channels;
+  }
+  size_t produced = 0;
+  if (m_preroll_pos < m_preroll.size()) {  // serve pre-decoded audio first
+    size_t count = std::min(needed, m_preroll.size() - m_preroll_pos);
+    std::memcpy(dst, m_preroll.data() + m_preroll_pos, count * sizeof(float));
+    m_preroll_pos += count;
+    produced += count;
+    if (m_preroll_pos == m_preroll.size()) {  // not needed anymore
+      m_preroll.clear();
+      m_preroll.shrink_to_fit();
+      m_preroll_pos = 0;
+    }
+  }
+  while (produced < needed && !m_eof) {
+    size_t count =
+        std::min((needed - produced) / m_device_channels, (size_t)kDecodeFrames);
+    sf_count_t got = sf_readf_float(m_file, m_decode_buffer.data(), count);
+    if (got <= 0) {
+      m_eof = true;
+      break;
+    }
+    remix(m_decode_buffer.data(), dst + produced, got);
+    if (m_record_limit > 0) {
+      if ((m_recorded.size() + got * m_device_channels) * sizeof(float) >
+          m_record_limit)
+        stop_recording();  // too long for cache
+      else
+        m_recorded.insert(m_recorded.end(), dst + produced,
+                          dst + produced + got * m_device_channels);
+    }
+    produced += got * m_device_channels;
+  }
+  m_position += produced / m_device_channels;
+  return produced / m_device_channels;
+}
+
+void LocalTrack::set_seek_index(std::shared_ptr<const SeekIndex> index) {
+  if (!index) return;
+  m_seek_index = std::move(index);
+  // length in header of compressed file is often estimated
+  m_info.frames = m_seek_index->get_frames();
+  m_duration = (double)m_info.frames / m_info.samplerate;
+}
+
+bool LocalTrack::seek(uint64_t frame) {
+  if (m_decoded) {
+    m_position = std::min<uint64_t>(frame, m_info.frames);
+    m_eof = false;
+    return true;
+  }
+  bool found = m_seek_index &&
+               m_seek_index->seek(m_file, m_mapped.data() ? &m_mapped : nullptr,
+                                  frame, m_decode_buffer);
+  if (!found && sf_seek(m_file, frame, SEEK_SET) < 0) {
+    Helper::get_instance().log("Can't seek " + m_filename);
+    return false;
+  }
+  m_preroll.clear();
+  m_preroll_pos = 0;
+  m_eof = false;
+  m_position = frame;
+  // recorded audio must be contiguous from start of track
+  if (frame == 0)
+    m_recorded.clear();
+  else
+    stop_recording();
+  return true;
+}
+
+AudioEngine::~AudioEngine() { shutdown(); }
+
+bool AudioEngine::start(int rate, int channels, int period) {
+  SDL_AudioSpec want = {0};
+  want.freq = rate;
+  want.format = AUDIO_F32SYS;  // engine works with float samples
+  want.channels = channels;
+  want.samples = period;
+  want.callback = &AudioEngine::audio_callback;
+  want.userdata = this;
+  m_device = SDL_OpenAudioDevice(nullptr, 0, &want, &m_spec,
+                                 SDL_AUDIO_ALLOW_FREQUENCY_CHANGE |
+                                     SDL_AUDIO_ALLOW_CHANNELS_CHANGE |
+                                     SDL_AUDIO_ALLOW_FORMAT_CHANGE);
+  if (m_device != 0 && m_spec.format != AUDIO_F32SYS &&
+      m_spec.format != AUDIO_S16SYS && m_spec.format != AUDIO_S32SYS) {
+    // no kernel for this format, let SDL convert floats
+    SDL_CloseAudioDevice(m_device);
+    m_device = SDL_OpenAudioDevice(
+        nullptr, 0, &want, &m_spec,
+        SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
+  }
+  if (m_device == 0) {
+    Helper::get_instance().log("SDL_OpenAudioDevice failed: " +
+                               std::string(SDL_GetError()));
+    return false;
+  }
+  m_ring.resize((size_t)(kRingSeconds * m_spec.freq) * m_spec.channels);
+  m_source_buffer.resize(kDecodeFrames * m_spec.channels);
+  m_decode_buffer.resize(kDecodeFrames * m_spec.channels);
+  m_fade_buffer.resize(kDecodeFrames * m_spec.channels);
+  m_render_buffer.resize(m_spec.samples * m_spec.channels);
+  m_period = m_spec.samples;
+  m_output_latency_us = estimate_output_latency_us();
+  m_tap.set_rate(m_spec.freq);
+  m_equalizer.setup(m_spec.freq, m_spec.channels, kDecodeFrames);
+  init_dither(m_dither);
+  m_running = true;
+  m_index_cancel = false;
+  m_decoder_thread = std::thread(&AudioEngine::decoder_thread, this);
+  SDL_PauseAudioDevice(m_device, 0);  // callback outputs silence when paused
+  return true;
+}
+
+bool AudioEngine::set_period(int period) {
+  if (m_device == 0) return false;
+  // decoder and other threads touch device only with m_mutex locked
+  std::lock_guard<std::mutex> lock(m_mutex);
+  SDL_AudioSpec want = m_spec, have;
+  want.samples = period;
+  want.callback = &AudioEngine::audio_callback;
+  want.userdata = this;
+  SDL_CloseAudioDevice(m_device);  // waits until callback returns
+  // same format, so ring and resampler stay valid
+  m_device = SDL_OpenAudioDevice(nullptr, 0, &want, &have,
+                                 SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+  bool opened = m_device != 0;
+  if (!opened) {
+    Helper::get_instance().log("Can't reopen audio device with period " +
+                               std::to_string(period) + ": " +
+                               SDL_GetError());
+    m_device = SDL_OpenAudioDevice(nullptr, 0, &m_spec, &have,
+                                   SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+    if (m_device == 0) {
+      Helper::get_instance().log("Audio device is lost: " +
+                                 std::string(SDL_GetError()));
+      return false;
+    }
+  }
+  m_spec.samples = have.samples;
+  m_period = have.samples;
+  m_render_buffer.resize(m_spec.samples * m_spec.channels);
+  m_output_latency_us = estimate_output_latency_us();
+  SDL_PauseAudioDevice(m_device, 0);
+  Helper::get_instance().log("Audio period: " + std::to_string(have.samples) +
+                             " frames, output latency " +
+                             std::to_string(m_output_latency_us / 1000.0) +
+                             " ms");
+  return opened;
+}
+
+int64_t AudioEngine::estimate_output_latency_us() const {
+  // buffer being played and the one filled by callback
+  return (int64_t)2 * m_spec.samples * 1000000 / m_spec.freq;
+}
+
+bool AudioEngine::measure_latency(Latency &latency) {
+  if (m_device == 0 || m_playing) return false;
+  // capture device stands in for ears, it hears output only if it is
+  // monitor of output or there is loopback cable
+  SDL_AudioSpec want = {0}, have;
+  want.freq = m_spec.freq;
+  want.format = AUDIO_F32SYS;
+  want.channels = 1;
+  want.samples = m_period;
+  want.callback = &AudioEngine::capture_callback;
+  want.userdata = this;
+  m_probe_heard_us = -1;
+  m_probe_sent_us = -1;
+  m_probe_threshold = kProbeMinLevel;  // raised above noise floor
+  SDL_AudioDeviceID capture =
+      SDL_OpenAudioDevice(nullptr, 1, &want, &have, 0);
+  int64_t capture_latency_us = 0;
+  if (capture != 0) {
+    m_capture_rate = have.freq;
+    // tone is seen only after capture buffer is filled
+    capture_latency_us = (int64_t)have.samples * 1000000 / have.freq;
+    SDL_PauseAudioDevice(capture, 0);
+    std::this_thread::sleep_for(kCaptureSettle);
+  } else {
+    Helper::get_instance().log("No capture device for latency measurement: " +
+                               std::string(SDL_GetError()));
+  }
+
+  int64_t start = now_us();
+  m_probe_pending = true;
+  while (now_us() - start < kProbeTimeout.count() * 1000 &&
+         (m_probe_sent_us < 0 || (capture != 0 && m_probe_heard_us < 0)))
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  if (capture != 0) SDL_CloseAudioDevice(capture);
+  m_probe_pending = false;
+  if (m_probe_sent_us < 0) return false;
+
+  latency.command = (m_probe_sent_us - start) / 1000.0;
+  latency.captured = m_probe_heard_us >= 0;
+  if (latency.captured)  // captured path includes input latency too
+    m_output_latency_us = std::max<int64_t>(
+        0, m_probe_heard_us - m_probe_sent_us - capture_latency_us);
+  latency.output = m_output_latency_us / 1000.0;
+  latency.total = latency.command + latency.output;
+  Helper::get_instance().log(
+      "Output latency: " + std::to_string(latency.total) + " ms, " +
+      std::to_string(latency.command) + " ms to device, " +
+      std::to_string(latency.output) + " ms to speakers" +
+      (latency.captured ? " (captured)" : " (estimated)"));
+  return true;
+}
+
+void AudioEngine::capture_callback(void *udata, Uint8 *stream, int len) {
+  AudioEngine *engine = static_cast<AudioEngine *>(udata);
+  const int64_t now = now_us();
+  const float *samples = reinterpret_cast<const float *>(stream);
+  const size_t frames = len / sizeof(float);
+  if (engine->m_probe_sent_us < 0) {  // learn noise floor before test tone
+    float peak = 0;
+    for (size_t i = 0; i < frames; i++)
+      peak = std::max(peak, std::abs(samples[i]));
+    float threshold = std::min(peak * 4, kProbeLevel / 2);
+    if (threshold > engine->m_probe_threshold)
+      engine->m_probe_threshold = threshold;
+    return;
+  }
+  if (engine->m_probe_heard_us >= 0) return;
+  for (size_t i = 0; i < frames; i++) {
+    if (std::abs(samples[i]) >= engine->m_probe_threshold) {
+      // last sample of buffer was captured just now
+      engine->m_probe_heard_us =
+          now - (int64_t)(frames - i) * 1000000 / engine->m_capture_rate;
+      return;
+    }
+  }
+}
+
+void AudioEngine::write_probe(float *out, size_t frames) {
+  const size_t channels = m_spec.channels;
+  size_t length = std::min(frames, (size_t)(kProbeSeconds * m_spec.freq));
+  for (size_t i = 0; i < length; i++) {
+    float sample = kProbeLevel * std::sin(2 * M_PI * kProbeFrequency * i /
+                                          m_spec.freq);
+    for (size_t c = 0; c < channels; c++) out[i * channels + c] = sample;
+  }
+  m_probe_sent_us = now_us();
+}
+
+void AudioEngine::shutdown() {
+  if (m_device == 0) return;
+  clear_next();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_running = false;
+    m_decoder_cv.notify_one();
+  }
+  if (m_decoder_thread.joinable()) m_decoder_thread.join();
+  m_index_cancel = true;
+  m_index_pool.reset();  // queued indexes are dropped
+  m_indexing.clear();
+  SDL_CloseAudioDevice(m_device);
+  m_device = 0;
+  m_current.reset();
+  m_previous.reset();
+  m_next.reset();
+}
+
+bool AudioEngine::open(const std::string &filename, float gain) {
+  if (m_device == 0) return false;
+  auto track = open_track(filename);
+  if (!track) return false;
+  track->set_gain(gain);
+  build_seek_index(*track);
+  clear_next();
+  std::unique_ptr<LocalTrack> current, previous, next;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    track->set_serial(++m_serial_counter);
+    uint64_t fade = 0;
+    std::vector<float> history;
+    int64_t history_frames = -1;
+    if (m_playing && m_current && m_crossfade_seconds > 0) {
+      // decode track which is heard now again from heard position, it fades
+      // out instead of stopping abruptly
+      restore_playing_track();
+      uint64_t heard = (double)m_position_frames / m_spec.freq *
+                       m_current->get_rate();
+      history_frames = seek_current(heard, history);
+      if (history_frames >= 0) fade = m_crossfade_seconds * m_spec.freq;
+    }
+    current = std::move(m_current);
+    previous = std::move(m_previous);
+    next = std::move(m_next);
+    m_current = std::move(track);
+    if (fade > 0) m_previous = std::move(current);
+    flush(0);
+    if (m_previous) {  // no transition is reported, new track is current
+      m_fade_resampler.setup(m_previous->get_rate(), m_spec.freq,
+                             m_spec.channels, m_resampler_quality);
+      m_fade_resampler.reset(history.data(), history_frames);
+      uint64_t left = (m_previous->get_frames() -
+                       std::min(m_previous->get_frames(),
+                                m_previous->get_read_frames())) *
+                      m_spec.freq / m_previous->get_rate();
+      m_fade_length = std::max<uint64_t>(1, std::min(fade, left));
+      m_fade_pos = 0;
+      m_fade_curve = m_crossfade_curve;
+      // device keeps playing, start of crossfade must be there before next
+      // callback, otherwise silence is heard between tracks
+      decode(m_spec.samples * 2);
+    }
+    if (m_playing) {  // measure how fast new track is heard
+      m_switch_start_us = now_us();
+      m_switch_measuring = true;
+    }
+  }
+  return true;  // previous tracks are closed here, outside of lock
+}
+
+void AudioEngine::queue_next(const std::string &filename, float gain) {
+  if (m_device == 0) return;
+  clear_next();
+  m_prepare_cancel = false;
+  m_prepare_thread = std::thread([this, filename, gain] {
+    auto track = open_track(filename);
+    if (!track) return;
+    track->set_gain(gain);
+    build_seek_index(*track);
+    track->preroll(kPrerollSeconds, m_prepare_cancel);
+    if (m_prepare_cancel) return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    track->set_serial(++m_serial_counter);
+    m_next = std::move(track);
+    m_decoder_wake = true;
+    m_decoder_cv.notify_one();
+    Helper::get_instance().log("Prepared next track: " + filename);
+  });
+}
+
+std::unique_ptr<LocalTrack> AudioEngine::open_track(
+    const std::string &filename) {
+  auto track = std::make_unique<LocalTrack>();
+  auto decoded = m_pcm_cache.get(filename, m_spec.channels);
+  if (decoded) {
+    Helper::get_instance().log("Decoded audio is cached: " + filename);
+    track->open_decoded(filename, std::move(decoded));
+    return track;
+  }
+  if (!track->open(filename, m_spec.channels)) return nullptr;
+  track->record(m_pcm_cache.get_budget());  // cached when read to end
+  return track;
+}
+
+void AudioEngine::clear_next() {
+  m_prepare_cancel = true;
+  if (m_prepare_thread.joinable()) m_prepare_thread.join();
+  std::unique_ptr<LocalTrack> next;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  next = std::move(m_next);
+}
+
+void AudioEngine::play() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_current) return;
+  SDL_LockAudioDevice(m_device);
+  bool finished = m_track_finished;
+  SDL_UnlockAudioDevice(m_device);
+  if (finished) {  // play ended track again
+    restore_playing_track();
+    m_current->seek(0);
+    flush(0);  // resampler starts from silence, as at track start
+  }
+  m_heard_frames = m_position_frames.load();  // new audio is heard later
+  m_playing = true;
+}
+
+void AudioEngine::pause() {
+  m_paused_us = now_us();
+  m_playing = false;
+  m_switch_measuring = false;  // new track will not be heard right now
+}
+
+void AudioEngine::stop() {
+  pause();
+  set_position(0);
+}
+
+bool AudioEngine::has_track() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_current != nullptr;
+}
+
+double AudioEngine::get_position() const {
+  if (m_device == 0) return 0;
+  int64_t frames = m_position_frames;
+  if (m_playing) {
+    // time passed since last callback, but not more than its buffer
+    int64_t elapsed =
+        std::min<int64_t>(now_us() - m_callback_us,
+                          (int64_t)m_period * 1000000 / m_spec.freq);
+    // audio given to device is heard only after output latency
+    frames += (elapsed - m_output_latency_us) * m_spec.freq / 1000000 *
+              m_played_speed;
+  } else {
+    // audio given to device before pause is still heard for a while
+    int64_t left = std::max<int64_t>(
+        0, m_output_latency_us - (now_us() - m_paused_us));
+    frames -= left * m_spec.freq / 1000000 * m_played_speed;
+  }
+  return (double)std::max<int64_t>(m_heard_frames, frames) / m_spec.freq;
+}
+
+bool AudioEngine::set_position(double seconds) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_current) return false;
+  restore_playing_track();
+  seconds = std::max(0.0, seconds);
+  std::vector<float> history;
+  int64_t got = seek_current(seconds * m_current->get_rate(), history);
+  if (got < 0) return false;
+  flush((uint64_t)(seconds * m_spec.freq), history.data(), got);
+  return true;
+}
+
+bool AudioEngine::set_speed(double speed) {
+  if (speed < TimeStretch::kMinSpeed || speed > TimeStretch::kMaxSpeed)
+    return false;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_speed == speed) return true;
+  m_speed = speed;
+  if (!m_current) return true;  // used from next track
+  // decode again from what is heard now, ring holds audio of old speed
+  restore_playing_track();
+  uint64_t heard = m_position_frames;
+  std::vector<float> history;
+  int64_t got = seek_current(
+      (double)heard / m_spec.freq * m_current->get_rate(), history);
+  if (got < 0) return false;
+  flush(heard, history.data(), got);
+  return true;
+}
+
+double AudioEngine::get_speed() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_speed;
+}
+
+int64_t AudioEngine::seek_current(uint64_t frame, std::vector<float> &history) {
+  // start a bit earlier, so resampler filter is filled with real audio
+  size_t prime = std::min<uint64_t>(kHistoryFrames, frame);
+  if (!m_current->seek(frame - prime)) return -1;
+  history.resize(prime * m_spec.channels);
+  size_t got = m_current->read(history.data(), prime);
+  float gain = m_current->get_gain();
+  if (gain != 1.0f)
+    get_sample_kernels().apply_gain(history.data(), got, m_spec.channels, gain,
+                                    gain);
+  return got;
+}
+
+void AudioEngine::build_seek_index(const LocalTrack &track) {
+  if (!track.needs_seek_index()) return;
+  const std::string filename = track.get_filename();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_running || !m_indexing.insert(filename).second) return;
+  // one thread, so indexing does not take CPU from decoder
+  if (!m_index_pool) m_index_pool = std::make_unique<ThreadPool>(1);
+  m_index_pool->submit([this, filename] {
+    auto index = std::make_shared<SeekIndex>();
+    bool built = index->build(filename, m_index_cancel);
+    if (built) index->save_cached();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_indexing.erase(filename);
+    if (!built) return;
+    for (LocalTrack *track : {m_current.get(), m_previous.get(), m_next.get()})
+      if (track && track->get_filename() == filename &&
+          track->needs_seek_index())
+        track->set_seek_index(index);
+  });
+}
+
+void AudioEngine::set_volume(double volume) {
+  m_volume = std::max(0.0, std::min(1.0, volume));
+}
+
+const LocalTrack *AudioEngine::playing_track() const {
+  if (m_previous && m_previous->get_serial() == m_playing_serial)
+    return m_previous.get();  // decoder is already at next track
+  return m_current.get();
+}
+
+std::string AudioEngine::get_title() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const LocalTrack *track = playing_track();
+  return track ? track->get_title() : "";
+}
+
+std::string AudioEngine::get_artist() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const LocalTrack *track = playing_track();
+  return track ? track->get_artist() : "";
+}
+
+std::string AudioEngine::get_filename() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const LocalTrack *track = playing_track();
+  return track ? track->get_filename() : "";
+}
+
+double AudioEngine::get_duration() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const LocalTrack *track = playing_track();
+  return track ? track->get_duration() : 0;
+}
+
+AudioEngine::Stats AudioEngine::get_stats() const {
+  Stats stats;
+  if (m_device == 0) return stats;
+  stats.buffer_fill = (double)m_ring.read_available() / m_ring.capacity();
+  stats.buffer_seconds =
+      (double)m_ring.capacity() / m_spec.channels / m_spec.freq;
+  stats.underruns = m_underruns;
+  stats.period = m_period;
+  stats.output_latency = m_output_latency_us / 1e6;
+  stats.cache = m_pcm_cache.get_stats();
+  return stats;
+}
+
+void AudioEngine::set_cache_budget(size_t bytes) {
+  m_pcm_cache.set_budget(bytes);
+}
+
+size_t AudioEngine::get_cache_budget() const {
+  return m_pcm_cache.get_budget();
+}
+
+void AudioEngine::set_resampler_quality(Resampler::Quality quality) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_resampler_quality = quality;
+}
+
+Resampler::Quality AudioEngine::get_resampler_quality() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_resampler_quality;
+}
+
+void AudioEngine::set_crossfade(double seconds, CrossfadeCurve curve) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_crossfade_seconds = std::max(0.0, seconds);
+  m_crossfade_curve = curve;
+}
+
+double AudioEngine::get_crossfade_seconds() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_crossfade_seconds;
+}
+
+AudioEngine::CrossfadeCurve AudioEngine::get_crossfade_curve() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_crossfade_curve;
+}
+
+void AudioEngine::set_track_end_callback(std::function<void(bool)> callback) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_track_end_callback = callback;
+}
+
+void AudioEngine::flush(uint64_t offset, const float *history,
+                        size_t history_frames) {
+  setup_resampler();
+  m_resampler.reset(history, history_frames);
+  m_fade_length = m_fade_pos = 0;  // fading track is not heard anymore
+  m_stretching = m_speed != 1;
+  if (m_stretching) m_stretch.setup(m_spec.freq, m_spec.channels, m_speed);
+  SDL_LockAudioDevice(m_device);  // audio callback does not run now
+  m_ring.clear();
+  m_written_frames = 0;
+  m_played_frames = 0;
+  m_track_start = 0;
+  m_track_offset = offset;
+  m_track_finished = false;
+  m_next_start = kNone;
+  m_end_frame = kNone;
+  m_position_frames = offset;
+  m_heard_frames = offset;
+  m_played_speed = m_stretching ? m_speed : 1;
+  m_playing_serial = m_current ? m_current->get_serial() : 0;
+  SDL_UnlockAudioDevice(m_device);
+  m_decoder_wake = true;
+  m_decoder_cv.notify_one();
+}
+
+void AudioEngine::setup_resampler() {
+  int rate = m_current ? m_current->get_rate() : m_spec.freq;
+  if (m_resampler.get_in_rate() == rate &&
+      m_resampler.get_out_rate() == m_spec.freq &&
+      m_resampler.get_quality() == m_resampler_quality)
+    return;
+  m_resampler.setup(rate, m_spec.freq, m_spec.channels, m_resampler_quality);
+  if (rate != m_spec.freq)
+    Helper::get_instance().log("Resampling " + std::to_string(rate) + " -> " +
+                               std::to_string(m_spec.freq) + " Hz");
+}
+
+void AudioEngine::start_next_track(uint64_t start) {
+  m_next_serial = m_next->get_serial();
+  m_next_start.store(start, std::memory_order_release);
+  m_previous = std::move(m_current);
+  m_current = std::move(m_next);
+  if (m_resampler.is_draining()) {  // tail of previous track already pulled
+    m_resampler.reset();
+    setup_resampler();
+  }
+  if (m_stretching && m_stretch.is_draining()) m_stretch.reset();
+}
+
+uint64_t AudioEngine::pending_frames(uint64_t frames) const {
+  if (!m_stretching) return frames;
+  return m_stretch.pending_output() + frames / m_speed;
+}
+
+void AudioEngine::feed(LocalTrack &track, Resampler &resampler) {
+  const size_t channels = m_spec.channels;
+  float *source = m_source_buffer.data();
+  size_t got = track.read(source, kDecodeFrames);
+  if (track.at_end()) {  // whole track was read, keep it for replay
+    auto decoded = track.take_recorded();
+    if (decoded) m_pcm_cache.put(track.get_filename(), std::move(decoded));
+  }
+  float gain = track.get_gain();
+  if (gain != 1.0f)  // before resampler, so joined tracks keep own gain
+    get_sample_kernels().apply_gain(source, got, channels, gain, gain);
+  resampler.push(source, got);
+}
+
+void AudioEngine::begin_crossfade() {
+  if (m_crossfade_seconds <= 0 || !m_next || m_previous ||
+      m_next_start != kNone || m_resampler.is_draining())
+    return;
+  // audio of current track still to be written, in device frames
+  uint64_t total = m_current->get_frames();
+  uint64_t left = (total - std::min(total, m_current->get_read_frames())) *
+                      m_spec.freq / m_current->get_rate() +
+                  m_resampler.pending_output();
+  uint64_t length = m_crossfade_seconds * m_spec.freq;
+  if (left > length) return;  // too early
+  uint64_t next_length =
+      m_next->get_frames() * m_spec.freq / m_next->get_rate();
+  length = std::min({length, left, next_length});
+  if (length == 0) return;  // too late, join them without crossfade
+  // fading out track keeps state of its resampler, next one starts clean
+  std::swap(m_resampler, m_fade_resampler);
+  start_next_track(m_written_frames + pending_frames(0));
+  m_resampler.reset();
+  setup_resampler();
+  m_fade_length = length;
+  m_fade_pos = 0;
+  m_fade_curve = m_crossfade_curve;
+}
+
+void AudioEngine::mix_crossfade(float *data, size_t frames) {
+  const size_t channels = m_spec.channels;
+  float *fading = m_fade_buffer.data();
+  size_t got = 0;
+  while (got < frames && m_previous) {
+    size_t pulled =
+        m_fade_resampler.pull(fading + got * channels, frames - got);
+    got += pulled;
+    if (pulled > 0) continue;
+    if (!m_previous->at_end())
+      feed(*m_previous, m_fade_resampler);
+    else if (!m_fade_resampler.is_draining())
+      m_fade_resampler.drain();
+    else
+      break;  // fading track ended before crossfade did
+  }
+  std::memset(fading + got * channels, 0,
+              (frames - got) * channels * sizeof(float));
+  // gains are exact at block edges and linear inside of short block
+  float in_from, out_from, in_to, out_to;
+  crossfade_gains(m_fade_curve, (double)m_fade_pos / m_fade_length, in_from,
+                  out_from);
+  m_fade_pos += frames;
+  crossfade_gains(m_fade_curve, (double)m_fade_pos / m_fade_length, in_to,
+                  out_to);
+  const SampleKernels &kernels = get_sample_kernels();
+  kernels.apply_gain(data, frames, channels, in_from, in_to);
+  kernels.mix(data, fading, frames, channels, out_from, out_to);
+  if (m_fade_pos >= m_fade_length)
+    m_fade_length = m_fade_pos = 0;  // previous track is freed when heard
+}
+
+void AudioEngine::restore_playing_track() {
+  if (!m_previous || m_previous->get_serial() != m_playing_serial) return;
+  m_current->seek(0);  // it will be played after previous one again
+  m_next = std::move(m_current);
+  m_current = std::move(m_previous);
+}
+
+void AudioEngine::decoder_thread() {
+  while (m_running) {
+    std::unique_ptr<LocalTrack> heard;
+    std::function<void(bool)> callback;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_decoder_cv.wait_for(lock, kDecoderPeriod,
+                            [this] { return m_decoder_wake || !m_running; });
+      m_decoder_wake = false;
+      if (!m_running) break;
+      if (m_previous && m_next_start == kNone && m_fade_length == 0)
+        heard = std::move(m_previous);  // callback already plays next track
+      decode();
+      callback = m_track_end_callback;
+    }
+    // report track changes outside of lock, callback may call engine
+    int transitions = m_transitions.exchange(0);
+    bool ended = m_ended.exchange(false);
+    if (!callback) continue;
+    for (int i = 0; i < transitions; i++) callback(true);
+    if (ended) callback(false);
+  }
+}
+
+void AudioEngine::decode(uint64_t limit) {
+  const size_t channels = m_spec.channels;
+  while (m_current && m_end_frame == kNone && m_written_frames < limit &&
+         m_ring.write_available() >= kDecodeFrames * channels) {
+    if (m_fade_length == 0) begin_crossfade();
+    std::vector<float> &buffer = m_decode_buffer;
+    if (m_stretching) {  // stretched audio goes to ring first
+      size_t frames = m_stretch.pull(buffer.data(), kDecodeFrames);
+      if (frames > 0) {
+        m_ring.write(buffer.data(), frames * channels);
+        m_written_frames += frames;
+        continue;
+      }
+    }
+    size_t wanted = kDecodeFrames;
+    if (m_fade_length > 0)  // block ends where crossfade ends
+      wanted = std::min<uint64_t>(wanted, m_fade_length - m_fade_pos);
+    size_t frames = m_resampler.pull(buffer.data(), wanted);
+    if (frames > 0) {
+      if (m_fade_length > 0) mix_crossfade(buffer.data(), frames);
+      m_equalizer.process(buffer.data(), frames);
+      if (m_stretching) {
+        m_stretch.push(buffer.data(), frames);
+      } else {
+        m_ring.write(buffer.data(), frames * channels);
+        m_written_frames += frames;
+      }
+      continue;
+    }
+    if (!m_current->at_end()) {  // resampler needs more input
+      feed(*m_current, m_resampler);
+      continue;
+    }
+    if (m_fade_length > 0) {  // track is shorter than crossfade, stop fading
+      m_fade_length = m_fade_pos = 0;
+      continue;
+    }
+    // current track ended, resampler keeps its last frames for lookahead
+    if (m_next && (m_previous || m_next_start != kNone))
+      break;  // previous switch is not heard yet, wait for it
+    if (m_next && !m_resampler.is_draining() &&
+        m_next->get_rate() == m_resampler.get_in_rate()) {
+      // same rate, continue with next track inside the filter, so join has
+      // no discontinuity; it starts after frames still held by resampler
+      start_next_track(m_written_frames +
+                       pending_frames(m_resampler.pending_output()));
+    } else if (!m_resampler.is_draining()) {
+      m_resampler.drain();  // take last frames of current track
+    } else if (m_next) {  // continue with next track from the very next sample
+      start_next_track(m_written_frames + pending_frames(0));
+    } else if (m_stretching && !m_stretch.is_draining()) {
+      m_stretch.drain();  // take last segments of stretched audio
+    } else {  // nothing queued, playback ends here
+      m_end_frame = m_written_frames;
+      break;
+    }
+  }
+}
+
+void AudioEngine::audio_callback(void *udata, Uint8 *stream, int len) {
+  AudioEngine *engine = static_cast<AudioEngine *>(udata);
+  const size_t channels = engine->m_spec.channels;
+  const size_t sample_size = SDL_AUDIO_BITSIZE(engine->m_spec.format) / 8;
+  size_t samples = len / sample_size;
+  if (engine->m_spec.format == AUDIO_F32SYS) {
+    engine->fill(reinterpret_cast<float *>(stream), samples / channels);
+    return;
+  }
+  // device wants integers, render floats and convert them
+  const SampleKernels &kernels = get_sample_kernels();
+  float *render = engine->m_render_buffer.data();
+  while (samples > 0) {
+    size_t count = std::min(samples, engine->m_render_buffer.size());
+    engine->fill(render, count / channels);
+    if (engine->m_spec.format == AUDIO_S16SYS)
+      kernels.float_to_s16(render, reinterpret_cast<int16_t *>(stream), count,
+                           engine->m_dither);
+    else
+      kernels.float_to_s32(render, reinterpret_cast<int32_t *>(stream), count);
+    stream += count * sample_size;
+    samples -= count;
+  }
+}
+
+void AudioEngine::fill(float *out, size_t frames) {
+  const size_t channels = m_spec.channels;
+  const size_t samples = frames * channels;
+  m_callback_us = now_us();
+  if (!m_playing) {
+    std::memset(out, 0, samples * sizeof(float));
+    m_tap.write(out, frames, channels);  // meters fall to silence
+    if (m_probe_pending.exchange(false)) write_probe(out, frames);
+    return;
+  }
+  size_t got = m_ring.read(out, samples) / channels;
+  m_played_frames += got;
+
+  uint64_t next_start = m_next_start.load(std::memory_order_acquire);
+  if (next_start != kNone && m_played_frames >= next_start) {
+    // queued track started inside this buffer
+    m_track_start = next_start;
+    m_track_offset = 0;
+    m_playing_serial = m_next_serial;
+    m_heard_frames = 0;
+    m_next_start.store(kNone, std::memory_order_release);
+    m_transitions++;
+  }
+  m_position_frames =
+      (m_played_frames - m_track_start) * m_played_speed + m_track_offset;
+
+  if (got < frames) {
+    std::memset(out + got * channels, 0,
+                (frames - got) * channels * sizeof(float));
+    if (m_played_frames >= m_end_frame) {  // whole track is played
+      m_playing = false;
+      m_track_finished = true;
+      m_ended = true;
+    } else if (m_played_frames > 0) {  // decoder is late
+      m_underruns++;
+    }
+  }
+
+  m_tap.write(out, frames, channels);  // does not depend on volume
+
+  float volume = m_volume;
+  if (volume != 1.0f || m_gain != 1.0f) {  // ramp from previous volume
+    get_sample_kernels().apply_gain(out, frames, channels, m_gain, volume);
+    m_gain = volume;
+  }
+
+  if (m_probe_pending.exchange(false)) write_probe(out, frames);
+  if (got > 0 && m_switch_measuring.exchange(false))
+    m_switch_latency_us = now_us() - m_switch_start_us;
+}
@@ -0,0 +1,526 @@
+#ifndef AUDIOENGINE_H
+#define AUDIOENGINE_H
+
+#include <SDL2/SDL.h>
+#include <sndfile.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "audiotap.h"
+#include "equalizer.h"
+#include "mappedfile.h"
+#include "pcmcache.h"
+#include "resampler.h"
+#include "ringbuffer.h"
+#include "samplekernels.h"
+#include "seekindex.h"
+#include "threadpool.h"
+#include "timestretch.h"
+
+/**
+ * Single local audio file opened for playback.
+ * Decodes file with libsndfile into float samples in device channels, but in
+ * its own sample rate. Resampling is done by engine, so its state continues
+ * across tracks.
+ */
+class LocalTrack {
+ public:
+  ~LocalTrack();
+  /**
+   * Opens audio file and prepares remixing into device channels
+   * @param filename - path to audio file (type: std::string)
+   * @param channels - device channels count (type: int)
+   * @return true on success, false otherwise (type: bool)
+   */
+  bool open(const std::string &filename, int channels);
+  /**
+   * Opens track which is already decoded, it is read from memory
+   * @param filename - path to audio file (type: std::string)
+   * @param audio - whole decoded track (type: DecodedAudio)
+   */
+  void open_decoded(const std::string &filename,
+                    std::shared_ptr<const DecodedAudio> audio);
+  /**
+   * Keeps copy of decoded audio while track is read from its start, so it
+   * can be cached when whole track is read. Seek to other position than
+   * start stops recording.
+   * @param limit - maximum of bytes to keep, recording stops when track is
+   * longer (type: size_t)
+   */
+  void record(size_t limit);
+  /**
+   * Takes recorded audio once whole track is read
+   * @return nullptr if track is not read to end or it was not recorded
+   */
+  std::shared_ptr<DecodedAudio> take_recorded();
+  /**
+   * Reads title, artist and duration of audio file without preparing it for
+   * playback
+   * @param filename - path to audio file (type: std::string)
+   * @return false if file is not audio file supported by libsndfile
+   */
+  static bool probe(const std::string &filename, std::string &title,
+                    std::string &artist, double &duration);
+  /**
+   * Decodes first seconds of track into memory, so track can be started
+   * without touching the disk
+   * @param seconds - how much audio to decode (type: double)
+   * @param cancel - flag for canceling decoding (type: std::atomic_bool)
+   */
+  void preroll(double seconds, const std::atomic_bool &cancel);
+  /**
+   * Reads audio remixed into device channels
+   * @param dst - destination buffer for interleaved float samples
+   * @param frames - count of frames needed
+   * @return count of frames written, less than frames only at the end of
+   * track
+   */
+  size_t read(float *dst, size_t frames);
+  /**
+   * Seeks to position
+   * @param frame - new position in frames of track (type: uint64_t)
+   * @return true on success, false otherwise (type: bool)
+   */
+  bool seek(uint64_t frame);
+  /**
+   * Whether seeking in track needs index, which is not built yet
+   */
+  bool needs_seek_index() const {
+    return !m_decoded && !m_seek_index && SeekIndex::is_needed(m_info);
+  }
+  /**
+   * Sets index for exact seeking, exact length of track is taken from it
+   * @param index - index of this file, may be nullptr (type: SeekIndex)
+   */
+  void set_seek_index(std::shared_ptr<const SeekIndex> index);
+
+  /**
+   * Whether all audio of track was already read
+   */
+  bool at_end() const { return m_eof && m_preroll.empty(); }
+
+  const std::string &get_filename() const { return m_filename; }
+  const std::string &get_title() const { return m_title; }
+  const std::string &get_artist() const { return m_artist; }
+  double get_duration() const { return m_duration; }
+  int get_rate() const { return m_info.samplerate; }
+  /**
+   * Gets length of track in frames of its own rate
+   */
+  uint64_t get_frames() const { return m_info.frames; }
+  /**
+   * Gets count of frames read since start of track
+   */
+  uint64_t get_read_frames() const { return m_position; }
+  /**
+   * Gain applied to track by engine, e.g. for loudness normalization
+   */
+  float get_gain() const { return m_gain; }
+  void set_gain(float gain) { m_gain = gain; }
+  /**
+   * Number which identifies track inside engine
+   */
+  uint64_t get_serial() const { return m_serial; }
+  void set_serial(uint64_t serial) { m_serial = serial; }
+
+ private:
+  std::string m_filename, m_title, m_artist;
+  double m_duration = 0;
+  float m_gain = 1.0f;
+  uint64_t m_serial = 0;
+  MappedFile m_mapped;  // file contents, must outlive m_file
+  SNDFILE *m_file = nullptr;
+  SF_INFO m_info = {0};
+  std::shared_ptr<const SeekIndex> m_seek_index;
+  int m_device_channels = 0;
+  std::vector<float> m_decode_buffer;  // buffer for sf_readf_float
+  std::vector<float> m_preroll;        // already remixed first seconds
+  size_t m_preroll_pos = 0;            // how much of preroll already read
+  uint64_t m_position = 0;             // frames read since start of track
+  bool m_eof = false;
+  std::shared_ptr<const DecodedAudio> m_decoded;  // whole track, if cached
+  std::vector<float> m_recorded;  // decoded audio from start of track
+  size_t m_record_limit = 0;      // in bytes, 0 if track is not recorded
+  void stop_recording();
+  /**
+   * Converts frames from channels of file into device channels
+   * @param src - frames in channels of file (type: const float *)
+   * @param dst - frames in device channels (type: float *)
+   * @param frames - count of frames (type: size_t)
+   */
+  void remix(const float *src, float *dst, size_t frames) const;
+};
+
+/**
+ * Local playback engine.
+ * Decoder thread reads current track, resamples it into device rate and
+ * pushes float samples into lock-free ring buffer, which is drained by SDL
+ * audio callback. Audio callback never
+ * locks, allocates or touches the disk. While track is playing, next track
+ * is prepared on worker thread, so decoder continues with it right after last
+ * sample of current one.
+ */
+class AudioEngine {
+ public:
+  /**
+   * Engine state, which can be shown to user or sent to clients
+   */
+  struct Stats {
+    double buffer_fill = 0;     // ring buffer fill, from 0 to 1
+    double buffer_seconds = 0;  // how much audio ring buffer can hold
+    uint64_t underruns = 0;     // how many times callback had no audio
+    int period = 0;             // frames requested by one audio callback
+    double output_latency = 0;  // seconds from callback to speakers
+    PcmCache::Stats cache;      // decoded tracks kept for replay
+  };
+  /**
+   * Result of output latency measurement, all values in milliseconds
+   */
+  struct Latency {
+    double command = 0;   // from request to test tone given to device
+    double output = 0;    // from device to speakers, estimated or captured
+    double total = 0;     // from request to audible test tone
+    bool captured = false;  // test tone was heard by capture device
+  };
+  static const int kDefaultPeriod = 1024;    // frames, normal profile
+  static const int kLowLatencyPeriod = 256;  // frames, low latency profile
+  /**
+   * Shape of volume change during crossfade
+   */
+  enum CrossfadeCurve {
+    CROSSFADE_LINEAR = 0,       // gains change linearly, dip in the middle
+    CROSSFADE_EQUAL_POWER = 1,  // sine and cosine, constant loudness
+    CROSSFADE_S_CURVE = 2,      // raised cosine, smooth start and end
+  };
+
+  AudioEngine() = default;
+  ~AudioEngine();
+  /**
+   * Opens default audio device and starts decoder thread
+   * @param rate - desired sample rate, device's native one (type: int)
+   * @param channels - desired channels count (type: int)
+   * @param period - frames requested by one audio callback, smaller period
+   * gives lower latency, but needs more wakeups (type: int)
+   * @return true on success, false otherwise (type: bool)
+   */
+  bool start(int rate, int channels, int period = kDefaultPeriod);
+  /**
+   * Stops engine, closes audio device and all tracks
+   */
+  void shutdown();
+  /**
+   * Opens track as current one. Previous current and queued tracks are
+   * dropped. If crossfade is enabled and something is playing, it is faded
+   * out from what is heard now, while new track fades in.
+   * @param filename - path to audio file (type: std::string)
+   * @param gain - linear gain of track, e.g. from ReplayGain (type: float)
+   * @return true on success, false otherwise (type: bool)
+   */
+  bool open(const std::string &filename, float gain = 1.0f);
+  /**
+   * Prepares track which will be played right after current one.
+   * Track is opened and its first seconds are decoded on worker thread.
+   * @param filename - path to audio file (type: std::string)
+   * @param gain - linear gain of track, e.g. from ReplayGain (type: float)
+   */
+  void queue_next(const std::string &filename, float gain = 1.0f);
+  /**
+   * Drops queued next track, so playback stops after current track
+   */
+  void clear_next();
+
+  void play();
+  void pause();
+  void stop();
+  bool is_playing() const { return m_playing; }
+  bool has_track() const;
+  /**
+   * Reopens audio device with new period. Format of device and playback
+   * state are kept, audio may click once.
+   * @param period - frames requested by one audio callback (type: int)
+   * @return true on success, false otherwise (type: bool)
+   */
+  bool set_period(int period);
+  int get_period() const { return m_period; }
+  /**
+   * Plays short test tone and measures when it is given to device and, if
+   * capture device hears output (e.g. monitor source or loopback cable),
+   * when it is heard. Captured latency without capture buffer is used for
+   * position compensation from now on, otherwise it is estimated from size
+   * of device buffer.
+   * Works only while nothing is playing.
+   * @param latency - struct to save result (type: Latency)
+   * @return false if something is playing or test tone was not played
+   */
+  bool measure_latency(Latency &latency);
+  /**
+   * Gets current position in seconds, calculated from count of frames
+   * consumed by audio callback minus audio which is still on its way to
+   * speakers, also for a while after pause
+   */
+  double get_position() const;
+  bool set_position(double seconds);
+  /**
+   * Sets playback speed, pitch is kept by time stretching. Audio is decoded
+   * again from heard position, so new speed is heard right away.
+   * @param speed - from TimeStretch::kMinSpeed to kMaxSpeed, 1 plays track
+   * unchanged (type: double)
+   * @return false if speed is out of range (type: bool)
+   */
+  bool set_speed(double speed);
+  double get_speed() const;
+  void set_volume(double volume);
+  double get_volume() const { return m_volume; }
+  std::string get_title() const;
+  std::string get_artist() const;
+  std::string get_filename() const;
+  double get_duration() const;
+  int get_rate() const { return m_spec.freq; }
+  int get_channels() const { return m_spec.channels; }
+  SDL_AudioFormat get_format() const { return m_spec.format; }
+  Stats get_stats() const;
+  /**
+   * Sets bands of equalizer, can be called from any thread. Change is
+   * heard within one decoded block, without clicks.
+   * @param bands - at most Equalizer::kMaxBands bands, empty disables
+   * equalizer (type: std::vector<EqBand>)
+   * @return false if some band is invalid (type: bool)
+   */
+  bool set_equalizer(const std::vector<EqBand> &bands) {
+    return m_equalizer.set_bands(bands);
+  }
+  std::vector<EqBand> get_equalizer() const {
+    return m_equalizer.get_bands();
+  }
+  /**
+   * Sets memory ceiling of decoded tracks kept for instant replay
+   * @param bytes - maximum of bytes, 0 disables caching (type: size_t)
+   */
+  void set_cache_budget(size_t bytes);
+  size_t get_cache_budget() const;
+  /**
+   * Gets tap of frames sent to device, before volume is applied. It can be
+   * read from any thread without blocking audio.
+   */
+  const AudioTap &get_tap() const { return m_tap; }
+  /**
+   * Sets quality of resampling, used from next track or seek
+   * @param quality - resampler quality (type: Resampler::Quality)
+   */
+  void set_resampler_quality(Resampler::Quality quality);
+  Resampler::Quality get_resampler_quality() const;
+  /**
+   * Sets crossfade between consecutive tracks, used from next transition
+   * @param seconds - length of crossfade, 0 disables it (type: double)
+   * @param curve - shape of volume change (type: CrossfadeCurve)
+   */
+  void set_crossfade(double seconds, CrossfadeCurve curve);
+  double get_crossfade_seconds() const;
+  CrossfadeCurve get_crossfade_curve() const;
+  /**
+   * Gets time between opening track while playing and first audio of it
+   * given to device
+   * @return latency in microseconds or -1 if there is no new measurement
+   */
+  int64_t take_switch_latency_us() { return m_switch_latency_us.exchange(-1); }
+  /**
+   * Sets function, which is called from decoder thread when current track
+   * ended. Function receives true if queued next track was already started.
+   */
+  void set_track_end_callback(std::function<void(bool)> callback);
+
+ private:
+  static const uint64_t kNone = UINT64_MAX;
+
+  /**
+   * SDL audio callback
+   */
+  static void audio_callback(void *udata, Uint8 *stream, int len);
+  void fill(float *out, size_t frames);
+  /**
+   * Writes test tone of latency measurement over start of buffer
+   */
+  void write_probe(float *out, size_t frames);
+  /**
+   * SDL capture callback of latency measurement, looks for test tone
+   */
+  static void capture_callback(void *udata, Uint8 *stream, int len);
+  /**
+   * Estimates output latency from size of device buffer
+   */
+  int64_t estimate_output_latency_us() const;
+  void decoder_thread();
+  /**
+   * Decodes current track into ring buffer until buffer is full. Called
+   * with m_mutex locked.
+   * @param limit - stop when this many frames are written since flush
+   * (type: uint64_t)
+   */
+  void decode(uint64_t limit = kNone);
+  /**
+   * Drops all buffered audio, so decoding starts again from current position
+   * of current track. Called with m_mutex locked.
+   * @param offset - position of current track in frames (type: uint64_t)
+   * @param history - frames of track right before current position, so
+   * resampler does not start from silence, may be nullptr
+   * @param history_frames - count of history frames (type: size_t)
+   */
+  void flush(uint64_t offset, const float *history = nullptr,
+             size_t history_frames = 0);
+  /**
+   * Makes next track current one, it is heard from given frame. Called with
+   * m_mutex locked.
+   * @param start - frame of ring where next track starts (type: uint64_t)
+   */
+  void start_next_track(uint64_t start);
+  /**
+   * Prepares resampler for rate of current track and chosen quality, if it
+   * is not ready yet. Called with m_mutex locked.
+   */
+  void setup_resampler();
+  /**
+   * Reads next block of track, applies its gain and pushes it into
+   * resampler. Track which is read to end goes to decoded audio cache.
+   * Called with m_mutex locked.
+   */
+  void feed(LocalTrack &track, Resampler &resampler);
+  /**
+   * Starts crossfade into queued next track, if current one is close enough
+   * to its end. Called with m_mutex locked.
+   */
+  void begin_crossfade();
+  /**
+   * Mixes fading out previous track into frames of current one. Called with
+   * m_mutex locked.
+   * @param data - resampled frames of current track (type: float *)
+   * @param frames - count of frames, not more than rest of fade
+   */
+  void mix_crossfade(float *data, size_t frames);
+  /**
+   * Gets in how many frames of ring audio, which is decoded but not written
+   * yet, will be heard. Called with m_mutex locked.
+   * @param frames - frames waiting in resampler (type: uint64_t)
+   */
+  uint64_t pending_frames(uint64_t frames) const;
+  /**
+   * Seeks current track a bit before position and reads frames before it,
+   * so resampler filter starts from real audio. Called with m_mutex locked.
+   * @param frame - position in frames of track (type: uint64_t)
+   * @param history - vector to save frames before position
+   * @return count of history frames or -1 on failure
+   */
+  int64_t seek_current(uint64_t frame, std::vector<float> &history);
+  /**
+   * If decoder already went to next track while previous one is still
+   * heard, makes previous track current again. Called with m_mutex locked.
+   */
+  void restore_playing_track();
+  const LocalTrack *playing_track() const;
+  /**
+   * Builds seek index of track in background, if it needs one. Index is
+   * given to track when it is ready and saved for next time.
+   * @param track - just opened track (type: LocalTrack)
+   */
+  void build_seek_index(const LocalTrack &track);
+  /**
+   * Opens track from decoded audio cache, or from file, then it is recorded
+   * for cache while it is read
+   * @param filename - path to audio file (type: std::string)
+   * @return nullptr on failure
+   */
+  std::unique_ptr<LocalTrack> open_track(const std::string &filename);
+
+  SDL_AudioDeviceID m_device = 0;
+  SDL_AudioSpec m_spec = {0};
+  RingBuffer m_ring;
+  AudioTap m_tap;  // written only by audio callback
+  PcmCache m_pcm_cache;  // recently played tracks, has own lock
+  Equalizer m_equalizer;  // run by decoder, bands are set lock-free
+
+  // shared between main and decoder thread
+  mutable std::mutex m_mutex;
+  std::condition_variable m_decoder_cv;
+  bool m_decoder_wake = false;
+  std::atomic_bool m_running{false};
+  std::thread m_decoder_thread;
+  std::unique_ptr<LocalTrack> m_current;   // track which is decoded now
+  std::unique_ptr<LocalTrack> m_previous;  // decoded, but still heard
+  std::unique_ptr<LocalTrack> m_next;      // prepared next track
+  uint64_t m_serial_counter = 0;
+  uint64_t m_written_frames = 0;  // frames written into ring since flush
+  Resampler m_resampler;  // converts current track into device rate
+  Resampler::Quality m_resampler_quality = Resampler::QUALITY_MEDIUM;
+  double m_speed = 1;       // playback speed, used from next flush
+  bool m_stretching = false;  // speed is not 1 since last flush
+  TimeStretch m_stretch;    // stretches device rate audio to speed
+  double m_crossfade_seconds = 0;
+  CrossfadeCurve m_crossfade_curve = CROSSFADE_EQUAL_POWER;
+  Resampler m_fade_resampler;   // resamples m_previous while it fades out
+  uint64_t m_fade_length = 0;   // frames of current crossfade, 0 if none
+  uint64_t m_fade_pos = 0;      // frames of crossfade already mixed
+  CrossfadeCurve m_fade_curve = CROSSFADE_EQUAL_POWER;  // of current fade
+  std::vector<float> m_fade_buffer;  // block of fading out track
+  std::vector<float> m_source_buffer;  // block read from current track
+  std::vector<float> m_decode_buffer;  // block resampled into device rate
+  std::function<void(bool)> m_track_end_callback;
+
+  // audio callback state, changed by other threads only with device locked
+  uint64_t m_played_frames = 0;  // frames read from ring since flush
+  uint64_t m_track_start = 0;    // played frames when current track started
+  uint64_t m_track_offset = 0;   // position of track when it started
+  uint64_t m_next_serial = 0;    // serial of track starting at m_next_start
+  bool m_track_finished = false;
+  float m_gain = 1.0f;  // volume applied to last buffer
+  std::vector<float> m_render_buffer;  // float audio for integer devices
+  DitherState m_dither;
+
+  // shared with audio callback
+  std::atomic<uint64_t> m_next_start{kNone};  // frame where next track starts
+  std::atomic<uint64_t> m_end_frame{kNone};   // frame where playback ends
+  std::atomic<uint64_t> m_position_frames{0};
+  std::atomic<double> m_played_speed{1};  // frames of track per played frame
+  std::atomic<uint64_t> m_playing_serial{0};
+  std::atomic<uint64_t> m_underruns{0};
+  std::atomic_int m_transitions{0};  // next tracks started, not reported yet
+  std::atomic_bool m_ended{false};   // playback ended, not reported yet
+  std::atomic_bool m_playing{false};
+  std::atomic<float> m_volume{1.0f};
+
+  std::atomic<int64_t> m_callback_us{0};  // when last callback ran
+  std::atomic_int m_period{0};  // m_spec.samples, read without m_mutex
+  std::atomic<int64_t> m_output_latency_us{0};  // compensated in position
+  std::atomic<int64_t> m_paused_us{0};  // when playback was paused
+  // position which is heard already, audio given to device before it, e.g.
+  // before seek, is not compensated for latency
+  std::atomic<uint64_t> m_heard_frames{0};
+
+  // latency measurement
+  std::atomic_bool m_probe_pending{false};  // next callback plays test tone
+  std::atomic<int64_t> m_probe_sent_us{-1};   // when test tone was given
+  std::atomic<int64_t> m_probe_heard_us{-1};  // when it was captured
+  std::atomic<float> m_probe_threshold{0};  // level of captured tone
+  int m_capture_rate = 0;
+
+  std::atomic_bool m_switch_measuring{false};
+  std::atomic<int64_t> m_switch_start_us{0};  // steady clock, microseconds
+  std::atomic<int64_t> m_switch_latency_us{-1};
+
+  std::thread m_prepare_thread;  // thread which prepares next track
+  std::atomic_bool m_prepare_cancel{false};
+
+  std::unique_ptr<ThreadPool> m_index_pool;  // builds seek indexes
+  std::unordered_set<std::string> m_indexing;  // files with index building
+  std::atomic_bool m_index_cancel{false};
+};
+
+#endif  // AUDIOENGINE_H
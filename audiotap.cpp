@@ -0,0 +1,36 @@
+#include "audiotap.h"
+
+AudioTap::AudioTap() : m_buffer(new std::atomic<float>[kCapacity]) {
+  for (size_t i = 0; i < kCapacity; i++)
+    m_buffer[i].store(0.0f, std::memory_order_relaxed);
+}
+
+void AudioTap::write(const float *data, size_t frames, size_t channels) {
+  if (channels == 0) return;
+  uint64_t written = m_written.load(std::memory_order_relaxed);
+  // announce frames before overwriting old ones, readers check it after copy
+  m_reserved.store(written + frames, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  const float scale = 1.0f / channels;
+  for (size_t frame = 0; frame < frames; frame++) {
+    float sum = 0;
+    for (size_t channel = 0; channel < channels; channel++)
+      sum += data[frame * channels + channel];
+    m_buffer[(written + frame) & (kCapacity - 1)].store(
+        sum * scale, std::memory_order_relaxed);
+  }
+  m_written.store(written + frames, std::memory_order_release);
+}
+
+bool AudioTap::read_latest(float *data, size_t frames) const {
+  if (frames > kCapacity) return false;
+  uint64_t end = m_written.load(std::memory_order_acquire);
+  if (end < frames) return false;
+  uint64_t start = end - frames;
+  for (size_t i = 0; i < frames; i++)
+    data[i] = m_buffer[(start + i) & (kCapacity - 1)].load(
+        std::memory_order_relaxed);
+  // copied frames are valid only if writer did not come round to them
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return m_reserved.load(std::memory_order_relaxed) - start <= kCapacity;
+}
@@ -0,0 +1,56 @@
+#ifndef AUDIOTAP_H
+#define AUDIOTAP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * Wait-free ring of latest output frames, downmixed to mono, for meters and
+ * visualizers. Only audio callback writes, it never waits and never
+ * allocates. Any number of threads may read latest frames at the same time,
+ * reader only detects that writer overwrote frames while they were copied.
+ */
+class AudioTap {
+ public:
+  static const size_t kCapacity = 1 << 15;  // mono frames, power of two
+
+  AudioTap();
+  /**
+   * Writes interleaved frames, called only from audio callback
+   * @param data - interleaved samples (type: const float *)
+   * @param frames - count of frames (type: size_t)
+   * @param channels - count of channels (type: size_t)
+   */
+  void write(const float *data, size_t frames, size_t channels);
+  /**
+   * Copies latest frames
+   * @param data - buffer for frames count of mono samples (type: float *)
+   * @param frames - count of frames, at most kCapacity (type: size_t)
+   * @return false if not enough frames were written yet or writer overwrote
+   * them while they were copied, caller may try again (type: bool)
+   */
+  bool read_latest(float *data, size_t frames) const;
+  /**
+   * Sets sample rate of written frames, called before audio starts
+   */
+  void set_rate(int rate) { m_rate.store(rate, std::memory_order_relaxed); }
+  int get_rate() const { return m_rate.load(std::memory_order_relaxed); }
+  /**
+   * Gets count of frames written since start
+   */
+  uint64_t get_written() const {
+    return m_written.load(std::memory_order_acquire);
+  }
+
+ private:
+  // samples are atomic, so readers racing with writer are defined behavior,
+  // relaxed access compiles into plain loads and stores
+  std::unique_ptr<std::atomic<float>[]> m_buffer;
+  std::atomic<uint64_t> m_written{0};   // frames which can be read
+  std::atomic<uint64_t> m_reserved{0};  // frames which are being written
+  std::atomic_int m_rate{0};
+};
+
+#endif  // AUDIOTAP_H
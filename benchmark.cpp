@@ -0,0 +1,716 @@
+// Benchmarks of local playback engine. Built only with -DBUILD_BENCHMARKS=ON.
+// Usage: crescendo_bench <benchmark> [arguments]
+#include <dirent.h>
+#include <fcntl.h>
+#include <sndfile.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "equalizer.h"
+#include "mappedfile.h"
+#include "playlistfile.h"
+#include "playlistmodel.h"
+#include "resampler.h"
+#include "samplekernels.h"
+#include "searchindex.h"
+#include "seekindex.h"
+#ifdef HAVE_TAGLIB
+#include "trackprobe.h"
+#endif
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ms(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+double median(std::vector<double> values) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+// count of read-like syscalls made by this process
+long read_syscalls() {
+  std::ifstream io("/proc/self/io");
+  std::string key;
+  long value;
+  while (io >> key >> value)
+    if (key == "syscr:") return value;
+  return -1;
+}
+
+long page_faults() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_majflt + usage.ru_minflt;
+}
+
+// drops file from page cache, so every run starts cold like on slow storage
+void drop_cache(const std::string &filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) return;
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+// ---------------------------------------------------------------------------
+// io: stdio (sf_open) against memory mapped (sf_open_virtual) source
+// ---------------------------------------------------------------------------
+struct IoResult {
+  double startup_ms = 0;  // open and decode first block
+  double total_ms = 0;    // decode whole file
+  long syscalls = 0;
+  long faults = 0;
+};
+
+bool decode_file(const std::string &filename, bool mapped, IoResult &result) {
+  const int block_frames = 4096;
+  long syscalls = read_syscalls();
+  long faults = page_faults();
+  Clock::time_point start = Clock::now();
+  MappedFile file;
+  SF_INFO info = {0};
+  SNDFILE *sf = nullptr;
+  if (mapped) {
+    if (file.open(filename)) sf = file.open_sndfile(&info);
+  } else {
+    sf = sf_open(filename.c_str(), SFM_READ, &info);
+  }
+  if (!sf) return false;
+  std::vector<float> block(block_frames * info.channels);
+  sf_readf_float(sf, block.data(), block_frames);
+  result.startup_ms = elapsed_ms(start);
+  while (sf_readf_float(sf, block.data(), block_frames) > 0) {
+  }
+  sf_close(sf);
+  result.total_ms = elapsed_ms(start);
+  result.syscalls = read_syscalls() - syscalls;
+  result.faults = page_faults() - faults;
+  return true;
+}
+
+int bench_io(int argc, char **argv) {
+  if (argc < 1) {
+    std::printf("usage: crescendo_bench io <audio file>...\n");
+    return 1;
+  }
+  const int runs = 5;
+  std::printf("%-8s %12s %12s %10s %10s  %s\n", "source", "startup ms",
+              "total ms", "syscalls", "faults", "file");
+  for (int i = 0; i < argc; i++) {
+    std::string filename = argv[i];
+    for (bool mapped : {false, true}) {
+      std::vector<double> startup, total, syscalls, faults;
+      for (int run = 0; run < runs; run++) {
+        drop_cache(filename);
+        IoResult result;
+        if (!decode_file(filename, mapped, result)) {
+          std::printf("can't decode %s\n", filename.c_str());
+          return 1;
+        }
+        startup.push_back(result.startup_ms);
+        total.push_back(result.total_ms);
+        syscalls.push_back(result.syscalls);
+        faults.push_back(result.faults);
+      }
+      std::printf("%-8s %12.3f %12.3f %10.0f %10.0f  %s\n",
+                  mapped ? "mmap" : "stdio", median(startup), median(total),
+                  median(syscalls), median(faults), filename.c_str());
+    }
+  }
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// kernels: throughput of every sample kernel for every supported instruction
+// set
+// ---------------------------------------------------------------------------
+// runs function until it took at least 200 ms, returns samples per second
+double samples_per_second(size_t samples, const std::function<void()> &run) {
+  size_t iterations = 0;
+  Clock::time_point start = Clock::now();
+  double ms;
+  do {
+    run();
+    iterations++;
+  } while ((ms = elapsed_ms(start)) < 200);
+  return samples * iterations / (ms / 1000);
+}
+
+int bench_kernels(int, char **) {
+  const size_t frames = 4096, channels = 2, samples = frames * channels;
+  std::vector<float> floats(samples), left(frames), right(frames);
+  std::vector<int16_t> s16(samples);
+  std::vector<uint8_t> s24(samples * 3);
+  std::vector<int32_t> s32(samples);
+  for (size_t i = 0; i < samples; i++) floats[i] = std::sin(i * 0.01f) * 0.9f;
+  float *planes[2] = {left.data(), right.data()};
+  const float *const_planes[2] = {left.data(), right.data()};
+  // silent FFT stage, every butterfly doubles energy of loud data
+  std::vector<float> fft_re(frames), fft_im(frames), twiddle_re(frames / 2),
+      twiddle_im(frames / 2);
+  for (size_t j = 0; j < frames / 2; j++) {
+    twiddle_re[j] = std::cos(M_PI * j / (frames / 2));
+    twiddle_im[j] = -std::sin(M_PI * j / (frames / 2));
+  }
+
+  std::printf("%-8s %-14s %14s\n", "isa", "kernel", "Msamples/s");
+  for (const SampleKernels *kernels : get_available_sample_kernels()) {
+    DitherState dither;
+    init_dither(dither);
+    std::vector<std::pair<const char *, std::function<void()>>> cases = {
+        {"float_to_s16",
+         [&] { kernels->float_to_s16(floats.data(), s16.data(), samples,
+                                     dither); }},
+        {"float_to_s24",
+         [&] { kernels->float_to_s24(floats.data(), s24.data(), samples,
+                                     dither); }},
+        {"float_to_s32",
+         [&] { kernels->float_to_s32(floats.data(), s32.data(), samples); }},
+        {"s16_to_float",
+         [&] { kernels->s16_to_float(s16.data(), floats.data(), samples); }},
+        {"s24_to_float",
+         [&] { kernels->s24_to_float(s24.data(), floats.data(), samples); }},
+        {"s32_to_float",
+         [&] { kernels->s32_to_float(s32.data(), floats.data(), samples); }},
+        // gain runs many times over same data, keep it near 1, so samples
+        // do not become denormal
+        {"gain",
+         [&] { kernels->apply_gain(floats.data(), frames, channels, 1.0f,
+                                   1.0f); }},
+        {"gain_ramp",
+         [&] { kernels->apply_gain(floats.data(), frames, channels, 1.0f,
+                                   1.0000001f); }},
+        {"interleave",
+         [&] { kernels->interleave(const_planes, floats.data(), frames,
+                                   channels); }},
+        {"deinterleave",
+         [&] { kernels->deinterleave(floats.data(), planes, frames,
+                                     channels); }},
+        {"mix",
+         [&] { kernels->mix(floats.data(), floats.data(), frames, channels,
+                            0.0f, 1.0f); }},
+        {"butterflies",
+         [&] { kernels->butterflies(fft_re.data(), fft_im.data(),
+                                    twiddle_re.data(), twiddle_im.data(),
+                                    frames / 2); }},
+    };
+    for (const auto &test : cases) {
+      // restore test signal, previous kernel overwrote it
+      for (size_t i = 0; i < samples; i++)
+        floats[i] = std::sin(i * 0.01f) * 0.9f;
+      double speed = samples_per_second(samples, test.second);
+      std::printf("%-8s %-14s %14.1f\n", kernels->name, test.first,
+                  speed / 1e6);
+    }
+  }
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// resampler: throughput and THD+N of every quality for common rate pairs
+// ---------------------------------------------------------------------------
+const char *quality_name(Resampler::Quality quality) {
+  switch (quality) {
+    case Resampler::QUALITY_FAST:
+      return "fast";
+    case Resampler::QUALITY_HIGH:
+      return "high";
+    default:
+      return "medium";
+  }
+}
+
+// resamples stereo sine, returns level of everything except sine in dB
+double thd_n_db(Resampler &resampler, int in_rate, int out_rate) {
+  const double frequency = 1000, amplitude = 0.5;
+  const size_t frames = in_rate * 3, block = 4096;
+  std::vector<float> input(frames * 2), output, buffer(block * 2);
+  for (size_t i = 0; i < frames; i++)
+    input[i * 2] = input[i * 2 + 1] =
+        amplitude * std::sin(2 * M_PI * frequency * i / in_rate);
+  auto pull_all = [&] {
+    size_t got;
+    while ((got = resampler.pull(buffer.data(), block)) > 0)
+      output.insert(output.end(), buffer.begin(), buffer.begin() + got * 2);
+  };
+  for (size_t i = 0; i < frames; i += block) {
+    resampler.push(input.data() + i * 2, std::min(block, frames - i));
+    pull_all();
+  }
+  resampler.drain();
+  pull_all();
+  // fit sine, cosine and DC over one second in the middle, it holds whole
+  // periods, so they are orthogonal and fit is plain projection
+  const size_t start = out_rate, count = out_rate;
+  if (output.size() < (start + count) * 2) return 0;
+  double sine = 0, cosine = 0, dc = 0;
+  for (size_t i = start; i < start + count; i++) {
+    double phase = 2 * M_PI * frequency * i / out_rate;
+    sine += output[i * 2] * std::sin(phase);
+    cosine += output[i * 2] * std::cos(phase);
+    dc += output[i * 2];
+  }
+  sine *= 2.0 / count;
+  cosine *= 2.0 / count;
+  dc /= count;
+  double noise = 0;
+  for (size_t i = start; i < start + count; i++) {
+    double phase = 2 * M_PI * frequency * i / out_rate;
+    double fit = sine * std::sin(phase) + cosine * std::cos(phase) + dc;
+    noise += (output[i * 2] - fit) * (output[i * 2] - fit);
+  }
+  double signal = (sine * sine + cosine * cosine) / 2;
+  return 10 * std::log10(noise / count / signal);
+}
+
+int bench_resampler(int, char **) {
+  const std::pair<int, int> rates[] = {
+      {44100, 48000}, {48000, 44100}, {96000, 48000}, {22050, 48000}};
+  const size_t block = 4096, channels = 2;
+  std::vector<float> input(block * channels), output(block * 2 * channels);
+  for (size_t i = 0; i < input.size(); i++)
+    input[i] = std::sin(i * 0.01f) * 0.9f;
+
+  std::printf("%-14s %-8s %12s %12s %10s\n", "rates", "quality", "Mframes/s",
+              "x realtime", "THD+N dB");
+  for (const auto &rate : rates) {
+    for (Resampler::Quality quality :
+         {Resampler::QUALITY_FAST, Resampler::QUALITY_MEDIUM,
+          Resampler::QUALITY_HIGH}) {
+      Resampler resampler;
+      resampler.setup(rate.first, rate.second, channels, quality);
+      // input frames per second, stereo
+      double speed = samples_per_second(block, [&] {
+        resampler.push(input.data(), block);
+        while (resampler.pull(output.data(), block * 2) > 0) {
+        }
+      });
+      resampler.setup(rate.first, rate.second, channels, quality);
+      double noise = thd_n_db(resampler, rate.first, rate.second);
+      std::string rates_name =
+          std::to_string(rate.first) + "->" + std::to_string(rate.second);
+      std::printf("%-14s %-8s %12.2f %12.0f %10.1f\n", rates_name.c_str(),
+                  quality_name(quality), speed / 1e6, speed / rate.first,
+                  noise);
+    }
+  }
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// eq: CPU cost of biquad cascade of equalizer per band count
+// ---------------------------------------------------------------------------
+int bench_equalizer(int, char **) {
+  const int rate = 48000;
+  const size_t frames = 4096, channels = 2;
+  std::vector<float> samples(frames * channels);
+  std::vector<float> state(Equalizer::kMaxBands * 2 * kBiquadLanes);
+  // alternating boosts and cuts keep level of repeatedly filtered signal
+  Biquad biquads[Equalizer::kMaxBands];
+  for (size_t i = 0; i < Equalizer::kMaxBands; i++) {
+    EqBand band;
+    band.frequency = 31.25 * std::pow(2, i);
+    band.gain = i % 2 == 0 ? 6 : -6;
+    band.q = 1.4;
+    biquads[i] = Equalizer::design(band, rate);
+  }
+
+  std::printf("%-8s %6s %12s %12s %10s\n", "isa", "bands", "Mframes/s",
+              "ns/frame", "CPU %");
+  for (const SampleKernels *kernels : get_available_sample_kernels()) {
+    for (size_t bands : {1, 2, 4, 6, 8, 10}) {
+      for (size_t i = 0; i < samples.size(); i++)
+        samples[i] = std::sin(i * 0.01f) * 0.5f;
+      std::fill(state.begin(), state.end(), 0.0f);
+      double speed = samples_per_second(frames, [&] {
+        kernels->biquads(samples.data(), frames, channels, biquads, bands,
+                         state.data());
+      });
+      // share of one core needed to equalize stereo stream in real time
+      std::printf("%-8s %6zu %12.2f %12.2f %10.3f\n", kernels->name, bands,
+                  speed / 1e6, 1e9 / speed, rate / speed * 100);
+    }
+  }
+  return 0;
+}
+
+#ifdef HAVE_TAGLIB
+// ---------------------------------------------------------------------------
+// probe: files per second and peak RSS of playlist metadata probe
+// ---------------------------------------------------------------------------
+void list_files(const std::string &path, std::vector<std::string> &files) {
+  DIR *dir = opendir(path.c_str());
+  if (!dir) {  // not a directory
+    files.push_back(path);
+    return;
+  }
+  while (dirent *entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name != "." && name != "..") list_files(path + "/" + name, files);
+  }
+  closedir(dir);
+}
+
+struct ProbeResult {
+  double ms = 0;
+  size_t accepted = 0;
+  long max_rss_kb = 0;
+};
+
+using ProbeFunction = bool (*)(const std::string &, std::string &,
+                               std::string &, double &);
+
+// runs probe over all files in child process, so peak RSS of every method is
+// measured separately
+bool run_probe(ProbeFunction probe, const std::vector<std::string> &files,
+               ProbeResult &result) {
+  int fds[2];
+  if (pipe(fds) != 0) return false;
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    ProbeResult child;
+    std::string title, artist;
+    double duration;
+    Clock::time_point start = Clock::now();
+    for (const auto &file : files)
+      if (probe(file, title, artist, duration)) child.accepted++;
+    child.ms = elapsed_ms(start);
+    ssize_t written = write(fds[1], &child, sizeof(child));
+    _exit(written == sizeof(child) ? 0 : 1);
+  }
+  close(fds[1]);
+  ssize_t got = pid > 0 ? read(fds[0], &result, sizeof(result)) : 0;
+  close(fds[0]);
+  int status = 0;
+  struct rusage usage;
+  if (pid <= 0 || wait4(pid, &status, 0, &usage) != pid) return false;
+  result.max_rss_kb = usage.ru_maxrss;
+  return got == sizeof(result) && WIFEXITED(status) &&
+         WEXITSTATUS(status) == 0;
+}
+
+int bench_probe(int argc, char **argv) {
+  if (argc < 1) {
+    std::printf("usage: crescendo_bench probe <file or directory>...\n");
+    return 1;
+  }
+  std::vector<std::string> files;
+  for (int i = 0; i < argc; i++) list_files(argv[i], files);
+  const struct {
+    const char *name;
+    ProbeFunction probe;
+  } methods[] = {{"decoder", TrackProbe::probe_with_decoder},
+                 {"headers", TrackProbe::probe}};
+  ProbeResult result;
+  run_probe(TrackProbe::probe, files, result);  // warm page cache
+  std::printf("%zu files\n", files.size());
+  std::printf("%-8s %10s %12s %10s %12s\n", "probe", "audio", "files/s",
+              "total ms", "peak RSS KB");
+  for (const auto &method : methods) {
+    if (!run_probe(method.probe, files, result)) {
+      std::printf("%s probe failed\n", method.name);
+      return 1;
+    }
+    std::printf("%-8s %10zu %12.0f %10.1f %12ld\n", method.name,
+                result.accepted, files.size() / (result.ms / 1000),
+                result.ms, result.max_rss_kb);
+  }
+  return 0;
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// playlist: save and load time of m3u8 and xspf playlists
+// ---------------------------------------------------------------------------
+int bench_playlist(int argc, char **argv) {
+  const size_t entries =
+      argc >= 1 ? std::strtoul(argv[0], nullptr, 10) : 100000;
+  std::vector<PlaylistTrack> tracks(entries);
+  for (size_t i = 0; i < entries; i++) {
+    const std::string number = std::to_string(i);
+    tracks[i].artist = "Artist " + std::to_string(i / 1000);
+    tracks[i].filename = "/home/user/Music/" + tracks[i].artist +
+                         "/Album & Friends/" + number + " - Track.flac";
+    tracks[i].title = "Track " + number;
+    tracks[i].album = "Album & Friends";
+    tracks[i].duration = 180 + i % 240;
+  }
+  char dir[] = "/tmp/crescendo_benchXXXXXX";
+  if (!mkdtemp(dir)) {
+    std::printf("can't create temporary directory\n");
+    return 1;
+  }
+  std::printf("%zu entries\n", entries);
+  std::printf("%-6s %10s %10s %10s\n", "format", "MB", "save ms", "load ms");
+  for (const char *extension : {"m3u8", "xspf"}) {
+    const std::string path = std::string(dir) + "/playlist." + extension;
+    std::vector<double> save_ms, load_ms;
+    for (int run = 0; run < 5; run++) {
+      Clock::time_point start = Clock::now();
+      if (!PlaylistFile::save(path, tracks)) {
+        std::printf("can't save %s\n", path.c_str());
+        return 1;
+      }
+      save_ms.push_back(elapsed_ms(start));
+      std::vector<PlaylistTrack> loaded;
+      loaded.reserve(entries);
+      start = Clock::now();
+      if (!PlaylistFile::load(path, loaded) || loaded.size() != entries) {
+        std::printf("can't load %s\n", path.c_str());
+        return 1;
+      }
+      load_ms.push_back(elapsed_ms(start));
+    }
+    struct stat st;
+    stat(path.c_str(), &st);
+    std::printf("%-6s %10.1f %10.1f %10.1f\n", extension,
+                st.st_size / 1048576.0, median(save_ms), median(load_ms));
+    unlink(path.c_str());
+  }
+  rmdir(dir);
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// search: build time of trigram index and query latency
+// ---------------------------------------------------------------------------
+int bench_search(int argc, char **argv) {
+  const size_t count =
+      argc >= 1 ? std::strtoul(argv[0], nullptr, 10) : 200000;
+  const char *words[] = {"love",  "night", "dream", "fire",  "rain",
+                         "queen", "ocean", "star",  "heart", "blue"};
+  std::mt19937 random(1);
+  std::vector<PlaylistTrack> tracks(count);
+  for (size_t i = 0; i < count; i++) {
+    tracks[i].title = std::string(words[random() % 10]) + " " +
+                      words[random() % 10] + " " + std::to_string(i);
+    tracks[i].artist = "Artist " + std::to_string(i % 5000);
+    tracks[i].album = "Album " + std::to_string(i % 20000);
+    tracks[i].filename = "/home/user/Music/" + tracks[i].artist + "/" +
+                         tracks[i].album + "/" + std::to_string(i) + ".flac";
+  }
+  SearchIndex index;
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < count; i += 256) {  // batches like import
+    std::vector<PlaylistTrack> batch(
+        tracks.begin() + i, tracks.begin() + std::min(count, i + 256));
+    index.splice(i, 0, batch);
+  }
+  std::printf("%zu tracks indexed in %.1f ms\n", count, elapsed_ms(start));
+  std::printf("%-20s %10s %12s\n", "query", "results", "us/query");
+  for (const char *query : {"artist 1234", "ocean star 1999", "199999",
+                            "dream", "lo", "album 77 dream"}) {
+    const int runs = 100;
+    size_t total = 0;
+    start = Clock::now();
+    for (int run = 0; run < runs; run++) index.search(query, 0, 50, total);
+    std::printf("%-20s %10zu %12.1f\n", query, total,
+                elapsed_ms(start) * 1000 / runs);
+  }
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// shuffle: next track choice with shuffle and repeat of whole playlist
+// ---------------------------------------------------------------------------
+// drives model as player does and checks that every epoch plays every track
+// once, so playback can't get stuck between few tracks
+int bench_shuffle(int argc, char **argv) {
+  const int runs = argc >= 1 ? std::atoi(argv[0]) : 2000;
+  std::printf("%-8s %8s %10s %10s\n", "tracks", "runs", "failed", "ns/step");
+  for (int count : {2, 3, 4, 7, 100, 10000}) {
+    const int epochs = count > 100 ? 3 : 15;
+    const int checked = count > 100 ? std::max(1, runs / 100) : runs;
+    int failed = 0;
+    long steps = 0;
+    Clock::time_point start = Clock::now();
+    for (int run = 0; run < checked; run++) {
+      PlaylistModel model;
+      model.add(std::vector<PlaylistTrack>(count));
+      model.set_current(run % count);
+      model.choose_next(1, true);  // shuffle starts from current track
+      std::vector<int> played{model.get_current()};
+      while ((int)played.size() < count * epochs) {
+        int next = model.choose_next(1, true);
+        model.set_next(next);
+        model.set_current(next);
+        played.push_back(next);
+      }
+      steps += played.size();
+      for (int epoch = 0; epoch < epochs; epoch++) {
+        std::vector<int> tracks(played.begin() + epoch * count,
+                                played.begin() + (epoch + 1) * count);
+        std::sort(tracks.begin(), tracks.end());
+        for (int i = 0; i < count; i++)
+          if (tracks[i] != i) {
+            failed++;
+            epoch = epochs;
+            break;
+          }
+      }
+    }
+    std::printf("%-8d %8d %10d %10.1f\n", count, checked, failed,
+                elapsed_ms(start) * 1e6 / steps);
+    if (failed > 0) return 1;
+  }
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// seek: latency and accuracy of sf_seek against seeking with SeekIndex
+// ---------------------------------------------------------------------------
+// first channel of whole file, decoded linearly, is reference for accuracy
+bool decode_reference(const std::string &filename, std::vector<float> &ref) {
+  SF_INFO info = {0};
+  SNDFILE *sf = sf_open(filename.c_str(), SFM_READ, &info);
+  if (!sf) return false;
+  std::vector<float> block(4096 * info.channels);
+  sf_count_t got;
+  ref.clear();
+  while ((got = sf_readf_float(sf, block.data(), 4096)) > 0)
+    for (sf_count_t i = 0; i < got; i++)
+      ref.push_back(block[i * info.channels]);
+  sf_close(sf);
+  return true;
+}
+
+// finds where decoded samples are in reference, near expected frame
+int64_t frame_error(const std::vector<float> &ref, const float *samples,
+                    size_t count, uint64_t expected) {
+  const int64_t reach = 8192;
+  int64_t best = 0;
+  double best_error = -1;
+  for (int64_t d = -reach; d <= reach; d++) {
+    int64_t at = (int64_t)expected + d;
+    if (at < 0 || at + (int64_t)count > (int64_t)ref.size()) continue;
+    double error = 0;
+    for (size_t i = 0; i < count; i++)
+      error += (ref[at + i] - samples[i]) * (ref[at + i] - samples[i]);
+    if (best_error < 0 || error < best_error ||
+        (error == best_error && std::abs(d) < std::abs(best))) {
+      best = d;
+      best_error = error;
+    }
+  }
+  return best;
+}
+
+int bench_seek(int argc, char **argv) {
+  if (argc < 1) {
+    std::printf("usage: crescendo_bench seek <audio file>...\n");
+    return 1;
+  }
+  const int seeks = 50;
+  const size_t check = 64;  // frames compared with reference after seek
+  std::printf("%-8s %10s %10s %10s %10s  %s\n", "seek", "median ms", "max ms",
+              "exact", "max error", "file");
+  for (int i = 0; i < argc; i++) {
+    std::string filename = argv[i];
+    std::vector<float> ref;
+    SeekIndex index;
+    std::atomic_bool cancel{false};
+    Clock::time_point start = Clock::now();
+    if (!decode_reference(filename, ref) || ref.size() <= check ||
+        !index.build(filename, cancel)) {
+      std::printf("can't decode %s\n", filename.c_str());
+      return 1;
+    }
+    std::printf("%-8s %10.3f %10s %10s %10s  %s (%s)\n", "build",
+                elapsed_ms(start), "", "", "", filename.c_str(),
+                index.is_exact() ? "exact decoder" : "imprecise decoder");
+    std::mt19937 random(1);
+    std::vector<uint64_t> targets;
+    for (int j = 0; j < seeks; j++)
+      targets.push_back(random() % (ref.size() - check));
+    for (bool indexed : {false, true}) {
+      std::vector<double> latency;
+      int exact = 0;
+      int64_t max_error = 0;
+      std::vector<float> buffer, samples(check);
+      for (uint64_t target : targets) {
+        drop_cache(filename);  // seek on cold cache, like after long pause
+        MappedFile file;
+        SF_INFO info = {0};
+        SNDFILE *sf = file.open(filename) ? file.open_sndfile(&info) : nullptr;
+        if (!sf) return 1;
+        std::vector<float> block(check * info.channels);
+        start = Clock::now();
+        if (!indexed || !index.seek(sf, &file, target, buffer))
+          sf_seek(sf, target, SEEK_SET);
+        sf_count_t got = sf_readf_float(sf, block.data(), check);
+        latency.push_back(elapsed_ms(start));
+        sf_close(sf);
+        for (sf_count_t k = 0; k < got; k++)
+          samples[k] = block[k * info.channels];
+        int64_t error = frame_error(ref, samples.data(), got, target);
+        if (error == 0) exact++;
+        max_error = std::max<int64_t>(max_error, std::abs(error));
+      }
+      std::printf("%-8s %10.3f %10.3f %7d/%-2d %10lld  %s\n",
+                  indexed ? "index" : "sf_seek", median(latency),
+                  *std::max_element(latency.begin(), latency.end()), exact,
+                  seeks, (long long)max_error, filename.c_str());
+    }
+  }
+  return 0;
+}
+
+struct Benchmark {
+  const char *name;
+  const char *description;
+  std::function<int(int, char **)> run;
+};
+
+const Benchmark kBenchmarks[] = {
+    {"eq", "CPU cost of equalizer biquad cascade per band count",
+     bench_equalizer},
+    {"io", "startup latency and syscalls of stdio and mmap sources",
+     bench_io},
+    {"kernels", "samples per second of SIMD sample kernels", bench_kernels},
+    {"playlist", "save and load time of m3u8 and xspf playlists",
+     bench_playlist},
+#ifdef HAVE_TAGLIB
+    {"probe", "files per second and peak RSS of playlist metadata probe",
+     bench_probe},
+#endif
+    {"resampler", "throughput and THD+N of resampler qualities",
+     bench_resampler},
+    {"search", "build time and query latency of playlist search index",
+     bench_search},
+    {"seek", "seek latency and accuracy with and without seek index",
+     bench_seek},
+    {"shuffle", "repeat-all shuffle covers every track once per epoch",
+     bench_shuffle},
+};
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc >= 2) {
+    for (const auto &benchmark : kBenchmarks)
+      if (std::strcmp(argv[1], benchmark.name) == 0)
+        return benchmark.run(argc - 2, argv + 2);
+  }
+  std::printf("usage: crescendo_bench <benchmark> [arguments]\n");
+  for (const auto &benchmark : kBenchmarks)
+    std::printf("  %-12s %s\n", benchmark.name, benchmark.description);
+  return 1;
+}
@@ -0,0 +1,200 @@
+#include "equalizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+namespace {
+const float kDenormal = 1e-25f;  // state below this is flushed to zero
+}  // namespace
+
+void Equalizer::setup(int rate, int channels, size_t max_frames) {
+  // more channels than lanes of kernels are played without equalizer
+  m_channels = channels <= (int)kBiquadLanes ? channels : 0;
+  m_state.assign(kMaxBands * 2 * kBiquadLanes, 0.0f);
+  m_fade_state.assign(m_state.size(), 0.0f);
+  m_fade_buffer.assign(max_frames * std::max(channels, 1), 0.0f);
+  m_active = Filters();
+  std::lock_guard<std::mutex> lock(m_bands_mutex);
+  m_rate = rate;
+  publish();  // coefficients depend on rate
+}
+
+bool Equalizer::set_bands(const std::vector<EqBand> &bands) {
+  if (bands.size() > kMaxBands) return false;
+  for (const EqBand &band : bands)
+    if (!is_valid(band)) return false;
+  std::lock_guard<std::mutex> lock(m_bands_mutex);
+  m_bands = bands;
+  publish();
+  return true;
+}
+
+void Equalizer::publish() {
+  int rate = m_rate;
+  // writer never touches slot which is published or copied by reader
+  int published = m_published.load(), reading = m_reading.load();
+  int slot = 0;
+  while (slot == published || slot == reading) slot++;
+  Filters &filters = m_slots[slot];
+  filters.count = rate > 0 ? m_bands.size() : 0;
+  for (size_t i = 0; i < filters.count; i++)
+    filters.biquads[i] = design(m_bands[i], rate);
+  filters.serial = ++m_serial;
+  m_published.store(slot);
+}
+
+std::vector<EqBand> Equalizer::get_bands() const {
+  std::lock_guard<std::mutex> lock(m_bands_mutex);
+  return m_bands;
+}
+
+int Equalizer::acquire_slot() {
+  int slot = m_published.load();
+  while (true) {
+    m_reading.store(slot);
+    // writer could publish other slot before it saw this one marked
+    int published = m_published.load();
+    if (published == slot) return slot;
+    slot = published;
+  }
+}
+
+void Equalizer::process(float *data, size_t frames) {
+  if (m_channels == 0 || frames == 0) return;
+  const SampleKernels &kernels = get_sample_kernels();
+  const size_t channels = m_channels;
+  int slot = acquire_slot();
+  if (m_slots[slot].serial == m_active.serial) {
+    m_reading.store(-1);
+    if (m_active.count > 0)
+      kernels.biquads(data, frames, channels, m_active.biquads,
+                      m_active.count, m_state.data());
+  } else {  // new bands, fade from old filters into new ones in this block
+    Filters next = m_slots[slot];
+    m_reading.store(-1);
+    size_t fade = std::min(frames, m_fade_buffer.size() / channels);
+    std::memcpy(m_fade_buffer.data(), data, fade * channels * sizeof(float));
+    m_fade_state = m_state;
+    kernels.biquads(m_fade_buffer.data(), fade, channels, m_active.biquads,
+                    m_active.count, m_fade_state.data());
+    // added bands start from silence, others continue from old state
+    for (size_t i = m_active.count; i < next.count; i++)
+      std::fill_n(m_state.begin() + i * 2 * kBiquadLanes, 2 * kBiquadLanes,
+                  0.0f);
+    kernels.biquads(data, frames, channels, next.biquads, next.count,
+                    m_state.data());
+    kernels.apply_gain(data, fade, channels, 0.0f, 1.0f);
+    kernels.mix(data, m_fade_buffer.data(), fade, channels, 1.0f, 0.0f);
+    m_active = next;
+  }
+  for (float &value : m_state)  // decaying tails would become denormal
+    if (std::fabs(value) < kDenormal) value = 0;
+}
+
+Biquad Equalizer::design(const EqBand &band, int rate) {
+  const double frequency = std::min(band.frequency, rate * 0.45);
+  const double a = std::pow(10, band.gain / 40);
+  const double w0 = 2 * M_PI * frequency / rate;
+  const double cos_w0 = std::cos(w0);
+  const double alpha = std::sin(w0) / (2 * band.q);
+  double b0, b1, b2, a0, a1, a2;
+  switch (band.type) {
+    case EqBand::LOW_SHELF: {
+      const double root = 2 * std::sqrt(a) * alpha;
+      b0 = a * ((a + 1) - (a - 1) * cos_w0 + root);
+      b1 = 2 * a * ((a - 1) - (a + 1) * cos_w0);
+      b2 = a * ((a + 1) - (a - 1) * cos_w0 - root);
+      a0 = (a + 1) + (a - 1) * cos_w0 + root;
+      a1 = -2 * ((a - 1) + (a + 1) * cos_w0);
+      a2 = (a + 1) + (a - 1) * cos_w0 - root;
+      break;
+    }
+    case EqBand::HIGH_SHELF: {
+      const double root = 2 * std::sqrt(a) * alpha;
+      b0 = a * ((a + 1) + (a - 1) * cos_w0 + root);
+      b1 = -2 * a * ((a - 1) + (a + 1) * cos_w0);
+      b2 = a * ((a + 1) + (a - 1) * cos_w0 - root);
+      a0 = (a + 1) - (a - 1) * cos_w0 + root;
+      a1 = 2 * ((a - 1) - (a + 1) * cos_w0);
+      a2 = (a + 1) - (a - 1) * cos_w0 - root;
+      break;
+    }
+    case EqBand::PEAK:
+    default:
+      b0 = 1 + alpha * a;
+      b1 = -2 * cos_w0;
+      b2 = 1 - alpha * a;
+      a0 = 1 + alpha / a;
+      a1 = -2 * cos_w0;
+      a2 = 1 - alpha / a;
+      break;
+  }
+  return {(float)(b0 / a0), (float)(b1 / a0), (float)(b2 / a0),
+          (float)(a1 / a0), (float)(a2 / a0)};
+}
+
+bool Equalizer::is_valid(const EqBand &band) {
+  return band.type >= EqBand::PEAK && band.type <= EqBand::HIGH_SHELF &&
+         band.frequency >= 10 && band.frequency <= 24000 &&
+         std::fabs(band.gain) <= kMaxGain && band.q >= 0.1 && band.q <= 20;
+}
+
+bool Equalizer::parse(const std::string &text, std::vector<EqBand> &bands) {
+  std::vector<EqBand> parsed;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ';')) {
+    if (item.empty()) continue;
+    std::stringstream fields(item);
+    std::string type, frequency, gain, q;
+    if (!std::getline(fields, type, ':') ||
+        !std::getline(fields, frequency, ':') ||
+        !std::getline(fields, gain, ':') || !std::getline(fields, q, ':'))
+      return false;
+    EqBand band;
+    if (type == "peak")
+      band.type = EqBand::PEAK;
+    else if (type == "lowshelf")
+      band.type = EqBand::LOW_SHELF;
+    else if (type == "highshelf")
+      band.type = EqBand::HIGH_SHELF;
+    else
+      return false;
+    try {
+      band.frequency = std::stod(frequency);
+      band.gain = std::stod(gain);
+      band.q = std::stod(q);
+    } catch (const std::exception &) {  // invalid_argument or out_of_range
+      return false;
+    }
+    if (!is_valid(band)) return false;
+    parsed.push_back(band);
+  }
+  if (parsed.size() > kMaxBands) return false;
+  bands = std::move(parsed);
+  return true;
+}
+
+std::string Equalizer::format(const std::vector<EqBand> &bands) {
+  std::ostringstream text;
+  for (size_t i = 0; i < bands.size(); i++) {
+    const EqBand &band = bands[i];
+    if (i > 0) text << ';';
+    switch (band.type) {
+      case EqBand::LOW_SHELF:
+        text << "lowshelf";
+        break;
+      case EqBand::HIGH_SHELF:
+        text << "highshelf";
+        break;
+      case EqBand::PEAK:
+      default:
+        text << "peak";
+        break;
+    }
+    text << ':' << band.frequency << ':' << band.gain << ':' << band.q;
+  }
+  return text.str();
+}
@@ -0,0 +1,117 @@
+#ifndef EQUALIZER_H
+#define EQUALIZER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "samplekernels.h"
+
+/**
+ * One band of parametric equalizer
+ */
+struct EqBand {
+  enum Type { PEAK, LOW_SHELF, HIGH_SHELF };
+  Type type = PEAK;
+  double frequency = 1000;  // center or corner frequency, Hz
+  double gain = 0;          // dB
+  double q = 0.707;         // width of band, bigger is narrower
+};
+
+/**
+ * Parametric equalizer, cascade of biquads run by SIMD sample kernels.
+ * Bands may be changed from any thread while audio is processed: new
+ * coefficients are published lock-free and processing crossfades from old
+ * filters into new ones during one block, so changes do not click.
+ */
+class Equalizer {
+ public:
+  static const size_t kMaxBands = 10;
+  static constexpr double kMaxGain = 24;  // dB, both boost and cut
+
+  /**
+   * Prepares processing. Not thread safe, must be called before process.
+   * @param rate - sample rate of processed audio (type: int)
+   * @param channels - count of channels, at most kBiquadLanes (type: int)
+   * @param max_frames - maximum of frames in one block (type: size_t)
+   */
+  void setup(int rate, int channels, size_t max_frames);
+  /**
+   * Sets bands, can be called from any thread. Empty bands disable
+   * equalizer.
+   * @param bands - at most kMaxBands bands (type: std::vector<EqBand>)
+   * @return false if some band is invalid (type: bool)
+   */
+  bool set_bands(const std::vector<EqBand> &bands);
+  std::vector<EqBand> get_bands() const;
+  /**
+   * Filters interleaved frames in place, called only from one thread
+   * @param data - interleaved frames (type: float *)
+   * @param frames - count of frames, at most max_frames of setup
+   */
+  void process(float *data, size_t frames);
+  /**
+   * Computes biquad of band by RBJ audio EQ cookbook
+   * @param band - band of equalizer (type: EqBand)
+   * @param rate - sample rate (type: int)
+   */
+  static Biquad design(const EqBand &band, int rate);
+  /**
+   * Checks band parameters
+   * @return false if band can't be used (type: bool)
+   */
+  static bool is_valid(const EqBand &band);
+  /**
+   * Parses bands from text like "lowshelf:100:3:0.7;peak:1000:-2:1.4", where
+   * band is type:frequency:gain:q and type is peak, lowshelf or highshelf.
+   * Empty text is flat equalizer.
+   * @param text - bands separated by ';' (type: std::string)
+   * @param bands - parsed bands (type: std::vector<EqBand>)
+   * @return false if text is malformed or some band is invalid (type: bool)
+   */
+  static bool parse(const std::string &text, std::vector<EqBand> &bands);
+  /**
+   * Formats bands into text which parse understands
+   * @param bands - bands of equalizer (type: std::vector<EqBand>)
+   */
+  static std::string format(const std::vector<EqBand> &bands);
+
+ private:
+  struct Filters {
+    Biquad biquads[kMaxBands];
+    size_t count = 0;
+    uint64_t serial = 0;  // changes with every set_bands
+  };
+  /**
+   * Gets index of newest published filters and marks it as used by reader,
+   * so writer does not overwrite it while it is copied
+   */
+  int acquire_slot();
+  /**
+   * Computes filters of m_bands into free slot and publishes them,
+   * m_bands_mutex must be locked
+   */
+  void publish();
+
+  // writers only, reader never takes this lock
+  mutable std::mutex m_bands_mutex;
+  std::vector<EqBand> m_bands;
+  uint64_t m_serial = 0;
+
+  // three slots: one published, one maybe read, one free for writer
+  Filters m_slots[3];
+  std::atomic_int m_published{0}, m_reading{-1};
+  std::atomic_int m_rate{0};
+
+  // reader only
+  Filters m_active;                 // filters which process audio now
+  int m_channels = 0;
+  std::vector<float> m_state;       // see SampleKernels::biquads
+  std::vector<float> m_fade_state;  // state of old filters while fading
+  std::vector<float> m_fade_buffer;  // audio through old filters
+};
+
+#endif  // EQUALIZER_H
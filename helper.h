@@ -1,7 +1,11 @@
 #ifndef HELPER_H
 #define HELPER_H
+#include <sys/stat.h>
+
 #include <chrono>
+#include <cstdlib>
 #include <ctime>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
@@ -49,6 +53,73 @@ class Helper {
     if (new_string) std::cout << std::endl;
   }
 
+  /**
+   * Gets directory for cache files, creates it if it does not exist
+   *
+   * @return Path like "~/.cache/crescendo" or empty string if there is no
+   * home directory (type: std::string)
+   */
+  std::string get_cache_dir() {
+    std::string dir;
+    const char *xdg_cache = std::getenv("XDG_CACHE_HOME");
+    const char *home = std::getenv("HOME");
+    if (xdg_cache && *xdg_cache) {
+      dir = xdg_cache;
+    } else if (home && *home) {
+      dir = std::string(home) + "/.cache";
+    } else {
+      return "";
+    }
+    mkdir(dir.c_str(), 0755);  // fails if already exists, it is fine
+    dir += "/crescendo";
+    mkdir(dir.c_str(), 0755);
+    return dir;
+  }
+
+  /**
+   * Gets directory for settings files, creates it if it does not exist
+   *
+   * @return Path like "~/.config/crescendo" or empty string if there is no
+   * home directory (type: std::string)
+   */
+  std::string get_config_dir() {
+    std::string dir;
+    const char *xdg_config = std::getenv("XDG_CONFIG_HOME");
+    const char *home = std::getenv("HOME");
+    if (xdg_config && *xdg_config) {
+      dir = xdg_config;
+    } else if (home && *home) {
+      dir = std::string(home) + "/.config";
+    } else {
+      return "";
+    }
+    mkdir(dir.c_str(), 0755);  // fails if already exists, it is fine
+    dir += "/crescendo";
+    mkdir(dir.c_str(), 0755);
+    return dir;
+  }
+
+  /**
+   * Gets path of cache file which belongs to some key, e.g. audio file
+   *
+   * @param subdir Subdirectory of cache directory (type: std::string)
+   * @param key Key, which is hashed into file name (type: std::string)
+   * @param extension Extension of file, e.g. ".idx" (type: std::string)
+   * @return Path like "~/.cache/crescendo/seek/0123456789abcdef.idx" or
+   * empty string if there is no cache directory (type: std::string)
+   */
+  std::string get_cache_file(const std::string &subdir, const std::string &key,
+                             const std::string &extension) {
+    std::string dir = get_cache_dir();
+    if (dir.empty()) return "";
+    dir += "/" + subdir;
+    mkdir(dir.c_str(), 0755);  // fails if already exists, it is fine
+    std::ostringstream path;
+    path << dir << '/' << std::hex << std::setw(16) << std::setfill('0')
+         << std::hash<std::string>()(key) << extension;
+    return path.str();
+  }
+
   // Find the first digit
   int firstDigit(int n) {
     // Remove last digit from number
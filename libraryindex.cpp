@@ -0,0 +1,232 @@
+#include "libraryindex.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+#include <unordered_map>
+
+#include "helper.h"
+#include "trackprobe.h"
+
+namespace {
+const char kMagic[4] = {'C', 'L', 'I', 'B'};
+const uint32_t kVersion = 1;
+const uint16_t kHasReplayGain = 1;  // flag of record
+
+enum StringField { PATH, TITLE, ARTIST, ALBUM, STRING_FIELDS };
+
+// header of index file, followed by records and string table
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t record_size;  // catches records of other layout
+  uint32_t reserved;
+  uint64_t count;           // records
+  uint64_t records_offset;  // bytes from start of file
+  uint64_t strings_offset;
+  uint64_t strings_size;
+};
+}  // namespace
+
+struct LibraryIndex::Record {
+  int64_t mtime, size;  // of audio file when it was probed
+  uint64_t art_hash;
+  double duration;
+  float replaygain_gain, replaygain_peak;
+  uint32_t sample_rate;
+  uint16_t channels, flags;
+  uint32_t offsets[STRING_FIELDS];  // of strings in string table
+  uint32_t lengths[STRING_FIELDS];
+};
+LibraryIndex::~LibraryIndex() { close(); }
+
+void LibraryIndex::close() {
+  if (m_data) munmap(m_data, m_size);
+  m_data = nullptr;
+  m_size = 0;
+  m_records = nullptr;
+  m_count = 0;
+  m_strings = nullptr;
+  m_strings_size = 0;
+}
+
+bool LibraryIndex::open(const std::string &path) {
+  static_assert(sizeof(Record) == 80, "record layout is part of file format");
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return false;  // not saved yet
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(Header)) {
+    ::close(fd);
+    return false;
+  }
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);  // mapping keeps file open
+  if (data == MAP_FAILED) return false;
+  m_data = static_cast<uint8_t *>(data);
+  m_size = st.st_size;
+
+  const Header *header = reinterpret_cast<const Header *>(m_data);
+  if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+      header->version != kVersion || header->record_size != sizeof(Record) ||
+      header->records_offset % alignof(Record) != 0 ||
+      header->records_offset > m_size ||
+      header->count > (m_size - header->records_offset) / sizeof(Record) ||
+      header->strings_offset > m_size ||
+      header->strings_size > m_size - header->strings_offset) {
+    Helper::get_instance().log("Library index " + path +
+                               " has old format or is broken, ignoring it.");
+    close();
+    return false;
+  }
+  m_records = reinterpret_cast<const Record *>(m_data + header->records_offset);
+  m_count = header->count;
+  m_strings = reinterpret_cast<const char *>(m_data + header->strings_offset);
+  m_strings_size = header->strings_size;
+  // pages are read on lookups in random order
+  madvise(m_data, m_size, MADV_RANDOM);
+  return true;
+}
+
+bool LibraryIndex::get_string(uint32_t offset, uint32_t length,
+                              std::string &value) const {
+  if (offset > m_strings_size || length > m_strings_size - offset)
+    return false;
+  value.assign(m_strings + offset, length);
+  return true;
+}
+
+int LibraryIndex::compare_path(const Record &record,
+                               const std::string &filename) const {
+  uint32_t offset = record.offsets[PATH], length = record.lengths[PATH];
+  if (offset > m_strings_size || length > m_strings_size - offset)
+    return 1;  // broken record is never found
+  return std::string_view(m_strings + offset, length).compare(filename);
+}
+
+bool LibraryIndex::get(size_t index, PlaylistTrack &track) const {
+  if (index >= m_count) return false;
+  const Record &record = m_records[index];
+  if (!get_string(record.offsets[PATH], record.lengths[PATH],
+                  track.filename) ||
+      !get_string(record.offsets[TITLE], record.lengths[TITLE], track.title) ||
+      !get_string(record.offsets[ARTIST], record.lengths[ARTIST],
+                  track.artist) ||
+      !get_string(record.offsets[ALBUM], record.lengths[ALBUM], track.album))
+    return false;
+  track.duration = record.duration;
+  track.sample_rate = record.sample_rate;
+  track.channels = record.channels;
+  track.has_replaygain = record.flags & kHasReplayGain;
+  track.replaygain_gain = record.replaygain_gain;
+  track.replaygain_peak = record.replaygain_peak;
+  track.art_hash = record.art_hash;
+  track.mtime = record.mtime;
+  track.size = record.size;
+  return true;
+}
+
+bool LibraryIndex::find(const std::string &filename,
+                        PlaylistTrack &track) const {
+  // records are sorted by path
+  size_t low = 0, high = m_count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (compare_path(m_records[middle], filename) < 0)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  if (low == m_count || compare_path(m_records[low], filename) != 0)
+    return false;
+  int64_t mtime, size;
+  if (!TrackProbe::stat_file(filename, mtime, size) ||
+      mtime != m_records[low].mtime || size != m_records[low].size)
+    return false;  // changed since it was probed
+  return get(low, track);
+}
+
+bool LibraryIndex::save(const std::string &path,
+                        std::vector<PlaylistTrack> tracks) {
+  // sort by path, for equal paths keep last one
+  std::stable_sort(tracks.begin(), tracks.end(),
+                   [](const PlaylistTrack &a, const PlaylistTrack &b) {
+                     return a.filename < b.filename;
+                   });
+  std::vector<PlaylistTrack> unique;
+  unique.reserve(tracks.size());
+  for (auto &track : tracks) {
+    if (!unique.empty() && unique.back().filename == track.filename)
+      unique.back() = std::move(track);
+    else
+      unique.push_back(std::move(track));
+  }
+
+  std::string strings;
+  std::unordered_map<std::string, uint32_t> string_offsets;
+  // equal artists and albums are stored once
+  auto add_string = [&](const std::string &value, uint32_t &offset,
+                        uint32_t &length) {
+    auto it = string_offsets.find(value);
+    if (it == string_offsets.end()) {
+      it = string_offsets.emplace(value, strings.size()).first;
+      strings += value;
+    }
+    offset = it->second;
+    length = value.size();
+  };
+  std::vector<Record> records(unique.size());
+  for (size_t i = 0; i < unique.size(); i++) {
+    const PlaylistTrack &track = unique[i];
+    Record &record = records[i];
+    std::memset(&record, 0, sizeof(record));
+    record.mtime = track.mtime;
+    record.size = track.size;
+    record.art_hash = track.art_hash;
+    record.duration = track.duration;
+    record.replaygain_gain = track.replaygain_gain;
+    record.replaygain_peak = track.replaygain_peak;
+    record.sample_rate = track.sample_rate;
+    record.channels = track.channels;
+    record.flags = track.has_replaygain ? kHasReplayGain : 0;
+    add_string(track.filename, record.offsets[PATH], record.lengths[PATH]);
+    add_string(track.title, record.offsets[TITLE], record.lengths[TITLE]);
+    add_string(track.artist, record.offsets[ARTIST], record.lengths[ARTIST]);
+    add_string(track.album, record.offsets[ALBUM], record.lengths[ALBUM]);
+    if (strings.size() > UINT32_MAX) {
+      Helper::get_instance().log("Library is too big for index.");
+      return false;
+    }
+  }
+
+  Header header = {{0}};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.record_size = sizeof(Record);
+  header.count = records.size();
+  header.records_offset = sizeof(Header);
+  header.strings_offset = sizeof(Header) + records.size() * sizeof(Record);
+  header.strings_size = strings.size();
+  std::string temp_path = path + ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      Helper::get_instance().log("Can't write " + temp_path);
+      return false;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(records.data()),
+               records.size() * sizeof(Record));
+    file.write(strings.data(), strings.size());
+    if (!file) return false;
+  }
+  // replace old file at once, so mapped one is never half-written
+  return std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,73 @@
+#ifndef LIBRARYINDEX_H
+#define LIBRARYINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "playlistmodel.h"
+
+/**
+ * On-disk index of probed audio files, so files are not probed again on
+ * every launch. File is memory mapped and used in place: header, fixed-size
+ * track records sorted by path and string table with paths and tags, where
+ * equal strings are stored once. Opening index of any size is one mmap,
+ * lookup is binary search over records. Record is valid only while
+ * modification time and size of file are the same as when it was probed.
+ */
+class LibraryIndex {
+ public:
+  LibraryIndex() = default;
+  LibraryIndex(const LibraryIndex &) = delete;
+  LibraryIndex &operator=(const LibraryIndex &) = delete;
+  ~LibraryIndex();
+  /**
+   * Maps index file
+   * @param path - path to index file (type: std::string)
+   * @return false if there is no valid index file
+   */
+  bool open(const std::string &path);
+  /**
+   * Writes index file
+   * @param path - path to index file (type: std::string)
+   * @param tracks - tracks to save, order does not matter, for equal paths
+   * last one is saved (type: std::vector<PlaylistTrack>)
+   * @return true on success, false otherwise (type: bool)
+   */
+  static bool save(const std::string &path, std::vector<PlaylistTrack> tracks);
+  /**
+   * Finds track of file, which did not change since it was probed
+   * @param filename - path to audio file (type: std::string)
+   * @param track - struct to save track (type: PlaylistTrack)
+   * @return false if file is not in index or it changed
+   */
+  bool find(const std::string &filename, PlaylistTrack &track) const;
+  /**
+   * Gets track by position in index, without checking file
+   * @param index - position, from 0 to size() - 1 (type: size_t)
+   * @param track - struct to save track (type: PlaylistTrack)
+   * @return false if record is broken
+   */
+  bool get(size_t index, PlaylistTrack &track) const;
+  size_t size() const { return m_count; }
+
+ private:
+  struct Record;
+  void close();
+  /**
+   * Gets string of record from string table
+   * @return false if string is out of table
+   */
+  bool get_string(uint32_t offset, uint32_t length, std::string &value) const;
+  int compare_path(const Record &record, const std::string &filename) const;
+
+  uint8_t *m_data = nullptr;  // mapped index file
+  size_t m_size = 0;
+  const Record *m_records = nullptr;
+  size_t m_count = 0;
+  const char *m_strings = nullptr;
+  size_t m_strings_size = 0;
+};
+
+#endif  // LIBRARYINDEX_H
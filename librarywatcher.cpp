@@ -0,0 +1,263 @@
+#include "librarywatcher.h"
+
+#include <dirent.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "helper.h"
+
+namespace {
+const uint32_t kWatchMask = IN_CREATE | IN_CLOSE_WRITE | IN_DELETE |
+                            IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF |
+                            IN_MOVE_SELF | IN_ONLYDIR;
+
+std::string parent_directory(const std::string &path) {
+  size_t slash = path.rfind('/');
+  return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+bool is_inside(const std::string &path, const std::string &directory) {
+  return path.size() > directory.size() &&
+         path.compare(0, directory.size(), directory) == 0 &&
+         path[directory.size()] == '/';
+}
+}  // namespace
+
+LibraryWatcher::LibraryWatcher(ChangesFunction on_changes)
+    : m_on_changes(std::move(on_changes)) {
+  m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_fd == -1 || m_wakeup == -1) {
+    Helper::get_instance().log(std::string("Can't start library watcher: ") +
+                               std::strerror(errno));
+    return;
+  }
+  m_thread = std::thread(&LibraryWatcher::run, this);
+}
+
+LibraryWatcher::~LibraryWatcher() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  if (m_wakeup != -1) {
+    uint64_t one = 1;
+    if (write(m_wakeup, &one, sizeof(one)) < 0) {
+    }  // thread wakes up anyway on next poll timeout
+  }
+  if (m_thread.joinable()) m_thread.join();
+  if (m_fd != -1) close(m_fd);
+  if (m_wakeup != -1) close(m_wakeup);
+}
+
+bool LibraryWatcher::add_root(const std::string &path) {
+  if (m_fd == -1) return false;
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) return false;
+  std::string root = path;
+  while (root.size() > 1 && root.back() == '/') root.pop_back();
+  {
+    std::lock_guard<std::mutex> lock(m_roots_mutex);
+    m_new_roots.push_back(root);
+  }
+  uint64_t one = 1;
+  if (write(m_wakeup, &one, sizeof(one)) < 0) {
+  }  // counter can't overflow, thread is woken up already
+  return true;
+}
+
+void LibraryWatcher::watch_tree(const std::string &directory) {
+  int wd = inotify_add_watch(m_fd, directory.c_str(), kWatchMask);
+  if (wd == -1) {
+    if (errno == ENOSPC && !m_limit_logged) {
+      Helper::get_instance().log(
+          "Limit of inotify watches reached, raise "
+          "fs.inotify.max_user_watches to watch whole library.");
+      m_limit_logged = true;
+    }
+    return;
+  }
+  m_paths[wd] = directory;
+  m_watches[directory] = wd;
+  DIR *dir = opendir(directory.c_str());
+  if (!dir) return;
+  while (dirent *entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name == "." || name == "..") continue;
+    // linked directories are not followed, like by importer
+    if (entry->d_type == DT_DIR) {
+      watch_tree(directory + "/" + name);
+    } else if (entry->d_type == DT_UNKNOWN) {
+      struct stat st;
+      std::string path = directory + "/" + name;
+      if (lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+        watch_tree(path);
+    }
+  }
+  closedir(dir);
+}
+
+void LibraryWatcher::unwatch_tree(const std::string &directory) {
+  for (auto it = m_watches.begin(); it != m_watches.end();) {
+    if (it->first == directory || is_inside(it->first, directory)) {
+      inotify_rm_watch(m_fd, it->second);  // fails if already removed
+      m_paths.erase(it->second);
+      it = m_watches.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void LibraryWatcher::add_file(const std::string &path, bool removed) {
+  if (m_collapsed) {  // too many events, directory will be rescanned
+    m_rescan_directories.insert(parent_directory(path));
+    return;
+  }
+  if (removed) {
+    m_changed.erase(path);
+    m_removed.insert(path);
+  } else {
+    m_removed.erase(path);
+    m_changed.insert(path);
+  }
+  if (m_changed.size() + m_removed.size() <= kMaxPending) return;
+  // keep only directories, rescan finds out what happened there
+  for (const auto &file : m_changed)
+    m_rescan_directories.insert(parent_directory(file));
+  for (const auto &file : m_removed)
+    m_rescan_directories.insert(parent_directory(file));
+  m_changed.clear();
+  m_removed.clear();
+  m_collapsed = true;
+}
+
+void LibraryWatcher::handle(int wd, uint32_t mask, const std::string &name) {
+  if (mask & IN_Q_OVERFLOW) {  // kernel dropped events, rescan everything
+    Helper::get_instance().log("Library watcher lost events, rescanning.");
+    for (const auto &watch : m_watches) {
+      bool nested = false;
+      for (const auto &other : m_watches)
+        nested = nested || is_inside(watch.first, other.first);
+      if (!nested) m_rescan_directories.insert(watch.first);
+    }
+    m_changed.clear();
+    m_removed.clear();
+    m_collapsed = true;
+    return;
+  }
+  auto it = m_paths.find(wd);
+  if (it == m_paths.end()) return;  // watch was removed already
+  const std::string directory = it->second;
+  if (mask & IN_IGNORED) {  // directory was deleted
+    m_watches.erase(directory);
+    m_paths.erase(it);
+    return;
+  }
+  if (mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+    m_removed_directories.insert(directory);
+    unwatch_tree(directory);
+    return;
+  }
+  const std::string path = directory + "/" + name;
+  if (mask & IN_ISDIR) {
+    if (mask & (IN_CREATE | IN_MOVED_TO)) {
+      m_removed_directories.erase(path);
+      watch_tree(path);
+      m_rescan_directories.insert(path);  // files could appear before watch
+    } else if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+      m_removed_directories.insert(path);
+      unwatch_tree(path);
+    }
+    return;
+  }
+  // file is reported when it is written completely, not when created
+  if (mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+    add_file(path, false);
+  else if (mask & (IN_DELETE | IN_MOVED_FROM))
+    add_file(path, true);
+}
+
+LibraryChanges LibraryWatcher::take_changes() {
+  LibraryChanges changes;
+  changes.changed.assign(m_changed.begin(), m_changed.end());
+  changes.removed.assign(m_removed.begin(), m_removed.end());
+  changes.removed_directories.assign(m_removed_directories.begin(),
+                                     m_removed_directories.end());
+  changes.rescan_directories.assign(m_rescan_directories.begin(),
+                                    m_rescan_directories.end());
+  std::sort(changes.changed.begin(), changes.changed.end());
+  m_changed.clear();
+  m_removed.clear();
+  m_removed_directories.clear();
+  m_rescan_directories.clear();
+  m_collapsed = false;
+  return changes;
+}
+
+void LibraryWatcher::run() {
+  using Clock = std::chrono::steady_clock;
+  alignas(inotify_event) char buffer[64 * 1024];
+  bool pending = false;
+  while (true) {
+    int timeout = -1;  // sleep until event
+    if (pending) {
+      auto now = Clock::now();
+      auto due = std::min(m_last_event + kQuietTime, m_first_event + kMaxDelay);
+      timeout = std::max<int64_t>(
+          0, std::chrono::duration_cast<std::chrono::milliseconds>(due - now)
+                 .count());
+    }
+    pollfd fds[2] = {{m_fd, POLLIN, 0}, {m_wakeup, POLLIN, 0}};
+    if (poll(fds, 2, timeout) < 0 && errno != EINTR) break;
+
+    uint64_t wakeups;
+    if (read(m_wakeup, &wakeups, sizeof(wakeups)) < 0) {
+    }  // nothing to reset when woken up by inotify or timeout
+    std::vector<std::string> roots;
+    {
+      std::lock_guard<std::mutex> lock(m_roots_mutex);
+      roots.swap(m_new_roots);
+    }
+
+    LibraryChanges changes;
+    bool deliver = false;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_stop) break;
+      for (const auto &root : roots)
+        if (!m_watches.count(root)) watch_tree(root);  // else watched already
+      ssize_t length;
+      while ((length = read(m_fd, buffer, sizeof(buffer))) > 0) {
+        for (char *ptr = buffer; ptr < buffer + length;) {
+          auto event = reinterpret_cast<const inotify_event *>(ptr);
+          handle(event->wd, event->mask, event->len ? event->name : "");
+          ptr += sizeof(inotify_event) + event->len;
+        }
+        auto now = Clock::now();
+        if (!pending) m_first_event = now;
+        m_last_event = now;
+        pending = true;
+      }
+      auto now = Clock::now();
+      if (pending && (now >= m_last_event + kQuietTime ||
+                      now >= m_first_event + kMaxDelay)) {
+        changes = take_changes();
+        pending = false;
+        deliver = true;
+      }
+    }
+    if (deliver &&
+        (!changes.changed.empty() || !changes.removed.empty() ||
+         !changes.removed_directories.empty() ||
+         !changes.rescan_directories.empty()))
+      m_on_changes(std::move(changes));
+  }
+}
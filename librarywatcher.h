@@ -0,0 +1,104 @@
+#ifndef LIBRARYWATCHER_H
+#define LIBRARYWATCHER_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Changes of watched directories, collected over short period
+ */
+struct LibraryChanges {
+  std::vector<std::string> changed;  // files created, rewritten or moved in
+  std::vector<std::string> removed;  // files deleted or moved out
+  std::vector<std::string> removed_directories;  // with everything inside
+  /**
+   * Directories which must be compared with disk: new ones, which could get
+   * files before they were watched, and ones which lost events on overflow
+   */
+  std::vector<std::string> rescan_directories;
+};
+
+/**
+ * Watches imported directories with inotify. Events are merged while they
+ * come, so file which is written in many steps is reported once, and are
+ * delivered after short quiet period. Pending events are bounded: when there
+ * are too many of them, or kernel queue overflows, only directories where
+ * something happened are remembered and reported for rescan.
+ */
+class LibraryWatcher {
+ public:
+  static constexpr size_t kMaxPending = 4096;  // files before rescan instead
+  static constexpr std::chrono::milliseconds kQuietTime{500};
+  static constexpr std::chrono::milliseconds kMaxDelay{3000};
+
+  /**
+   * Receives changes. Called from watcher thread.
+   */
+  using ChangesFunction = std::function<void(LibraryChanges &&)>;
+
+  /**
+   * Starts watcher thread
+   * @param on_changes - function which receives changes (type:
+   * ChangesFunction)
+   */
+  explicit LibraryWatcher(ChangesFunction on_changes);
+  /**
+   * Stops watcher thread
+   */
+  ~LibraryWatcher();
+  LibraryWatcher(const LibraryWatcher &) = delete;
+  LibraryWatcher &operator=(const LibraryWatcher &) = delete;
+  /**
+   * Watches directory and all its subdirectories. Tree is walked by watcher
+   * thread, so caller doesn't wait for huge library.
+   * @param path - path to directory (type: std::string)
+   * @return false if inotify is not available or path is not directory
+   */
+  bool add_root(const std::string &path);
+
+ private:
+  void run();
+  /**
+   * Adds watches for directory tree, called with m_mutex locked
+   */
+  void watch_tree(const std::string &directory);
+  /**
+   * Drops watches of directory tree, which was removed or moved out
+   */
+  void unwatch_tree(const std::string &directory);
+  void handle(int wd, uint32_t mask, const std::string &name);
+  /**
+   * Adds file event to pending ones, falls back to rescan of its directory
+   * when there are too many pending files
+   */
+  void add_file(const std::string &path, bool removed);
+  /**
+   * Moves pending changes out, called with m_mutex locked
+   */
+  LibraryChanges take_changes();
+
+  ChangesFunction m_on_changes;
+  int m_fd = -1;      // inotify descriptor
+  int m_wakeup = -1;  // eventfd, wakes thread up for new roots or stopping
+  bool m_stop = false;
+  std::mutex m_roots_mutex;  // guards m_new_roots only, not held while walking
+  std::vector<std::string> m_new_roots;  // added, but not watched yet
+  bool m_limit_logged = false;  // watch limit reached
+  std::mutex m_mutex;           // guards everything below
+  std::unordered_map<int, std::string> m_paths;  // watched directories
+  std::unordered_map<std::string, int> m_watches;
+  std::unordered_set<std::string> m_changed, m_removed, m_removed_directories,
+      m_rescan_directories;
+  bool m_collapsed = false;  // file events are kept as their directories
+  std::chrono::steady_clock::time_point m_first_event, m_last_event;
+  std::thread m_thread;  // last, so it starts after members are ready
+};
+
+#endif  // LIBRARYWATCHER_H
@@ -0,0 +1,116 @@
+#include "loudnessmeter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+const double kAbsoluteGate = -70;  // LUFS
+const double kRelativeGate = -10;  // LU below ungated loudness
+const int kStepsPerBlock = 4;      // 400 ms gating block of 100 ms steps
+
+double power_to_lufs(double power) {
+  return power > 0 ? -0.691 + 10 * std::log10(power) : -HUGE_VAL;
+}
+}  // namespace
+
+void LoudnessMeter::setup(int rate, int channels) {
+  m_channels = channels;
+  m_step_frames = std::max(1, rate / 10);
+  m_frames_in_step = 0;
+
+  // K-weighting, coefficients of BS.1770 recalculated for any rate
+  double f0 = 1681.974450955533, gain = 3.999843853973347,
+         q = 0.7071752369554196;
+  double k = std::tan(M_PI * f0 / rate);
+  double vh = std::pow(10, gain / 20), vb = std::pow(vh, 0.4996667741545416);
+  double a0 = 1 + k / q + k * k;
+  m_shelf = {(vh + vb * k / q + k * k) / a0, 2 * (k * k - vh) / a0,
+             (vh - vb * k / q + k * k) / a0, 2 * (k * k - 1) / a0,
+             (1 - k / q + k * k) / a0};
+  f0 = 38.13547087602444;
+  q = 0.5003270373238773;
+  k = std::tan(M_PI * f0 / rate);
+  a0 = 1 + k / q + k * k;
+  m_highpass = {1, -2, 1, 2 * (k * k - 1) / a0, (1 - k / q + k * k) / a0};
+
+  m_state.assign(channels * 4, 0);
+  m_weights.assign(channels, 1.0);
+  if (channels == 6) {  // 5.1: LFE is ignored, surround channels boosted
+    m_weights[3] = 0;
+    m_weights[4] = m_weights[5] = 1.41;
+  }
+  m_step_power.assign(channels, 0);
+  m_steps.clear();
+  m_true_peak = 0;
+  int oversampling = rate < 96000 ? 4 : rate < 192000 ? 2 : 1;
+  m_oversampler.setup(rate, rate * oversampling, channels,
+                      Resampler::QUALITY_MEDIUM);
+}
+
+void LoudnessMeter::process(const float *data, size_t frames) {
+  const size_t channels = m_channels;
+  for (size_t i = 0; i < frames; i++) {
+    for (size_t c = 0; c < channels; c++) {
+      double x = data[i * channels + c];
+      m_true_peak = std::max(m_true_peak, std::abs(x));  // sample peak
+      double *z = m_state.data() + c * 4;  // direct form II transposed
+      double y = m_shelf.b0 * x + z[0];
+      z[0] = m_shelf.b1 * x - m_shelf.a1 * y + z[1];
+      z[1] = m_shelf.b2 * x - m_shelf.a2 * y;
+      x = y;
+      y = m_highpass.b0 * x + z[2];
+      z[2] = m_highpass.b1 * x - m_highpass.a1 * y + z[3];
+      z[3] = m_highpass.b2 * x - m_highpass.a2 * y;
+      m_step_power[c] += y * y;
+    }
+    if (++m_frames_in_step == m_step_frames) end_step();
+  }
+
+  // peaks between samples are found on oversampled signal
+  m_oversampler.push(data, frames);
+  m_oversampled.resize(4096 * channels);
+  size_t got;
+  while ((got = m_oversampler.pull(m_oversampled.data(), 4096)) > 0)
+    for (size_t i = 0; i < got * channels; i++)
+      m_true_peak = std::max(m_true_peak, (double)std::abs(m_oversampled[i]));
+}
+
+void LoudnessMeter::end_step() {
+  double power = 0;
+  for (int c = 0; c < m_channels; c++) {
+    power += m_weights[c] * m_step_power[c] / m_step_frames;
+    m_step_power[c] = 0;
+  }
+  m_steps.push_back(power);
+  m_frames_in_step = 0;
+}
+
+double LoudnessMeter::integrated() const {
+  // power of every 400 ms block, blocks start every 100 ms
+  std::vector<double> blocks;
+  for (size_t i = 0; i + kStepsPerBlock <= m_steps.size(); i++) {
+    double power = 0;
+    for (int j = 0; j < kStepsPerBlock; j++) power += m_steps[i + j];
+    blocks.push_back(power / kStepsPerBlock);
+  }
+  double sum = 0;
+  size_t count = 0;
+  for (double power : blocks) {
+    if (power_to_lufs(power) > kAbsoluteGate) {
+      sum += power;
+      count++;
+    }
+  }
+  if (count == 0) return kAbsoluteGate;
+  double threshold = power_to_lufs(sum / count) + kRelativeGate;
+  sum = 0;
+  count = 0;
+  for (double power : blocks) {
+    double loudness = power_to_lufs(power);
+    if (loudness > kAbsoluteGate && loudness > threshold) {
+      sum += power;
+      count++;
+    }
+  }
+  return count == 0 ? kAbsoluteGate : power_to_lufs(sum / count);
+}
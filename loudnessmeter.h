@@ -0,0 +1,57 @@
+#ifndef LOUDNESSMETER_H
+#define LOUDNESSMETER_H
+
+#include <cstddef>
+#include <vector>
+
+#include "resampler.h"
+
+/**
+ * EBU R128 (ITU-R BS.1770) loudness meter.
+ * Measures integrated loudness of K-weighted audio with absolute and relative
+ * gating, and true peak on 4 times oversampled audio.
+ */
+class LoudnessMeter {
+ public:
+  /**
+   * Prepares meter for new stream
+   * @param rate - sample rate (type: int)
+   * @param channels - channels count, 6 channels are treated as 5.1
+   * (type: int)
+   */
+  void setup(int rate, int channels);
+  /**
+   * Measures next part of stream
+   * @param data - interleaved float frames (type: const float *)
+   * @param frames - count of frames (type: size_t)
+   */
+  void process(const float *data, size_t frames);
+  /**
+   * Gets integrated loudness of whole stream in LUFS, -70 for silence
+   */
+  double integrated() const;
+  /**
+   * Gets maximal true peak, linear, 1.0 is full scale
+   */
+  double true_peak() const { return m_true_peak; }
+
+ private:
+  struct Biquad {
+    double b0, b1, b2, a1, a2;
+  };
+  void end_step();
+
+  int m_channels = 0;
+  size_t m_step_frames = 0;     // 100 ms, gating blocks overlap by 75 %
+  size_t m_frames_in_step = 0;  // frames in current 100 ms step
+  Biquad m_shelf = {0}, m_highpass = {0};  // K-weighting stages
+  std::vector<double> m_state;    // 4 filter delays per channel
+  std::vector<double> m_weights;  // channel weights
+  std::vector<double> m_step_power;  // weighted power of current step
+  std::vector<double> m_steps;    // mean power of every finished step
+  double m_true_peak = 0;
+  Resampler m_oversampler;
+  std::vector<float> m_oversampled;
+};
+
+#endif  // LOUDNESSMETER_H
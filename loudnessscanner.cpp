@@ -0,0 +1,226 @@
+#include "loudnessscanner.h"
+
+#include <sndfile.h>
+#include <sys/stat.h>
+#include <taglib/fileref.h>
+#include <taglib/tfile.h>
+#include <taglib/tpropertymap.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "helper.h"
+#include "loudnessmeter.h"
+#include "mappedfile.h"
+
+namespace {
+// saves of cache file during long scans, whole file is rewritten every time
+const std::chrono::seconds kSaveInterval(30);
+const int kDecodeFrames = 16384;  // frames decoded by one sf_readf_float
+}  // namespace
+
+LoudnessScanner::LoudnessScanner(const std::string &cache_path)
+    : m_cache_path(cache_path),
+      m_last_save(std::chrono::steady_clock::now()) {
+  if (m_cache_path.empty()) {
+    std::string dir = Helper::get_instance().get_cache_dir();
+    if (!dir.empty()) m_cache_path = dir + "/loudness.tsv";
+  }
+  load();
+}
+
+LoudnessScanner::~LoudnessScanner() {
+  m_cancel = true;
+  m_pool.reset();  // running scans stop, queued ones are dropped
+  save();
+}
+
+void LoudnessScanner::scan(const std::string &filename) {
+  LoudnessInfo info;
+  if (get(filename, info)) return;  // already scanned
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_queued.insert(filename).second) return;  // already queued
+  if (!m_pool) m_pool = std::make_unique<ThreadPool>();
+  m_pool->submit([this, filename] { scan_file(filename); });
+}
+
+bool LoudnessScanner::get(const std::string &filename, LoudnessInfo &info) {
+  Entry current;
+  if (!stat_file(filename, current)) return false;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_cache.find(filename);
+  if (it == m_cache.end() || it->second.mtime != current.mtime ||
+      it->second.size != current.size)
+    return false;  // not scanned or changed since
+  info = it->second.info;
+  return true;
+}
+
+void LoudnessScanner::wait() {
+  ThreadPool *pool;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    pool = m_pool.get();
+  }
+  if (pool) pool->wait();
+}
+
+bool LoudnessScanner::stat_file(const std::string &filename, Entry &entry) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0) return false;
+  entry.mtime = st.st_mtime;
+  entry.size = st.st_size;
+  return true;
+}
+
+void LoudnessScanner::scan_file(const std::string &filename) {
+  Entry entry;
+  bool ok = stat_file(filename, entry) &&
+            (read_tags(filename, entry.info) ||
+             measure(filename, entry.info, m_cancel));
+  bool save_now;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queued.erase(filename);
+    if (m_cancel) return;
+    if (ok) {
+      m_cache[filename] = entry;
+      m_unsaved++;
+      m_scanned++;
+    } else {
+      Helper::get_instance().log("Can't scan loudness of " + filename);
+    }
+    if (m_queued.empty() && m_scanned > 0) {
+      Helper::get_instance().log("Scanned loudness of " +
+                                 std::to_string(m_scanned) + " files");
+      m_scanned = 0;
+    }
+    // save when scanning is over or periodically during long scans
+    auto now = std::chrono::steady_clock::now();
+    save_now = m_unsaved > 0 &&
+               (m_queued.empty() || now - m_last_save >= kSaveInterval);
+    if (save_now) m_last_save = now;  // other workers don't save too
+  }
+  if (save_now) save();
+}
+
+bool LoudnessScanner::read_tags(const std::string &filename,
+                                LoudnessInfo &info) {
+  TagLib::FileRef ref(filename.c_str(), false);
+  if (ref.isNull() || !ref.file()) return false;
+  TagLib::PropertyMap properties = ref.file()->properties();
+  if (!properties.contains("REPLAYGAIN_TRACK_GAIN") ||
+      properties["REPLAYGAIN_TRACK_GAIN"].isEmpty())
+    return false;
+  // value looks like "-6.53 dB"
+  std::string gain =
+      properties["REPLAYGAIN_TRACK_GAIN"].front().to8Bit(true);
+  char *end;
+  info.gain = std::strtod(gain.c_str(), &end);
+  if (end == gain.c_str()) return false;
+  info.loudness = kReferenceLoudness - info.gain;
+  info.peak = 0;
+  if (properties.contains("REPLAYGAIN_TRACK_PEAK") &&
+      !properties["REPLAYGAIN_TRACK_PEAK"].isEmpty())
+    info.peak = std::strtod(
+        properties["REPLAYGAIN_TRACK_PEAK"].front().to8Bit(true).c_str(),
+        nullptr);
+  info.from_tags = true;
+  return true;
+}
+
+bool LoudnessScanner::measure(const std::string &filename,
+                              LoudnessInfo &info,
+                              const std::atomic_bool &cancel) {
+  MappedFile mapped;
+  SF_INFO sf_info = {0};
+  SNDFILE *file = nullptr;
+  if (mapped.open(filename)) file = mapped.open_sndfile(&sf_info);
+  if (!file) file = sf_open(filename.c_str(), SFM_READ, &sf_info);
+  if (!file) return false;
+  if (sf_info.samplerate <= 0 || sf_info.channels <= 0) {
+    sf_close(file);
+    return false;
+  }
+  LoudnessMeter meter;
+  meter.setup(sf_info.samplerate, sf_info.channels);
+  std::vector<float> buffer(kDecodeFrames * sf_info.channels);
+  sf_count_t frames;
+  while (!cancel &&
+         (frames = sf_readf_float(file, buffer.data(), kDecodeFrames)) > 0)
+    meter.process(buffer.data(), frames);
+  sf_close(file);
+  if (cancel) return false;
+  info.loudness = meter.integrated();
+  info.peak = meter.true_peak();
+  info.gain = kReferenceLoudness - info.loudness;
+  info.from_tags = false;
+  return true;
+}
+
+bool LoudnessScanner::load() {
+  if (m_cache_path.empty()) return false;
+  std::ifstream file(m_cache_path);
+  if (!file) return false;
+  // line: mtime, size, loudness, peak, gain, from tags, path; tab separated
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    Entry entry;
+    int from_tags = 0;
+    std::string filename;
+    if (!(fields >> entry.mtime >> entry.size >> entry.info.loudness >>
+          entry.info.peak >> entry.info.gain >> from_tags))
+      continue;
+    fields.get();  // tab before path
+    std::getline(fields, filename);
+    if (filename.empty()) continue;
+    entry.info.from_tags = from_tags != 0;
+    m_cache[filename] = entry;
+  }
+  Helper::get_instance().log("Loaded loudness of " +
+                             std::to_string(m_cache.size()) + " files");
+  return true;
+}
+
+bool LoudnessScanner::save() {
+  if (m_cache_path.empty()) return false;
+  std::lock_guard<std::mutex> save_lock(m_save_mutex);
+  std::vector<std::pair<std::string, Entry>> entries;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_unsaved == 0) return true;  // nothing new or saved by other worker
+    entries.assign(m_cache.begin(), m_cache.end());
+    m_unsaved = 0;
+  }
+  auto failed = [this] {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_unsaved++;  // try again next time
+    return false;
+  };
+  std::string temp_path = m_cache_path + ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::trunc);
+    if (!file) {
+      Helper::get_instance().log("Can't write " + temp_path);
+      return failed();
+    }
+    file.precision(10);
+    for (const auto &item : entries) {
+      if (item.first.find('\n') != std::string::npos) continue;
+      const Entry &entry = item.second;
+      file << entry.mtime << '\t' << entry.size << '\t' << entry.info.loudness
+           << '\t' << entry.info.peak << '\t' << entry.info.gain << '\t'
+           << entry.info.from_tags << '\t' << item.first << '\n';
+    }
+    if (!file) return failed();
+  }
+  // replace old file at once, so it is never half-written
+  if (std::rename(temp_path.c_str(), m_cache_path.c_str()) != 0)
+    return failed();
+  return true;
+}
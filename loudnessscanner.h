@@ -0,0 +1,106 @@
+#ifndef LOUDNESSSCANNER_H
+#define LOUDNESSSCANNER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "threadpool.h"
+
+/**
+ * Loudness of one audio file
+ */
+struct LoudnessInfo {
+  double loudness = 0;     // integrated loudness, LUFS
+  double peak = 0;         // true peak, linear, 0 if unknown
+  double gain = 0;         // gain to reference loudness, dB
+  bool from_tags = false;  // taken from ReplayGain tags, not measured
+};
+
+/**
+ * Background loudness scanner for ReplayGain-style normalization.
+ * Files are measured on work-stealing pool over all cores, existing
+ * ReplayGain tags are used instead of measuring when file has them. Results
+ * are kept in cache file, keyed by path, modification time and size, so file
+ * is scanned again only after it changed.
+ */
+class LoudnessScanner {
+ public:
+  static constexpr double kReferenceLoudness = -18;  // LUFS, ReplayGain 2.0
+
+  /**
+   * Loads results of previous scans
+   * @param cache_path - path of cache file, empty for default one in user's
+   * cache directory (type: std::string)
+   */
+  explicit LoudnessScanner(const std::string &cache_path = "");
+  /**
+   * Cancels queued scans and saves results
+   */
+  ~LoudnessScanner();
+  /**
+   * Queues file for scanning, if it has no fresh result yet
+   * @param filename - path to audio file (type: std::string)
+   */
+  void scan(const std::string &filename);
+  /**
+   * Gets result of scan
+   * @param filename - path to audio file (type: std::string)
+   * @param info - struct to save result (type: LoudnessInfo)
+   * @return false if file was not scanned yet or changed after scan
+   */
+  bool get(const std::string &filename, LoudnessInfo &info);
+  /**
+   * Waits until all queued files are scanned
+   */
+  void wait();
+  /**
+   * Reads ReplayGain track gain and peak from tags of file
+   * @return false if file has no ReplayGain tags
+   */
+  static bool read_tags(const std::string &filename, LoudnessInfo &info);
+  /**
+   * Decodes whole file and measures its EBU R128 loudness and true peak
+   * @param cancel - flag for canceling measuring (type: std::atomic_bool)
+   * @return false if file can't be decoded or measuring was canceled
+   */
+  static bool measure(const std::string &filename, LoudnessInfo &info,
+                      const std::atomic_bool &cancel);
+
+ private:
+  struct Entry {
+    int64_t mtime = 0;
+    int64_t size = 0;
+    LoudnessInfo info;
+  };
+  /**
+   * Gets modification time and size of file
+   * @return false if file does not exist
+   */
+  static bool stat_file(const std::string &filename, Entry &entry);
+  void scan_file(const std::string &filename);
+  bool load();
+  /**
+   * Writes cache file if it has unsaved results. Takes m_mutex only to copy
+   * results, so lookups are not blocked by writing.
+   */
+  bool save();
+
+  std::string m_cache_path;
+  std::mutex m_mutex;
+  std::mutex m_save_mutex;  // one writer of cache file at a time
+  std::unordered_map<std::string, Entry> m_cache;
+  std::unordered_set<std::string> m_queued;  // files queued or being scanned
+  size_t m_unsaved = 0;                      // results not saved yet
+  size_t m_scanned = 0;  // results since queue was empty last time
+  std::chrono::steady_clock::time_point m_last_save;
+  std::atomic_bool m_cancel{false};
+  std::unique_ptr<ThreadPool> m_pool;  // started on first scan
+};
+
+#endif  // LOUDNESSSCANNER_H
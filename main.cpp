@@ -46,6 +46,8 @@ void runNoGuiMode() {
 }
 
 int main(int argc, char *argv[]) {
+  // disconnected socket client must not kill player, send() reports error
+  std::signal(SIGPIPE, SIG_IGN);
   // Check if the "--no-gui" argument is present
   for (int i = 1; i < argc; i++) {
     std::string arg = argv[i];
@@ -0,0 +1,161 @@
+#include "mappedfile.h"
+
+#include <fcntl.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+
+#include "helper.h"
+
+namespace {
+const size_t kReadAheadBytes = 4 << 20;  // region prefetched at start and seek
+const size_t kCopyChunk = 4096;  // bytes which are lost at most on fault
+
+// set while thread copies from mapping, SIGBUS jumps back there
+thread_local sigjmp_buf *t_fault_jump = nullptr;
+struct sigaction g_previous_sigbus;
+
+void on_sigbus(int, siginfo_t *, void *) {
+  if (t_fault_jump) siglongjmp(*t_fault_jump, 1);
+  // fault is not ours, faulting access is repeated with previous action
+  sigaction(SIGBUS, &g_previous_sigbus, nullptr);
+}
+
+void install_sigbus_handler() {
+  static std::once_flag installed;
+  std::call_once(installed, [] {
+    struct sigaction action = {};
+    action.sa_sigaction = on_sigbus;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;  // not blocked after jump
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGBUS, &action, &g_previous_sigbus);
+  });
+}
+}  // namespace
+
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const std::string &filename) {
+  close();
+  int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    Helper::get_instance().log("Can't open " + filename + ": " +
+                               std::strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size <= 0) {  // nothing to map
+    ::close(fd);
+    return false;
+  }
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);  // mapping keeps file open
+  if (data == MAP_FAILED) {
+    Helper::get_instance().log("Can't map " + filename + ": " +
+                               std::strerror(errno));
+    return false;
+  }
+  install_sigbus_handler();
+  m_data = static_cast<uint8_t *>(data);
+  m_size = st.st_size;
+  m_pos = 0;
+  m_truncated = false;
+  madvise(m_data, m_size, MADV_SEQUENTIAL);  // aggressive read-ahead
+  will_need(0, kReadAheadBytes);             // header and first seconds
+  return true;
+}
+
+void MappedFile::close() {
+  if (m_data) munmap(m_data, m_size);
+  m_data = nullptr;
+  m_size = 0;
+  m_pos = 0;
+}
+
+SNDFILE *MappedFile::open_sndfile(SF_INFO *info) {
+  static SF_VIRTUAL_IO vio = {&MappedFile::vio_get_filelen,
+                              &MappedFile::vio_seek, &MappedFile::vio_read,
+                              &MappedFile::vio_write, &MappedFile::vio_tell};
+  if (!m_data) return nullptr;
+  m_pos = 0;
+  return sf_open_virtual(&vio, SFM_READ, info, this);
+}
+
+void MappedFile::will_need(size_t offset, size_t length) {
+  if (!m_data || offset >= m_size) return;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t start = offset / page * page;  // madvise needs aligned address
+  size_t end = std::min(m_size, offset + length);
+  madvise(m_data + start, end - start, MADV_WILLNEED);
+}
+
+sf_count_t MappedFile::vio_get_filelen(void *user_data) {
+  return static_cast<MappedFile *>(user_data)->m_size;
+}
+
+sf_count_t MappedFile::vio_seek(sf_count_t offset, int whence,
+                                void *user_data) {
+  MappedFile *file = static_cast<MappedFile *>(user_data);
+  sf_count_t pos;
+  switch (whence) {
+    case SEEK_SET:
+      pos = offset;
+      break;
+    case SEEK_CUR:
+      pos = file->m_pos + offset;
+      break;
+    case SEEK_END:
+      pos = file->m_size + offset;
+      break;
+    default:
+      return -1;
+  }
+  if (pos < 0 || (size_t)pos > file->m_size) return -1;
+  // far jump means seek inside track, prefetch audio around new position
+  if ((size_t)pos > file->m_pos + kReadAheadBytes ||
+      (size_t)pos + kReadAheadBytes < file->m_pos)
+    file->will_need(pos, kReadAheadBytes);
+  file->m_pos = pos;
+  return pos;
+}
+
+sf_count_t MappedFile::vio_read(void *ptr, sf_count_t count,
+                                void *user_data) {
+  MappedFile *file = static_cast<MappedFile *>(user_data);
+  size_t available = file->m_size - file->m_pos;
+  size_t size = std::min<size_t>(count, available);
+  // pages past end of file truncated by another program raise SIGBUS,
+  // read stops there as at end of file instead of killing the player
+  volatile size_t copied = 0;
+  sigjmp_buf jump;
+  if (sigsetjmp(jump, 0) == 0) {
+    t_fault_jump = &jump;
+    while (copied < size) {
+      size_t chunk = std::min(size - copied, kCopyChunk);
+      std::memcpy(static_cast<uint8_t *>(ptr) + copied,
+                  file->m_data + file->m_pos + copied, chunk);
+      copied += chunk;
+    }
+  } else if (!file->m_truncated) {
+    file->m_truncated = true;
+    Helper::get_instance().log("Mapped file was truncated while reading");
+  }
+  t_fault_jump = nullptr;
+  file->m_pos += copied;
+  return copied;
+}
+
+sf_count_t MappedFile::vio_write(const void *, sf_count_t, void *) {
+  return 0;  // file mapped read-only
+}
+
+sf_count_t MappedFile::vio_tell(void *user_data) {
+  return static_cast<MappedFile *>(user_data)->m_pos;
+}
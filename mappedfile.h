@@ -0,0 +1,63 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <sndfile.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Read-only memory mapped file, which can be decoded by libsndfile through
+ * virtual I/O. Decoder reads file straight from page cache without read()
+ * syscalls, kernel is told that file is read sequentially and which region
+ * will be needed after seek.
+ */
+class MappedFile {
+ public:
+  ~MappedFile();
+  /**
+   * Maps whole file into memory
+   * @param filename - path to file (type: std::string)
+   * @return true on success, false otherwise (type: bool)
+   */
+  bool open(const std::string &filename);
+  /**
+   * Unmaps file
+   */
+  void close();
+  /**
+   * Opens mapped file with libsndfile. Mapping must outlive returned handle.
+   * @param info - structure to save format of file (type: SF_INFO)
+   * @return libsndfile handle or nullptr on failure
+   */
+  SNDFILE *open_sndfile(SF_INFO *info);
+  /**
+   * Asks kernel to read region of file in background
+   * @param offset - start of region in bytes (type: size_t)
+   * @param length - length of region in bytes (type: size_t)
+   */
+  void will_need(size_t offset, size_t length);
+
+  const uint8_t *data() const { return m_data; }
+  size_t size() const { return m_size; }
+  /**
+   * Gets position of virtual file, where decoder reads next
+   */
+  size_t position() const { return m_pos; }
+
+ private:
+  static sf_count_t vio_get_filelen(void *user_data);
+  static sf_count_t vio_seek(sf_count_t offset, int whence, void *user_data);
+  static sf_count_t vio_read(void *ptr, sf_count_t count, void *user_data);
+  static sf_count_t vio_write(const void *ptr, sf_count_t count,
+                              void *user_data);
+  static sf_count_t vio_tell(void *user_data);
+
+  uint8_t *m_data = nullptr;
+  size_t m_size = 0;
+  size_t m_pos = 0;  // position of virtual file
+  bool m_truncated = false;  // file shrank under mapping, logged once
+};
+
+#endif  // MAPPEDFILE_H
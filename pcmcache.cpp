@@ -0,0 +1,83 @@
+#include "pcmcache.h"
+
+#include <sys/stat.h>
+
+namespace {
+bool stat_file(const std::string &filename, int64_t &mtime, int64_t &size) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0) return false;
+  mtime = st.st_mtime;
+  size = st.st_size;
+  return true;
+}
+}  // namespace
+
+std::shared_ptr<const DecodedAudio> PcmCache::get(const std::string &filename,
+                                                  int channels) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto found = m_index.find(filename);
+  if (found == m_index.end()) {
+    m_misses++;
+    return nullptr;
+  }
+  auto entry = found->second;
+  int64_t mtime, size;
+  if (!stat_file(filename, mtime, size) || mtime != entry->mtime ||
+      size != entry->size || entry->audio->channels != channels) {
+    erase(entry);  // file changed since it was decoded
+    m_misses++;
+    return nullptr;
+  }
+  m_entries.splice(m_entries.begin(), m_entries, entry);  // recently used
+  m_hits++;
+  return entry->audio;
+}
+
+void PcmCache::put(const std::string &filename,
+                   std::shared_ptr<const DecodedAudio> audio) {
+  int64_t mtime, size;
+  if (!audio || !stat_file(filename, mtime, size)) return;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto found = m_index.find(filename);
+  if (found != m_index.end()) erase(found->second);
+  size_t bytes = audio->get_bytes();
+  if (bytes > m_budget) return;
+  evict(m_budget - bytes);
+  m_entries.push_front({filename, std::move(audio), mtime, size});
+  m_index[filename] = m_entries.begin();
+  m_bytes += bytes;
+}
+
+void PcmCache::set_budget(size_t bytes) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_budget = bytes;
+  evict(bytes);
+}
+
+size_t PcmCache::get_budget() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_budget;
+}
+
+PcmCache::Stats PcmCache::get_stats() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Stats stats;
+  stats.hits = m_hits;
+  stats.misses = m_misses;
+  stats.bytes = m_bytes;
+  stats.budget = m_budget;
+  stats.tracks = m_entries.size();
+  return stats;
+}
+
+void PcmCache::evict(size_t budget) {
+  // tracks which are played now keep their samples until they are closed
+  while (m_bytes > budget && !m_entries.empty())
+    erase(std::prev(m_entries.end()));
+}
+
+void PcmCache::erase(std::list<Entry>::iterator entry) {
+  m_bytes -= entry->audio->get_bytes();
+  m_index.erase(entry->filename);
+  m_entries.erase(entry);
+}
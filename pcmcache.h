@@ -0,0 +1,86 @@
+#ifndef PCMCACHE_H
+#define PCMCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Whole track decoded into float samples in device channels, but in its own
+ * sample rate, like LocalTrack reads it
+ */
+struct DecodedAudio {
+  std::string title, artist;
+  int rate = 0, channels = 0;
+  std::vector<float> samples;  // interleaved
+
+  uint64_t get_frames() const {
+    return channels > 0 ? samples.size() / channels : 0;
+  }
+  size_t get_bytes() const { return samples.capacity() * sizeof(float); }
+};
+
+/**
+ * Memory-budgeted LRU cache of recently played tracks. Track which is taken
+ * from cache starts and seeks without touching the disk or decoder. Entry
+ * is dropped when its file changed.
+ */
+class PcmCache {
+ public:
+  static const size_t kDefaultBudget = (size_t)256 << 20;  // bytes
+
+  struct Stats {
+    uint64_t hits = 0, misses = 0;  // lookups since start
+    size_t bytes = 0;               // samples held by cache
+    size_t budget = 0;              // maximum of bytes
+    size_t tracks = 0;              // count of cached tracks
+  };
+  /**
+   * Finds decoded track and marks it as recently used
+   * @param filename - path to audio file (type: std::string)
+   * @param channels - device channels count (type: int)
+   * @return nullptr if track is not cached
+   */
+  std::shared_ptr<const DecodedAudio> get(const std::string &filename,
+                                          int channels);
+  /**
+   * Adds decoded track, least recently used ones are dropped until all fit
+   * into budget. Track bigger than budget is not cached.
+   * @param filename - path to audio file (type: std::string)
+   * @param audio - whole decoded track (type: DecodedAudio)
+   */
+  void put(const std::string &filename,
+           std::shared_ptr<const DecodedAudio> audio);
+  /**
+   * Sets memory ceiling, 0 disables caching
+   * @param bytes - maximum of bytes held by cache (type: size_t)
+   */
+  void set_budget(size_t bytes);
+  size_t get_budget() const;
+  Stats get_stats() const;
+
+ private:
+  struct Entry {
+    std::string filename;
+    std::shared_ptr<const DecodedAudio> audio;
+    int64_t mtime, size;  // of file when it was decoded
+  };
+  /**
+   * Drops least recently used tracks, m_mutex must be locked
+   */
+  void evict(size_t budget);
+  void erase(std::list<Entry>::iterator entry);
+
+  mutable std::mutex m_mutex;
+  std::list<Entry> m_entries;  // most recently used first
+  std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+  size_t m_bytes = 0, m_budget = kDefaultBudget;
+  uint64_t m_hits = 0, m_misses = 0;
+};
+
+#endif  // PCMCACHE_H
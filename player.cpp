@@ -1,12 +1,17 @@
 #include "player.h"
 
 #include <fcntl.h>
+#include <linux/sockios.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <unistd.h>
 
+#include <cmath>
 #include <thread>
+
 /**
  * Converts bool to const char*
  *
@@ -93,14 +98,15 @@ void Player::server_thread() {
         Helper::get_instance().log(
             "SOCKET: Failed to accept client connection");
         close(serverSocket);
-        clients.erase(std::remove(clients.begin(), clients.end(), clientSocket),
-                      clients.end());
         return;
       }
     }
     // Handle the client request
 
-    clients.push_back(clientSocket);
+    {
+      std::lock_guard<std::mutex> lock(m_clients_mutex);
+      clients.push_back(clientSocket);
+    }
     while (serverRunning) {
       // Set up the timeout for recv()
       struct timeval timeout;
@@ -115,16 +121,12 @@ void Player::server_thread() {
           select(clientSocket + 1, &readSet, nullptr, nullptr, &timeout);
       if (selectResult == -1) {
         Helper::get_instance().log("SOCKET: Select failed");
-        close(clientSocket);
-        clients.erase(std::remove(clients.begin(), clients.end(), clientSocket),
-                      clients.end());
+        remove_client(clientSocket);
         break;
       } else if (selectResult == 0) {
         Helper::get_instance().log(
             "SOCKET: Timeout occurred. Closing the client connection.");
-        close(clientSocket);
-        clients.erase(std::remove(clients.begin(), clients.end(), clientSocket),
-                      clients.end());
+        remove_client(clientSocket);
         break;
       }
 
@@ -137,16 +139,12 @@ void Player::server_thread() {
       memset(&(received[0]), 0, 2048);
       if (bytesRead == -1) {
         Helper::get_instance().log("SOCKET: Failed to read from client socket");
-        close(clientSocket);
-        clients.erase(std::remove(clients.begin(), clients.end(), clientSocket),
-                      clients.end());
+        remove_client(clientSocket);
         break;
       } else if (bytesRead == 0) {
         // Client disconnected
         Helper::get_instance().log("SOCKET: Client disconnected");
-        close(clientSocket);
-        clients.erase(std::remove(clients.begin(), clients.end(), clientSocket),
-                      clients.end());
+        remove_client(clientSocket);
         break;
       } else {
         // Process the received byte
@@ -158,6 +156,9 @@ void Player::server_thread() {
               4; // At startup in some reason receives "400" instead of "4"
         if (operation_code != 0)
           Helper::get_instance().log("Received: " + receivedStr);
+        // text after "NN||" of two-digit opcodes, empty when message is short
+        std::string argument =
+            receivedStr.size() > 4 ? receivedStr.substr(4) : "";
         switch (operation_code) {
         case 0: {
           // std::cout << "Received byte: 0 (Testing connection)" <<
@@ -230,19 +231,7 @@ void Player::server_thread() {
             else
               result += "||" + player.first + "||" + player.second;
           }
-          for (int client : clients) {
-            ssize_t bytesSent = send(client, result.c_str(), result.size(), 0);
-
-            if (bytesSent == -1) {
-              Helper::get_instance().log(
-                  "Failed to send message to the client " +
-                  std::to_string(client));
-            } else {
-              Helper::get_instance().log("Sent " + std::to_string(bytesSent) +
-                                         " bytes to the client " +
-                                         std::to_string(client));
-            }
-          }
+          send_to_clients(result);
           break;
         }
         case 9: { // change player. Desired input format: "9||playerIndex"
@@ -275,30 +264,18 @@ void Player::server_thread() {
             result +=
                 "||" + device.first + "||" + std::to_string(device.second);
           }
-          for (int client : clients) {
-            ssize_t bytesSent = send(client, result.c_str(), result.size(), 0);
-
-            if (bytesSent == -1) {
-              Helper::get_instance().log(
-                  "Failed to send message to the client " +
-                  std::to_string(client));
-            } else {
-              Helper::get_instance().log("Sent " + std::to_string(bytesSent) +
-                                         " bytes to the client " +
-                                         std::to_string(client));
-            }
-          }
+          send_to_clients(result);
           break;
         }
         case 11: { // change output device. Desired input format:
                    // "11||sinkIndex"
           Helper::get_instance().log(
               "SOCKET: Received byte: 11 (Set output device)");
-          std::string deviceID = receivedStr.substr(4);
+          std::string deviceID = argument;
           uint64_t index;
           try {
             index = std::stoi(deviceID);
-          } catch (std::invalid_argument) {
+          } catch (const std::exception &) {
             Helper::get_instance().log(
                 "Error while setting output device! Can't cast \"" + deviceID +
                 "\" to int.");
@@ -308,11 +285,11 @@ void Player::server_thread() {
         }
         case 12: { // change volume. Desired input format: "12||newVolume"
           Helper::get_instance().log("SOCKET: Received byte: 12 (Set volume)");
-          std::string volume = receivedStr.substr(4);
+          std::string volume = argument;
           double newVolume;
           try {
             newVolume = std::stod(volume);
-          } catch (std::invalid_argument) {
+          } catch (const std::exception &) {
             Helper::get_instance().log(
                 "Error while setting volume! Can't cast \"" + volume +
                 "\" to double.");
@@ -320,6 +297,298 @@ void Player::server_thread() {
           set_volume(newVolume);
           break;
         }
+        case 13: { // load output device routing rules. Desired input format:
+                   // "13||identity->sink,fallback;identity2->sink2"
+          Helper::get_instance().log(
+              "SOCKET: Received byte: 13 (Load routing rules)");
+          std::string rules = argument;
+          std::string result = "13||";
+          if (load_routing_rules(rules))
+            result += get_routing_rules(); // echo rules which are active now
+          else
+            result += "error";
+          send_to_clients(result);
+          break;
+        }
+        case 14: { // get local audio engine stats
+          Helper::get_instance().log(
+              "SOCKET: Received byte: 14 (Get audio engine stats)");
+          std::string result = "14||";
+#ifdef SUPPORT_AUDIO_OUTPUT
+          result += get_audio_stats();
+#endif
+          send_to_clients(result);
+          break;
+        }
+        case 15: { // set resampler quality. Desired input format:
+                   // "15||quality", where quality is 0 (fast), 1 (medium) or
+                   // 2 (high)
+          Helper::get_instance().log(
+              "SOCKET: Received byte: 15 (Set resampler quality)");
+          std::string result = "15||";
+#ifdef SUPPORT_AUDIO_OUTPUT
+          std::string quality = argument;
+          int newQuality = -1;
+          try {
+            newQuality = std::stoi(quality);
+          } catch (const std::exception &) {
+            Helper::get_instance().log(
+                "Error while setting resampler quality! Can't cast \"" +
+                quality + "\" to int.");
+          }
+          if (set_resampler_quality(newQuality))
+            result += std::to_string(get_resampler_quality());
+          else
+            result += "error";
+#else
+          result += "error";
+#endif
+          send_to_clients(result);
+          break;
+        }
+        case 16: { // set crossfade. Desired input format:
+                   // "16||seconds,curve", where curve is 0 (linear), 1 (equal
+                   // power) or 2 (S-curve)
+          Helper::get_instance().log("SOCKET: Received byte: 16 (Set crossfade)");
+          std::string result = "16||";
+#ifdef SUPPORT_AUDIO_OUTPUT
+          std::string settings = argument;
+          double seconds = -1;
+          int curve = AudioEngine::CROSSFADE_EQUAL_POWER;
+          try {
+            size_t comma = settings.find(',');
+            seconds = std::stod(settings.substr(0, comma));
+            if (comma != std::string::npos)
+              curve = std::stoi(settings.substr(comma + 1));
+          } catch (const std::exception &) {
+            seconds = -1;
+            Helper::get_instance().log(
+                "Error while setting crossfade! Can't parse \"" + settings +
+                "\".");
+          }
+          if (set_crossfade(seconds, curve))
+            result += get_crossfade();
+          else
+            result += "error";
+#else
+          result += "error";
+#endif
+          send_to_clients(result);
+          break;
+        }
+        case 17: { // set period of audio device. Desired input format:
+                   // "17||frames", where 0 means low latency profile
+          Helper::get_instance().log(
+              "SOCKET: Received byte: 17 (Set audio period)");
+          std::string result = "17||";
+#ifdef SUPPORT_AUDIO_OUTPUT
+          std::string frames = argument;
+          int newPeriod = -1;
+          try {
+            newPeriod = std::stoi(frames);
+          } catch (const std::exception &) {
+            Helper::get_instance().log(
+                "Error while setting audio period! Can't cast \"" + frames +
+                "\" to int.");
+          }
+          if (set_output_period(newPeriod))
+            result += std::to_string(m_engine.get_period());
+          else
+            result += "error";
+#else
+          result += "error";
+#endif
+          send_to_clients(result);
+          break;
+        }
+        case 18: { // measure output latency
+          Helper::get_instance().log(
+              "SOCKET: Received byte: 18 (Measure output latency)");
+          std::string result = "18||";
+#ifdef SUPPORT_AUDIO_OUTPUT
+          std::string latency = measure_output_latency();
+          result += latency.empty() ? "error" : latency;
+#else
+          result += "error";
+#endif
+          send_to_clients(result);
+          break;
+        }
+        case 19: { // stream band levels of local output. Desired input
+                   // format: "19||rate,bands", e.g. "19||30,16", or "19||0"
+                   // to stop. Levels are sent as "spectrum||l1;l2;...||"
+          Helper::get_instance().log(
+              "SOCKET: Received byte: 19 (Stream spectrum)");
+          std::string result = "19||";
+#ifdef SUPPORT_AUDIO_OUTPUT
+          std::string settings = argument;
+          int rate = -1, bands = kDefaultSpectrumBands;
+          try {
+            size_t comma = settings.find(',');
+            rate = std::stoi(settings.substr(0, comma));
+            if (comma != std::string::npos)
+              bands = std::stoi(settings.substr(comma + 1));
+          } catch (const std::exception &) {
+            rate = -1;
+            Helper::get_instance().log(
+                "Error while setting spectrum stream! Can't parse \"" +
+                settings + "\".");
+          }
+          if (set_spectrum_stream(rate, bands))
+            result += get_spectrum_stream();
+          else
+            result += "error";
+#else
+          result += "error";
+#endif
+          send_to_clients(result);
+          break;
+        }
+        case 20: { // set size of decoded tracks cache. Desired input format:
+                   // "20||megabytes", 0 disables cache
+          Helper::get_instance().log(
+              "SOCKET: Received byte: 20 (Set audio cache size)");
+          std::string result = "20||";
+#ifdef SUPPORT_AUDIO_OUTPUT
+          int megabytes = -1;
+          try {
+            megabytes = std::stoi(argument);
+          } catch (const std::exception &) {
+            Helper::get_instance().log(
+                "Error while setting audio cache size! Can't parse \"" +
+                argument + "\".");
+          }
+          if (set_audio_cache_size(megabytes))
+            result += std::to_string(get_audio_cache_size());
+          else
+            result += "error";
+#else
+          result += "error";
+#endif
+          send_to_clients(result);
+          break;
+        }
+        case 21: { // set equalizer bands. Desired input format:
+                   // "21||type:frequency:gain:q;...", empty bands disable it
+          Helper::get_instance().log(
+              "SOCKET: Received byte: 21 (Set equalizer)");
+          std::string result = "21||";
+#ifdef SUPPORT_AUDIO_OUTPUT
+          if (set_equalizer(argument))
+            result += get_equalizer();
+          else
+            result += "error";
+#else
+          result += "error";
+#endif
+          send_to_clients(result);
+          break;
+        }
+        case 22: { // set playback rate. Desired input format: "22||rate",
+                   // e.g. "22||1.5"
+          Helper::get_instance().log(
+              "SOCKET: Received byte: 22 (Set playback rate)");
+          std::string result = "22||";
+          double rate = -1;
+          try {
+            rate = std::stod(argument);
+          } catch (const std::exception &) {
+            Helper::get_instance().log(
+                "Error while setting playback rate! Can't parse \"" +
+                argument + "\".");
+          }
+          if (rate > 0 && set_rate(rate))
+            result += std::to_string(get_rate());
+          else
+            result += "error";
+          send_to_clients(result);
+          break;
+        }
+        case 23: { // append playlist file to local playlist. Desired input
+                   // format: "23||/path/to/playlist.m3u8", m3u or xspf
+          Helper::get_instance().log(
+              "SOCKET: Received byte: 23 (Load playlist)");
+          std::string result = "23||";
+#ifdef SUPPORT_AUDIO_OUTPUT
+          // entries are imported in background, as dropped directory
+          result += load_playlist(argument) ? "ok" : "error";
+#else
+          result += "error";
+#endif
+          send_to_clients(result);
+          break;
+        }
+        case 24: { // save local playlist into file. Desired input format:
+                   // "24||/path/to/playlist.xspf", m3u or xspf
+          Helper::get_instance().log(
+              "SOCKET: Received byte: 24 (Save playlist)");
+          std::string result = "24||";
+#ifdef SUPPORT_AUDIO_OUTPUT
+          result += save_playlist(argument) ? "ok" : "error";
+#else
+          result += "error";
+#endif
+          send_to_clients(result);
+          break;
+        }
+        case 25:   // search local playlist. Desired input format:
+                   // "25||offset||limit||query", limit is at most 100.
+                   // Answer: "25||total||index||artist||title||..."
+        case 26: { // search library index, also files not in playlist.
+                   // Desired input format: "26||offset||limit||query".
+                   // Answer: "26||total||path||artist||title||..."
+          const bool library = operation_code == 26;
+          Helper::get_instance().log(
+              library ? "SOCKET: Received byte: 26 (Search library)"
+                      : "SOCKET: Received byte: 25 (Search playlist)");
+          std::string result = library ? "26||" : "25||";
+#ifdef SUPPORT_AUDIO_OUTPUT
+          const size_t kMaxPage = 100; // answer fits into one message
+          std::string request = argument;
+          size_t first = request.find("||");
+          size_t second = first == std::string::npos
+                              ? std::string::npos
+                              : request.find("||", first + 2);
+          long offset = -1, limit = -1;
+          if (second != std::string::npos) {
+            try {
+              offset = std::stol(request.substr(0, first));
+              limit = std::stol(request.substr(first + 2, second - first - 2));
+            } catch (const std::exception &) {
+              offset = -1;
+            }
+          }
+          if (offset < 0 || limit <= 0) {
+            Helper::get_instance().log("Error while searching! "
+                                       "Can't parse \"" + request + "\".");
+            result += "error";
+          } else if (library) {
+            size_t total = 0;
+            auto tracks = search_library(request.substr(second + 2), offset,
+                                         std::min<size_t>(limit, kMaxPage),
+                                         total);
+            result += std::to_string(total);
+            for (const auto &track : tracks)
+              result += "||" + track.filename + "||" + track.artist + "||" +
+                        track.title;
+          } else {
+            size_t total = 0;
+            std::vector<int> indexes = search_playlist(
+                request.substr(second + 2), offset,
+                std::min<size_t>(limit, kMaxPage), total);
+            result += std::to_string(total);
+            PlaylistTrack track;
+            for (int index : indexes)
+              if (m_playlist.get(index, track))
+                result += "||" + std::to_string(index) + "||" + track.artist +
+                          "||" + track.title;
+          }
+#else
+          result += "error";
+#endif
+          send_to_clients(result);
+          break;
+        }
         default: {
           Helper::get_instance().log("SOCKET: Received unknown byte: " +
                                      std::to_string(operation_code));
@@ -328,17 +597,31 @@ void Player::server_thread() {
         }
       }
     }
-    close(clientSocket);
-    clients.erase(std::remove(clients.begin(), clients.end(), clientSocket),
-                  clients.end());
+    remove_client(clientSocket);
   }
 
   // Close the server socket
   close(serverSocket);
 }
 
+void Player::remove_client(int client) {
+  {
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    auto it = std::find(clients.begin(), clients.end(), client);
+    if (it == clients.end())
+      return; // already removed
+    clients.erase(it);
+  }
+  close(client);
+}
+
 void Player::send_info_to_clients() {
-  if (!clients.empty()) {
+  bool has_clients;
+  {
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    has_clients = !clients.empty();
+  }
+  if (has_clients) {
     std::string current_info = "";
     auto metadata = get_metadata();
     for (const auto &data : metadata) {
@@ -372,18 +655,24 @@ void Player::send_info_to_clients() {
     current_info += "shuffle||" + std::to_string(get_shuffle()) + "||";
     current_info += "repeat||" + std::to_string(get_repeat()) + "||";
     current_info += "volume||" + std::to_string(get_volume()) + "||";
-    for (int client : clients) {
-      ssize_t bytesSent =
-          send(client, current_info.c_str(), current_info.size(), 0);
+    current_info += "rate||" + std::to_string(get_rate()) + "||";
+    send_to_clients(current_info);
+  }
+}
 
-      if (bytesSent == -1) {
-        Helper::get_instance().log("Failed to send message to the client " +
-                                   std::to_string(client));
-      } else {
-        Helper::get_instance().log("Sent " + std::to_string(bytesSent) +
-                                   " bytes to the client " +
-                                   std::to_string(client));
-      }
+void Player::send_to_clients(const std::string &message) {
+  std::lock_guard<std::mutex> lock(m_clients_mutex);
+  for (int client : clients) {
+    ssize_t bytesSent =
+        send(client, message.c_str(), message.size(), MSG_NOSIGNAL);
+
+    if (bytesSent == -1) {
+      Helper::get_instance().log("Failed to send message to the client " +
+                                 std::to_string(client));
+    } else {
+      Helper::get_instance().log("Sent " + std::to_string(bytesSent) +
+                                 " bytes to the client " +
+                                 std::to_string(client));
     }
   }
 }
@@ -412,6 +701,12 @@ Player::Player(bool with_gui) {
   start_server();
 #endif
 
+#if defined(HAVE_PULSEAUDIO) || defined(HAVE_PIPEWIRE)
+  // start listening sound server for routing rules
+  m_routing_rules.set_local_pid(getpid());
+  m_routing_thread = std::thread(&Player::routing_thread, this);
+#endif
+
   // get current players
   get_players();
   // if players size is not null
@@ -457,10 +752,11 @@ Player::Player(bool with_gui) {
         std::cerr << "SDL initialization failed: " << SDL_GetError() << std::endl;
         exit(EXIT_FAILURE);
       }
-      if (Mix_OpenAudio(44100, AUDIO_S16SYS, 2, 4096) < 0) {
-        std::cerr << "Mix_OpenAudio failed: " << Mix_GetError() << std::endl;
+      if (!open_audio_device()) {
         exit(EXIT_FAILURE);
       }
+      load_library(); // one mmap, files are not probed again
+      restore_session();
   }
 #endif
 }
@@ -470,11 +766,26 @@ Player::~Player() {
   // release proxy
   m_proxy_signal.reset();
 #endif
+#if defined(HAVE_PULSEAUDIO) || defined(HAVE_PIPEWIRE)
+  // stop routing thread
+  m_routing_running = false;
+  wakeup_routing_thread();
+  if (m_routing_thread.joinable())
+    m_routing_thread.join();
+#endif
 #ifdef SUPPORT_AUDIO_OUTPUT
-  // free music from mix
-  Mix_FreeMusic(m_current_music);
-  // close audio output device
-  Mix_CloseAudio();
+  set_spectrum_stream(0, 0); // stop streaming before engine
+  m_watcher.reset();          // stop applying changes of directories
+  m_rescanner.reset();
+  m_importer.reset();         // cancel import, so library is not changed
+  if (m_with_gui)
+    save_session();
+  save_library();
+  m_library_search_cancel = true; // index is not needed anymore
+  if (m_library_search_thread.joinable())
+    m_library_search_thread.join();
+  // stop local engine and close all tracks
+  m_engine.shutdown();
   // quit from SDL
   SDL_Quit();
 #endif
@@ -830,11 +1141,11 @@ bool Player::send_play_pause() {
   }
 #ifdef SUPPORT_AUDIO_OUTPUT
   if (m_players[m_selected_player_id].first == "Local") { // if local player
-    if (Mix_PlayingMusic() && Mix_PausedMusic()) { // if music opened and paused
-      play_audio();                                // just play
-    } else if (Mix_PlayingMusic() &&
-               !Mix_PausedMusic()) { // if opened and playing
-      pause_audio();                 // just pause
+    if (m_engine.has_track() &&
+        !m_engine.is_playing()) { // if music opened and paused
+      play_audio();               // just play
+    } else if (m_engine.is_playing()) { // if opened and playing
+      pause_audio();                    // just pause
     } else {                         // in any other variant
       Helper::get_instance().log("Starting playing");
       play_audio(); // just play
@@ -958,6 +1269,10 @@ bool Player::send_next() {
     Helper::get_instance().log("Player not selected, can't continue.");
     return false;
   }
+#ifdef SUPPORT_AUDIO_OUTPUT
+  if (m_players[m_selected_player_id].first == "Local")
+    return next_track(); // if local player then go to next track of playlist
+#endif
 #ifdef HAVE_DBUS
   if (!m_dbus_conn) {
     Helper::get_instance().log(
@@ -993,6 +1308,10 @@ bool Player::send_previous() {
     Helper::get_instance().log("Player not selected, can't continue.");
     return false;
   }
+#ifdef SUPPORT_AUDIO_OUTPUT
+  if (m_players[m_selected_player_id].first == "Local")
+    return previous_track(); // if local player then go to previous track
+#endif
 #ifdef HAVE_DBUS
   if (!m_dbus_conn) {
     Helper::get_instance().log(
@@ -1081,6 +1400,8 @@ bool Player::set_shuffle(bool isShuffle) {
     if (m_is_shuffle != isShuffle) {
       m_is_shuffle = isShuffle; // if local player then just set variable
       notify_observers_is_shuffle_changed(); // and notify that shuffle changed
+      if (m_playlist.get_current() != -1)
+        queue_next_track(); // next track changed
     }
     return true;
   }
@@ -1186,6 +1507,8 @@ bool Player::set_repeat(int new_repeat = -1) {
       m_repeat = new_repeat; // if local player then just set variable
       notify_observers_loop_status_changed(); // and notify that variable
                                               // changed
+      if (m_playlist.get_current() != -1)
+        queue_next_track(); // next track changed
     }
     return true;
   }
@@ -1244,8 +1567,9 @@ int64_t Player::get_position() {
   }
 #ifdef SUPPORT_AUDIO_OUTPUT
   if (m_players[m_selected_player_id].first == "Local") {
-    // if local player then get current position from SDL
-    int64_t pos = Mix_GetMusicPosition(m_current_music);
+    log_engine_stats(); // position polled periodically, good place to log
+    // if local player then get current position from engine
+    int64_t pos = m_engine.get_position();
     if (pos > 0)
       return pos;
     else
@@ -1302,9 +1626,8 @@ bool Player::set_position(int64_t pos) {
   }
 #ifdef SUPPORT_AUDIO_OUTPUT
   if (m_players[m_selected_player_id].first == "Local") {
-    int res =
-        Mix_SetMusicPosition(pos); // if local player then set position via SDL
-    return res == 0;
+    // if local player then set position via engine
+    return m_engine.set_position(pos);
   }
 #endif
 #ifdef HAVE_DBUS
@@ -1382,9 +1705,7 @@ double Player::get_volume() {
   }
 #ifdef SUPPORT_AUDIO_OUTPUT
   if (m_players[m_selected_player_id].first == "Local") { // if local player
-    return Mix_GetMusicVolume(m_current_music) /
-           128; // then get current volume and divide by 128 because max volume
-                // in SDL is 128 but we work with 0-1 values
+    return m_engine.get_volume(); // then get current volume of engine
   }
 #endif
 #ifdef HAVE_DBUS
@@ -1427,9 +1748,7 @@ bool Player::set_volume(double volume) {
   }
 #ifdef SUPPORT_AUDIO_OUTPUT
   if (m_players[m_selected_player_id].first == "Local") {
-    int newVolume = 128 * volume; // if local player then convert from 0-1 to
-                                  // SDL's 0-128 volume format
-    Mix_VolumeMusic(newVolume);   // set new volume via SDL
+    m_engine.set_volume(volume); // if local player then set engine volume
     return true;
   }
 #endif
@@ -1471,6 +1790,90 @@ bool Player::set_volume(double volume) {
   return true;
 }
 
+double Player::get_rate() {
+  if (m_selected_player_id < 0 || m_selected_player_id > m_players.size()) {
+    Helper::get_instance().log("Player not selected, can't continue.");
+    return 1;
+  }
+#ifdef SUPPORT_AUDIO_OUTPUT
+  if (m_players[m_selected_player_id].first == "Local") {
+    return m_engine.get_speed(); // if local player then get engine speed
+  }
+#endif
+#ifdef HAVE_DBUS
+  if (!m_dbus_conn) {
+    Helper::get_instance().log(
+        "Not connected to DBus, can't get Rate. Aborting.");
+    return 1;
+  }
+  try {
+    auto proxy = sdbus::createProxy(*m_dbus_conn.get(),
+                                    m_players[m_selected_player_id].second,
+                                    "/org/mpris/MediaPlayer2");
+    sdbus::Variant rate_v;
+    proxy->callMethod("Get")
+        .onInterface("org.freedesktop.DBus.Properties")
+        .withArguments("org.mpris.MediaPlayer2.Player",
+                       "Rate") // if dbus player, then get Rate property
+        .storeResultsTo(rate_v);
+    double rate = rate_v.get<double>();
+    return rate > 0 ? rate : 1; // some players report 0 when paused
+  } catch (const sdbus::Error &e) {
+    Helper::get_instance().log(
+        std::string("Error while trying to get Rate property: ") + e.what());
+    return 1;
+  }
+#endif
+  return 1;
+}
+
+bool Player::set_rate(double rate) {
+  if (m_selected_player_id < 0 || m_selected_player_id > m_players.size()) {
+    Helper::get_instance().log("Player not selected, can't continue.");
+    return false;
+  }
+#ifdef SUPPORT_AUDIO_OUTPUT
+  if (m_players[m_selected_player_id].first == "Local") {
+    if (!m_engine.set_speed(rate)) { // if local player then stretch time
+      Helper::get_instance().log("Invalid playback rate: " +
+                                 std::to_string(rate));
+      return false;
+    }
+    return true;
+  }
+#endif
+#ifdef HAVE_DBUS
+  if (!m_dbus_conn) {
+    Helper::get_instance().log(
+        "Not connected to DBus, can't set Rate. Aborting.");
+    return false;
+  }
+  if (rate <= 0) { // MPRIS forbids zero rate, player must be paused instead
+    Helper::get_instance().log("Invalid playback rate: " +
+                               std::to_string(rate));
+    return false;
+  }
+  try {
+    auto proxy = sdbus::createProxy(*m_dbus_conn.get(),
+                                    m_players[m_selected_player_id].second,
+                                    "/org/mpris/MediaPlayer2");
+
+    proxy->callMethod("Set")
+        .onInterface("org.freedesktop.DBus.Properties")
+        .withArguments(
+            "org.mpris.MediaPlayer2.Player", "Rate",
+            sdbus::Variant(rate)) // if Dbus player, then just set Rate property
+        .dontExpectReply();
+    return true;
+  } catch (const sdbus::Error &e) {
+    Helper::get_instance().log(
+        std::string("Error while trying to set Rate property: ") + e.what());
+    return false;
+  }
+#endif
+  return false;
+}
+
 bool Player::get_playback_status() {
   if (m_selected_player_id < 0 || m_selected_player_id > m_players.size()) {
     Helper::get_instance().log("Player not selected, can't continue.");
@@ -1478,9 +1881,8 @@ bool Player::get_playback_status() {
   }
 #ifdef SUPPORT_AUDIO_OUTPUT
   if (m_players[m_selected_player_id].first == "Local") {
-    return Mix_PlayingMusic() && // if local player return whether song opened
-                                 // and
-           !Mix_PausedMusic();   // not paused
+    return m_engine.is_playing(); // if local player return whether engine
+                                  // plays song
   }
 #endif
 #ifdef HAVE_DBUS
@@ -1786,13 +2188,13 @@ std::vector<std::pair<std::string, std::string>> Player::get_metadata() {
   std::vector<std::pair<std::string, std::string>> metadata;
 #ifdef SUPPORT_AUDIO_OUTPUT
   if (get_current_player_name() == "Local") { // if local
-    metadata.push_back(std::make_pair(
-        "xesam:title", Mix_GetMusicTitle(m_current_music))); // set title
-    metadata.push_back(std::make_pair(
-        "xesam:artist", Mix_GetMusicArtistTag(m_current_music))); // set artist
+    metadata.push_back(
+        std::make_pair("xesam:title", m_engine.get_title())); // set title
+    metadata.push_back(
+        std::make_pair("xesam:artist", m_engine.get_artist())); // set artist
     metadata.push_back(std::make_pair(
         "mpris:length",
-        std::to_string(Mix_MusicDuration(m_current_music)))); // set length
+        std::to_string((int64_t)m_engine.get_duration()))); // set length
     return metadata;                                          // and return
   }
 #endif
@@ -2405,8 +2807,369 @@ void Player::set_output_device(unsigned short output_sink_index) {
   }
 
 #endif
+#ifdef SUPPORT_AUDIO_OUTPUT
+  if (get_current_player_name() == "Local") {
+    // equalizer follows output device of local player
+    std::string device = "default";
+    for (const auto &output : get_output_devices())
+      if (output.second == output_sink_index) device = output.first;
+    {
+      std::lock_guard<std::mutex> lock(m_equalizer_mutex);
+      m_equalizer_device = device;
+    }
+    apply_equalizer_preset();
+  }
+#endif
+}
+
+bool Player::load_routing_rules(const std::string &rules) {
+#if defined(HAVE_PULSEAUDIO) || defined(HAVE_PIPEWIRE)
+  std::vector<RoutingRule> parsed;
+  if (!RoutingRules::parse(rules, parsed))
+    return false;
+  auto moves = m_routing_rules.set_rules(parsed);
+  {
+    std::lock_guard<std::mutex> lock(m_routing_mutex);
+    m_routing_pending.insert(m_routing_pending.end(), moves.begin(),
+                             moves.end());
+  }
+  wakeup_routing_thread(); // moves must be executed at routing thread
+  return true;
+#else
+  Helper::get_instance().log(
+      "PulseAudio or PipeWire not installed, can't load routing rules.");
+  return false;
+#endif
+}
+
+std::string Player::get_routing_rules() {
+#if defined(HAVE_PULSEAUDIO) || defined(HAVE_PIPEWIRE)
+  return m_routing_rules.to_string();
+#else
+  return "";
+#endif
+}
+
+#if defined(HAVE_PULSEAUDIO) || defined(HAVE_PIPEWIRE)
+void Player::wakeup_routing_thread() {
+  std::lock_guard<std::mutex> lock(m_routing_mutex);
+#ifdef HAVE_PULSEAUDIO
+  if (m_routing_mainloop)
+    pa_mainloop_wakeup(m_routing_mainloop);
+#endif
+#ifdef HAVE_PIPEWIRE
+  if (m_routing_loop && m_routing_event)
+    pw_loop_signal_event(m_routing_loop, m_routing_event);
+#endif
+}
+#endif
+
+#ifdef HAVE_PULSEAUDIO
+/**
+ * Executes moves of routing engine using PulseAudio context
+ */
+static void pulse_execute_moves(pa_context *context,
+                                const std::vector<RoutingMove> &moves) {
+  for (const auto &move : moves) {
+    Helper::get_instance().log("Routing: moving sink input #" +
+                               std::to_string(move.stream_id) + " to sink #" +
+                               std::to_string(move.sink_id));
+    pa_operation *operation = pa_context_move_sink_input_by_index(
+        context, move.stream_id, move.sink_id, NULL, NULL);
+    if (operation)
+      pa_operation_unref(operation); // we don't wait for result
+  }
 }
 
+/**
+ * Fills routing stream from PulseAudio sink input info
+ */
+static RoutingStream pulse_stream(const pa_sink_input_info *info) {
+  RoutingStream stream;
+  stream.id = info->index;
+  stream.sink = info->sink;
+  const char *app_name = pa_proplist_gets(info->proplist, "application.name");
+  const char *binary =
+      pa_proplist_gets(info->proplist, "application.process.binary");
+  const char *pid = pa_proplist_gets(info->proplist, "application.process.id");
+  stream.app_name = app_name ? app_name : "";
+  stream.binary = binary ? binary : "";
+  stream.pid = pid ? std::strtoul(pid, nullptr, 10) : 0;
+  return stream;
+}
+
+void Player::routing_thread() {
+  const int kReconnectSeconds = 5; // after sound server restart or failure
+  pa_mainloop *mainloop = pa_mainloop_new();
+  {
+    // published at once, so destructor can wake up connecting thread too
+    std::lock_guard<std::mutex> lock(m_routing_mutex);
+    m_routing_mainloop = mainloop;
+  }
+
+  // callbacks with info about sinks and sink inputs
+  static auto on_sink_info = [](pa_context *context, const pa_sink_info *info,
+                                int eol, void *userdata) {
+    if (eol != 0)
+      return;
+    Player *player = static_cast<Player *>(userdata);
+    RoutingSink sink;
+    sink.id = info->index;
+    sink.name = info->name ? info->name : "";
+    sink.description = info->description ? info->description : "";
+    pulse_execute_moves(context, player->m_routing_rules.on_sink_added(sink));
+  };
+  static auto on_sink_input_info = [](pa_context *context,
+                                      const pa_sink_input_info *info, int eol,
+                                      void *userdata) {
+    if (eol != 0)
+      return;
+    Player *player = static_cast<Player *>(userdata);
+    pulse_execute_moves(
+        context, player->m_routing_rules.on_stream_added(pulse_stream(info)));
+  };
+  static auto on_sink_input_change = [](pa_context *context,
+                                        const pa_sink_input_info *info,
+                                        int eol, void *userdata) {
+    if (eol != 0)
+      return;
+    Player *player = static_cast<Player *>(userdata);
+    pulse_execute_moves(
+        context, player->m_routing_rules.on_stream_changed(pulse_stream(info)));
+  };
+
+  bool failure_logged = false; // failures to connect are logged once
+  while (m_routing_running) {
+    pa_context *context =
+        pa_context_new(pa_mainloop_get_api(mainloop), "crescendo_routing");
+    bool ready = false;
+    if (pa_context_connect(context, NULL, PA_CONTEXT_NOFLAGS, NULL) >= 0) {
+      // Wait for the context to be ready
+      while (m_routing_running) {
+        pa_context_state_t state = pa_context_get_state(context);
+        if (state == PA_CONTEXT_READY) {
+          ready = true;
+          break;
+        }
+        if (!PA_CONTEXT_IS_GOOD(state) ||
+            pa_mainloop_iterate(mainloop, true, NULL) < 0)
+          break;
+      }
+    }
+
+    if (ready) {
+      failure_logged = false;
+      // subscribe to sinks and sink inputs events
+      pa_context_set_subscribe_callback(
+          context,
+          [](pa_context *context, pa_subscription_event_type_t event,
+             uint32_t idx, void *userdata) {
+            Player *player = static_cast<Player *>(userdata);
+            unsigned facility = event & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+            unsigned type = event & PA_SUBSCRIPTION_EVENT_TYPE_MASK;
+            pa_operation *operation = nullptr;
+            if (facility == PA_SUBSCRIPTION_EVENT_SINK) {
+              if (type == PA_SUBSCRIPTION_EVENT_NEW)
+                operation = pa_context_get_sink_info_by_index(
+                    context, idx, on_sink_info, player);
+              else if (type == PA_SUBSCRIPTION_EVENT_REMOVE)
+                pulse_execute_moves(
+                    context, player->m_routing_rules.on_sink_removed(idx));
+            } else if (facility == PA_SUBSCRIPTION_EVENT_SINK_INPUT) {
+              if (type == PA_SUBSCRIPTION_EVENT_NEW)
+                operation = pa_context_get_sink_input_info(
+                    context, idx, on_sink_input_info, player);
+              else if (type == PA_SUBSCRIPTION_EVENT_CHANGE)
+                // e.g. moved by user, so its sink must be refreshed
+                operation = pa_context_get_sink_input_info(
+                    context, idx, on_sink_input_change, player);
+              else if (type == PA_SUBSCRIPTION_EVENT_REMOVE)
+                player->m_routing_rules.on_stream_removed(idx);
+            }
+            if (operation)
+              pa_operation_unref(operation);
+          },
+          this);
+      pa_operation *operation = pa_context_subscribe(
+          context,
+          (pa_subscription_mask_t)(PA_SUBSCRIPTION_MASK_SINK |
+                                   PA_SUBSCRIPTION_MASK_SINK_INPUT),
+          NULL, NULL);
+      if (operation)
+        pa_operation_unref(operation);
+      // get sinks and streams which exist already
+      operation = pa_context_get_sink_info_list(context, on_sink_info, this);
+      if (operation)
+        pa_operation_unref(operation);
+      operation = pa_context_get_sink_input_info_list(
+          context, on_sink_input_info, this);
+      if (operation)
+        pa_operation_unref(operation);
+
+      Helper::get_instance().log("Routing: listening PulseAudio events.");
+      while (m_routing_running &&
+             PA_CONTEXT_IS_GOOD(pa_context_get_state(context))) {
+        if (pa_mainloop_iterate(mainloop, true, NULL) < 0)
+          break;
+        std::vector<RoutingMove> pending;
+        {
+          std::lock_guard<std::mutex> lock(m_routing_mutex);
+          pending.swap(m_routing_pending);
+        }
+        pulse_execute_moves(context, pending);
+      }
+      // indexes of sinks and streams are not valid after reconnect
+      m_routing_rules.clear_objects();
+    }
+    pa_context_disconnect(context);
+    pa_context_unref(context);
+    if (!m_routing_running)
+      break;
+
+    if (ready) {
+      Helper::get_instance().log(
+          "Routing: connection to PulseAudio lost, reconnecting.");
+    } else if (!failure_logged) {
+      Helper::get_instance().log("Routing: can't connect to PulseAudio, "
+                                 "trying again every " +
+                                 std::to_string(kReconnectSeconds) +
+                                 " seconds.");
+      failure_logged = true;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_routing_mutex);
+      m_routing_pending.clear(); // made for old indexes
+    }
+    // wait before reconnecting, wakeup_routing_thread interrupts it
+    auto until = std::chrono::steady_clock::now() +
+                 std::chrono::seconds(kReconnectSeconds);
+    while (m_routing_running && std::chrono::steady_clock::now() < until) {
+      int left = std::chrono::duration_cast<std::chrono::microseconds>(
+                     until - std::chrono::steady_clock::now())
+                     .count();
+      if (pa_mainloop_prepare(mainloop, std::max(0, left)) < 0 ||
+          pa_mainloop_poll(mainloop) < 0 || pa_mainloop_dispatch(mainloop) < 0)
+        break;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_routing_mutex);
+    m_routing_mainloop = nullptr;
+  }
+  pa_mainloop_free(mainloop);
+}
+#endif
+
+#ifdef HAVE_PIPEWIRE
+void Player::routing_thread() {
+  auto main_loop = pipewire::main_loop::create();
+  auto context = pipewire::context::create(main_loop);
+  auto core = context->core();
+  auto reg = core->registry();
+  auto reg_listener = reg->listen<pipewire::registry_listener>();
+  pw_metadata *metadata = nullptr;
+
+  auto execute_moves = [&](const std::vector<RoutingMove> &moves) {
+    for (const auto &move : moves) {
+      if (!metadata) {
+        Helper::get_instance().log(
+            "Routing: metadata not found, so can't change output device.");
+        return;
+      }
+      Helper::get_instance().log("Routing: setting node #" +
+                                 std::to_string(move.stream_id) +
+                                 " target to #" +
+                                 std::to_string(move.sink_id));
+      pw_metadata_set_property(metadata, move.stream_id, "target.node",
+                               "Spa:Id",
+                               std::to_string(move.sink_id).c_str());
+    }
+  };
+
+  reg_listener.on<pipewire::registry_event::global>(
+      [&](const pipewire::global &global) {
+        if (!metadata && global.type == PW_TYPE_INTERFACE_Metadata) {
+          for (const auto &prop : global.props) {
+            if (prop.first == "metadata.name" && prop.second == "default") {
+              metadata = static_cast<pw_metadata *>(pw_registry_bind(
+                  reg.get()->get(), global.id, PW_TYPE_INTERFACE_Metadata,
+                  PW_VERSION_METADATA, 0));
+              break;
+            }
+          }
+          return;
+        }
+        if (global.type != pipewire::node::type)
+          return;
+        auto node = reg->bind<pipewire::node>(global.id).get();
+        auto info = node->info();
+        std::string media_class;
+        RoutingSink sink;
+        RoutingStream stream;
+        sink.id = stream.id = info.id;
+        for (const auto &prop : info.props) {
+          if (prop.first == "media.class")
+            media_class = prop.second;
+          else if (prop.first == "node.name")
+            sink.name = prop.second;
+          else if (prop.first == "node.description")
+            sink.description = prop.second;
+          else if (prop.first == "application.name")
+            stream.app_name = prop.second;
+          else if (prop.first == "application.process.binary")
+            stream.binary = prop.second;
+          else if (prop.first == "application.process.id")
+            stream.pid = std::strtoul(prop.second.c_str(), nullptr, 10);
+        }
+        if (media_class == "Audio/Sink")
+          execute_moves(m_routing_rules.on_sink_added(sink));
+        else if (media_class == "Stream/Output/Audio")
+          execute_moves(m_routing_rules.on_stream_added(stream));
+      });
+  reg_listener.on<pipewire::registry_event::global_removed>(
+      [&](const std::uint32_t id) {
+        // id may belong either to sink or to stream
+        execute_moves(m_routing_rules.on_sink_removed(id));
+        m_routing_rules.on_stream_removed(id);
+      });
+  core->update(); // get objects which exist already
+
+  pw_loop *loop = pw_main_loop_get_loop(main_loop->get());
+  {
+    std::lock_guard<std::mutex> lock(m_routing_mutex);
+    m_routing_loop = loop;
+    // event for waking up loop from other threads
+    m_routing_event = pw_loop_add_event(
+        loop, [](void *, uint64_t) {}, nullptr);
+  }
+
+  Helper::get_instance().log("Routing: listening PipeWire events.");
+  pw_loop_enter(loop);
+  while (m_routing_running) {
+    if (pw_loop_iterate(loop, -1) < 0)
+      break;
+    std::vector<RoutingMove> pending;
+    {
+      std::lock_guard<std::mutex> lock(m_routing_mutex);
+      pending.swap(m_routing_pending);
+    }
+    execute_moves(pending);
+  }
+  pw_loop_leave(loop);
+
+  {
+    std::lock_guard<std::mutex> lock(m_routing_mutex);
+    pw_loop_destroy_source(loop, m_routing_event);
+    m_routing_event = nullptr;
+    m_routing_loop = nullptr;
+  }
+  m_routing_rules.clear_objects();
+  if (metadata)
+    pw_proxy_destroy(reinterpret_cast<pw_proxy *>(metadata));
+}
+#endif
+
 bool Player::get_play_pause_method() const { return m_play_pause_method; }
 
 bool Player::get_pause_method() const { return m_pause_method; }
@@ -2938,48 +3701,825 @@ void Player::notify_observers_player_choosed(const bool toLocal) {
 }
 
 #ifdef SUPPORT_AUDIO_OUTPUT
+void Player::notify_observers_current_track_changed() {
+  int index = m_playlist.get_current();
+  for (auto observer : m_observers) {
+    observer->on_current_track_changed(index);
+  }
+}
 
-bool Player::open_audio(const std::string &filename) {
-  Mix_FreeMusic(m_current_music); // free previous opened music
-  SF_INFO info = {0};
-  SNDFILE *sndfile = sf_open(filename.c_str(), SFM_READ, &info);
-  if (!sndfile) {
-    Helper::get_instance().log("Error opening file " + filename + ": " +
-                               sf_strerror(sndfile));
+void Player::notify_observers_playlist_changed(int position, int removed,
+                                               int added) {
+  // index is spliced like views, so it is searchable before they update
+  std::vector<PlaylistTrack> tracks(added);
+  for (int i = 0; i < added; i++)
+    m_playlist.get(position + i, tracks[i]);
+  m_search.splice(position, removed, tracks);
+  for (auto observer : m_observers) {
+    observer->on_playlist_changed(position, removed, added);
+  }
+}
+
+std::string Player::get_library_path() {
+  std::string dir = Helper::get_instance().get_cache_dir();
+  return dir.empty() ? "" : dir + "/library.idx";
+}
+
+void Player::load_library() {
+  std::string path = get_library_path();
+  if (path.empty()) return;
+  auto library = std::make_shared<LibraryIndex>();
+  if (!library->open(path)) return;
+  Helper::get_instance().log("Loaded library index of " +
+                             std::to_string(library->size()) + " files");
+  std::lock_guard<std::mutex> lock(m_library_mutex);
+  m_library = library;
+  update_library_search();
+}
+
+void Player::save_library() {
+  std::lock_guard<std::mutex> lock(m_library_mutex);
+  std::string path = get_library_path();
+  if ((m_library_added.empty() && m_library_removed.empty()) || path.empty())
+    return;
+  auto is_removed = [this](const std::string &filename) {
+    if (m_library_removed.count(filename))
+      return true;
+    for (const auto &directory : m_library_removed_directories)
+      if (filename.compare(0, directory.size() + 1, directory + "/") == 0)
+        return true;
+    return false;
+  };
+  std::vector<PlaylistTrack> tracks;
+  if (m_library) { // keep indexed tracks, re-probed ones are replaced
+    tracks.reserve(m_library->size() + m_library_added.size());
+    PlaylistTrack track;
+    for (size_t i = 0; i < m_library->size(); i++)
+      if (m_library->get(i, track) && !is_removed(track.filename))
+        tracks.push_back(track);
+  }
+  for (const auto &track : m_library_added)
+    if (!m_library_removed.count(track.filename))
+      tracks.push_back(track);
+  if (!LibraryIndex::save(path, std::move(tracks))) {
+    Helper::get_instance().log("Can't save library index " + path);
+    return;
+  }
+  m_library_added.clear();
+  m_library_removed.clear();
+  m_library_removed_directories.clear();
+  auto library = std::make_shared<LibraryIndex>();
+  if (library->open(path)) {
+    m_library = library;
+    update_library_search();
+  }
+}
+
+void Player::update_library_search() {
+  // previous build is for old index, so it is stopped
+  m_library_search_cancel = true;
+  if (m_library_search_thread.joinable())
+    m_library_search_thread.join();
+  m_library_search_cancel = false;
+  std::shared_ptr<const LibraryIndex> library = m_library;
+  m_library_search_thread = std::thread([this, library] {
+    const size_t kChunk = 4096; // records indexed between checks of cancel
+    auto search = std::make_shared<LibrarySearch>();
+    search->library = library;
+    std::vector<PlaylistTrack> tracks;
+    PlaylistTrack track;
+    for (size_t start = 0; start < library->size(); start += kChunk) {
+      if (m_library_search_cancel)
+        return;
+      tracks.clear();
+      // broken record stays empty document, so indexes match records
+      for (size_t i = start; i < std::min(start + kChunk, library->size());
+           i++)
+        tracks.push_back(library->get(i, track) ? track : PlaylistTrack());
+      search->index.splice(start, 0, tracks);
+    }
+    std::lock_guard<std::mutex> lock(m_library_search_mutex);
+    m_library_search = search; // newer index waits for this thread
+  });
+}
+
+bool Player::probe_track(const std::string &filename, PlaylistTrack &track) {
+  std::shared_ptr<const LibraryIndex> library;
+  {
+    std::lock_guard<std::mutex> lock(m_library_mutex);
+    library = m_library;
+  }
+  if (library && library->find(filename, track))
+    return true; // indexed and not changed
+  if (!TrackProbe::probe(filename, track))
+    return false;
+  std::lock_guard<std::mutex> lock(m_library_mutex);
+  m_library_added.push_back(track);
+  m_library_removed.erase(filename); // file appeared again
+  return true;
+}
+
+int Player::add_to_playlist(const std::string &filename) {
+  PlaylistTrack track;
+  if (!probe_track(filename, track)) // if it is not audio file
+    return -1;
+  std::unique_lock<std::mutex> lock(m_playlist_edit_mutex);
+  int index = m_playlist.add(track);
+  notify_observers_playlist_changed(index, 0, 1);
+  lock.unlock();
+  scan_loudness(filename); // measure in background for normalization
+  return index;
+}
+
+bool Player::load_playlist(const std::string &path) {
+  if (PlaylistFile::get_format(path) == PlaylistFile::FORMAT_UNKNOWN) {
+    Helper::get_instance().log("Unknown playlist format of " + path);
+    return false;
+  }
+  import_to_playlist(path); // entries are probed in background, in order
+  return true;
+}
+
+bool Player::save_playlist(const std::string &path) {
+  std::vector<PlaylistTrack> tracks;
+  {
+    std::lock_guard<std::mutex> lock(m_playlist_edit_mutex);
+    tracks.resize(m_playlist.size());
+    for (size_t i = 0; i < tracks.size(); i++)
+      m_playlist.get(i, tracks[i]);
+  }
+  if (!PlaylistFile::save(path, tracks)) {
+    Helper::get_instance().log("Can't save playlist " + path);
+    return false;
+  }
+  return true;
+}
+
+std::vector<int> Player::search_playlist(const std::string &query,
+                                         size_t offset, size_t limit,
+                                         size_t &total) {
+  return m_search.search(query, offset, limit, total);
+}
+
+std::vector<PlaylistTrack> Player::search_library(const std::string &query,
+                                                  size_t offset, size_t limit,
+                                                  size_t &total) {
+  std::shared_ptr<const LibrarySearch> search;
+  {
+    std::lock_guard<std::mutex> lock(m_library_search_mutex);
+    search = m_library_search;
+  }
+  std::vector<PlaylistTrack> tracks;
+  total = 0;
+  if (!search)
+    return tracks; // not built yet
+  std::vector<int> indexes = search->index.search(query, offset, limit, total);
+  tracks.resize(indexes.size());
+  for (size_t i = 0; i < indexes.size(); i++)
+    search->library->get(indexes[i], tracks[i]);
+  return tracks;
+}
+
+void Player::save_session() {
+  std::string dir = Helper::get_instance().get_config_dir();
+  if (dir.empty() || !save_playlist(dir + "/session.m3u8"))
+    return;
+  PlaylistTrack current;
+  int index = m_playlist.get_current();
+  m_playlist.get(index, current);
+  pugi::xml_document doc;
+  pugi::xml_node session = doc.append_child("session");
+  session.append_attribute("current") = index;
+  // index can change if some files are gone, then track is found by name
+  session.append_attribute("filename") = current.filename.c_str();
+  session.append_attribute("position") =
+      index != -1 ? m_engine.get_position() : 0.0; // seconds
+  session.append_attribute("shuffle") = m_is_shuffle;
+  session.append_attribute("repeat") = m_repeat;
+  if (!doc.save_file((dir + "/session.xml").c_str()))
+    Helper::get_instance().log("Can't save session into " + dir);
+}
+
+void Player::restore_session() {
+  std::string dir = Helper::get_instance().get_config_dir();
+  if (dir.empty())
+    return;
+  pugi::xml_document doc;
+  if (!doc.load_file((dir + "/session.xml").c_str()))
+    return; // first launch
+  pugi::xml_node session = doc.child("session");
+  m_is_shuffle = session.attribute("shuffle").as_bool();
+  m_repeat = std::max(0, std::min(2, session.attribute("repeat").as_int()));
+  // only library index is looked up, so start is not delayed by probing;
+  // entries which are not indexed, e.g. on unmounted drive, are kept as
+  // saved, so next save does not lose them
+  std::vector<PlaylistTrack> tracks;
+  if (!PlaylistFile::load(dir + "/session.m3u8", tracks) || tracks.empty())
+    return;
+  {
+    std::shared_ptr<const LibraryIndex> library;
+    {
+      std::lock_guard<std::mutex> lock(m_library_mutex);
+      library = m_library;
+    }
+    PlaylistTrack indexed;
+    for (auto &track : tracks)
+      if (library && library->find(track.filename, indexed))
+        track = std::move(indexed);
+    std::lock_guard<std::mutex> lock(m_playlist_edit_mutex);
+    int first = m_playlist.add(tracks);
+    notify_observers_playlist_changed(first, 0, tracks.size());
+  }
+  for (const auto &track : tracks)
+    if (track.mtime != 0) // not probed entries may be missing
+      scan_loudness(track.filename);
+  int index = session.attribute("current").as_int(-1);
+  std::string filename = session.attribute("filename").as_string();
+  PlaylistTrack track;
+  if (!m_playlist.get(index, track) || track.filename != filename) {
+    auto indexes = m_playlist.find_if(
+        [&](const PlaylistTrack &entry) { return entry.filename == filename; });
+    index = indexes.empty() ? -1 : indexes.front();
+  }
+  if (!m_playlist.get(index, track) || !open_audio(track.filename))
+    return;
+  m_playlist.set_current(index);
+  m_engine.set_position(session.attribute("position").as_double());
+  queue_next_track();
+  Helper::get_instance().log("Restored session at " + track.filename);
+}
+
+void Player::import_to_playlist(const std::string &path) {
+  std::lock_guard<std::mutex> lock(m_importer_mutex);
+  if (!m_importer) {
+    m_importer = std::make_unique<PlaylistImporter>(
+        [this](const std::string &filename, PlaylistTrack &track) {
+          return probe_track(filename, track);
+        },
+        [this](std::vector<PlaylistTrack> &&tracks,
+               const ImportProgress &progress) {
+          if (!tracks.empty()) {
+            std::lock_guard<std::mutex> lock(m_playlist_edit_mutex);
+            int first = m_playlist.add(tracks);
+            notify_observers_playlist_changed(first, 0, tracks.size());
+          }
+          for (const auto &track : tracks)
+            if (track.mtime != 0) // not probed playlist entries may be missing
+              scan_loudness(track.filename); // for normalization
+          if (m_import_callback) m_import_callback(progress);
+          if (progress.finished)
+            save_library(); // next import of same files is one lookup each
+        });
+  }
+  if (PlaylistFile::get_format(path) != PlaylistFile::FORMAT_UNKNOWN) {
+    m_importer->add_playlist(path); // m3u or xspf, its entries in order
+    return;
+  }
+  m_importer->add(path);
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+    return;
+  // changes of imported directory are applied without full rescan
+  if (!m_watcher) {
+    m_watcher = std::make_unique<LibraryWatcher>(
+        [this](LibraryChanges &&changes) {
+          on_library_changes(std::move(changes));
+        });
+    m_rescanner = std::make_unique<PlaylistImporter>(
+        [this](const std::string &filename, PlaylistTrack &track) {
+          return probe_track(filename, track);
+        },
+        [this](std::vector<PlaylistTrack> &&tracks,
+               const ImportProgress &progress) {
+          update_tracks(std::move(tracks));
+          if (progress.finished)
+            save_library();
+        });
+  }
+  m_watcher->add_root(path);
+}
+
+void Player::update_tracks(std::vector<PlaylistTrack> &&tracks) {
+  std::unordered_map<std::string, size_t> positions; // in batch
+  for (size_t i = 0; i < tracks.size(); i++)
+    positions[tracks[i].filename] = i;
+  std::vector<bool> listed(tracks.size(), false);
+  std::lock_guard<std::mutex> lock(m_playlist_edit_mutex);
+  PlaylistTrack old;
+  for (int index : m_playlist.find_if([&](const PlaylistTrack &track) {
+         return positions.count(track.filename) != 0;
+       })) {
+    if (!m_playlist.get(index, old))
+      continue;
+    size_t i = positions[old.filename];
+    listed[i] = true;
+    if (old.mtime == tracks[i].mtime && old.size == tracks[i].size)
+      continue; // not changed, e.g. found by rescan
+    m_playlist.set(index, tracks[i]);
+    notify_observers_playlist_changed(index, 1, 1);
+    scan_loudness(tracks[i].filename);
+  }
+  std::vector<PlaylistTrack> added; // new files in imported directories
+  for (size_t i = 0; i < tracks.size(); i++)
+    if (!listed[i])
+      added.push_back(std::move(tracks[i]));
+  if (added.empty())
+    return;
+  int first = m_playlist.add(added);
+  notify_observers_playlist_changed(first, 0, added.size());
+  for (const auto &track : added)
+    scan_loudness(track.filename);
+}
+
+void Player::remove_tracks(
+    const std::function<bool(const PlaylistTrack &)> &match) {
+  std::vector<int> indexes = m_playlist.find_if(match);
+  // remove runs of neighbouring tracks from the end, so indexes stay valid
+  for (size_t end = indexes.size(); end > 0;) {
+    size_t start = end - 1;
+    while (start > 0 && indexes[start - 1] == indexes[start] - 1)
+      start--;
+    int count = end - start;
+    m_playlist.remove(indexes[start], count);
+    notify_observers_playlist_changed(indexes[start], count, 0);
+    end = start;
+  }
+}
+
+void Player::on_library_changes(LibraryChanges &&changes) {
+  Helper::get_instance().log(
+      "Library changed: " + std::to_string(changes.changed.size()) +
+      " files changed, " + std::to_string(changes.removed.size()) +
+      " removed, " + std::to_string(changes.rescan_directories.size()) +
+      " directories to rescan");
+  auto is_inside = [](const std::string &filename,
+                      const std::vector<std::string> &directories) {
+    for (const auto &directory : directories)
+      if (filename.compare(0, directory.size() + 1, directory + "/") == 0)
+        return true;
+    return false;
+  };
+  std::unordered_set<std::string> removed(changes.removed.begin(),
+                                          changes.removed.end());
+  {
+    std::lock_guard<std::mutex> lock(m_playlist_edit_mutex);
+    int current = m_playlist.get_current(), next = m_playlist.get_next();
+    remove_tracks([&](const PlaylistTrack &track) {
+      if (removed.count(track.filename) ||
+          is_inside(track.filename, changes.removed_directories))
+        return true;
+      // rescanned directory could lose files without events
+      struct stat st;
+      return is_inside(track.filename, changes.rescan_directories) &&
+             stat(track.filename.c_str(), &st) != 0;
+    });
+    if (m_playlist.get_current() != current)
+      notify_observers_current_track_changed();
+    if (m_playlist.get_current() != -1 && m_playlist.get_next() != next)
+      queue_next_track(); // queued track was removed
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_library_mutex);
+    m_library_removed.insert(changes.removed.begin(), changes.removed.end());
+    m_library_removed_directories.insert(
+        m_library_removed_directories.end(),
+        changes.removed_directories.begin(), changes.removed_directories.end());
+  }
+  if (changes.changed.empty() && changes.rescan_directories.empty()) {
+    save_library(); // only removals, nothing will be probed
+    return;
+  }
+  // only affected files are probed again, on worker pool
+  for (const auto &filename : changes.changed)
+    m_rescanner->add(filename);
+  for (const auto &directory : changes.rescan_directories)
+    m_rescanner->add(directory);
+}
+
+void Player::cancel_import() {
+  std::lock_guard<std::mutex> lock(m_importer_mutex);
+  if (m_importer) m_importer->cancel();
+}
+
+bool Player::is_importing() {
+  std::lock_guard<std::mutex> lock(m_importer_mutex);
+  return m_importer && m_importer->is_running();
+}
+
+void Player::set_import_callback(void (*callback)(const ImportProgress &)) {
+  m_import_callback = callback;
+}
+
+bool Player::play_track(int index) {
+  PlaylistTrack track;
+  if (!m_playlist.get(index, track))
+    return false;
+  if (!open_audio(track.filename)) {
+    Helper::get_instance().log("Can't open " + track.filename +
+                               " as audio file.");
+    return false;
+  }
+  if (get_is_playing())
+    play_audio(); // continue playing with new track
+  m_playlist.set_current(index);
+  notify_observers_current_track_changed();
+  queue_next_track();
+  return true;
+}
+
+bool Player::next_track() {
+  int index = m_playlist.choose_skip(get_shuffle());
+  if (index == -1) {
+    Helper::get_instance().log("No song picked at all.");
+    return false;
+  }
+  return play_track(index);
+}
+
+bool Player::previous_track() {
+  int index = m_playlist.choose_previous(get_shuffle());
+  if (index == -1) {
+    Helper::get_instance().log("No song picked at all.");
+    return false;
+  }
+  return play_track(index);
+}
+
+void Player::queue_next_track() {
+  if (get_current_player_name() != "Local")
+    return;
+  int index = m_playlist.choose_next(get_repeat(), get_shuffle());
+  PlaylistTrack track;
+  if (m_playlist.get(index, track)) { // engine will decode it in background
+    m_playlist.set_next(index);
+    queue_next_audio(track.filename);
+  } else { // stop after current track
+    m_playlist.set_next(-1);
+    clear_next_audio();
+  }
+}
+
+void Player::on_audio_ended(bool advanced) {
+  if (m_playlist.get_current() == -1) {
+    Helper::get_instance().log("WARNING: current track is unitialized.");
+    m_playlist.set_current(0);
+  }
+  int next = m_playlist.get_next();
+  if (advanced && next != -1) { // next track already playing
+    m_playlist.set_current(next);
+    notify_observers_current_track_changed();
+    advance_audio();    // update song data
+    queue_next_track(); // and prepare track after it
+    return;
+  }
+  next = m_playlist.choose_next(get_repeat(), get_shuffle());
+  PlaylistTrack track;
+  if (!m_playlist.get(next, track)) { // if no next track, just stop
+    stop_audio();
+    return;
+  }
+  m_playlist.set_current(next);
+  notify_observers_current_track_changed();
+  if (open_audio(track.filename)) {
+    play_audio();
+    queue_next_track();
+  } else {
+    Helper::get_instance().log("Can't open " + track.filename +
+                               " as audio file.");
+  }
+}
+
+
+bool Player::open_audio_device() {
+  // ask device for its native format, so SDL does not convert it once more
+  SDL_AudioSpec native = {0};
+  native.freq = 48000;
+  native.format = AUDIO_F32SYS;
+  native.channels = 2;
+#if SDL_VERSION_ATLEAST(2, 24, 0)
+  char *device_name = nullptr;
+  if (SDL_GetDefaultAudioInfo(&device_name, &native, 0) == 0) {
+    Helper::get_instance().log(std::string("Default audio device: ") +
+                               (device_name ? device_name : "unknown"));
+    SDL_free(device_name);
+  }
+#endif
+  // engine resamples and remixes every track into format we got here
+  if (!m_engine.start(native.freq, native.channels)) {
+    std::cerr << "Can't open audio device: " << SDL_GetError() << std::endl;
     return false;
   }
+  Helper::get_instance().log(
+      "Opened audio device: " + std::to_string(m_engine.get_rate()) + " Hz, " +
+      std::to_string(m_engine.get_channels()) + " channels, " +
+      (SDL_AUDIO_ISFLOAT(m_engine.get_format()) ? "float " : "integer ") +
+      std::to_string(SDL_AUDIO_BITSIZE(m_engine.get_format())) + " bit");
+  load_equalizer_presets();
+  apply_equalizer_preset();
+  return true;
+}
+
+void Player::log_engine_stats() {
+  int64_t latency = m_engine.take_switch_latency_us();
+  if (latency >= 0)
+    Helper::get_instance().log("Time to first audio after track switch: " +
+                               std::to_string(latency / 1000.0) + " ms");
+  AudioEngine::Stats stats = m_engine.get_stats();
+  if (stats.underruns != m_reported_underruns) {
+    Helper::get_instance().log(
+        "Audio buffer underruns: " + std::to_string(stats.underruns) +
+        ", buffer fill: " + std::to_string((int)(stats.buffer_fill * 100)) +
+        "%");
+    m_reported_underruns = stats.underruns;
+  }
+}
+
+std::string Player::get_audio_stats() {
+  AudioEngine::Stats stats = m_engine.get_stats();
+  uint64_t lookups = stats.cache.hits + stats.cache.misses;
+  double hit_rate = lookups > 0 ? (double)stats.cache.hits / lookups : 0;
+  return "fill=" + std::to_string(stats.buffer_fill) +
+         ";buffer=" + std::to_string(stats.buffer_seconds) +
+         ";underruns=" + std::to_string(stats.underruns) +
+         ";period=" + std::to_string(stats.period) +
+         ";latency=" + std::to_string(stats.output_latency) +
+         ";cache_hits=" + std::to_string(stats.cache.hits) +
+         ";cache_misses=" + std::to_string(stats.cache.misses) +
+         ";cache_hit_rate=" + std::to_string(hit_rate) +
+         ";cache_tracks=" + std::to_string(stats.cache.tracks) +
+         ";cache_bytes=" + std::to_string(stats.cache.bytes);
+}
+
+bool Player::set_audio_cache_size(int megabytes) {
+  if (megabytes < 0 || megabytes > 16384) {
+    Helper::get_instance().log("Invalid audio cache size: " +
+                               std::to_string(megabytes) + " MB");
+    return false;
+  }
+  m_engine.set_cache_budget((size_t)megabytes << 20);
+  return true;
+}
+
+int Player::get_audio_cache_size() const {
+  return m_engine.get_cache_budget() >> 20;
+}
+
+bool Player::set_equalizer(const std::string &bands) {
+  std::vector<EqBand> parsed;
+  if (!Equalizer::parse(bands, parsed) || !m_engine.set_equalizer(parsed)) {
+    Helper::get_instance().log("Invalid equalizer bands: \"" + bands + "\"");
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(m_equalizer_mutex);
+  std::string formatted = Equalizer::format(parsed);
+  if (formatted.empty())
+    m_equalizer_presets.erase(m_equalizer_device);
+  else
+    m_equalizer_presets[m_equalizer_device] = formatted;
+  save_equalizer_presets();
+  return true;
+}
+
+std::string Player::get_equalizer() const {
+  return Equalizer::format(m_engine.get_equalizer());
+}
+
+void Player::apply_equalizer_preset() {
+  std::lock_guard<std::mutex> lock(m_equalizer_mutex);
+  std::vector<EqBand> bands;
+  auto preset = m_equalizer_presets.find(m_equalizer_device);
+  if (preset != m_equalizer_presets.end() &&
+      !Equalizer::parse(preset->second, bands)) {
+    Helper::get_instance().log("Invalid equalizer preset of device " +
+                               m_equalizer_device + ", using flat one.");
+    bands.clear();
+  }
+  m_engine.set_equalizer(bands);
+  Helper::get_instance().log("Equalizer preset of device " +
+                             m_equalizer_device + ": \"" +
+                             Equalizer::format(bands) + "\"");
+}
+
+void Player::load_equalizer_presets() {
+  std::string dir = Helper::get_instance().get_config_dir();
+  if (dir.empty()) return;
+  pugi::xml_document doc;
+  if (!doc.load_file((dir + "/equalizer.xml").c_str())) return;  // no presets
+  std::lock_guard<std::mutex> lock(m_equalizer_mutex);
+  for (pugi::xml_node device : doc.child("equalizer").children("device"))
+    m_equalizer_presets[device.attribute("name").as_string()] =
+        device.attribute("bands").as_string();
+}
+
+void Player::save_equalizer_presets() {
+  std::string dir = Helper::get_instance().get_config_dir();
+  if (dir.empty()) return;
+  pugi::xml_document doc;
+  pugi::xml_node root = doc.append_child("equalizer");
+  for (const auto &preset : m_equalizer_presets) {
+    pugi::xml_node device = root.append_child("device");
+    device.append_attribute("name") = preset.first.c_str();
+    device.append_attribute("bands") = preset.second.c_str();
+  }
+  if (!doc.save_file((dir + "/equalizer.xml").c_str()))
+    Helper::get_instance().log("Can't save equalizer presets into " + dir);
+}
+
+bool Player::set_resampler_quality(int quality) {
+  if (quality < Resampler::QUALITY_FAST || quality > Resampler::QUALITY_HIGH) {
+    Helper::get_instance().log("Invalid resampler quality: " +
+                               std::to_string(quality));
+    return false;
+  }
+  m_engine.set_resampler_quality((Resampler::Quality)quality);
+  Helper::get_instance().log("Resampler quality set to " +
+                             std::to_string(quality));
+  return true;
+}
 
-  Helper::get_instance().log("Audio file: " + filename); // take info from file
-  Helper::get_instance().log("Sample rate: " + std::to_string(info.samplerate));
-  Helper::get_instance().log("Channels: " + std::to_string(info.channels));
+int Player::get_resampler_quality() const {
+  return m_engine.get_resampler_quality();
+}
 
-  sf_close(sndfile);
-  int audio_rate = info.samplerate;
-  Uint16 audio_format = AUDIO_S16SYS;
-  int audio_channels = info.channels;
-  int audio_buffers = 4096;
+bool Player::set_crossfade(double seconds, int curve) {
+  if (seconds < 0 || curve < AudioEngine::CROSSFADE_LINEAR ||
+      curve > AudioEngine::CROSSFADE_S_CURVE) {
+    Helper::get_instance().log("Invalid crossfade: " + std::to_string(seconds) +
+                               " seconds, curve " + std::to_string(curve));
+    return false;
+  }
+  m_engine.set_crossfade(seconds, (AudioEngine::CrossfadeCurve)curve);
+  Helper::get_instance().log("Crossfade set to " + std::to_string(seconds) +
+                             " seconds, curve " + std::to_string(curve));
+  return true;
+}
 
-  if (Mix_OpenAudio(audio_rate, audio_format, audio_channels, audio_buffers) <
-      0) { // if file cannot be opened
-    Helper::get_instance().log("Failed to open audio: " +
-                               std::string(Mix_GetError()));
+bool Player::set_output_period(int frames) {
+  if (frames == 0) frames = AudioEngine::kLowLatencyPeriod;
+  if (frames < 64 || frames > 8192 || (frames & (frames - 1)) != 0) {
+    Helper::get_instance().log("Invalid audio period: " +
+                               std::to_string(frames));
     return false;
   }
-  m_current_music = Mix_LoadMUS(filename.c_str()); // open file
-  if (!m_current_music) {                          // if not opened
-    Helper::get_instance().log("Mix_LoadMUS failed: " +
-                               std::string(Mix_GetError()));
+  return m_engine.set_period(frames);
+}
+
+bool Player::set_spectrum_stream(int rate, int bands) {
+  if (rate == 0) {
+    m_spectrum_running = false;
+    if (m_spectrum_thread.joinable())
+      m_spectrum_thread.join();
+    m_spectrum_rate = 0;
+    return true;
+  }
+  if (rate < 1 || rate > 60 || bands < 1 || bands > 64) {
+    Helper::get_instance().log("Invalid spectrum stream: " +
+                               std::to_string(rate) + " per second, " +
+                               std::to_string(bands) + " bands");
     return false;
   }
-  Mix_PlayMusic(m_current_music, 0);
-  Mix_PauseMusic();
-  m_song_title = Mix_GetMusicTitle(m_current_music);      // get title
-  m_song_artist = Mix_GetMusicArtistTag(m_current_music); // get artist
-  if (m_song_title == "" && m_song_artist == "") {
-    m_song_title = filename; // if no title and artist in audio file metadata,
-                             // then just make title named as filename
+  m_spectrum_rate = rate;
+  m_spectrum_bands = bands;
+  if (!m_spectrum_running.exchange(true))
+    m_spectrum_thread = std::thread(&Player::spectrum_thread, this);
+  return true;
+}
+
+std::string Player::get_spectrum_stream() const {
+  if (!m_spectrum_running)
+    return "0";
+  return std::to_string(m_spectrum_rate) + "," +
+         std::to_string(m_spectrum_bands);
+}
+
+/**
+ * Sends whole frame to client without blocking on slow client. Frame is
+ * dropped when it doesn't fit into free space of socket send buffer, partly
+ * written frame is finished, so client never sees broken message.
+ *
+ *@param client - socket of client (type: int)
+ *@param frame - message to send (type: std::string)
+ */
+static void send_frame_nonblocking(int client, const std::string &frame) {
+  int buffer = 0, queued = 0;
+  socklen_t length = sizeof(buffer);
+  if (getsockopt(client, SOL_SOCKET, SO_SNDBUF, &buffer, &length) == 0 &&
+      ioctl(client, SIOCOUTQ, &queued) == 0 &&
+      buffer - queued < (int)frame.size())
+    return; // client doesn't read, skip frame
+  size_t sent = 0;
+  while (sent < frame.size()) {
+    ssize_t result = send(client, frame.c_str() + sent, frame.size() - sent,
+                          MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (result > 0) {
+      sent += result;
+      continue;
+    }
+    if (result == -1 && errno == EINTR)
+      continue;
+    if (result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (sent == 0)
+        return; // nothing written, frame is just dropped
+      pollfd writable = {client, POLLOUT, 0};
+      if (poll(&writable, 1, 100) > 0) // rest of frame is short
+        continue;
+    }
+    return; // disconnected, server thread removes client
+  }
+}
+
+void Player::spectrum_thread() {
+  // analyzer copies frames from tap, so audio thread never waits for it
+  SpectrumAnalyzer analyzer;
+  std::vector<float> bands;
+  auto next = std::chrono::steady_clock::now();
+  while (m_spectrum_running) {
+    bands.resize(m_spectrum_bands);
+    bool has_clients;
+    {
+      std::lock_guard<std::mutex> lock(m_clients_mutex);
+      has_clients = !clients.empty();
+    }
+    if (has_clients && analyzer.analyze(m_engine.get_tap(), bands)) {
+      std::ostringstream message;
+      message << std::fixed << std::setprecision(1) << "spectrum||";
+      for (size_t i = 0; i < bands.size(); i++)
+        message << (i > 0 ? ";" : "") << bands[i];
+      message << "||";
+      std::string levels = message.str();
+      // sent under lock, so server thread can't close socket meanwhile;
+      // slow client drops frames instead of blocking others
+      std::lock_guard<std::mutex> lock(m_clients_mutex);
+      for (int client : clients)
+        send_frame_nonblocking(client, levels);
+    }
+    next += std::chrono::microseconds(1000000 / m_spectrum_rate);
+    std::this_thread::sleep_until(next);
+  }
+}
+
+std::string Player::measure_output_latency() {
+  AudioEngine::Latency latency;
+  if (!m_engine.measure_latency(latency)) {
+    Helper::get_instance().log(
+        "Can't measure output latency, pause playback first");
+    return "";
   }
-  m_song_length = Mix_MusicDuration(m_current_music); // get duration
+  return "command=" + std::to_string(latency.command) +
+         ";output=" + std::to_string(latency.output) +
+         ";total=" + std::to_string(latency.total) +
+         ";captured=" + std::to_string(latency.captured);
+}
+
+std::string Player::get_crossfade() const {
+  return std::to_string(m_engine.get_crossfade_seconds()) + "," +
+         std::to_string(m_engine.get_crossfade_curve());
+}
+
+std::shared_ptr<const Waveform> Player::get_waveform() {
+  if (m_selected_player_id >= m_players.size() ||
+      m_players[m_selected_player_id].first != "Local" || !has_audio())
+    return nullptr;
+  std::string filename = m_engine.get_filename();
+  auto waveform = m_waveforms.get(filename);
+  if (!waveform) m_waveforms.request(filename); // computed in background
+  return waveform;
+}
+
+void Player::set_waveform_callback(void (*callback)(const std::string &)) {
+  m_waveforms.set_ready_callback(callback);
+}
+
+void Player::scan_loudness(const std::string &filename) {
+  m_loudness.scan(filename);
+}
+
+float Player::get_track_gain(const std::string &filename) {
+  LoudnessInfo info;
+  if (!m_loudness.get(filename, info)) {
+    m_loudness.scan(filename); // normalized next time it is played
+    return 1.0f;
+  }
+  double gain = std::pow(10, info.gain / 20);
+  if (info.peak > 0 && info.peak * gain > 1)
+    gain = 1 / info.peak; // do not clip loud peaks of quiet tracks
+  return gain;
+}
+
+bool Player::open_audio(const std::string &filename) {
+  Helper::get_instance().log("Audio file: " + filename);
+  if (!m_engine.open(filename, get_track_gain(filename))) { // open file
+    Helper::get_instance().log("Can't open audio file " + filename);
+    return false;
+  }
+  update_audio_metadata();
+  return true;
+}
+
+void Player::update_audio_metadata() {
+  m_song_title = m_engine.get_title();   // get title
+  m_song_artist = m_engine.get_artist(); // get artist
+  m_song_length = m_engine.get_duration(); // get duration
   m_song_length_str = Helper::get_instance().format_time(m_song_length);
   Helper::get_instance().log("Title: " + m_song_title);
   notify_observers_song_title_changed(); // notify that title changed
@@ -2988,36 +4528,40 @@ bool Player::open_audio(const std::string &filename) {
   Helper::get_instance().log("Length (seconds): " +
                              std::to_string(m_song_length));
   notify_observers_song_length_changed();
-  m_song_pos = 0;                           // position from start
+  m_song_pos = m_engine.get_position();     // position from start
   notify_observers_song_position_changed(); // notify that pos changed
-  return true;
+}
+
+void Player::queue_next_audio(const std::string &filename) {
+  // prepare next track on worker thread
+  m_engine.queue_next(filename, get_track_gain(filename));
+  m_waveforms.request(filename); // ready before track starts
+}
+
+void Player::clear_next_audio() { m_engine.clear_next(); }
+
+void Player::advance_audio() {
+  update_audio_metadata(); // engine already plays next track
+}
+
+void Player::set_track_end_callback(void (*callback)(bool)) {
+  m_engine.set_track_end_callback(callback);
 }
 
 void Player::play_audio() {
-  if (!Mix_PlayingMusic()) { // if not playing
-    // Start playing the audio
-    if (Mix_PlayMusic(m_current_music, 0) == -1) {
-      Helper::get_instance().log("Mix_PlayMusic failed: " +
-                                 std::string(Mix_GetError()));
-      return;
-    }
-    if (!m_is_playing) {
-      m_is_playing = true;
-      notify_observers_is_playing_changed(); // notify that music playing now
-    }
-    return;
-  } else if (!Mix_PlayingMusic() || Mix_PausedMusic()) { // if paused
-    Mix_ResumeMusic();                                   // then just resume
-    if (!m_is_playing) {
-      m_is_playing = true;
-      notify_observers_is_playing_changed(); // notify that music playing now
-    }
+  m_engine.play(); // start or resume playing
+  if (!m_engine.is_playing()) {
+    Helper::get_instance().log("Nothing to play.");
     return;
   }
+  if (!m_is_playing) {
+    m_is_playing = true;
+    notify_observers_is_playing_changed(); // notify that music playing now
+  }
 }
 
 void Player::stop_audio() {
-  Mix_HaltMusic(); // stop playing
+  m_engine.stop(); // stop playing
   if (m_is_playing) {
     m_is_playing = false;
     notify_observers_is_playing_changed();
@@ -3025,14 +4569,14 @@ void Player::stop_audio() {
 }
 
 void Player::pause_audio() {
-  Mix_PauseMusic(); // pause playing
+  m_engine.pause(); // pause playing
   if (m_is_playing) {
     m_is_playing = false;
     notify_observers_is_playing_changed();
   }
 }
 
-Mix_Music *Player::get_music() const { return m_current_music; }
+bool Player::has_audio() const { return m_engine.has_track(); }
 
 void Player::start_server() {
   // start server
@@ -13,6 +13,13 @@
 #include "helper.h"
 #include "pugixml.hpp"
 
+#if defined(HAVE_PULSEAUDIO) || defined(HAVE_PIPEWIRE)
+#include <atomic>
+#include <mutex>
+
+#include "routingrules.h"
+#endif
+
 #ifdef HAVE_PULSEAUDIO
 #include <pulse/proplist.h>
 #include <pulse/pulseaudio.h>
@@ -31,11 +38,27 @@
 
 #ifdef SUPPORT_AUDIO_OUTPUT
 #include <SDL2/SDL.h>
-#include <SDL2/SDL_mixer.h>
 #include <sndfile.h>
 #include <unistd.h>
 
+#include "audioengine.h"
+#include "libraryindex.h"
+#include "librarywatcher.h"
+#include "loudnessscanner.h"
+#include "playlistfile.h"
+#include "playlistimporter.h"
+#include "playlistmodel.h"
+#include "searchindex.h"
+#include "spectrum.h"
+#include "trackprobe.h"
+#include "waveformcache.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
 #include <mutex>
+#include <unordered_set>
 #endif
 
 #ifdef HAVE_DBUS
@@ -100,6 +123,27 @@ class PlayerObserver {
    * @param new_loop_status New volume (type: const int&)
    */
   virtual void on_player_toggled(const bool toLocal) = 0;
+#ifdef SUPPORT_AUDIO_OUTPUT
+  /**
+   * Function, that will be called when current track of local playlist
+   * changed. It may be called from any thread.
+   *
+   * @param new_track_index Index of track in playlist, -1 if none (type:
+   * const int&)
+   */
+  virtual void on_current_track_changed(const int &new_track_index) = 0;
+  /**
+   * Function, that will be called when tracks of local playlist are removed,
+   * added or replaced. Changes come in the order they were made. It may be
+   * called from any thread.
+   *
+   * @param position Index of first changed track (type: const int&)
+   * @param removed Count of removed tracks (type: const int&)
+   * @param added Count of tracks added in their place (type: const int&)
+   */
+  virtual void on_playlist_changed(const int &position, const int &removed,
+                                   const int &added) = 0;
+#endif
 };
 
 class Player {
@@ -217,9 +261,147 @@ class Player {
   double m_song_volume;
 #ifdef SUPPORT_AUDIO_OUTPUT
   /**
-   * Pointer to current selected Music for local player
+   * Local playback engine, which decodes and plays local files
+   */
+  AudioEngine m_engine;
+  /**
+   * Opens audio device in its native rate and channels. Device opened once
+   * and every track converted into its format.
+   * @return true on success, false otherwise (type: bool)
+   */
+  bool open_audio_device();
+  /**
+   * Count of buffer underruns which was already logged
+   */
+  uint64_t m_reported_underruns = 0;
+  /**
+   * Logs new time-to-first-audio measurement and new buffer underruns
+   */
+  void log_engine_stats();
+  /**
+   * Takes title, artist and length of current track from engine and
+   * notifies observers
+   */
+  void update_audio_metadata();
+  /**
+   * Measures loudness of local files in background and keeps results
+   */
+  LoudnessScanner m_loudness;
+  /**
+   * Computes waveforms of local files in background and keeps them in cache
+   */
+  WaveformCache m_waveforms;
+  /**
+   * Local playlist, current and queued next track
    */
-  Mix_Music *m_current_music = nullptr;
+  PlaylistModel m_playlist;
+  /**
+   * Trigram index of m_playlist, updated with every change of it
+   */
+  SearchIndex m_search;
+  /**
+   * Imports directories into m_playlist, started on first import
+   */
+  std::unique_ptr<PlaylistImporter> m_importer;
+  std::mutex m_importer_mutex;  // guards creating of importers and watcher
+  /**
+   * Playlist is changed and observers are notified under this mutex, so
+   * views get changes in the same order
+   */
+  std::mutex m_playlist_edit_mutex;
+  /**
+   * Watches imported directories, changes are applied to playlist and
+   * library index
+   */
+  std::unique_ptr<LibraryWatcher> m_watcher;
+  /**
+   * Probes changed files, replaces their tracks or appends new ones
+   */
+  std::unique_ptr<PlaylistImporter> m_rescanner;
+  void on_library_changes(LibraryChanges &&changes);
+  /**
+   * Replaces tracks of changed files and appends new files
+   */
+  void update_tracks(std::vector<PlaylistTrack> &&tracks);
+  /**
+   * Removes tracks by condition, called with m_playlist_edit_mutex locked
+   */
+  void remove_tracks(const std::function<bool(const PlaylistTrack &)> &match);
+  void (*m_import_callback)(const ImportProgress &) = nullptr;
+  /**
+   * Index of probed files, kept in ~/.cache/crescendo/library.idx. Tracks
+   * probed since it was loaded are added to it after import and on exit.
+   */
+  std::shared_ptr<const LibraryIndex> m_library;
+  std::vector<PlaylistTrack> m_library_added;  // probed, not in index yet
+  std::unordered_set<std::string> m_library_removed;  // deleted files
+  std::vector<std::string> m_library_removed_directories;
+  std::mutex m_library_mutex;  // guards four above
+  /**
+   * Trigram index of library index, so files which are not in playlist are
+   * found too. It is built in background every time m_library is replaced.
+   */
+  struct LibrarySearch {
+    std::shared_ptr<const LibraryIndex> library;  // documents are its records
+    SearchIndex index;
+  };
+  std::shared_ptr<const LibrarySearch> m_library_search;
+  // guards m_library_search, thread which builds it doesn't take
+  // m_library_mutex, so it can be joined with m_library_mutex locked
+  std::mutex m_library_search_mutex;
+  std::thread m_library_search_thread;
+  std::atomic_bool m_library_search_cancel{false};
+  /**
+   * Starts building m_library_search for m_library, called with
+   * m_library_mutex locked
+   */
+  void update_library_search();
+  std::string get_library_path();
+  void load_library();
+  void save_library();
+  /**
+   * Takes track from library index or probes file, when it is not indexed
+   * or changed since
+   * @return false if file is not audio file
+   */
+  bool probe_track(const std::string &filename, PlaylistTrack &track);
+  /**
+   * Local playlist, current track with its position, shuffle and repeat are
+   * saved on exit into ~/.config/crescendo/session.m3u8 and session.xml, and
+   * restored on start. Tracks of restored playlist come from library index,
+   * ones which are not indexed keep what session.m3u8 says about them.
+   */
+  void save_session();
+  void restore_session();
+  /**
+   * Equalizer presets by output device name, "default" is used when device
+   * is unknown. Presets are kept in ~/.config/crescendo/equalizer.xml
+   */
+  std::map<std::string, std::string> m_equalizer_presets;
+  std::string m_equalizer_device = "default";
+  mutable std::mutex m_equalizer_mutex;
+  void load_equalizer_presets();
+  void save_equalizer_presets();
+  /**
+   * Applies preset of current output device to engine, flat equalizer if
+   * device has no preset
+   */
+  void apply_equalizer_preset();
+  /**
+   * Sends band levels of local output to clients while streaming is enabled
+   */
+  void spectrum_thread();
+  std::thread m_spectrum_thread;
+  std::atomic_bool m_spectrum_running{false};
+  std::atomic_int m_spectrum_rate{0}, m_spectrum_bands{0};
+  static const int kDefaultSpectrumBands = 16;
+  /**
+   * Gets gain which brings track to reference loudness without clipping its
+   * peaks. Track which was not scanned yet is queued for scanning.
+   * @param filename - path to audio file (type: std::string)
+   * @return linear gain, 1 if loudness is unknown (type: float)
+   */
+  float get_track_gain(const std::string &filename);
 #endif
   /**
    * Whether to use player class with gui or not
@@ -236,6 +418,50 @@ class Player {
 
   // Sends all current player info to the clients
   void send_info_to_clients();
+  // Sends message to all connected clients, logs result for each of them
+  void send_to_clients(const std::string &message);
+
+  /**
+   * Guards clients: server thread adds and removes them, spectrum thread
+   * sends to them
+   */
+  std::mutex m_clients_mutex;
+  /**
+   * Removes client from clients and closes its socket, so no thread sends
+   * to closed or reused descriptor
+   */
+  void remove_client(int client);
+
+#if defined(HAVE_PULSEAUDIO) || defined(HAVE_PIPEWIRE)
+  /**
+   * Rules for automatic routing of players streams to output devices
+   */
+  RoutingRules m_routing_rules;
+  /**
+   * Thread which listens sound server for sinks and streams events and
+   * applies routing rules
+   */
+  void routing_thread();
+  std::thread m_routing_thread;
+  std::atomic_bool m_routing_running{true};
+  /**
+   * Moves computed outside of routing thread (after rules reload), which
+   * routing thread must execute. Protected by m_routing_mutex.
+   */
+  std::vector<RoutingMove> m_routing_pending;
+  std::mutex m_routing_mutex;
+  /**
+   * Wakes up routing thread event loop
+   */
+  void wakeup_routing_thread();
+#ifdef HAVE_PULSEAUDIO
+  pa_mainloop *m_routing_mainloop = nullptr;
+#endif
+#ifdef HAVE_PIPEWIRE
+  pw_loop *m_routing_loop = nullptr;
+  spa_source *m_routing_event = nullptr;
+#endif
+#endif
 
  public:
   /**
@@ -353,6 +579,20 @@ class Player {
    * bool)
    */
   bool set_volume(double volume);
+  /**
+   * Gets current playback rate, MPRIS Rate property. Position advances by
+   * rate seconds per second, so clients extrapolate it with rate.
+   * @return current rate, 1 is normal speed (type: double)
+   */
+  double get_rate();
+  /**
+   * Sets playback rate for currently selected player. Local player keeps
+   * pitch by time stretching.
+   * @param rate - new rate, from 0.5 to 3 for local player (type: double)
+   * @return true if rate successully changed, false otherwise (type:
+   * bool)
+   */
+  bool set_rate(double rate);
   /**
    * Gets current playback status
    * @return true if some song is playing, false otherwise (type:
@@ -394,6 +634,20 @@ class Player {
    * @param sink index for new output device
    */
   void set_output_device(unsigned short);
+  /**
+   * Loads or replaces output device routing rules. Rules are applied to
+   * already known streams immediately and to new sinks and streams when they
+   * appear.
+   * @param rules - rules in text form "identity->sink,fallback;..." (type:
+   * std::string)
+   * @return true if rules parsed and loaded, false otherwise (type: bool)
+   */
+  bool load_routing_rules(const std::string &rules);
+  /**
+   * Gets current output device routing rules
+   * @return rules in text form (type: std::string)
+   */
+  std::string get_routing_rules();
   /**
    * Gets whether current player supports PlayPause method
    * @return true if player support PlayPause, false otherwise (type: bool)
@@ -612,6 +866,149 @@ class Player {
   void notify_observers_player_choosed(const bool toLocal);
 
 #ifdef SUPPORT_AUDIO_OUTPUT
+  /**
+   * Notifies observers that current track of local playlist has changed.
+   */
+  void notify_observers_current_track_changed();
+
+  /**
+   * Notifies observers that tracks of local playlist were changed. Must be
+   * called with m_playlist_edit_mutex locked, right after change.
+   */
+  void notify_observers_playlist_changed(int position, int removed,
+                                         int added);
+
+  /**
+   * Gets local playlist. Views show it in the same order, so index of row is
+   * index of track.
+   */
+  PlaylistModel &get_playlist() { return m_playlist; }
+
+  /**
+   * Adds local audio file to the end of playlist and queues its loudness
+   * scan.
+   *
+   * @param filename The filename of the audio file.
+   * @return Index of added track, -1 if file is not audio file.
+   */
+  int add_to_playlist(const std::string &filename);
+
+  /**
+   * Imports audio file, playlist file or whole directory into playlist in
+   * background.
+   * Tracks are appended in batches, callback set by set_import_callback is
+   * called after every batch.
+   *
+   * @param path Path to audio file or directory.
+   */
+  void import_to_playlist(const std::string &path);
+
+  /**
+   * Appends tracks of M3U/M3U8 or XSPF playlist file in background, as
+   * import_to_playlist does, keeping order of playlist. Files which are in
+   * library index are not probed, other ones are probed on all cores. Files
+   * which can't be probed are kept with title, artist and duration stored
+   * in playlist.
+   *
+   * @param path Path to playlist file.
+   * @return False if path is not playlist file.
+   */
+  bool load_playlist(const std::string &path);
+
+  /**
+   * Saves local playlist into M3U/M3U8 or XSPF file, format is chosen by
+   * extension.
+   *
+   * @param path Path to playlist file.
+   * @return True if playlist was saved, false otherwise.
+   */
+  bool save_playlist(const std::string &path);
+
+  /**
+   * Finds tracks of local playlist, which contain every word of query in
+   * title, artist, album or path.
+   *
+   * @param query Words to find, empty query matches all tracks.
+   * @param offset Count of first results to skip.
+   * @param limit Maximal count of results, 0 for all.
+   * @param total Count of all results is saved here.
+   * @return Indexes of tracks, ascending.
+   */
+  std::vector<int> search_playlist(const std::string &query, size_t offset,
+                                   size_t limit, size_t &total);
+
+  /**
+   * Finds files of library index, which contain every word of query in
+   * title, artist, album or path, also files which are not in playlist.
+   * Index is built in background after start and after every import, until
+   * then nothing or previous library is found.
+   *
+   * @param query Words to find, empty query matches all files.
+   * @param offset Count of first results to skip.
+   * @param limit Maximal count of results, 0 for all.
+   * @param total Count of all results is saved here.
+   * @return Found tracks, sorted by path.
+   */
+  std::vector<PlaylistTrack> search_library(const std::string &query,
+                                            size_t offset, size_t limit,
+                                            size_t &total);
+
+  /**
+   * Cancels running import, tracks which are already added stay in playlist.
+   */
+  void cancel_import();
+
+  /**
+   * Checks whether import is running.
+   */
+  bool is_importing();
+
+  /**
+   * Sets function, which will be called from worker thread after batch of
+   * imported tracks is added to playlist.
+   *
+   * @param callback Function, receives progress of import.
+   */
+  void set_import_callback(void (*callback)(const ImportProgress &));
+
+  /**
+   * Opens track of playlist and makes it current. It is played if something
+   * was playing, track after it is queued.
+   *
+   * @param index Index of track in playlist.
+   * @return True if track was opened, false otherwise.
+   */
+  bool play_track(int index);
+
+  /**
+   * Opens next track of playlist, honouring shuffle. After last track goes
+   * first one.
+   *
+   * @return True if track was opened, false otherwise.
+   */
+  bool next_track();
+
+  /**
+   * Opens previous track of playlist. Before first track goes last one.
+   *
+   * @return True if track was opened, false otherwise.
+   */
+  bool previous_track();
+
+  /**
+   * Chooses track which is played after current one, honouring repeat and
+   * shuffle, and gives it to engine, so it starts without gap.
+   */
+  void queue_next_track();
+
+  /**
+   * Must be called when current track ended, continues with next track of
+   * playlist or stops.
+   *
+   * @param advanced Whether queued next track already started playing.
+   */
+  void on_audio_ended(bool advanced);
+
   /**
    * Opens an audio file for playback.
    *
@@ -636,29 +1033,182 @@ class Player {
   void pause_audio();
 
   /**
-   * Gets a pointer to the Mix_Music object representing the currently open
-   * audio file.
+   * Gets whether some audio file is currently open.
+   *
+   * @return True if audio file is open, false otherwise.
+   */
+  bool has_audio() const;
+
+  /**
+   * Queues audio file which will be played right after current one without
+   * gap. File is opened and its beginning is decoded in background.
+   *
+   * @param filename The filename of the next audio file.
+   */
+  void queue_next_audio(const std::string &filename);
+
+  /**
+   * Drops queued next audio file.
+   */
+  void clear_next_audio();
+
+  /**
+   * Must be called after engine started queued audio file by itself, updates
+   * song data for new file.
+   */
+  void advance_audio();
+
+  /**
+   * Sets function, which will be called from decoder thread when current audio
+   * file ends.
+   *
+   * @param callback Function, receives true if queued next file already
+   * started playing.
+   */
+  void set_track_end_callback(void (*callback)(bool));
+
+  /**
+   * Gets state of local audio engine: ring buffer fill, its size in seconds,
+   * count of underruns and usage of decoded tracks cache.
+   *
+   * @return Stats in form
+   * "fill=0.95;buffer=1.0;underruns=0;period=1024;latency=0.042;
+   * cache_hits=1;cache_misses=3;cache_hit_rate=0.25;cache_tracks=2;
+   * cache_bytes=105840000".
+   */
+  std::string get_audio_stats();
+
+  /**
+   * Sets memory ceiling of decoded tracks kept for instant previous and
+   * replay.
+   *
+   * @param megabytes Maximum size of cache, 0 disables it.
+   * @return True if size is valid, false otherwise.
+   */
+  bool set_audio_cache_size(int megabytes);
+
+  /**
+   * Gets memory ceiling of decoded tracks cache in megabytes.
+   */
+  int get_audio_cache_size() const;
+
+  /**
+   * Sets bands of parametric equalizer of local output. Bands are applied
+   * without clicks and saved as preset of current output device, which is
+   * restored when device is selected again.
+   *
+   * @param bands Bands in form "type:frequency:gain:q;...", where type is
+   * peak, lowshelf or highshelf, gain in dB from -24 to 24, e.g.
+   * "lowshelf:100:3:0.7;peak:2500:-2:1.4". Empty string disables equalizer.
+   * @return True if bands are valid, false otherwise.
+   */
+  bool set_equalizer(const std::string &bands);
+
+  /**
+   * Gets bands of parametric equalizer of local output.
+   *
+   * @return Bands in form "type:frequency:gain:q;...".
+   */
+  std::string get_equalizer() const;
+
+  /**
+   * Queues local audio file for loudness scan, so its volume is normalized
+   * when it is played.
+   *
+   * @param filename The filename of the audio file.
+   */
+  void scan_loudness(const std::string &filename);
+
+  /**
+   * Sets quality of resampling tracks into device rate. New quality is used
+   * from next track or seek.
+   *
+   * @param quality 0 - fast, 1 - medium, 2 - high.
+   * @return True if quality is valid, false otherwise.
+   */
+  bool set_resampler_quality(int quality);
+
+  /**
+   * Gets quality of resampling tracks into device rate.
+   *
+   * @return 0 - fast, 1 - medium, 2 - high.
+   */
+  int get_resampler_quality() const;
+
+  /**
+   * Sets crossfade between consecutive local tracks. It is also used when
+   * track is switched manually while playing.
+   *
+   * @param seconds Length of crossfade, 0 disables it.
+   * @param curve 0 - linear, 1 - equal power, 2 - S-curve.
+   * @return True if parameters are valid, false otherwise.
+   */
+  bool set_crossfade(double seconds, int curve);
+
+  /**
+   * Sets period of audio device, which is size of one device buffer.
+   * Smaller period lowers latency of play, pause and track switch, but
+   * needs more CPU wakeups.
+   *
+   * @param frames Period in frames, power of two from 64 to 8192, or 0 for
+   * low latency profile.
+   * @return True on success, false otherwise.
+   */
+  bool set_output_period(int frames);
+
+  /**
+   * Measures latency from command to audible audio with short test tone.
+   * Capture device stands in for loopback, if it hears output. Measured
+   * latency is used to compensate positions. Works only while nothing plays.
+   *
+   * @return Result in form "command=0.5;output=42.6;total=43.1;captured=0",
+   * times in milliseconds, or empty string on failure.
+   */
+  std::string measure_output_latency();
+
+  /**
+   * Gets crossfade settings.
+   *
+   * @return Settings in form "seconds,curve", e.g. "3.000000,1".
+   */
+  std::string get_crossfade() const;
+
+  /**
+   * Starts or stops streaming band levels of local output to server clients
+   * as "spectrum||l1;l2;...||", levels in dBFS from -120 to about 0.
+   * Levels are computed from audio tap without blocking audio thread.
+   *
+   * @param rate Levels per second, from 1 to 60, or 0 to stop streaming.
+   * @param bands Count of logarithmic bands from 40 Hz to 16 kHz, from 1 to
+   * 64.
+   * @return True if parameters are valid, false otherwise.
+   */
+  bool set_spectrum_stream(int rate, int bands);
+
+  /**
+   * Gets spectrum streaming settings.
    *
-   * @return A pointer to the Mix_Music object representing the currently open
-   * audio file, or NULL if no file is currently open.
+   * @return Settings in form "rate,bands", or "0" if streaming is stopped.
    */
-  Mix_Music *get_music() const;
+  std::string get_spectrum_stream() const;
 
   /**
-   * Gets a vector of pointers to the Mix_Music objects in the audio player's
-   * playlist.
+   * Gets waveform of current local track. Waveform which is not computed yet
+   * is queued for computing, callback set by set_waveform_callback is called
+   * when it is ready.
    *
-   * @return A vector of pointers to the Mix_Music objects in the audio player's
-   * playlist.
+   * @return Waveform, or nullptr if it is not ready or local player is not
+   * selected.
    */
-  std::vector<Mix_Music *> get_playlist() const;
+  std::shared_ptr<const Waveform> get_waveform();
 
   /**
-   * Adds a Mix_Music object to the audio player's playlist.
+   * Sets function, which will be called from worker thread when waveform of
+   * audio file is computed.
    *
-   * @param music A pointer to the Mix_Music object to add to the playlist.
+   * @param callback Function, receives filename of audio file.
    */
-  void add_to_playlist(Mix_Music *music);
+  void set_waveform_callback(void (*callback)(const std::string &));
 
   /**
    * Starts Socket server
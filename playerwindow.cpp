@@ -3,13 +3,8 @@
 // define static variables
 // Player PlayerWindow::m_player;
 Gtk::ScrolledWindow *PlayerWindow::m_playlist_scrolled_window = nullptr;
-PlaylistRow *PlayerWindow::m_activated_row = nullptr;
 PlayerWindow *PlayerWindow::s_instance = nullptr;
 
-#ifdef SUPPORT_AUDIO_OUTPUT
-unsigned int PlayerWindow::m_current_track = -1;
-#endif
-
 void PlayerWindow::signalHandler(int signal) {
   if (signal == SIGINT || signal == SIGTERM) {
     // Set the flag to false to stop the application
@@ -83,6 +78,25 @@ PlayerWindow::PlayerWindow() {
   m_volume_and_player_box.set_orientation(Gtk::Orientation::HORIZONTAL);
   m_volume_and_player_box.set_halign(Gtk::Align::END);
   m_volume_and_player_box.set_valign(Gtk::Align::END);
+  m_rate_button.set_has_frame(false);
+  m_rate_button.set_tooltip_text("Playback rate");
+  m_rate_scale.set_orientation(Gtk::Orientation::HORIZONTAL);
+  m_rate_scale.set_adjustment(Gtk::Adjustment::create(1, 0.5, 3, 0.05, 0.25));
+  m_rate_scale.set_digits(2);
+  m_rate_scale.set_size_request(200, -1);
+  for (double mark : {0.5, 1.0, 1.5, 2.0, 3.0})
+    m_rate_scale.add_mark(mark, Gtk::PositionType::BOTTOM, "");
+  m_rate_scale.signal_value_changed().connect(  // set signal for changing rate
+      [this] {
+        if (m_lock_rate_changing) return;
+        m_player.set_rate(m_rate_scale.get_value());
+        update_rate_button();
+      });
+  m_rate_popover.set_child(m_rate_scale);
+  m_rate_popover.signal_closed().connect([this] { m_rate_popover.unparent(); });
+  update_rate_button();
+
+  m_volume_and_player_box.append(m_rate_button);
   m_volume_and_player_box.append(m_player_choose_button);
   m_volume_and_player_box.append(m_device_choose_button);
   m_volume_and_player_box.append(m_volume_bar_scale_button);
@@ -174,6 +188,8 @@ PlayerWindow::PlayerWindow() {
       sigc::mem_fun(*this, &PlayerWindow::on_device_choose_clicked));
   m_repeat_button.signal_clicked().connect(
       sigc::mem_fun(*this, &PlayerWindow::on_loop_clicked));
+  m_rate_button.signal_clicked().connect(
+      sigc::mem_fun(*this, &PlayerWindow::on_rate_clicked));
 
   // attach all element to main grid
   m_main_grid.attach(m_current_pos_label, 0, 1);
@@ -196,10 +212,10 @@ PlayerWindow::PlayerWindow() {
   // Apply the stylesheet to our custom widget
   m_song_title_list.get_style_context()->add_provider(
       css_provider, GTK_STYLE_PROVIDER_PRIORITY_USER);
-  m_playlist_listbox.get_style_context()->add_provider(
+  m_playlist_view.get_style_context()->add_provider(
       css_provider, GTK_STYLE_PROVIDER_PRIORITY_USER);
   m_song_title_list.get_style_context()->add_class("new-background");
-  m_playlist_listbox.get_style_context()->add_class("new-background");
+  m_playlist_view.get_style_context()->add_class("new-background");
   m_shuffle_button.get_style_context()->add_provider(
       css_provider, GTK_STYLE_PROVIDER_PRIORITY_USER);
   if (m_player.get_shuffle()) {
@@ -238,36 +254,61 @@ PlayerWindow::PlayerWindow() {
   m_playlist_scrolled_window->set_vexpand();
   m_playlist_scrolled_window->set_hexpand();
   m_playlist_scrolled_window->set_margin_start(50);
-  m_playlist_scrolled_window->set_child(m_playlist_listbox);
-  m_playlist_listbox.set_show_separators();
+  // list view reuses few rows for visible items, so huge playlists are cheap
+  m_playlist_store = Gio::ListStore<PlaylistItem>::create();
+  auto factory = Gtk::SignalListItemFactory::create();
+  factory->signal_setup().connect(
+      [](const Glib::RefPtr<Gtk::ListItem> &list_item) {
+        list_item->set_child(*Gtk::make_managed<PlaylistRow>());
+      });
+  factory->signal_bind().connect(
+      [this](const Glib::RefPtr<Gtk::ListItem> &list_item) {
+        m_bound_items.insert(list_item.get());
+        bind_playlist_row(*list_item);
+      });
+  factory->signal_unbind().connect(
+      [this](const Glib::RefPtr<Gtk::ListItem> &list_item) {
+        m_bound_items.erase(list_item.get());
+        auto item = std::dynamic_pointer_cast<PlaylistItem>(
+            list_item->get_item());
+        if (item) item->m_row = nullptr;
+      });
+  m_playlist_model = Gtk::NoSelection::create(m_playlist_store);
+  m_search_store = Gio::ListStore<PlaylistItem>::create();
+  m_search_model = Gtk::NoSelection::create(m_search_store);
+  m_playlist_view.set_model(m_playlist_model);
+  m_playlist_view.set_factory(factory);
+  m_playlist_view.set_single_click_activate();
+  m_playlist_view.set_show_separators();
+  m_playlist_scrolled_window->set_child(m_playlist_view);
 
 #ifdef SUPPORT_AUDIO_OUTPUT
   // add signal when we choose song in playlist
-  m_playlist_listbox.signal_row_activated().connect(
-      [this](Gtk::ListBoxRow *row) {
-        auto playlist_row = dynamic_cast<PlaylistRow *>(row);
-        m_current_track = playlist_row->get_index();
-        if (!m_player.open_audio(playlist_row->get_filename())) {  // open song
-          Helper::get_instance().log("Can't open file as audio: " +
-                                     playlist_row->get_filename());
-        } else {
-          if (m_activated_row != NULL) {
-            m_activated_row->stop_highlight();
-          }
-          playlist_row->highlight();
-          m_activated_row = playlist_row;
-          if (m_player.get_is_playing()) {  // and if song already playing
-            m_player.play_audio();          // play new song
-          }
-        }
-      });
+  m_playlist_view.signal_activate().connect([this](guint position) {
+    // item position is track index, unless playlist is filtered
+    m_player.play_track(m_filtered ? m_search_results[position] : position);
+  });
+  m_search_entry.signal_search_changed().connect(
+      [this] { update_search(); });
 #endif
   // add elements of playlist to main grid
   m_main_grid.attach(m_add_song_to_playlist_button, 0, 0);
-  m_main_grid.attach(*m_playlist_scrolled_window, 0, 0, 3, 1);
+  // typing in playlist opens search bar below it, which filters playlist
+  m_search_bar.set_child(m_search_entry);
+  m_search_bar.connect_entry(m_search_entry);
+  m_search_bar.set_key_capture_widget(m_playlist_view);
+  m_search_bar.set_show_close_button();
+  m_playlist_box.set_orientation(Gtk::Orientation::VERTICAL);
+  m_playlist_box.append(*m_playlist_scrolled_window);
+  m_playlist_box.append(m_search_bar);
+  m_main_grid.attach(m_playlist_box, 0, 0, 3, 1);
 #ifdef SUPPORT_AUDIO_OUTPUT
   m_add_song_to_playlist_button.signal_clicked().connect(
       [this] {  // if we support local audio
+        if (m_player.is_importing()) {  // button cancels running import
+          m_player.cancel_import();
+          return;
+        }
         auto file_dialog =
             Gtk::FileDialog::create();  // create file dialog when
                                         // button "add" clicked
@@ -277,20 +318,20 @@ PlayerWindow::PlayerWindow() {
             auto file = file_dialog->open_finish(
                 result);  // get file from result of dialog
 
-            auto opened_file =
-                Mix_LoadMUS(file->get_path().c_str());  // try to open it
-            if (opened_file) {  // and if it was audio file
-              add_song_to_playlist(
-                  file->get_path().c_str());  // add it to playlist
-            }
+            add_song_to_playlist(
+                file->get_path().c_str());  // add it to playlist if it is
+                                            // audio file
 
           } catch (Glib::Error err) {  // if user closed dialog
           }
         });
       });
-  // Mix_HookMusicFinished(&PlayerWindow::on_music_ends);  // add signal what to
-  // do when music ends
-  Mix_HookMusicFinished(&PlayerWindow::on_music_ends_static);
+  // add signal what to do when music ends
+  m_player.set_track_end_callback(&PlayerWindow::on_music_ends_static);
+  // redraw progress bar when waveform is computed
+  m_player.set_waveform_callback(&PlayerWindow::on_waveform_ready_static);
+  // show imported tracks and progress of import
+  m_player.set_import_callback(&PlayerWindow::on_import_progress_static);
 
   m_drop_target = Gtk::DropTarget::create(
       Gio::File::get_type(), Gdk::DragAction::COPY);  // create drop_target
@@ -308,6 +349,17 @@ PlayerWindow::PlayerWindow() {
       m_drop_target->signal_leave().connect([&] { return on_signal_leave(); });
   add_controller(m_drop_target);  // add drop_target to main window
 
+  if (m_player.get_current_player_name() == "Local") {
+    // show session restored by player, window was not its observer yet
+    update_playlist_view(0, 0, m_player.get_playlist().size());
+    if (m_player.get_playlist().get_current() != -1) {
+      on_song_title_changed(m_player.get_song_name());
+      on_song_artist_changed(m_player.get_song_author());
+      on_song_length_changed(m_player.get_song_length_str());
+      on_song_position_changed(m_player.get_position());
+    }
+    on_loop_status_changed(m_player.get_repeat());
+  }
 #endif
 
   if (m_player.get_current_player_name() !=
@@ -341,7 +393,8 @@ void PlayerWindow::on_playpause_clicked() {
 #ifdef SUPPORT_AUDIO_OUTPUT
 
   if (m_player.get_current_player_name() == "Local" &&
-      m_activated_row) {  // some song is already chosen
+      m_player.get_playlist().get_current() !=
+          -1) {  // some song is already chosen
     if (m_player.get_is_playing()) {
       m_player.pause_audio();
     } else {
@@ -350,38 +403,17 @@ void PlayerWindow::on_playpause_clicked() {
     return;
   }
   if (m_player.get_current_player_name() == "Local" &&
-      m_player.get_music() ==
-          NULL) {  // no chosen song and playpause clicked, picking first song
-
-    auto listbox = dynamic_cast<Gtk::ListBox *>(
-        m_playlist_scrolled_window->get_child()->get_first_child());
-    if (listbox) {
-      int n_children = listbox->observe_children()->get_n_items();
-      if (n_children != 0) {
-        auto listitem = dynamic_cast<PlaylistRow *>(
-            listbox->get_row_at_index(0));  // getting first item in playlist
-        if (listitem) {                     // if first item is present
-          m_current_track = 0;              // set id of current track to 0
-          if (m_activated_row)              // if current activated
-            m_activated_row->stop_highlight();  // stop current highlight
-          m_activated_row = listitem;           // set activated to first
-          m_activated_row->highlight();         // set highlight to first
-          if (m_player.open_audio(
-                  listitem->get_filename())) {  // open audio from first item
-            m_player.play_audio();              // play audio
-          } else {
-            Helper::get_instance().log(
-                "Can't open " + listitem->get_filename() + " as audio file.");
-          }
-          return;
-        }
-      } else {
-        auto error_dialog = Gtk::AlertDialog::create(
-            "You need to add song or choose another player");
-        error_dialog->show(*this);
-        return;
-      }
+      !m_player.has_audio()) {  // no chosen song and playpause clicked,
+                                // picking first song
+    if (m_player.get_playlist().size() == 0) {
+      auto error_dialog = Gtk::AlertDialog::create(
+          "You need to add song or choose another player");
+      error_dialog->show(*this);
+      return;
     }
+    if (m_player.play_track(0))  // open first song
+      m_player.play_audio();     // and play it
+    return;
   }
 
 #endif
@@ -392,66 +424,7 @@ void PlayerWindow::on_prev_clicked() {
 #ifdef SUPPORT_AUDIO_OUTPUT
   if (m_player.get_current_player_name() == "Local") {  // if local player
     Helper::get_instance().log("Prev clicked");
-    auto listbox = dynamic_cast<Gtk::ListBox *>(
-        m_playlist_scrolled_window->get_child()->get_first_child());
-    if (listbox) {  // if found listbox
-      int n_children =
-          listbox->observe_children()->get_n_items();  // get count of rows
-      for (int i = 0; i < n_children; i++) {
-        auto listitem = dynamic_cast<PlaylistRow *>(
-            listbox->get_row_at_index(i));  // get ith row
-        if (listitem == m_activated_row) {  // found current row
-          Helper::get_instance().log("Current song: " +
-                                     listitem->get_filename());
-          auto prev_list_item = dynamic_cast<PlaylistRow *>(
-              listbox->get_row_at_index(i - 1));  // get previous row
-          if (prev_list_item) {                   // if found
-            Helper::get_instance().log("Prev song: " +
-                                       prev_list_item->get_filename());
-            if (m_player.open_audio(
-                    prev_list_item->get_filename())) {  // then open previous
-              if (m_player.get_is_playing())            // if song was playing
-                m_player.play_audio();                  // play previous song
-              m_current_track = prev_list_item->get_index();
-              if (m_activated_row)  // update highlightning
-                m_activated_row->stop_highlight();
-              m_activated_row = prev_list_item;
-              m_activated_row->highlight();
-              stop_flag = false;
-              return;
-            } else {
-              Helper::get_instance().log("Can't open " +
-                                         prev_list_item->get_filename() +
-                                         " as audio file.");
-            }
-          } else {  // if no previous row
-            auto last_list_item = dynamic_cast<PlaylistRow *>(
-                listbox->get_row_at_index(n_children - 1));  // get last
-            if (last_list_item) {
-              Helper::get_instance().log("Prev song: " +
-                                         last_list_item->get_filename());
-              if (m_player.open_audio(
-                      last_list_item->get_filename())) {  // open last
-                if (m_player.get_is_playing())
-                  m_player.play_audio();  // play last
-                if (m_activated_row) m_activated_row->stop_highlight();
-                m_current_track = last_list_item->get_index();
-                m_activated_row = last_list_item;
-                m_activated_row->highlight();
-                stop_flag = false;
-                return;
-              } else {
-                Helper::get_instance().log("Can't open " +
-                                           last_list_item->get_filename() +
-                                           " as audio file.");
-              }
-            }
-            return;
-          }
-        }
-      }
-      Helper::get_instance().log("No song picked at all.");
-    }
+    if (m_player.previous_track()) stop_flag = false;
     return;
   }
 #endif
@@ -462,99 +435,7 @@ void PlayerWindow::on_next_clicked() {
 #ifdef SUPPORT_AUDIO_OUTPUT
   if (m_player.get_current_player_name() == "Local") {  // if local player
     Helper::get_instance().log("Next clicked");
-    auto listbox =
-        dynamic_cast<Gtk::ListBox *>(m_playlist_scrolled_window->get_child()
-                                         ->get_first_child());  // get listbox
-    if (listbox) {
-      int n_children =
-          listbox->observe_children()->get_n_items();  // get count of rows
-      if (m_player.get_shuffle()) {                    // if shuffle enabled
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> dis(0, n_children - 1);
-        int new_track_index = dis(gen);
-        while (m_current_track == new_track_index) {  // generate new song
-          new_track_index = dis(gen);
-        }
-        m_current_track = new_track_index;
-        auto listitem = dynamic_cast<PlaylistRow *>(
-            listbox->get_row_at_index(m_current_track));  // get random song
-        if (m_activated_row)  // update highlightning
-          m_activated_row->stop_highlight();
-        m_activated_row = listitem;
-        m_activated_row->highlight();
-        if (m_player.open_audio(
-                m_activated_row->get_filename())) {  // open new song
-          if (m_player.get_is_playing())
-            m_player.play_audio();  // and play if played before
-        } else {
-          Helper::get_instance().log("Can't open " +
-                                     m_activated_row->get_filename() +
-                                     " as audio file.");
-        }
-      } else {  // if shuffle disabled
-        for (int i = 0; i < n_children; i++) {
-          auto listitem =
-              dynamic_cast<PlaylistRow *>(listbox->get_row_at_index(i));
-          if (listitem == m_activated_row) {  // find current song row
-            Helper::get_instance().log("Current song: " +
-                                       listitem->get_filename());
-            auto next_list_item = dynamic_cast<PlaylistRow *>(
-                listbox->get_row_at_index(i + 1));  // go to next
-            if (m_player.get_repeat() == 1 &&
-                !next_list_item) {  // repeat playlist if it's last song
-              next_list_item =
-                  dynamic_cast<PlaylistRow *>(listbox->get_row_at_index(0));
-            }
-            if (next_list_item) {  // if found next song
-              Helper::get_instance().log("Next song: " +
-                                         next_list_item->get_filename());
-              if (m_player.open_audio(
-                      next_list_item->get_filename())) {  // open it
-                if (m_player.get_is_playing()) m_player.play_audio();  // play
-                if (m_activated_row)  // change highlight
-                  m_activated_row->stop_highlight();
-                m_activated_row = next_list_item;
-                m_activated_row->highlight();
-                m_current_track =
-                    m_activated_row->get_index();  // change m_current_track
-                stop_flag = false;
-                return;
-              } else {
-                Helper::get_instance().log("Can't open " +
-                                           next_list_item->get_filename() +
-                                           " as audio file.");
-              }
-            } else {  // if current song is last
-              auto last_list_item = dynamic_cast<PlaylistRow *>(
-                  listbox->get_row_at_index(0));  // go to the last
-              if (last_list_item) {
-                Helper::get_instance().log("Next song: " +
-                                           last_list_item->get_filename());
-                if (m_player.open_audio(
-                        last_list_item->get_filename())) {  // open last
-                  if (m_player.get_is_playing())
-                    m_player.play_audio();  // play last
-                  if (m_activated_row)      // update highlightning
-                    m_activated_row->stop_highlight();
-                  m_activated_row = last_list_item;
-                  m_activated_row->highlight();
-                  m_current_track = m_activated_row->get_index();
-                  stop_flag = false;
-                  return;
-                } else {
-                  Helper::get_instance().log("Can't open " +
-                                             last_list_item->get_filename() +
-                                             " as audio file.");
-                }
-                return;
-              }
-            }
-          }
-        }
-      }
-      Helper::get_instance().log("No song picked at all.");
-    }
+    if (m_player.next_track()) stop_flag = false;
     return;
   }
 #endif
@@ -621,6 +502,10 @@ void PlayerWindow::on_player_choosed(unsigned short player_index) {
         "shuffle-enabled");  // or remove if disabled
   }
   check_buttons_features();  // check what buttons must be accessible
+  update_rate_button();      // every player has own rate
+#ifdef SUPPORT_AUDIO_OUTPUT
+  update_waveform();  // only local player has waveform
+#endif
   bool is_playing = m_player.get_playback_status();  // get is playing
   if (!is_playing) {                                 // if not playing
     m_playpause_button.set_icon_name(
@@ -668,6 +553,7 @@ void PlayerWindow::on_player_choosed(unsigned short player_index) {
   } else {                                 // if player not local
     m_add_song_to_playlist_button.hide();  // hide playlist add button
     m_playlist_scrolled_window->hide();    // hide playlist
+    m_search_bar.set_search_mode(false);
     m_main_grid.set_valign(Gtk::Align::END);
     set_default_size(500, 100);  // set smallest size
     if (m_conn_accept.connected()) {
@@ -764,6 +650,20 @@ void PlayerWindow::on_loop_clicked() {
   }
 }
 
+void PlayerWindow::on_rate_clicked() {
+  m_rate_popover.set_parent(m_rate_button);  // set parent for popover
+  m_lock_rate_changing = true;  // show rate of player without setting it
+  m_rate_scale.set_value(m_player.get_rate());
+  m_lock_rate_changing = false;
+  m_rate_popover.popup();  // show popover
+}
+
+void PlayerWindow::update_rate_button() {
+  std::ostringstream label;
+  label << std::fixed << std::setprecision(2) << m_player.get_rate() << "x";
+  m_rate_button.set_label(label.str());
+}
+
 void PlayerWindow::check_buttons_features() {
   // just set buttons sensitivitly whether button method is available in player
   if (m_player.get_play_pause_method()) {
@@ -923,6 +823,29 @@ void PlayerWindow::stop_position_thread() {
   }
 }
 
+void PlayerWindow::bind_playlist_row(Gtk::ListItem &list_item) {
+  auto item = std::dynamic_pointer_cast<PlaylistItem>(list_item.get_item());
+  auto row = dynamic_cast<PlaylistRow *>(list_item.get_child());
+  if (!item || !row) return;
+#ifdef SUPPORT_AUDIO_OUTPUT
+  // found tracks keep index, in whole playlist it is position
+  int index = item->m_index >= 0 ? item->m_index
+                                 : (int)list_item.get_position();
+  PlaylistTrack track;
+  if (m_player.get_playlist().get(index, track)) {
+    row->set_track(track.title, track.artist,
+                   Helper::get_instance().format_time(track.duration),
+                   track.filename);
+  }
+#endif
+  item->m_row = row;  // so highlight can be changed while bound
+  if (item == m_highlighted_item) {
+    row->highlight();
+  } else {
+    row->stop_highlight();  // row may be recycled from current track
+  }
+}
+
 #ifdef SUPPORT_AUDIO_OUTPUT
 
 gboolean PlayerWindow::on_signal_accept(const std::shared_ptr<Gdk::Drop> &) {
@@ -941,9 +864,9 @@ gboolean PlayerWindow::on_signal_drop(const Glib::ValueBase &value, double,
                              Gio::FileQueryInfoFlags::NONE);
 
     if (file_info == Gio::FileType::DIRECTORY) {  // if dropped directory
-      // Add all files recursively
-      add_directory_files_to_playlist(file_path);
-      set_cursor();  // set cursor to default after added files to playlist
+      // Add all files recursively in background, rows appear in batches
+      m_player.import_to_playlist(file_path);
+      set_cursor();
       return true;
     } else {                            // if dropped file
       add_song_to_playlist(file_path);  // just add file
@@ -959,108 +882,163 @@ void PlayerWindow::on_signal_leave() {
   set_cursor();  // change cursor to default
 }
 
-void PlayerWindow::add_directory_files_to_playlist(
-    const std::string &directory_path) {
-  auto file = Gio::File::create_for_path(directory_path);  // get file
-  auto enumerator = file->enumerate_children();  // if it have children
-  while (auto info = enumerator->next_file()) {  // get while not got all
-    auto child_file = file->get_child(info->get_name());  // get child file
-    auto child_info = child_file->query_file_type(
-        Gio::FileQueryInfoFlags::NONE);            // get child info
-    if (child_info == Gio::FileType::DIRECTORY) {  // if child info is directory
-      add_directory_files_to_playlist(
-          child_file->get_path());               // call the same function
-    } else {                                     // if file
-      auto child_path = child_file->get_path();  // get path
-      Helper::get_instance().log("File: " + child_path);
-      add_song_to_playlist(child_path);  // and add this to playlist
-    }
-  }
-}
-
 void PlayerWindow::add_song_to_playlist(const std::string &filename) {
-  Mix_Music *music = Mix_LoadMUS(filename.c_str());  // load music from filename
-  if (!music) {                                      // if cannot load
-    Helper::get_instance().log("Mix_LoadMUS failed: " +
-                               std::string(Mix_GetError()));
+  if (PlaylistFile::get_format(filename) != PlaylistFile::FORMAT_UNKNOWN) {
+    m_player.load_playlist(filename);  // m3u or xspf, adds all its tracks
     return;
   }
-  std::string song_title = Mix_GetMusicTitle(music);       // get title
-  std::string song_artist = Mix_GetMusicArtistTag(music);  // get artist
-  std::string song_length = Helper::get_instance().format_time(
-      Mix_MusicDuration(music));  // get song length
+  m_player.add_to_playlist(filename);  // row appears on playlist change
+}
 
-  m_playlist_listbox.append(*Gtk::make_managed<PlaylistRow>(
-      song_title, song_artist, song_length, filename));  // create row
+void PlayerWindow::on_playlist_changed(const int &position, const int &removed,
+                                       const int &added) {
+  // may be called from worker or watcher thread, so update in GTK main loop
+  g_idle_add(
+      [](gpointer data) -> gboolean {
+        auto change = static_cast<std::tuple<int, int, int> *>(data);
+        if (s_instance)
+          s_instance->update_playlist_view(std::get<0>(*change),
+                                           std::get<1>(*change),
+                                           std::get<2>(*change));
+        delete change;
+        return false;
+      },
+      new std::tuple<int, int, int>(position, removed, added));
 }
 
-void PlayerWindow::on_music_ends() {
-  Helper::get_instance().log("On music ends");
-  if (m_current_track == -1) {
-    Helper::get_instance().log("WARNING: m_current_track is unitialized.");
-    m_current_track = 0;
+void PlayerWindow::update_playlist_view(int position, int removed,
+                                        int added) {
+  // changes come in the same order as they were made in playlist
+  const int count = m_playlist_store->get_n_items();
+  position = std::min(position, count);
+  removed = std::min(removed, count - position);
+  std::vector<Glib::RefPtr<PlaylistItem>> items;
+  items.reserve(added);
+  for (int i = 0; i < added; i++) items.push_back(PlaylistItem::create());
+  // one update for whole batch, rows are created only when visible
+  m_playlist_store->splice(position, removed, items);
+  // rows could be bound while this change waited in main loop, when
+  // positions in store pointed to other tracks of playlist
+  for (Gtk::ListItem *list_item : m_bound_items)
+    bind_playlist_row(*list_item);
+  if (m_filtered) {
+    update_search();  // found tracks could change or move
+    return;
   }
+  update_current_row();  // index of current track could move
+}
 
-  auto listbox =
-      dynamic_cast<Gtk::ListBox *>(m_playlist_scrolled_window->get_child()
-                                       ->get_first_child());  // get playlist
-  int n_children = 0;
-  if (listbox) {
-    n_children =
-        listbox->observe_children()->get_n_items();  // get size of playlist
-  }
-  if (m_player.get_repeat() == 2) {  // if repeat current song enabled
-    m_player.play_audio();           // just play again
+void PlayerWindow::update_search() {
+  const std::string query = m_search_entry.get_text();
+  if (query.empty()) {  // whole playlist again
+    m_filtered = false;
+    m_search_results.clear();
+    m_search_store->remove_all();
+    m_playlist_view.set_model(m_playlist_model);
+    update_current_row();
     return;
   }
-  if (m_player.get_shuffle()) {  // if shuffle
-    // Generate random number from 0 to n_children-1
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(0, n_children - 1);
-    int new_track_index = dis(gen);
-    while (m_current_track == new_track_index) {  // generate new number
-      new_track_index = dis(gen);
-    }
-    m_current_track = new_track_index;  // set index
-  } else {                              // if not shufflle
-    m_current_track++;                  // just go to the next
+  size_t total;
+  m_search_results = m_player.search_playlist(query, 0, 0, total);
+  std::vector<Glib::RefPtr<PlaylistItem>> items;
+  items.reserve(m_search_results.size());
+  for (int index : m_search_results)
+    items.push_back(PlaylistItem::create(index));
+  m_search_store->splice(0, m_search_store->get_n_items(), items);
+  if (!m_filtered) {
+    m_filtered = true;
+    m_playlist_view.set_model(m_search_model);
   }
-  m_activated_row->stop_highlight();
-  auto next_list_item =
-      dynamic_cast<PlaylistRow *>(listbox->get_row_at_index(m_current_track));
-  if (!next_list_item) {               // if no next song
-    if (m_player.get_repeat() == 1) {  // if need to repeat playlist
-      m_current_track = 0;             // go to the first
-      auto first_list_item = dynamic_cast<PlaylistRow *>(
-          listbox->get_row_at_index(m_current_track));  // get first
-      if (first_list_item) {                            // if first present
-        m_activated_row = first_list_item;
-        m_activated_row->highlight();  // highlight
-        if (m_player.open_audio(first_list_item->get_filename())) {
-          m_player.play_audio();  // and play
-        } else {
-          Helper::get_instance().log("Can't open " +
-                                     first_list_item->get_filename() +
-                                     " as audio file.");
+  update_current_row();
+}
+
+void PlayerWindow::on_import_progress(const ImportProgress &progress) {
+  if (progress.finished) {
+    Helper::get_instance().log(
+        std::string(progress.cancelled ? "Import cancelled: " : "Imported ") +
+        std::to_string(progress.added) + " of " +
+        std::to_string(progress.probed) + " files.");
+    m_add_song_to_playlist_button.set_icon_name("add");
+    m_add_song_to_playlist_button.set_tooltip_text("");
+    return;
+  }
+  // while importing, add button cancels import
+  m_add_song_to_playlist_button.set_icon_name("process-stop");
+  m_add_song_to_playlist_button.set_tooltip_text(
+      "Importing: " + std::to_string(progress.probed) + " of " +
+      std::to_string(progress.found) + " files. Click to cancel.");
+}
+
+void PlayerWindow::on_import_progress_static(const ImportProgress &progress) {
+  // called from worker thread, so handle it in GTK main loop
+  g_idle_add(
+      [](gpointer data) -> gboolean {
+        auto progress = static_cast<ImportProgress *>(data);
+        if (s_instance) s_instance->on_import_progress(*progress);
+        delete progress;
+        return false;
+      },
+      new ImportProgress(progress));
+}
+
+void PlayerWindow::on_music_ends(bool advanced) {
+  Helper::get_instance().log("On music ends");
+  m_player.on_audio_ended(advanced);  // playlist decides what goes next
+}
+
+void PlayerWindow::on_current_track_changed(const int &new_track_index) {
+  // may be called from decoder or socket thread, so update in GTK main loop
+  g_idle_add(
+      [](gpointer) -> gboolean {
+        if (s_instance) {
+          s_instance->update_current_row();
+          s_instance->update_waveform();  // cached one is shown at once
         }
-      }
-    } else {  // if no repeat playlist disabled, just turn off music
-      Mix_HaltMusic();
-    }
-  } else {  // if there is next
-    m_activated_row = next_list_item;
-    m_activated_row->highlight();  // highlight
-    if (m_player.open_audio(next_list_item->get_filename())) {
-      m_player.play_audio();  // play
-    } else {
-      Helper::get_instance().log(
-          "Can't open " + next_list_item->get_filename() + " as audio file.");
-    }
+        return false;
+      },
+      nullptr);
+}
+
+void PlayerWindow::update_current_row() {
+  // only rows on screen exist, others are highlighted when bound
+  if (m_highlighted_item && m_highlighted_item->m_row)
+    m_highlighted_item->m_row->stop_highlight();
+  int current = m_player.get_playlist().get_current();
+  m_highlighted_item = nullptr;
+  if (m_filtered) {  // current track is shown only if it was found
+    auto found = std::lower_bound(m_search_results.begin(),
+                                  m_search_results.end(), current);
+    if (found != m_search_results.end() && *found == current)
+      m_highlighted_item =
+          m_search_store->get_item(found - m_search_results.begin());
+  } else if (current >= 0) {
+    m_highlighted_item = m_playlist_store->get_item(current);
   }
+  if (m_highlighted_item && m_highlighted_item->m_row)
+    m_highlighted_item->m_row->highlight();
 }
 
-void PlayerWindow::on_music_ends_static() {
-  if (s_instance) s_instance->on_music_ends();
+void PlayerWindow::on_music_ends_static(bool advanced) {
+  // called from decoder thread, so handle it in GTK main loop
+  g_idle_add(
+      [](gpointer data) -> gboolean {
+        if (s_instance) s_instance->on_music_ends(GPOINTER_TO_INT(data));
+        return false;
+      },
+      GINT_TO_POINTER(advanced));
+}
+
+void PlayerWindow::update_waveform() {
+  m_progress_bar_song_scale.set_waveform(m_player.get_waveform());
+}
+
+void PlayerWindow::on_waveform_ready_static(const std::string &filename) {
+  // called from worker thread, so handle it in GTK main loop
+  g_idle_add(
+      [](gpointer) -> gboolean {
+        if (s_instance) s_instance->update_waveform();
+        return false;
+      },
+      nullptr);
 }
 #endif
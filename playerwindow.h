@@ -3,6 +3,7 @@
 
 // #include <gio/gfile.h>
 #include <fcntl.h>
+#include <giomm/liststore.h>
 #include <glib.h>
 #include <gtkmm/alertdialog.h>
 #include <gtkmm/application.h>
@@ -17,10 +18,15 @@
 #include <gtkmm/grid.h>
 #include <gtkmm/label.h>
 #include <gtkmm/listbox.h>
+#include <gtkmm/listview.h>
+#include <gtkmm/noselection.h>
 #include <gtkmm/popover.h>
 #include <gtkmm/scale.h>
 #include <gtkmm/scalebutton.h>
 #include <gtkmm/scrolledwindow.h>
+#include <gtkmm/searchbar.h>
+#include <gtkmm/searchentry.h>
+#include <gtkmm/signallistitemfactory.h>
 #include <gtkmm/togglebutton.h>
 #include <gtkmm/viewport.h>
 #include <netinet/in.h>
@@ -35,10 +41,12 @@
 #include <random>
 #include <thread>
 #include <tuple>
+#include <unordered_set>
 
 #include "player.h"
 #include "playlistrow.h"
 #include "volumebutton.h"
+#include "waveformscale.h"
 /**
 
 * A class representing the main window of the music player application
@@ -91,6 +99,9 @@ class PlayerWindow : public Gtk::ApplicationWindow, public PlayerObserver {
     Helper::get_instance().log("New song length PlayerWindow: " +
                                new_song_length);
     m_song_length_label.set_label(new_song_length);
+#ifdef SUPPORT_AUDIO_OUTPUT
+    update_waveform();  // length changes with track
+#endif
   }
   /**
    * Override method called when the current player's shuffle state changes
@@ -200,6 +211,7 @@ class PlayerWindow : public Gtk::ApplicationWindow, public PlayerObserver {
     } else {                                 // if changed player not local
       m_add_song_to_playlist_button.hide();  // hide playlist add button
       m_playlist_scrolled_window->hide();    // hide playlist
+      m_search_bar.set_search_mode(false);
       m_main_grid.set_valign(Gtk::Align::END);
       set_default_size(500, 100);  // set smallest size
       if (m_conn_accept.connected()) {
@@ -227,10 +239,63 @@ class PlayerWindow : public Gtk::ApplicationWindow, public PlayerObserver {
   void add_song_to_playlist(const std::string &filename);
   /**
    * Callback function, which called after current music ends
+   * @param advanced Whether queued next song already started playing
+   */
+  void on_music_ends(bool advanced);
+  static void on_music_ends_static(bool advanced);
+  /**
+   * Shows waveform of current track on progress bar, or plain progress bar if
+   * waveform is not ready or current player is not local
+   */
+  void update_waveform();
+  /**
+   * Callback function, which called from worker thread after waveform of file
+   * is computed
+   * @param filename Path to audio file (type: std::string)
+   */
+  static void on_waveform_ready_static(const std::string &filename);
+  /**
+   * Override method called when current track of local playlist changes
+   * Highlights row of new track.
+   * @param new_track_index Index of new track, -1 if none.
+   */
+  void on_current_track_changed(const int &new_track_index) override;
+  /**
+   * Moves highlight to row of current track of local playlist
+   */
+  void update_current_row();
+  /**
+   * Override method called when tracks of local playlist are removed, added
+   * or replaced. It may be called from any thread.
+   * @param position Index of first changed track.
+   * @param removed Count of removed tracks.
+   * @param added Count of tracks added in their place.
+   */
+  void on_playlist_changed(const int &position, const int &removed,
+                           const int &added) override;
+  /**
+   * Applies change of local playlist to playlist view
    */
-  void on_music_ends();
-  static void on_music_ends_static();
+  void update_playlist_view(int position, int removed, int added);
+  /**
+   * Filters playlist view by text of search entry, shows whole playlist
+   * when it is empty
+   */
+  void update_search();
+  /**
+   * Shows progress of import on add button
+   * @param progress State of import (type: ImportProgress)
+   */
+  void on_import_progress(const ImportProgress &progress);
+  static void on_import_progress_static(const ImportProgress &progress);
 #endif
+  /**
+   * Shows track of list item in its row. Rows are bound by position, which
+   * is valid only when all playlist changes are applied to store, so bound
+   * rows are shown again after each change.
+   * @param list_item Item of playlist view with row.
+   */
+  void bind_playlist_row(Gtk::ListItem &list_item);
 
  protected:
   Player m_player;  // Player object
@@ -239,33 +304,47 @@ class PlayerWindow : public Gtk::ApplicationWindow, public PlayerObserver {
    */
   void on_playpause_clicked(), on_prev_clicked(), on_next_clicked(),
       on_shuffle_clicked(), on_player_choose_clicked(),
-      on_device_choose_clicked(), on_loop_clicked();
+      on_device_choose_clicked(), on_loop_clicked(), on_rate_clicked();
   Gtk::Grid m_main_grid;  // Main UI Grid
   Gtk::Box m_control_buttons_box,
       m_volume_and_player_box;  // Box that contains buttons
   Gtk::Button m_playpause_button, m_prev_button, m_next_button,
       m_shuffle_button, m_player_choose_button, m_device_choose_button,
-      m_add_song_to_playlist_button, m_repeat_button;
+      m_add_song_to_playlist_button, m_repeat_button,
+      m_rate_button;  // shows playback rate, opens rate popover
   Gtk::Label m_song_title_label, m_song_artist_label, m_current_pos_label,
       m_song_length_label;
-  Gtk::Scale m_progress_bar_song_scale;  // Scale which contains progress bar
+  WaveformScale m_progress_bar_song_scale;  // progress bar with waveform
   /**
    * VolumeButton object, which creates button, that on click creates popup for
    * volume choosing
    */
   VolumeButton m_volume_bar_scale_button;
-  Gtk::Popover m_player_choose_popover,
-      m_device_choose_popover;  // Popover for choosing Player or Device
-  Gtk::ListBox m_song_title_list,
-      m_playlist_listbox;  // Listbox for title and artist or for playlist items
-  static PlaylistRow
-      *m_activated_row;  // Pointer to currently selected row in local player
+  Gtk::Popover m_player_choose_popover, m_device_choose_popover,
+      m_rate_popover;  // Popover for choosing Player, Device or rate
+  Gtk::Scale m_rate_scale;  // playback rate, from 0.5x to 3x
+  Gtk::ListBox m_song_title_list;  // Listbox for title and artist
+  Gtk::ListView m_playlist_view;   // playlist, creates only visible rows
+  Glib::RefPtr<Gio::ListStore<PlaylistItem>>
+      m_playlist_store;  // items of playlist view, one per track
+  Glib::RefPtr<PlaylistItem>
+      m_highlighted_item;  // item of current track in local player
+  Glib::RefPtr<Gtk::NoSelection> m_playlist_model,
+      m_search_model;  // whole playlist and tracks found by search
+  Glib::RefPtr<Gio::ListStore<PlaylistItem>>
+      m_search_store;  // items of found tracks, they keep track index
+  std::vector<int> m_search_results;  // indexes of found tracks, ascending
+  std::unordered_set<Gtk::ListItem *>
+      m_bound_items;  // list items with rows on screen
+  bool m_filtered = false;            // playlist view shows found tracks
+  Gtk::Box m_playlist_box;            // playlist with search bar below it
+  Gtk::SearchBar m_search_bar;        // appears when typing in playlist
+  Gtk::SearchEntry m_search_entry;
 
   std::atomic_bool stop_flag{false};  // Flag to signal thread to stop
   std::mutex m_mutex;                 // Mutex to protect shared resources
   std::thread m_position_thread;      // Thread for updating position
   bool m_wait = false;                // Whether there is need to suspend thread
-  static unsigned int m_current_track;  // current track index
   static Gtk::ScrolledWindow *m_playlist_scrolled_window;
 
  private:
@@ -290,7 +369,12 @@ class PlayerWindow : public Gtk::ApplicationWindow, public PlayerObserver {
    * we need to stop sending position_changed signal to DBus, because position
    * thread just got new pos and updated it
    */
-  bool m_lock_pos_changing = false, m_lock_volume_changing = false;
+  bool m_lock_pos_changing = false, m_lock_volume_changing = false,
+       m_lock_rate_changing = false;
+  /**
+   * Shows rate of current player on rate button
+   */
+  void update_rate_button();
   void update_position_thread();  // Thread function for updating position
   void pause_position_thread();   // Pause position thread function
   void resume_position_thread();  // Resume position thread function
@@ -302,9 +386,6 @@ class PlayerWindow : public Gtk::ApplicationWindow, public PlayerObserver {
   gboolean on_signal_drop(const Glib::ValueBase &value, double,
                           double);  // when file or folder dropped at window
   void on_signal_leave();           // when dropping canceled
-  void add_directory_files_to_playlist(
-      const std::string
-          &directory_path);  // at files at directory recursively to playlist
   sigc::connection m_conn_accept;               // connection for signal accept
   sigc::connection m_conn_drop;                 // connection for signal drop
   sigc::connection m_conn_leave;                // connection for signal leave
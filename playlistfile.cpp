@@ -0,0 +1,388 @@
+#include "playlistfile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+
+#include "helper.h"
+
+namespace {
+bool starts_with(std::string_view text, std::string_view prefix) {
+  return text.compare(0, prefix.size(), prefix) == 0;
+}
+
+std::string_view trim(std::string_view text) {
+  while (!text.empty() && std::isspace((unsigned char)text.front()))
+    text.remove_prefix(1);
+  while (!text.empty() && std::isspace((unsigned char)text.back()))
+    text.remove_suffix(1);
+  return text;
+}
+
+int hex_digit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// "%20" -> " ", broken escapes are kept as is
+std::string decode_uri(std::string_view uri) {
+  std::string result;
+  result.reserve(uri.size());
+  for (size_t i = 0; i < uri.size(); i++) {
+    int high, low;
+    if (uri[i] == '%' && i + 2 < uri.size() &&
+        (high = hex_digit(uri[i + 1])) >= 0 &&
+        (low = hex_digit(uri[i + 2])) >= 0) {
+      result += (char)(high * 16 + low);
+      i += 2;
+    } else {
+      result += uri[i];
+    }
+  }
+  return result;
+}
+
+std::string encode_uri(const std::string &path) {
+  static const char kHex[] = "0123456789ABCDEF";
+  std::string result;
+  result.reserve(path.size() + 16);
+  for (unsigned char c : path) {
+    if (std::isalnum(c) || std::strchr("/-_.~", c)) {
+      result += c;
+    } else {
+      result += '%';
+      result += kHex[c >> 4];
+      result += kHex[c & 15];
+    }
+  }
+  return result;
+}
+
+void append_utf8(std::string &text, unsigned long code) {
+  if (code < 0x80) {
+    text += (char)code;
+  } else if (code < 0x800) {
+    text += (char)(0xC0 | code >> 6);
+    text += (char)(0x80 | (code & 0x3F));
+  } else if (code < 0x10000) {
+    text += (char)(0xE0 | code >> 12);
+    text += (char)(0x80 | (code >> 6 & 0x3F));
+    text += (char)(0x80 | (code & 0x3F));
+  } else if (code < 0x110000) {
+    text += (char)(0xF0 | code >> 18);
+    text += (char)(0x80 | (code >> 12 & 0x3F));
+    text += (char)(0x80 | (code >> 6 & 0x3F));
+    text += (char)(0x80 | (code & 0x3F));
+  }
+}
+
+// text content of XML element: entities are replaced, CDATA is copied
+std::string decode_text(std::string_view text) {
+  if (text.find_first_of("&<") == std::string_view::npos)
+    return std::string(trim(text));  // usual case, nothing to decode
+  std::string result;
+  result.reserve(text.size());
+  for (size_t i = 0; i < text.size(); i++) {
+    if (starts_with(text.substr(i), "<![CDATA[")) {
+      size_t end = text.find("]]>", i + 9);
+      if (end == std::string_view::npos) end = text.size();
+      result.append(text.substr(i + 9, end - i - 9));
+      i = end + 2;
+      continue;
+    }
+    if (text[i] != '&') {
+      result += text[i];
+      continue;
+    }
+    size_t semicolon = text.find(';', i);
+    if (semicolon == std::string_view::npos) {
+      result += text[i];
+      continue;
+    }
+    std::string_view entity = text.substr(i + 1, semicolon - i - 1);
+    if (entity == "amp") result += '&';
+    else if (entity == "lt") result += '<';
+    else if (entity == "gt") result += '>';
+    else if (entity == "quot") result += '"';
+    else if (entity == "apos") result += '\'';
+    else if (starts_with(entity, "#x") || starts_with(entity, "#X"))
+      append_utf8(result,
+                  std::strtoul(std::string(entity.substr(2)).c_str(),
+                               nullptr, 16));
+    else if (starts_with(entity, "#"))
+      append_utf8(result, std::strtoul(std::string(entity.substr(1)).c_str(),
+                                       nullptr, 10));
+    else
+      result.append(text.substr(i, semicolon - i + 1));  // unknown, kept
+    i = semicolon;
+  }
+  return std::string(trim(result));
+}
+
+void append_escaped(std::string &out, const std::string &text) {
+  for (char c : text) {
+    switch (c) {
+      case '&': out += "&amp;"; break;
+      case '<': out += "&lt;"; break;
+      case '>': out += "&gt;"; break;
+      case '"': out += "&quot;"; break;
+      default: out += c;
+    }
+  }
+}
+
+// line of m3u can't contain line break
+std::string single_line(const std::string &text) {
+  std::string line = text;
+  std::replace(line.begin(), line.end(), '\n', ' ');
+  std::replace(line.begin(), line.end(), '\r', ' ');
+  return line;
+}
+}  // namespace
+
+PlaylistFile::Format PlaylistFile::get_format(const std::string &path) {
+  size_t dot = path.rfind('.');
+  if (dot == std::string::npos || path.find('/', dot) != std::string::npos)
+    return FORMAT_UNKNOWN;
+  std::string extension = path.substr(dot + 1);
+  for (auto &c : extension) c = std::tolower((unsigned char)c);
+  if (extension == "m3u" || extension == "m3u8") return FORMAT_M3U;
+  if (extension == "xspf") return FORMAT_XSPF;
+  return FORMAT_UNKNOWN;
+}
+
+bool PlaylistFile::load(const std::string &path,
+                        std::vector<PlaylistTrack> &tracks) {
+  Format format = get_format(path);
+  if (format == FORMAT_UNKNOWN) {
+    Helper::get_instance().log("Unknown playlist format of " + path);
+    return false;
+  }
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    Helper::get_instance().log("Can't open playlist " + path);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    ::close(fd);
+    return false;
+  }
+  if (st.st_size == 0) {  // empty playlist, nothing to map
+    ::close(fd);
+    return true;
+  }
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);  // mapping keeps file open
+  if (data == MAP_FAILED) {
+    Helper::get_instance().log("Can't map playlist " + path);
+    return false;
+  }
+  madvise(data, st.st_size, MADV_SEQUENTIAL);  // read once from start to end
+  size_t slash = path.rfind('/');
+  std::string directory =
+      slash == std::string::npos ? "." : path.substr(0, slash);
+  if (format == FORMAT_M3U)
+    parse_m3u(static_cast<const char *>(data), st.st_size, directory, tracks);
+  else
+    parse_xspf(static_cast<const char *>(data), st.st_size, directory, tracks);
+  munmap(data, st.st_size);
+  return true;
+}
+
+void PlaylistFile::parse_m3u(const char *data, size_t size,
+                             const std::string &directory,
+                             std::vector<PlaylistTrack> &tracks) {
+  const char *pos = data, *end = data + size;
+  if (size >= 3 && std::memcmp(data, "\xEF\xBB\xBF", 3) == 0)
+    pos += 3;  // byte order mark
+  PlaylistTrack track;  // info of #EXTINF line is for next entry
+  while (pos < end) {
+    const char *eol =
+        static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+    if (!eol) eol = end;
+    std::string_view line = trim(std::string_view(pos, eol - pos));
+    pos = eol == end ? end : eol + 1;
+    if (line.empty()) continue;
+    if (line[0] == '#') {
+      if (!starts_with(line, "#EXTINF:")) continue;  // other directives
+      // "#EXTINF:duration attributes,Artist - Title"
+      line.remove_prefix(8);
+      size_t comma = line.find(',');
+      track.duration =
+          std::max(0.0, std::strtod(std::string(line.substr(0, comma)).c_str(),
+                                    nullptr));
+      if (comma == std::string_view::npos) continue;
+      std::string_view name = line.substr(comma + 1);
+      size_t dash = name.find(" - ");
+      if (dash != std::string_view::npos) {
+        track.artist = trim(name.substr(0, dash));
+        track.title = trim(name.substr(dash + 3));
+      } else {
+        track.title = trim(name);
+      }
+      continue;
+    }
+    if (resolve(std::string(line), directory, track.filename))
+      tracks.push_back(std::move(track));
+    track = PlaylistTrack();
+  }
+}
+
+void PlaylistFile::parse_xspf(const char *data, size_t size,
+                              const std::string &directory,
+                              std::vector<PlaylistTrack> &tracks) {
+  const char *pos = data, *end = data + size;
+  int depth = 0;  // of elements inside track, 1 is track itself
+  PlaylistTrack track;
+  std::string_view element;   // last opened element
+  const char *text = nullptr;  // where its content starts
+  auto skip_to = [&](const char *from, std::string_view terminator) {
+    std::string_view rest(from, end - from);
+    size_t found = rest.find(terminator);
+    return found == std::string_view::npos ? end
+                                           : from + found + terminator.size();
+  };
+  while (pos < end) {
+    const char *tag =
+        static_cast<const char *>(std::memchr(pos, '<', end - pos));
+    if (!tag) break;
+    std::string_view rest(tag, end - tag);
+    if (starts_with(rest, "<!--")) {
+      pos = skip_to(tag, "-->");
+      continue;
+    }
+    if (starts_with(rest, "<![CDATA[")) {  // part of text, decoded later
+      pos = skip_to(tag, "]]>");
+      continue;
+    }
+    const char *close =
+        static_cast<const char *>(std::memchr(tag, '>', end - tag));
+    if (!close) break;
+    pos = close + 1;
+    if (rest.size() > 1 && (rest[1] == '?' || rest[1] == '!'))
+      continue;  // declaration or doctype
+    const bool closing = rest.size() > 1 && rest[1] == '/';
+    const char *name_start = tag + 1 + closing, *name_end = name_start;
+    while (name_end < close && !std::isspace((unsigned char)*name_end) &&
+           *name_end != '/')
+      name_end++;
+    std::string_view name(name_start, name_end - name_start);
+    if (!closing) {
+      const bool empty = close[-1] == '/';
+      if (depth == 0 && name == "track" && !empty) {
+        track = PlaylistTrack();
+        depth = 1;
+      } else if (depth > 0 && !empty) {
+        depth++;
+      }
+      element = name;
+      text = empty ? nullptr : close + 1;
+      continue;
+    }
+    if (depth == 1 && name == "track") {
+      if (!track.filename.empty()) tracks.push_back(std::move(track));
+    } else if (depth == 2 && text && name == element) {  // field of track
+      std::string value = decode_text(std::string_view(text, tag - text));
+      if (name == "location") {
+        if (track.filename.empty())  // first location which is local file
+          resolve(value, directory, track.filename);
+      } else if (name == "title") {
+        track.title = value;
+      } else if (name == "creator") {
+        track.artist = value;
+      } else if (name == "album") {
+        track.album = value;
+      } else if (name == "duration") {
+        track.duration = std::max(0.0, std::atof(value.c_str()) / 1000);
+      }
+    }
+    if (depth > 0) depth--;
+    text = nullptr;
+  }
+}
+
+bool PlaylistFile::resolve(std::string entry, const std::string &directory,
+                           std::string &filename) {
+  if (entry.empty()) return false;
+  if (starts_with(entry, "file://")) {
+    entry = decode_uri(std::string_view(entry).substr(7));
+    if (starts_with(entry, "localhost/")) entry.erase(0, 9);
+    if (entry.empty() || entry[0] != '/') return false;  // file of other host
+  } else if (entry.find("://") != std::string::npos) {
+    return false;  // stream, only local files can be played
+  } else if (entry[0] != '/') {
+    if (starts_with(entry, "./")) entry.erase(0, 2);
+    entry = directory + "/" + entry;  // relative to playlist
+  }
+  filename = std::move(entry);
+  return true;
+}
+
+bool PlaylistFile::save(const std::string &path,
+                        const std::vector<PlaylistTrack> &tracks) {
+  Format format = get_format(path);
+  if (format == FORMAT_UNKNOWN) {
+    Helper::get_instance().log("Unknown playlist format of " + path);
+    return false;
+  }
+  std::string out;
+  out.reserve(tracks.size() * 160);
+  if (format == FORMAT_M3U) {
+    out += "#EXTM3U\n";
+    for (const auto &track : tracks) {
+      out += "#EXTINF:" + std::to_string(std::lround(track.duration)) + ",";
+      if (!track.artist.empty()) out += single_line(track.artist) + " - ";
+      out += single_line(track.title) + "\n";
+      out += track.filename + "\n";
+    }
+  } else {
+    out +=
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<playlist version=\"1\" xmlns=\"http://xspf.org/ns/0/\">\n"
+        "  <trackList>\n";
+    for (const auto &track : tracks) {
+      out += "    <track>\n      <location>file://";
+      append_escaped(out, encode_uri(track.filename));
+      out += "</location>\n";
+      auto append_field = [&out](const char *name, const std::string &value) {
+        if (value.empty()) return;
+        out += std::string("      <") + name + ">";
+        append_escaped(out, value);
+        out += std::string("</") + name + ">\n";
+      };
+      append_field("title", track.title);
+      append_field("creator", track.artist);
+      append_field("album", track.album);
+      if (track.duration > 0)
+        append_field("duration",
+                     std::to_string(std::llround(track.duration * 1000)));
+      out += "    </track>\n";
+    }
+    out += "  </trackList>\n</playlist>\n";
+  }
+  std::string temp_path = path + ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      Helper::get_instance().log("Can't write " + temp_path);
+      return false;
+    }
+    file.write(out.data(), out.size());
+    if (!file) return false;
+  }
+  // replace old file at once, so it is never half-written
+  return std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
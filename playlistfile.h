@@ -0,0 +1,60 @@
+#ifndef PLAYLISTFILE_H
+#define PLAYLISTFILE_H
+
+#include <string>
+#include <vector>
+
+#include "playlistmodel.h"
+
+/**
+ * Reads and writes playlist files in M3U/M3U8 and XSPF formats. File is
+ * memory mapped and scanned once without building document tree, so
+ * playlist of 100k entries is parsed in milliseconds. Only local files are
+ * read, remote URLs are skipped. Title, artist and duration stored in
+ * playlist are kept in loaded tracks, so they can be shown for files which
+ * are not probed.
+ */
+class PlaylistFile {
+ public:
+  enum Format { FORMAT_UNKNOWN, FORMAT_M3U, FORMAT_XSPF };
+
+  /**
+   * Gets format of playlist file by its extension
+   * @param path - path to playlist file (type: std::string)
+   * @return format, FORMAT_UNKNOWN if it is not playlist (type: Format)
+   */
+  static Format get_format(const std::string &path);
+  /**
+   * Reads entries of playlist. Relative paths are resolved against directory
+   * of playlist, "file://" URIs are decoded.
+   * @param path - path to playlist file (type: std::string)
+   * @param tracks - vector to append entries, only filename, title, artist,
+   * album and duration are filled (type: std::vector<PlaylistTrack>)
+   * @return false if file can't be read or format is unknown (type: bool)
+   */
+  static bool load(const std::string &path, std::vector<PlaylistTrack> &tracks);
+  /**
+   * Writes playlist, format is chosen by extension of path
+   * @param path - path to playlist file (type: std::string)
+   * @param tracks - tracks to save (type: std::vector<PlaylistTrack>)
+   * @return true on success, false otherwise (type: bool)
+   */
+  static bool save(const std::string &path,
+                   const std::vector<PlaylistTrack> &tracks);
+
+ private:
+  static void parse_m3u(const char *data, size_t size,
+                        const std::string &directory,
+                        std::vector<PlaylistTrack> &tracks);
+  static void parse_xspf(const char *data, size_t size,
+                         const std::string &directory,
+                         std::vector<PlaylistTrack> &tracks);
+  /**
+   * Turns playlist entry into absolute path
+   * @return false if entry is not local file (type: bool)
+   */
+  static bool resolve(std::string entry, const std::string &directory,
+                      std::string &filename);
+};
+
+#endif  // PLAYLISTFILE_H
@@ -0,0 +1,226 @@
+#include "playlistimporter.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include "helper.h"
+#include "playlistfile.h"
+
+PlaylistImporter::PlaylistImporter(ProbeFunction probe, BatchFunction on_batch,
+                                   size_t threads)
+    : m_probe(std::move(probe)),
+      m_on_batch(std::move(on_batch)),
+      m_pool(threads) {}
+
+PlaylistImporter::~PlaylistImporter() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_generation++;  // queued tasks return at once
+    m_running = false;
+  }
+  m_pool.wait();
+}
+
+void PlaylistImporter::add(const std::string &path) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_running) {  // new import
+    m_running = true;
+    m_progress = ImportProgress();
+  }
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+    submit([this, path](uint64_t generation) { walk(path, generation); },
+           m_generation);
+  } else {
+    m_progress.found++;
+    std::vector<std::string> files{path};
+    submit([this, files](uint64_t generation) { probe(files, generation); },
+           m_generation);
+  }
+}
+
+void PlaylistImporter::add_playlist(const std::string &path) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_running) {  // new import
+    m_running = true;
+    m_progress = ImportProgress();
+  }
+  submit([this, path](uint64_t generation) { read_playlist(path, generation); },
+         m_generation);
+}
+
+void PlaylistImporter::cancel() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (!m_running) return;
+  m_generation++;
+  m_tasks = 0;
+  m_running = false;
+  m_tracks.clear();
+  m_outbox.clear();
+  m_progress.finished = true;
+  m_progress.cancelled = true;
+  deliver(lock);  // empty batch
+}
+
+bool PlaylistImporter::is_running() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_running;
+}
+
+void PlaylistImporter::submit(std::function<void(uint64_t)> task,
+                              uint64_t generation) {
+  // called with m_mutex locked
+  m_tasks++;
+  m_pool.submit([this, task, generation] {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (generation != m_generation) return;  // import was cancelled
+    }
+    task(generation);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (generation != m_generation || --m_tasks != 0) return;
+    m_running = false;  // it was last task of import
+    m_progress.finished = true;
+    deliver(lock);
+  });
+}
+
+void PlaylistImporter::walk(const std::string &directory, uint64_t generation) {
+  DIR *dir = opendir(directory.c_str());
+  if (!dir) {
+    Helper::get_instance().log("Can't open directory " + directory);
+    return;
+  }
+  std::vector<std::string> files, directories;
+  while (dirent *entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name == "." || name == "..") continue;
+    std::string path = directory + "/" + name;
+    unsigned char type = entry->d_type;
+    if (type == DT_UNKNOWN || type == DT_LNK) {
+      struct stat st;
+      if (stat(path.c_str(), &st) != 0) continue;  // broken link
+      if (S_ISDIR(st.st_mode)) {
+        // linked directories are skipped, they may form loops
+        if (type == DT_UNKNOWN) directories.push_back(path);
+      } else if (S_ISREG(st.st_mode)) {
+        files.push_back(path);
+      }
+    } else if (type == DT_DIR) {
+      directories.push_back(path);
+    } else if (type == DT_REG) {
+      files.push_back(path);
+    }
+  }
+  closedir(dir);
+  std::sort(files.begin(), files.end());
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (generation != m_generation) return;
+  m_progress.found += files.size();
+  for (const std::string &path : directories)
+    submit([this, path](uint64_t generation) { walk(path, generation); },
+           generation);
+  for (size_t i = 0; i < files.size(); i += kChunkSize) {
+    std::vector<std::string> chunk(
+        files.begin() + i, files.begin() + std::min(files.size(), i + kChunkSize));
+    submit([this, chunk](uint64_t generation) { probe(chunk, generation); },
+           generation);
+  }
+}
+
+void PlaylistImporter::probe(const std::vector<std::string> &files,
+                             uint64_t generation) {
+  std::vector<PlaylistTrack> tracks;
+  tracks.reserve(files.size());
+  size_t probed = 0;
+  for (const std::string &file : files) {
+    if (probed % 8 == 0) {  // stop soon after cancel
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (generation != m_generation) return;
+    }
+    PlaylistTrack track;
+    track.filename = file;
+    if (m_probe(file, track)) tracks.push_back(std::move(track));
+    probed++;
+  }
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (generation != m_generation) return;
+  m_progress.probed += probed;
+  m_progress.added += tracks.size();
+  m_tracks.insert(m_tracks.end(), std::make_move_iterator(tracks.begin()),
+                  std::make_move_iterator(tracks.end()));
+  if (m_tracks.size() >= kBatchSize) deliver(lock);
+}
+
+void PlaylistImporter::read_playlist(const std::string &path,
+                                     uint64_t generation) {
+  std::vector<PlaylistTrack> entries;
+  if (!PlaylistFile::load(path, entries)) return;
+  auto job = std::make_shared<PlaylistJob>();
+  for (size_t i = 0; i < entries.size(); i += kChunkSize)
+    job->chunks.emplace_back(
+        std::make_move_iterator(entries.begin() + i),
+        std::make_move_iterator(
+            entries.begin() + std::min(entries.size(), i + kChunkSize)));
+  job->probed.resize(job->chunks.size(), false);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (generation != m_generation) return;
+  m_progress.found += entries.size();
+  for (size_t i = 0; i < job->chunks.size(); i++)
+    submit([this, job, i](uint64_t generation) {
+             probe_entries(job, i, generation);
+           },
+           generation);
+}
+
+void PlaylistImporter::probe_entries(std::shared_ptr<PlaylistJob> job,
+                                     size_t chunk, uint64_t generation) {
+  std::vector<PlaylistTrack> tracks;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (generation != m_generation) return;
+    tracks.swap(job->chunks[chunk]);
+  }
+  for (size_t i = 0; i < tracks.size(); i++) {
+    if (i % 8 == 0) {  // stop soon after cancel
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (generation != m_generation) return;
+    }
+    PlaylistTrack track;
+    track.filename = tracks[i].filename;
+    // entry which can't be probed keeps what playlist says about it
+    if (m_probe(track.filename, track)) tracks[i] = std::move(track);
+  }
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (generation != m_generation) return;
+  m_progress.probed += tracks.size();
+  m_progress.added += tracks.size();  // every entry stays in playlist
+  job->chunks[chunk] = std::move(tracks);
+  job->probed[chunk] = true;
+  // pass on chunks, which are not waiting for previous ones anymore
+  while (job->next < job->chunks.size() && job->probed[job->next]) {
+    auto &ready = job->chunks[job->next++];
+    m_tracks.insert(m_tracks.end(), std::make_move_iterator(ready.begin()),
+                    std::make_move_iterator(ready.end()));
+    std::vector<PlaylistTrack>().swap(ready);
+  }
+  if (m_tracks.size() >= kBatchSize) deliver(lock);
+}
+
+void PlaylistImporter::deliver(std::unique_lock<std::mutex> &lock) {
+  m_outbox.emplace_back(std::move(m_tracks), m_progress);
+  m_tracks.clear();
+  if (m_delivering) return;  // that thread delivers this batch after its own
+  m_delivering = true;
+  while (!m_outbox.empty()) {
+    auto batch = std::move(m_outbox.front());
+    m_outbox.pop_front();
+    lock.unlock();
+    m_on_batch(std::move(batch.first), batch.second);
+    lock.lock();
+  }
+  m_delivering = false;
+}
@@ -0,0 +1,132 @@
+#ifndef PLAYLISTIMPORTER_H
+#define PLAYLISTIMPORTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "playlistmodel.h"
+#include "threadpool.h"
+
+/**
+ * State of import, delivered with every batch
+ */
+struct ImportProgress {
+  size_t found = 0;     // files found in directories so far
+  size_t probed = 0;    // files already probed
+  size_t added = 0;     // audio files among probed ones
+  bool finished = false;   // last batch of import
+  bool cancelled = false;  // import was cancelled, batch is empty
+};
+
+/**
+ * Imports files and directories into playlist on work-stealing pool.
+ * Every directory is listed by its own task, which queues tasks for its
+ * subdirectories and for chunks of its files, so big trees are walked and
+ * probed on all cores at once. Probed tracks are collected and delivered
+ * in batches, so receiver does not wake up for every file. Tracks of one
+ * chunk keep directory order, chunks themselves may arrive in any order.
+ * Entries of playlist files are probed the same way, but delivered in order
+ * of playlist.
+ */
+class PlaylistImporter {
+ public:
+  static constexpr size_t kChunkSize = 32;   // files probed by one task
+  static constexpr size_t kBatchSize = 256;  // tracks delivered at once
+
+  /**
+   * Reads title, artist and duration of file
+   * @return false if file is not audio file
+   */
+  using ProbeFunction =
+      std::function<bool(const std::string &, PlaylistTrack &)>;
+  /**
+   * Receives batch of tracks. Called from one thread at a time, in order of
+   * batches, with importer unlocked, so slow receiver doesn't stop workers.
+   */
+  using BatchFunction = std::function<void(std::vector<PlaylistTrack> &&,
+                                           const ImportProgress &)>;
+
+  /**
+   * @param probe - function which reads file metadata (type: ProbeFunction)
+   * @param on_batch - function which receives tracks (type: BatchFunction)
+   * @param threads - count of workers, 0 means one per core (type: size_t)
+   */
+  PlaylistImporter(ProbeFunction probe, BatchFunction on_batch,
+                   size_t threads = 0);
+  /**
+   * Cancels import and waits for running tasks
+   */
+  ~PlaylistImporter();
+  /**
+   * Starts importing file or directory. When import is running already,
+   * path joins it.
+   * @param path - path to audio file or directory (type: std::string)
+   */
+  void add(const std::string &path);
+  /**
+   * Starts importing entries of M3U/M3U8 or XSPF playlist, in its order.
+   * Entries which can't be probed, e.g. files on unmounted drive, are kept
+   * with title, artist and duration stored in playlist.
+   * @param path - path to playlist file (type: std::string)
+   */
+  void add_playlist(const std::string &path);
+  /**
+   * Drops not delivered tracks and queued files, delivers empty cancelled
+   * batch
+   */
+  void cancel();
+  bool is_running();
+  /**
+   * Waits until import is finished
+   */
+  void wait() { m_pool.wait(); }
+
+ private:
+  /**
+   * Lists directory, queues its subdirectories and chunks of its files
+   */
+  void walk(const std::string &directory, uint64_t generation);
+  void probe(const std::vector<std::string> &files, uint64_t generation);
+  /**
+   * Entries of one playlist, chunks are probed in any order and passed on
+   * in order of playlist, guarded by m_mutex
+   */
+  struct PlaylistJob {
+    std::vector<std::vector<PlaylistTrack>> chunks;
+    std::vector<bool> probed;
+    size_t next = 0;  // first chunk not passed on
+  };
+  void read_playlist(const std::string &path, uint64_t generation);
+  void probe_entries(std::shared_ptr<PlaylistJob> job, size_t chunk,
+                     uint64_t generation);
+  /**
+   * Queues task of current import
+   */
+  void submit(std::function<void(uint64_t)> task, uint64_t generation);
+  /**
+   * Queues collected tracks for delivering. Called with m_mutex locked,
+   * unlocks it while receiver runs, if no other thread delivers already.
+   */
+  void deliver(std::unique_lock<std::mutex> &lock);
+
+  ProbeFunction m_probe;
+  BatchFunction m_on_batch;
+  std::mutex m_mutex;  // guards everything below
+  uint64_t m_generation = 0;  // increased by cancel, old tasks do nothing
+  size_t m_tasks = 0;         // tasks of current import queued or running
+  bool m_running = false;
+  ImportProgress m_progress;
+  std::vector<PlaylistTrack> m_tracks;  // probed, not delivered yet
+  // batches waiting for receiver, which is busy with previous one
+  std::deque<std::pair<std::vector<PlaylistTrack>, ImportProgress>> m_outbox;
+  bool m_delivering = false;  // some thread runs receiver now
+  ThreadPool m_pool;  // last, so workers stop before members are destroyed
+};
+
+#endif  // PLAYLISTIMPORTER_H
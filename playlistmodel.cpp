@@ -0,0 +1,247 @@
+#include "playlistmodel.h"
+
+#include <algorithm>
+#include <numeric>
+
+int PlaylistModel::add(const PlaylistTrack &track) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_tracks.push_back(track);
+  const int index = m_tracks.size() - 1;
+  if (m_shuffled) append_shuffled(index);
+  return index;
+}
+
+int PlaylistModel::add(const std::vector<PlaylistTrack> &tracks) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  int first = m_tracks.size();
+  m_tracks.insert(m_tracks.end(), tracks.begin(), tracks.end());
+  if (m_shuffled)
+    for (int index = first; index < (int)m_tracks.size(); index++)
+      append_shuffled(index);
+  return first;
+}
+
+void PlaylistModel::remove(int first, int count) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const int size = m_tracks.size();
+  if (first < 0 || count <= 0 || first >= size) return;
+  count = std::min(count, size - first);
+  m_tracks.erase(m_tracks.begin() + first, m_tracks.begin() + first + count);
+  auto shift = [first, count](int &index) {
+    if (index >= first + count)
+      index -= count;
+    else if (index >= first)
+      index = -1;  // removed
+  };
+  shift(m_current);
+  shift(m_next);
+  if (!m_shuffled) return;
+  // drop removed tracks from permutations, cursor stays at last played track
+  auto filter = [first, count](std::vector<int> &order, int &cursor) {
+    int kept = 0, place = -1;
+    for (int i = 0; i < (int)order.size(); i++) {
+      const int index = order[i];
+      if (index >= first && index < first + count) continue;
+      if (i <= cursor) place = kept;
+      order[kept++] = index >= first + count ? index - count : index;
+    }
+    order.resize(kept);
+    cursor = place;
+  };
+  filter(m_order, m_cursor);
+  int unused = -1;
+  filter(m_next_order, unused);
+  m_positions.resize(m_order.size());
+  update_positions(0, m_order.size() - 1);
+}
+
+bool PlaylistModel::set(int index, const PlaylistTrack &track) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (index < 0 || index >= (int)m_tracks.size()) return false;
+  m_tracks[index] = track;
+  return true;
+}
+
+std::vector<int> PlaylistModel::find_if(
+    const std::function<bool(const PlaylistTrack &)> &match) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<int> indexes;
+  for (size_t i = 0; i < m_tracks.size(); i++)
+    if (match(m_tracks[i])) indexes.push_back(i);
+  return indexes;
+}
+
+void PlaylistModel::clear() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_tracks.clear();
+  m_current = m_next = -1;
+  update_order(false);
+}
+
+int PlaylistModel::size() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_tracks.size();
+}
+
+bool PlaylistModel::get(int index, PlaylistTrack &track) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (index < 0 || index >= (int)m_tracks.size()) return false;
+  track = m_tracks[index];
+  return true;
+}
+
+int PlaylistModel::get_current() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_current;
+}
+
+void PlaylistModel::set_current(int index) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_current = index >= 0 && index < (int)m_tracks.size() ? index : -1;
+  const bool epoch_chosen = m_epoch_chosen;
+  m_epoch_chosen = false;
+  if (!m_shuffled || m_current == -1) return;
+  const int count = m_order.size();
+  if (m_cursor >= 0 && m_order[m_cursor] == index) return;  // played again
+  // checked before step back: first track of next epoch is often previous
+  // track of this one, as only current track is avoided
+  if (epoch_chosen && m_cursor == count - 1 && !m_next_order.empty() &&
+      m_next_order[0] == index) {  // next epoch starts
+    m_order.swap(m_next_order);
+    m_next_order.clear();
+    update_positions(0, count - 1);
+    m_cursor = 0;
+    return;
+  }
+  if (m_cursor + 1 < count && m_order[m_cursor + 1] == index) {
+    m_cursor++;
+    return;
+  }
+  if (m_cursor > 0 && m_order[m_cursor - 1] == index) {
+    m_cursor--;
+    return;
+  }
+  // chosen by user: it becomes current, played tracks stay in history and
+  // unplayed ones are still played in this epoch
+  const int place = m_positions[index];
+  if (place <= m_cursor) {
+    std::rotate(m_order.begin() + place, m_order.begin() + place + 1,
+                m_order.begin() + m_cursor + 1);
+    update_positions(place, m_cursor);
+  } else {
+    std::rotate(m_order.begin() + m_cursor + 1, m_order.begin() + place,
+                m_order.begin() + place + 1);
+    m_cursor++;
+    update_positions(m_cursor, place);
+  }
+}
+
+int PlaylistModel::get_next() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_next;
+}
+
+void PlaylistModel::set_next(int index) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_next = index >= 0 && index < (int)m_tracks.size() ? index : -1;
+}
+
+int PlaylistModel::choose_next(int repeat, bool shuffle) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  update_order(shuffle);
+  const int count = m_tracks.size();
+  if (count == 0 || m_current == -1) return -1;
+  if (repeat == 2) return m_current;  // play current track again
+  if (shuffle) {
+    if (m_cursor + 1 < count) return m_order[m_cursor + 1];
+    return repeat == 1 ? peek_next_epoch() : -1;
+  }
+  if (m_current + 1 < count) return m_current + 1;
+  return repeat == 1 ? 0 : -1;  // first one if whole playlist is repeated
+}
+
+int PlaylistModel::choose_skip(bool shuffle) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  update_order(shuffle);
+  const int count = m_tracks.size();
+  if (count == 0 || m_current == -1) return -1;
+  if (shuffle)
+    return m_cursor + 1 < count ? m_order[m_cursor + 1] : peek_next_epoch();
+  return (m_current + 1) % count;
+}
+
+int PlaylistModel::choose_previous(bool shuffle) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  update_order(shuffle);
+  const int count = m_tracks.size();
+  if (count == 0 || m_current == -1) return -1;
+  if (shuffle) {
+    m_epoch_chosen = false;  // going back, not to next epoch
+    return m_cursor > 0 ? m_order[m_cursor - 1] : m_current;
+  }
+  return (m_current + count - 1) % count;
+}
+
+void PlaylistModel::update_order(bool shuffle) {
+  if (shuffle == m_shuffled) return;
+  m_shuffled = shuffle;
+  m_next_order.clear();
+  m_epoch_chosen = false;
+  if (!shuffle) {  // list order, permutation is not needed anymore
+    m_order.clear();
+    m_positions.clear();
+    m_cursor = -1;
+    return;
+  }
+  m_order = shuffle_order(m_current, -1);  // epoch starts from current track
+  m_positions.resize(m_order.size());
+  update_positions(0, m_order.size() - 1);
+  m_cursor = m_current == -1 ? -1 : 0;
+}
+
+std::vector<int> PlaylistModel::shuffle_order(int first, int avoid) {
+  const int count = m_tracks.size();
+  std::vector<int> order(count);
+  std::iota(order.begin(), order.end(), 0);
+  int start = 0;
+  if (first >= 0 && first < count) {
+    std::swap(order[0], order[first]);
+    start = 1;
+  }
+  for (int i = count - 1; i > start; i--) {
+    std::uniform_int_distribution<int> place(start, i);
+    std::swap(order[i], order[place(m_random)]);
+  }
+  if (avoid >= 0 && count > 1 && order[0] == avoid) {
+    // otherwise same track would be played twice in a row between epochs
+    std::uniform_int_distribution<int> place(1, count - 1);
+    std::swap(order[0], order[place(m_random)]);
+  }
+  return order;
+}
+
+int PlaylistModel::peek_next_epoch() {
+  if (m_next_order.empty()) m_next_order = shuffle_order(-1, m_current);
+  m_epoch_chosen = !m_next_order.empty();
+  return m_next_order.empty() ? -1 : m_next_order[0];
+}
+
+void PlaylistModel::update_positions(int from, int to) {
+  for (int i = from; i <= to; i++) m_positions[m_order[i]] = i;
+}
+
+void PlaylistModel::append_shuffled(int index) {
+  m_order.push_back(index);
+  m_positions.push_back(m_order.size() - 1);
+  const int last = m_order.size() - 1;
+  std::uniform_int_distribution<int> place(m_cursor + 1, last);
+  const int swapped = place(m_random);
+  std::swap(m_order[swapped], m_order[last]);
+  update_positions(swapped, swapped);
+  update_positions(last, last);
+  if (m_next_order.empty()) return;
+  // first track of next epoch may be queued already, so it stays first
+  m_next_order.push_back(index);
+  std::uniform_int_distribution<int> next_place(1, m_next_order.size() - 1);
+  std::swap(m_next_order[next_place(m_random)], m_next_order.back());
+}
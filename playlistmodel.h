@@ -0,0 +1,152 @@
+#ifndef PLAYLISTMODEL_H
+#define PLAYLISTMODEL_H
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Track of local playlist
+ */
+struct PlaylistTrack {
+  std::string filename, title, artist, album;
+  double duration = 0;  // seconds
+  int sample_rate = 0, channels = 0;
+  bool has_replaygain = false;  // gain and peak are read from tags
+  float replaygain_gain = 0;    // track gain, dB
+  float replaygain_peak = 0;    // track peak, linear
+  uint64_t art_hash = 0;        // hash of embedded cover, 0 if none
+  int64_t mtime = 0, size = 0;  // of file when it was probed
+};
+
+/**
+ * Local playlist: tracks in play order and index of current one. Choosing
+ * next or previous track is arithmetic on indexes, so it does not depend on
+ * how playlist is shown. In shuffle mode tracks are played in permutation,
+ * which is shuffled once per epoch, so no track repeats until all others are
+ * played, and previous track is previously played one. Thread safe.
+ */
+class PlaylistModel {
+ public:
+  /**
+   * Appends track to the end of playlist
+   * @param track - track to add (type: PlaylistTrack)
+   * @return index of added track (type: int)
+   */
+  int add(const PlaylistTrack &track);
+  /**
+   * Appends tracks to the end of playlist
+   * @param tracks - tracks to add (type: std::vector<PlaylistTrack>)
+   * @return index of first added track (type: int)
+   */
+  int add(const std::vector<PlaylistTrack> &tracks);
+  /**
+   * Removes tracks, following tracks move back. Current and next track keep
+   * pointing to the same tracks, or become -1 if they are removed.
+   * @param first - index of first removed track (type: int)
+   * @param count - count of removed tracks (type: int)
+   */
+  void remove(int first, int count);
+  /**
+   * Replaces track, e.g. after file changed
+   * @return false if index is out of range (type: bool)
+   */
+  bool set(int index, const PlaylistTrack &track);
+  /**
+   * Finds tracks by condition
+   * @param match - condition, called with model locked, so it must not call
+   * model (type: std::function<bool(const PlaylistTrack &)>)
+   * @return indexes of matching tracks, ascending (type: std::vector<int>)
+   */
+  std::vector<int> find_if(
+      const std::function<bool(const PlaylistTrack &)> &match) const;
+  /**
+   * Removes all tracks, there is no current track after it
+   */
+  void clear();
+  int size() const;
+  /**
+   * Gets copy of track
+   * @param index - index of track (type: int)
+   * @param track - struct to save track (type: PlaylistTrack)
+   * @return false if index is out of range (type: bool)
+   */
+  bool get(int index, PlaylistTrack &track) const;
+  /**
+   * Index of track which is played now, -1 if none
+   */
+  int get_current() const;
+  void set_current(int index);
+  /**
+   * Index of track which is queued after current one, -1 if none
+   */
+  int get_next() const;
+  void set_next(int index);
+  /**
+   * Chooses track which is played when current one ends. With whole
+   * playlist repeated new shuffle epoch starts after last track of permutation.
+   * @param repeat - 0 none, 1 whole playlist, 2 current track (type: int)
+   * @param shuffle - whether to follow shuffled permutation (type: bool)
+   * @return index of track or -1 if playback must stop (type: int)
+   */
+  int choose_next(int repeat, bool shuffle);
+  /**
+   * Chooses track for "next" command, after last track goes first one
+   * @param shuffle - whether to follow shuffled permutation (type: bool)
+   * @return index of track or -1 if there is no current track (type: int)
+   */
+  int choose_skip(bool shuffle);
+  /**
+   * Chooses track for "previous" command, before first track goes last one.
+   * In shuffle mode it is previously played track, or current one at the
+   * start of epoch.
+   * @param shuffle - whether to follow shuffled permutation (type: bool)
+   * @return index of track or -1 if there is no current track (type: int)
+   */
+  int choose_previous(bool shuffle);
+
+ private:
+  /**
+   * Starts shuffle mode or leaves it, m_mutex must be locked
+   */
+  void update_order(bool shuffle);
+  /**
+   * Shuffles all tracks into new epoch by Fisher-Yates, m_mutex must be locked
+   * @param first - track which must be first, -1 for any (type: int)
+   * @param avoid - track which must not be first, -1 for none (type: int)
+   */
+  std::vector<int> shuffle_order(int first, int avoid);
+  /**
+   * First track of next epoch, which is shuffled on first call. Marks it as
+   * chosen, so set_current starts new epoch with it.
+   */
+  int peek_next_epoch();
+  /**
+   * Updates m_positions for part of m_order
+   */
+  void update_positions(int from, int to);
+  /**
+   * Inserts appended track into random unplayed place of order, it is one
+   * step of inside-out Fisher-Yates, so order stays uniformly shuffled
+   * @param index - index of appended track (type: int)
+   */
+  void append_shuffled(int index);
+
+  mutable std::mutex m_mutex;
+  std::vector<PlaylistTrack> m_tracks;
+  int m_current = -1, m_next = -1;
+  std::mt19937 m_random{std::random_device{}()};
+  bool m_shuffled = false;       // m_order is valid
+  std::vector<int> m_order;      // play order of tracks in this epoch
+  std::vector<int> m_positions;  // place of every track in m_order
+  int m_cursor = -1;             // place of current track in m_order
+  std::vector<int> m_next_order;  // next epoch, empty until it is needed
+  // first track of next epoch was chosen as next, so set_current of it
+  // starts new epoch, not step back to same track in this one
+  bool m_epoch_chosen = false;
+};
+
+#endif  // PLAYLISTMODEL_H
@@ -1,28 +1,55 @@
 #ifndef PLAYLISTROW_H
 #define PLAYLISTROW_H
 
+#include <glibmm/object.h>
 #include <gtkmm/box.h>
 #include <gtkmm/cssprovider.h>
 #include <gtkmm/grid.h>
 #include <gtkmm/label.h>
-#include <gtkmm/listboxrow.h>
 
-class PlaylistRow : public Gtk::ListBoxRow {
+class PlaylistRow;
+
+/**
+ * Item of playlist list model. It keeps no track data, position of item is
+ * index of track in PlaylistModel, so model of huge playlist stays small.
+ * Items of filtered playlist keep index of track, as positions differ there.
+ */
+class PlaylistItem : public Glib::Object {
+public:
+  static Glib::RefPtr<PlaylistItem> create(int index = -1);
+  PlaylistRow *m_row = nullptr; // row widget, which shows item now, if any
+  int m_index = -1;             // index of track, -1 if it is position
+
+protected:
+  PlaylistItem() = default;
+};
+
+/**
+ * Row widget of playlist view. List view creates only rows which fit on
+ * screen and binds them to different items while scrolling.
+ */
+class PlaylistRow : public Gtk::Grid {
 public:
-  const std::string m_filename; // file name for row item
+  PlaylistRow();
   /**
-   * Constructor with parameters
+   * Shows track in row
    * @param artist - song author (type: std::string)
    * @param title - song title (type: std::string)
    * @param duration - song duration in formated string (type: std::string)
    * @param filename - song file path (type: std::string)
    */
-  PlaylistRow(const std::string &artist, const std::string &title,
-              const std::string &duration, const std::string &filename);
+  void set_track(const std::string &artist, const std::string &title,
+                 const std::string &duration, const std::string &filename);
   Gtk::Label *label_artist_title;          // label with artist and title
+  Gtk::Label *label_duration;              // label with song duration
   void highlight();                        // highlight text with accent color
   void stop_highlight();                   // disable highlight
-  const std::string &get_filename() const; // get file path
+
+private:
+  /**
+   * Css provider with .highlight class, shared by all rows
+   */
+  static Glib::RefPtr<Gtk::CssProvider> get_css_provider();
 };
 
 #endif // PLAYLISTROW_H
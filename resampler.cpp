@@ -0,0 +1,185 @@
+#include "resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "helper.h"
+#include "samplekernels.h"
+
+namespace {
+const uint64_t kMaxPhases = 2048;  // bigger ratios are approximated
+const size_t kCompactFrames = 8192;  // consumed input kept before erasing
+
+struct FilterParams {
+  size_t taps;
+  double rolloff;  // cutoff relative to Nyquist of lower rate
+  double beta;     // Kaiser window shape, bigger is deeper stopband
+};
+
+FilterParams filter_params(Resampler::Quality quality) {
+  switch (quality) {
+    case Resampler::QUALITY_FAST:
+      return {16, 0.80, 5.0};
+    case Resampler::QUALITY_HIGH:
+      return {64, 0.92, 10.0};
+    case Resampler::QUALITY_MEDIUM:
+    default:
+      return {32, 0.88, 8.0};
+  }
+}
+
+// modified Bessel function of first kind, order zero
+double bessel_i0(double x) {
+  double sum = 1, term = 1;
+  for (int k = 1; k < 50; k++) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+    if (term < sum * 1e-12) break;
+  }
+  return sum;
+}
+}  // namespace
+
+void Resampler::setup(int in_rate, int out_rate, int channels,
+                      Quality quality) {
+  m_in_rate = in_rate;
+  m_out_rate = out_rate;
+  m_channels = channels;
+  m_quality = quality;
+  uint64_t divisor = std::gcd(in_rate, out_rate);
+  m_up = out_rate / divisor;
+  m_down = in_rate / divisor;
+  if (m_up > kMaxPhases) {  // odd rates, use nearest ratio with less phases
+    m_down = std::llround((double)in_rate * kMaxPhases / out_rate);
+    m_up = kMaxPhases;
+    divisor = std::gcd(m_up, m_down);
+    m_up /= divisor;
+    m_down /= divisor;
+    Helper::get_instance().log("Resampler: approximating " +
+                               std::to_string(in_rate) + " -> " +
+                               std::to_string(out_rate) + " Hz ratio");
+  }
+  if (is_passthrough()) {
+    m_taps = 1;
+    m_filter.assign(1, 1.0f);
+  } else {
+    build_filter();
+  }
+  m_input.assign(channels, {});
+  m_planes.resize(channels);
+  reset();
+}
+
+void Resampler::build_filter() {
+  FilterParams params = filter_params(m_quality);
+  m_taps = params.taps;
+  // cutoff in cycles per input sample, below Nyquist of lower rate
+  double cutoff =
+      0.5 * params.rolloff * std::min(1.0, (double)m_up / m_down);
+  double half = m_taps / 2.0;
+  double window_norm = bessel_i0(params.beta);
+  m_filter.resize(m_up * m_taps);
+  for (uint64_t phase = 0; phase < m_up; phase++) {
+    float *coeffs = m_filter.data() + phase * m_taps;
+    double sum = 0;
+    for (size_t i = 0; i < m_taps; i++) {
+      // distance between output time and input sample i of window
+      double t = half - 1 - (double)i + (double)phase / m_up;
+      double x = t / half;
+      double window =
+          std::abs(x) >= 1
+              ? 0
+              : bessel_i0(params.beta * std::sqrt(1 - x * x)) / window_norm;
+      double arg = 2 * cutoff * t;
+      double sinc = arg == 0 ? 1 : std::sin(M_PI * arg) / (M_PI * arg);
+      double value = 2 * cutoff * sinc * window;
+      coeffs[i] = value;
+      sum += value;
+    }
+    for (size_t i = 0; i < m_taps; i++)
+      coeffs[i] /= sum;  // unity gain for every phase, no DC ripple
+  }
+}
+
+void Resampler::reset(const float *history, size_t frames) {
+  size_t prefill = history_frames();
+  size_t count = std::min(frames, prefill);
+  if (history)
+    history += (frames - count) * m_channels;  // only last frames are used
+  else
+    count = 0;
+  for (int channel = 0; channel < m_channels; channel++) {
+    std::vector<float> &input = m_input[channel];
+    input.assign(prefill, 0.0f);
+    for (size_t i = 0; i < count; i++)  // history goes right before new input
+      input[prefill - count + i] = history[i * m_channels + channel];
+  }
+  m_pos = 0;
+  m_phase = 0;
+  m_draining = false;
+  m_end = 0;
+}
+
+void Resampler::push(const float *in, size_t frames) {
+  if (m_channels == 0 || frames == 0) return;
+  for (int channel = 0; channel < m_channels; channel++) {
+    std::vector<float> &input = m_input[channel];
+    size_t size = input.size();
+    input.resize(size + frames);
+    m_planes[channel] = input.data() + size;
+  }
+  get_sample_kernels().deinterleave(in, m_planes.data(), frames, m_channels);
+}
+
+void Resampler::drain() {
+  if (m_channels == 0 || m_draining) return;
+  m_draining = true;
+  m_end = m_input[0].size();
+  for (auto &input : m_input)  // zeros for lookahead of last outputs
+    input.resize(input.size() + m_taps - history_frames());
+}
+
+size_t Resampler::pull(float *out, size_t frames) {
+  if (m_channels == 0) return 0;
+  const SampleKernels &kernels = get_sample_kernels();
+  const size_t lookahead = history_frames();
+  size_t produced = 0;
+  while (produced < frames) {
+    if (m_pos + m_taps > m_input[0].size()) break;        // need more input
+    if (m_draining && m_pos + lookahead >= m_end) break;  // all input used
+    float *frame = out + produced * m_channels;
+    if (m_taps == 1) {
+      for (int channel = 0; channel < m_channels; channel++)
+        frame[channel] = m_input[channel][m_pos];
+    } else {
+      const float *coeffs = m_filter.data() + m_phase * m_taps;
+      for (int channel = 0; channel < m_channels; channel++)
+        frame[channel] =
+            kernels.dot(coeffs, m_input[channel].data() + m_pos, m_taps);
+    }
+    produced++;
+    m_phase += m_down;
+    m_pos += m_phase / m_up;
+    m_phase %= m_up;
+  }
+  compact();
+  return produced;
+}
+
+uint64_t Resampler::pending_output() const {
+  if (m_channels == 0) return 0;
+  size_t end = m_draining ? m_end : m_input[0].size();
+  // times in 1/L of input frame
+  uint64_t now = (uint64_t)(m_pos + history_frames()) * m_up + m_phase;
+  uint64_t end_time = (uint64_t)end * m_up;
+  if (end_time <= now) return 0;
+  return (end_time - now + m_down - 1) / m_down;
+}
+
+void Resampler::compact() {
+  if (m_pos < kCompactFrames) return;
+  for (auto &input : m_input) input.erase(input.begin(), input.begin() + m_pos);
+  if (m_draining) m_end -= m_pos;
+  m_pos = 0;
+}
@@ -0,0 +1,91 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Streaming polyphase resampler for interleaved float audio.
+ * Rate ratio is reduced to L/M, input is (virtually) upsampled by L,
+ * filtered by Kaiser windowed sinc and downsampled by M, computing only
+ * outputs which are needed. Output is aligned with input, first output frame
+ * is at time of first input frame. Audio can be pushed in any portions,
+ * filter history is kept between them, so consecutive tracks with same rate
+ * are joined without discontinuity.
+ */
+class Resampler {
+ public:
+  enum Quality {
+    QUALITY_FAST = 0,    // 16 taps, ~60 dB stopband
+    QUALITY_MEDIUM = 1,  // 32 taps, ~85 dB stopband
+    QUALITY_HIGH = 2,    // 64 taps, ~110 dB stopband
+  };
+
+  /**
+   * Prepares resampler for new rates and drops all buffered audio
+   * @param in_rate - sample rate of input (type: int)
+   * @param out_rate - sample rate of output (type: int)
+   * @param channels - channels count (type: int)
+   * @param quality - filter length and steepness (type: Quality)
+   */
+  void setup(int in_rate, int out_rate, int channels, Quality quality);
+  /**
+   * Drops buffered audio, so new stream starts, e.g. after seek
+   * @param history - interleaved frames right before new stream position,
+   * filter starts from them instead of silence, may be nullptr
+   * @param frames - count of history frames (type: size_t)
+   */
+  void reset(const float *history = nullptr, size_t frames = 0);
+  /**
+   * Appends input frames
+   * @param in - interleaved frames (type: float *)
+   * @param frames - count of frames (type: size_t)
+   */
+  void push(const float *in, size_t frames);
+  /**
+   * Marks end of input, so last frames, which wait for filter lookahead, can
+   * be pulled
+   */
+  void drain();
+  /**
+   * Takes resampled frames
+   * @param out - buffer for interleaved frames (type: float *)
+   * @param frames - maximal count of frames (type: size_t)
+   * @return count of frames written
+   */
+  size_t pull(float *out, size_t frames);
+  /**
+   * Gets count of output frames, which pushed input will still produce.
+   * Next pushed frame appears in output right after them.
+   */
+  uint64_t pending_output() const;
+  /**
+   * Count of input frames needed before first output, filter lookahead
+   */
+  size_t history_frames() const { return m_taps > 1 ? m_taps / 2 - 1 : 0; }
+
+  int get_in_rate() const { return m_in_rate; }
+  int get_out_rate() const { return m_out_rate; }
+  Quality get_quality() const { return m_quality; }
+  bool is_passthrough() const { return m_up == 1 && m_down == 1; }
+  bool is_draining() const { return m_draining; }
+
+ private:
+  void build_filter();
+  void compact();
+
+  int m_in_rate = 0, m_out_rate = 0, m_channels = 0;
+  Quality m_quality = QUALITY_MEDIUM;
+  uint64_t m_up = 1, m_down = 1;   // ratio L/M
+  size_t m_taps = 1;                // filter taps per phase
+  std::vector<float> m_filter;      // m_up phases, m_taps coefficients each
+  std::vector<std::vector<float>> m_input;  // planar input per channel
+  size_t m_pos = 0;         // index of first input of current filter window
+  uint64_t m_phase = 0;     // phase of current output, 0..m_up-1
+  bool m_draining = false;  // input ended, filter tail is padded by zeros
+  size_t m_end = 0;         // index of input end, valid when draining
+  std::vector<float *> m_planes;  // scratch for deinterleave
+};
+
+#endif  // RESAMPLER_H
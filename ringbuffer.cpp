@@ -0,0 +1,50 @@
+#include "ringbuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+void RingBuffer::resize(size_t capacity) {
+  size_t size = 1;
+  while (size < capacity) size <<= 1;
+  m_buffer.assign(size, 0.0f);
+  m_mask = size - 1;
+  clear();
+}
+
+size_t RingBuffer::write(const float *data, size_t count) {
+  size_t write_pos = m_write_pos.load(std::memory_order_relaxed);
+  size_t read_pos = m_read_pos.load(std::memory_order_acquire);
+  count = std::min(count, m_buffer.size() - (write_pos - read_pos));
+  size_t index = write_pos & m_mask;
+  size_t first = std::min(count, m_buffer.size() - index);  // till buffer end
+  std::memcpy(m_buffer.data() + index, data, first * sizeof(float));
+  std::memcpy(m_buffer.data(), data + first, (count - first) * sizeof(float));
+  m_write_pos.store(write_pos + count, std::memory_order_release);
+  return count;
+}
+
+size_t RingBuffer::read(float *data, size_t count) {
+  size_t read_pos = m_read_pos.load(std::memory_order_relaxed);
+  size_t write_pos = m_write_pos.load(std::memory_order_acquire);
+  count = std::min(count, write_pos - read_pos);
+  size_t index = read_pos & m_mask;
+  size_t first = std::min(count, m_buffer.size() - index);  // till buffer end
+  std::memcpy(data, m_buffer.data() + index, first * sizeof(float));
+  std::memcpy(data + first, m_buffer.data(), (count - first) * sizeof(float));
+  m_read_pos.store(read_pos + count, std::memory_order_release);
+  return count;
+}
+
+void RingBuffer::clear() {
+  m_write_pos.store(0, std::memory_order_relaxed);
+  m_read_pos.store(0, std::memory_order_relaxed);
+}
+
+size_t RingBuffer::read_available() const {
+  return m_write_pos.load(std::memory_order_acquire) -
+         m_read_pos.load(std::memory_order_acquire);
+}
+
+size_t RingBuffer::write_available() const {
+  return m_buffer.size() - read_available();
+}
@@ -0,0 +1,60 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Lock-free single-producer/single-consumer ring buffer of float samples.
+ * One thread may only write and one other thread may only read, neither of
+ * them ever blocks, so it is safe to read from audio callback.
+ */
+class RingBuffer {
+ public:
+  /**
+   * Allocates buffer. Not thread safe, must be called before buffer is used.
+   * @param capacity - minimal count of samples buffer can hold, rounded up to
+   * power of two (type: size_t)
+   */
+  void resize(size_t capacity);
+  /**
+   * Writes samples, called only by producer
+   * @param data - samples to write
+   * @param count - count of samples
+   * @return count of samples written, less than count if buffer is full
+   */
+  size_t write(const float *data, size_t count);
+  /**
+   * Reads samples, called only by consumer
+   * @param data - buffer to save samples
+   * @param count - count of samples needed
+   * @return count of samples read, less than count if buffer is empty
+   */
+  size_t read(float *data, size_t count);
+  /**
+   * Drops all samples. Neither producer nor consumer may use buffer while it
+   * is cleared.
+   */
+  void clear();
+  /**
+   * Gets count of samples which can be read now
+   */
+  size_t read_available() const;
+  /**
+   * Gets count of samples which can be written now
+   */
+  size_t write_available() const;
+  size_t capacity() const { return m_buffer.size(); }
+
+ private:
+  std::vector<float> m_buffer;
+  size_t m_mask = 0;  // capacity - 1, capacity is power of two
+  // positions only grow, index in buffer is position & m_mask. Kept on
+  // separate cache lines, so producer and consumer do not slow down each
+  // other.
+  alignas(64) std::atomic<size_t> m_write_pos{0};
+  alignas(64) std::atomic<size_t> m_read_pos{0};
+};
+
+#endif  // RINGBUFFER_H
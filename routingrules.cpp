@@ -0,0 +1,250 @@
+#include "routingrules.h"
+
+#include <algorithm>
+#include <cctype>
+
+#include "helper.h"
+
+namespace {
+// lowercases string for case insensitive comparing
+std::string to_lower(std::string str) {
+  std::transform(str.begin(), str.end(), str.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return str;
+}
+
+// removes spaces from both sides of string
+std::string trim(const std::string &str) {
+  size_t begin = str.find_first_not_of(" \t\r\n");
+  if (begin == std::string::npos) return "";
+  size_t end = str.find_last_not_of(" \t\r\n");
+  return str.substr(begin, end - begin + 1);
+}
+}  // namespace
+
+bool RoutingRules::parse(const std::string &text,
+                         std::vector<RoutingRule> &rules) {
+  rules.clear();
+  size_t start = 0;
+  while (start <= text.size()) {
+    size_t end = text.find_first_of(";\n", start);
+    if (end == std::string::npos) end = text.size();
+    std::string line = trim(text.substr(start, end - start));
+    start = end + 1;
+    if (line.empty()) continue;  // allow empty rules, e.g. "a->b;"
+
+    size_t arrow = line.find("->");
+    if (arrow == std::string::npos) {
+      Helper::get_instance().log("Routing rule \"" + line +
+                                 "\" has no \"->\", skipping all rules.");
+      return false;
+    }
+    RoutingRule rule;
+    rule.identity = trim(line.substr(0, arrow));
+    std::string sinks = line.substr(arrow + 2);
+    size_t sink_start = 0;
+    while (sink_start <= sinks.size()) {
+      size_t comma = sinks.find(',', sink_start);
+      if (comma == std::string::npos) comma = sinks.size();
+      std::string pattern = trim(sinks.substr(sink_start, comma - sink_start));
+      if (!pattern.empty()) rule.sinks.push_back(pattern);
+      sink_start = comma + 1;
+    }
+    if (rule.identity.empty() || rule.sinks.empty()) {
+      Helper::get_instance().log("Routing rule \"" + line +
+                                 "\" is incomplete, skipping all rules.");
+      return false;
+    }
+    rules.push_back(rule);
+  }
+  return true;
+}
+
+std::vector<RoutingMove> RoutingRules::set_rules(
+    std::vector<RoutingRule> rules) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_rules = std::move(rules);
+  std::vector<RoutingMove> moves;
+  for (auto &stream : m_streams) {  // rules changed, so check every stream
+    stream.rule = match_rule(stream);
+    stream.priority = -1;
+    evaluate_stream(stream, moves);
+  }
+  Helper::get_instance().log("Loaded " + std::to_string(m_rules.size()) +
+                             " routing rules.");
+  return moves;
+}
+
+std::string RoutingRules::to_string() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::string result;
+  for (const auto &rule : m_rules) {
+    if (!result.empty()) result += ";";
+    result += rule.identity + "->";
+    for (size_t i = 0; i < rule.sinks.size(); i++) {
+      if (i != 0) result += ",";
+      result += rule.sinks[i];
+    }
+  }
+  return result;
+}
+
+void RoutingRules::set_local_pid(uint32_t pid) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_local_pid = pid;
+}
+
+std::vector<RoutingMove> RoutingRules::on_sink_added(const RoutingSink &sink) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<RoutingMove> moves;
+  m_sinks.erase(std::remove_if(m_sinks.begin(), m_sinks.end(),
+                               [&](const RoutingSink &known) {
+                                 return known.id == sink.id;
+                               }),
+                m_sinks.end());
+  m_sinks.push_back(sink);
+  // only streams whose rule prefers this sink more than current one are moved
+  for (auto &stream : m_streams) {
+    if (stream.rule == -1) continue;
+    int priority = sink_priority(m_rules[stream.rule], sink);
+    if (priority == -1) continue;
+    if (stream.priority == -1 || priority < stream.priority) {
+      Helper::get_instance().log("Routing: sink \"" + sink.description +
+                                 "\" appeared, moving stream #" +
+                                 std::to_string(stream.id));
+      stream.priority = priority;
+      stream.sink = sink.id;
+      moves.push_back({stream.id, sink.id});
+    }
+  }
+  return moves;
+}
+
+std::vector<RoutingMove> RoutingRules::on_sink_removed(uint32_t sink_id) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<RoutingMove> moves;
+  m_sinks.erase(std::remove_if(m_sinks.begin(), m_sinks.end(),
+                               [&](const RoutingSink &known) {
+                                 return known.id == sink_id;
+                               }),
+                m_sinks.end());
+  // sound server moved streams of removed sink somewhere, route them to
+  // fallback
+  for (auto &stream : m_streams) {
+    if (stream.sink != sink_id) continue;
+    stream.sink = UINT32_MAX;
+    stream.priority = -1;
+    evaluate_stream(stream, moves);
+  }
+  return moves;
+}
+
+std::vector<RoutingMove> RoutingRules::on_stream_added(
+    const RoutingStream &stream) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<RoutingMove> moves;
+  m_streams.erase(std::remove_if(m_streams.begin(), m_streams.end(),
+                                 [&](const RoutingStream &known) {
+                                   return known.id == stream.id;
+                                 }),
+                  m_streams.end());
+  m_streams.push_back(stream);
+  RoutingStream &added = m_streams.back();
+  added.rule = match_rule(added);
+  added.priority = -1;
+  evaluate_stream(added, moves);
+  return moves;
+}
+
+std::vector<RoutingMove> RoutingRules::on_stream_changed(
+    const RoutingStream &stream) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto known = std::find_if(m_streams.begin(), m_streams.end(),
+                              [&](const RoutingStream &known) {
+                                return known.id == stream.id;
+                              });
+    if (known != m_streams.end()) {
+      std::vector<RoutingMove> moves;
+      known->sink = stream.sink;  // e.g. moved by user, so it is kept
+      if (known->app_name == stream.app_name &&
+          known->binary == stream.binary && known->pid == stream.pid)
+        return moves;
+      known->app_name = stream.app_name;
+      known->binary = stream.binary;
+      known->pid = stream.pid;
+      int rule = match_rule(*known);
+      if (rule != known->rule) {  // other player now, route by its rule
+        known->rule = rule;
+        known->priority = -1;
+        evaluate_stream(*known, moves);
+      }
+      return moves;
+    }
+  }
+  return on_stream_added(stream);
+}
+
+void RoutingRules::on_stream_removed(uint32_t stream_id) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_streams.erase(std::remove_if(m_streams.begin(), m_streams.end(),
+                                 [&](const RoutingStream &known) {
+                                   return known.id == stream_id;
+                                 }),
+                  m_streams.end());
+}
+
+void RoutingRules::clear_objects() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_sinks.clear();
+  m_streams.clear();
+}
+
+int RoutingRules::match_rule(const RoutingStream &stream) const {
+  std::string app_name = to_lower(stream.app_name);
+  std::string binary = to_lower(stream.binary);
+  for (size_t i = 0; i < m_rules.size(); i++) {
+    std::string identity = to_lower(m_rules[i].identity);
+    if (identity == "*" || identity == app_name || identity == binary)
+      return i;
+    if (identity == "local" && m_local_pid != 0 && stream.pid == m_local_pid)
+      return i;  // our own local player
+  }
+  return -1;
+}
+
+int RoutingRules::sink_priority(const RoutingRule &rule,
+                                const RoutingSink &sink) const {
+  std::string name = to_lower(sink.name);
+  std::string description = to_lower(sink.description);
+  for (size_t i = 0; i < rule.sinks.size(); i++) {
+    std::string pattern = to_lower(rule.sinks[i]);
+    if (name.find(pattern) != std::string::npos ||
+        description.find(pattern) != std::string::npos)
+      return i;
+  }
+  return -1;
+}
+
+void RoutingRules::evaluate_stream(RoutingStream &stream,
+                                   std::vector<RoutingMove> &moves) {
+  if (stream.rule == -1) return;  // no rule for this stream
+  const RoutingRule &rule = m_rules[stream.rule];
+  const RoutingSink *best = nullptr;
+  int best_priority = -1;
+  for (const auto &sink : m_sinks) {
+    int priority = sink_priority(rule, sink);
+    if (priority != -1 && (best_priority == -1 || priority < best_priority)) {
+      best = &sink;
+      best_priority = priority;
+    }
+  }
+  if (!best) return;  // none of rule sinks available, leave stream as is
+  stream.priority = best_priority;
+  if (stream.sink == best->id) return;  // already there
+  Helper::get_instance().log("Routing: stream #" + std::to_string(stream.id) +
+                             " (" + stream.app_name + ") to \"" +
+                             best->description + "\"");
+  stream.sink = best->id;
+  moves.push_back({stream.id, best->id});
+}
@@ -0,0 +1,141 @@
+#ifndef ROUTINGRULES_H
+#define ROUTINGRULES_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Rule, which describes to which output device streams of some player must be
+ * routed. Text form of rule is "identity->sink pattern,fallback pattern,...".
+ */
+struct RoutingRule {
+  /**
+   * Player identity (application name, process binary or "Local").
+   * "*" matches every stream.
+   */
+  std::string identity;
+  /**
+   * Sink patterns in priority order. First one is preferred sink, others are
+   * fallbacks. Pattern matches sink if it is a case insensitive substring of
+   * sink name or description.
+   */
+  std::vector<std::string> sinks;
+};
+
+/**
+ * Output device (sink) known to routing engine
+ */
+struct RoutingSink {
+  uint32_t id = 0;          // PulseAudio sink index or PipeWire node id
+  std::string name;         // sink name, e.g. "alsa_output.usb-..."
+  std::string description;  // human readable description
+};
+
+/**
+ * Player's audio stream known to routing engine
+ */
+struct RoutingStream {
+  uint32_t id = 0;          // PulseAudio sink input index or PipeWire node id
+  std::string app_name;     // application.name property
+  std::string binary;       // application.process.binary property
+  uint32_t pid = 0;         // application.process.id property
+  uint32_t sink = UINT32_MAX;  // sink to which stream is routed now
+  int rule = -1;            // index of rule which matched this stream
+  int priority = -1;        // index of sink pattern stream was routed by
+};
+
+/**
+ * Request to move stream to another sink, produced by routing engine
+ */
+struct RoutingMove {
+  uint32_t stream_id;
+  uint32_t sink_id;
+};
+
+/**
+ * Event-driven routing rules engine.
+ * It does not talk to sound server itself: backend feeds it with sink and
+ * stream appear/disappear events and executes returned moves. Every event
+ * re-evaluates only streams and rules affected by it.
+ */
+class RoutingRules {
+ public:
+  /**
+   * Parses rules from text form.
+   * Rules are separated by ';' or new line, every rule is
+   * "identity->sink,fallback,...".
+   * @param text - rules in text form (type: std::string)
+   * @param rules - vector to save parsed rules (type: std::vector<RoutingRule>)
+   * @return true on success, false if some rule is malformed (type: bool)
+   */
+  static bool parse(const std::string &text, std::vector<RoutingRule> &rules);
+  /**
+   * Replaces current rules and re-evaluates all known streams
+   * @param rules - new rules (type: std::vector<RoutingRule>)
+   * @return moves which must be executed by backend
+   */
+  std::vector<RoutingMove> set_rules(std::vector<RoutingRule> rules);
+  /**
+   * Gets current rules in text form
+   * @return rules in text form (type: std::string)
+   */
+  std::string to_string() const;
+  /**
+   * Sets process id of this process, so "Local" identity can be matched
+   * @param pid - process id (type: uint32_t)
+   */
+  void set_local_pid(uint32_t pid);
+  /**
+   * Called by backend when new sink appeared
+   * @return moves which must be executed by backend
+   */
+  std::vector<RoutingMove> on_sink_added(const RoutingSink &sink);
+  /**
+   * Called by backend when sink disappeared
+   * @return moves which must be executed by backend
+   */
+  std::vector<RoutingMove> on_sink_removed(uint32_t sink_id);
+  /**
+   * Called by backend when new stream appeared
+   * @return moves which must be executed by backend
+   */
+  std::vector<RoutingMove> on_stream_added(const RoutingStream &stream);
+  /**
+   * Called by backend when properties or sink of stream changed. Stream
+   * moved by user stays on its sink, unknown stream is handled as new one.
+   * @return moves which must be executed by backend
+   */
+  std::vector<RoutingMove> on_stream_changed(const RoutingStream &stream);
+  /**
+   * Called by backend when stream disappeared
+   */
+  void on_stream_removed(uint32_t stream_id);
+  /**
+   * Forgets all sinks and streams, for example when backend reconnects
+   */
+  void clear_objects();
+
+ private:
+  /**
+   * Returns index of first rule matching stream or -1
+   */
+  int match_rule(const RoutingStream &stream) const;
+  /**
+   * Returns priority of sink for rule (index of matched pattern) or -1
+   */
+  int sink_priority(const RoutingRule &rule, const RoutingSink &sink) const;
+  /**
+   * Routes single stream to best available sink of its rule
+   */
+  void evaluate_stream(RoutingStream &stream, std::vector<RoutingMove> &moves);
+
+  mutable std::mutex m_mutex;
+  std::vector<RoutingRule> m_rules;
+  std::vector<RoutingSink> m_sinks;
+  std::vector<RoutingStream> m_streams;
+  uint32_t m_local_pid = 0;
+};
+
+#endif  // ROUTINGRULES_H
@@ -0,0 +1,981 @@
+#include "samplekernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define KERNELS_X86
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+void init_dither(DitherState &state, uint32_t seed) {
+  if (seed == 0) seed = 0x9e3779b9;  // xorshift never leaves zero
+  for (int i = 0; i < 8; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    state.seed[i] = seed;
+  }
+}
+
+namespace {
+const float kS16Scale = 32768.0f;
+const float kS24Scale = 8388608.0f;
+const float kS32Scale = 2147483648.0f;
+const float kS32Max = 2147483520.0f;  // biggest float below 2^31
+
+// ---------------------------------------------------------------------------
+// scalar kernels, also used for tails of SIMD kernels
+// ---------------------------------------------------------------------------
+inline uint32_t next_random(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+// triangular noise in (-1, 1), difference of two uniform random numbers
+inline float tpdf(uint32_t &state) {
+  float first = (next_random(state) >> 8) * (1.0f / 16777216.0f);
+  float second = (next_random(state) >> 8) * (1.0f / 16777216.0f);
+  return first - second;
+}
+
+inline int32_t quantize(float value, float scale, float max, uint32_t &state) {
+  float v = value * scale + tpdf(state);
+  v = std::min(std::max(v, -scale), max);
+  return (int32_t)std::lrint(v);
+}
+
+inline void store_s24(uint8_t *dst, int32_t value) {
+  dst[0] = value & 0xff;
+  dst[1] = (value >> 8) & 0xff;
+  dst[2] = (value >> 16) & 0xff;
+}
+
+void float_to_s16_scalar(const float *src, int16_t *dst, size_t count,
+                         DitherState &dither) {
+  for (size_t i = 0; i < count; i++)
+    dst[i] = quantize(src[i], kS16Scale, kS16Scale - 1, dither.seed[0]);
+}
+
+void float_to_s24_scalar(const float *src, uint8_t *dst, size_t count,
+                         DitherState &dither) {
+  for (size_t i = 0; i < count; i++)
+    store_s24(dst + i * 3,
+              quantize(src[i], kS24Scale, kS24Scale - 1, dither.seed[0]));
+}
+
+void float_to_s32_scalar(const float *src, int32_t *dst, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    float v = std::min(std::max(src[i] * kS32Scale, -kS32Scale), kS32Max);
+    dst[i] = (int32_t)std::lrint(v);
+  }
+}
+
+void s16_to_float_scalar(const int16_t *src, float *dst, size_t count) {
+  for (size_t i = 0; i < count; i++) dst[i] = src[i] * (1.0f / kS16Scale);
+}
+
+void s24_to_float_scalar(const uint8_t *src, float *dst, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    uint32_t value = src[i * 3] | (src[i * 3 + 1] << 8) | (src[i * 3 + 2] << 16);
+    dst[i] = ((int32_t)(value << 8) >> 8) * (1.0f / kS24Scale);
+  }
+}
+
+void s32_to_float_scalar(const int32_t *src, float *dst, size_t count) {
+  for (size_t i = 0; i < count; i++) dst[i] = src[i] * (1.0f / kS32Scale);
+}
+
+void apply_gain_scalar(float *data, size_t frames, size_t channels, float from,
+                       float to) {
+  if (frames == 0) return;
+  float step = (to - from) / frames;
+  for (size_t frame = 0; frame < frames; frame++) {
+    float gain = from + step * frame;
+    for (size_t channel = 0; channel < channels; channel++)
+      data[frame * channels + channel] *= gain;
+  }
+}
+
+void interleave_scalar(const float *const *src, float *dst, size_t frames,
+                       size_t channels) {
+  for (size_t frame = 0; frame < frames; frame++)
+    for (size_t channel = 0; channel < channels; channel++)
+      dst[frame * channels + channel] = src[channel][frame];
+}
+
+void deinterleave_scalar(const float *src, float *const *dst, size_t frames,
+                         size_t channels) {
+  for (size_t frame = 0; frame < frames; frame++)
+    for (size_t channel = 0; channel < channels; channel++)
+      dst[channel][frame] = src[frame * channels + channel];
+}
+
+float dot_scalar(const float *a, const float *b, size_t count) {
+  float sum = 0;
+  for (size_t i = 0; i < count; i++) sum += a[i] * b[i];
+  return sum;
+}
+
+void mix_scalar(float *dst, const float *src, size_t frames, size_t channels,
+                float from, float to) {
+  if (frames == 0) return;
+  float step = (to - from) / frames;
+  for (size_t frame = 0; frame < frames; frame++) {
+    float gain = from + step * frame;
+    for (size_t channel = 0; channel < channels; channel++)
+      dst[frame * channels + channel] += src[frame * channels + channel] * gain;
+  }
+}
+
+// butterflies from index `from`, also tail of SIMD kernels
+inline void butterflies_from(float *re, float *im, const float *w_re,
+                             const float *w_im, size_t half, size_t from) {
+  for (size_t j = from; j < half; j++) {
+    float b_re = re[j + half] * w_re[j] - im[j + half] * w_im[j];
+    float b_im = re[j + half] * w_im[j] + im[j + half] * w_re[j];
+    re[j + half] = re[j] - b_re;
+    im[j + half] = im[j] - b_im;
+    re[j] += b_re;
+    im[j] += b_im;
+  }
+}
+
+void butterflies_scalar(float *re, float *im, const float *w_re,
+                        const float *w_im, size_t half) {
+  butterflies_from(re, im, w_re, w_im, half, 0);
+}
+
+void biquads_scalar(float *data, size_t frames, size_t channels,
+                    const Biquad *filters, size_t count, float *state) {
+  for (size_t channel = 0; channel < channels; channel++) {
+    for (size_t i = 0; i < count; i++) {
+      const Biquad &f = filters[i];
+      float *z = state + i * 2 * kBiquadLanes + channel;
+      float z1 = z[0], z2 = z[kBiquadLanes];
+      for (size_t frame = 0; frame < frames; frame++) {
+        float x = data[frame * channels + channel];
+        float y = f.b0 * x + z1;
+        z1 = f.b1 * x - f.a1 * y + z2;
+        z2 = f.b2 * x - f.a2 * y;
+        data[frame * channels + channel] = y;
+      }
+      z[0] = z1;
+      z[kBiquadLanes] = z2;
+    }
+  }
+}
+
+const SampleKernels kScalarKernels = {
+    "scalar",           float_to_s16_scalar, float_to_s24_scalar,
+    float_to_s32_scalar, s16_to_float_scalar, s24_to_float_scalar,
+    s32_to_float_scalar, apply_gain_scalar,   interleave_scalar,
+    deinterleave_scalar, dot_scalar, mix_scalar,
+    butterflies_scalar,  biquads_scalar};
+
+#ifdef KERNELS_X86
+// ---------------------------------------------------------------------------
+// SSE2 kernels, always available on x86-64
+// ---------------------------------------------------------------------------
+inline __m128i next_random_sse2(__m128i state) {
+  state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+  state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+  return _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+}
+
+// random floats in [1, 2) made from 23 random mantissa bits
+inline __m128 random_unit_sse2(__m128i state) {
+  return _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(state, 9),
+                                       _mm_set1_epi32(0x3f800000)));
+}
+
+inline __m128 tpdf_sse2(__m128i &state) {
+  state = next_random_sse2(state);
+  __m128 first = random_unit_sse2(state);
+  state = next_random_sse2(state);
+  return _mm_sub_ps(first, random_unit_sse2(state));
+}
+
+inline __m128i quantize_sse2(__m128 value, __m128 scale, __m128 min,
+                             __m128 max, __m128i &state) {
+  __m128 v = _mm_add_ps(_mm_mul_ps(value, scale), tpdf_sse2(state));
+  return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(v, min), max));
+}
+
+void float_to_s16_sse2(const float *src, int16_t *dst, size_t count,
+                       DitherState &dither) {
+  __m128i state0 = _mm_loadu_si128((const __m128i *)dither.seed);
+  __m128i state1 = _mm_loadu_si128((const __m128i *)(dither.seed + 4));
+  const __m128 scale = _mm_set1_ps(kS16Scale);
+  const __m128 min = _mm_set1_ps(-kS16Scale), max = _mm_set1_ps(kS16Scale - 1);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i a = quantize_sse2(_mm_loadu_ps(src + i), scale, min, max, state0);
+    __m128i b =
+        quantize_sse2(_mm_loadu_ps(src + i + 4), scale, min, max, state1);
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(a, b));
+  }
+  _mm_storeu_si128((__m128i *)dither.seed, state0);
+  _mm_storeu_si128((__m128i *)(dither.seed + 4), state1);
+  float_to_s16_scalar(src + i, dst + i, count - i, dither);
+}
+
+void float_to_s24_sse2(const float *src, uint8_t *dst, size_t count,
+                       DitherState &dither) {
+  __m128i state = _mm_loadu_si128((const __m128i *)dither.seed);
+  const __m128 scale = _mm_set1_ps(kS24Scale);
+  const __m128 min = _mm_set1_ps(-kS24Scale), max = _mm_set1_ps(kS24Scale - 1);
+  alignas(16) int32_t values[4];
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    _mm_store_si128((__m128i *)values,
+                    quantize_sse2(_mm_loadu_ps(src + i), scale, min, max, state));
+    for (int j = 0; j < 4; j++) store_s24(dst + (i + j) * 3, values[j]);
+  }
+  _mm_storeu_si128((__m128i *)dither.seed, state);
+  float_to_s24_scalar(src + i, dst + i * 3, count - i, dither);
+}
+
+void float_to_s32_sse2(const float *src, int32_t *dst, size_t count) {
+  const __m128 scale = _mm_set1_ps(kS32Scale);
+  const __m128 min = _mm_set1_ps(-kS32Scale), max = _mm_set1_ps(kS32Max);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 v = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(v, min), max)));
+  }
+  float_to_s32_scalar(src + i, dst + i, count - i);
+}
+
+void s16_to_float_sse2(const int16_t *src, float *dst, size_t count) {
+  const __m128 scale = _mm_set1_ps(1.0f / kS16Scale);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    // sign extend by putting sample into upper half and shifting back
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+  s16_to_float_scalar(src + i, dst + i, count - i);
+}
+
+void s32_to_float_sse2(const int32_t *src, float *dst, size_t count) {
+  const __m128 scale = _mm_set1_ps(1.0f / kS32Scale);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+  }
+  s32_to_float_scalar(src + i, dst + i, count - i);
+}
+
+void apply_gain_sse2(float *data, size_t frames, size_t channels, float from,
+                     float to) {
+  if (frames == 0) return;
+  size_t count = frames * channels;
+  size_t i = 0;
+  if (from == to) {  // constant gain, layout does not matter
+    const __m128 gain = _mm_set1_ps(from);
+    for (; i + 4 <= count; i += 4)
+      _mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), gain));
+    for (; i < count; i++) data[i] *= from;
+    return;
+  }
+  if (channels > 2) return apply_gain_scalar(data, frames, channels, from, to);
+  float step = (to - from) / frames;
+  // frame index of every lane, 4 mono or 2 stereo frames per vector
+  __m128 index = channels == 1 ? _mm_setr_ps(0, 1, 2, 3)
+                               : _mm_setr_ps(0, 0, 1, 1);
+  const __m128 advance = _mm_set1_ps(4.0f / channels);
+  const __m128 base = _mm_set1_ps(from), slope = _mm_set1_ps(step);
+  for (; i + 4 <= count; i += 4) {
+    __m128 gain = _mm_add_ps(base, _mm_mul_ps(slope, index));
+    _mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), gain));
+    index = _mm_add_ps(index, advance);
+  }
+  size_t done = i / channels;
+  apply_gain_scalar(data + i, frames - done, channels, from + step * done, to);
+}
+
+void interleave_sse2(const float *const *src, float *dst, size_t frames,
+                     size_t channels) {
+  if (channels != 2) return interleave_scalar(src, dst, frames, channels);
+  size_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    __m128 left = _mm_loadu_ps(src[0] + i), right = _mm_loadu_ps(src[1] + i);
+    _mm_storeu_ps(dst + i * 2, _mm_unpacklo_ps(left, right));
+    _mm_storeu_ps(dst + i * 2 + 4, _mm_unpackhi_ps(left, right));
+  }
+  const float *tail[2] = {src[0] + i, src[1] + i};
+  interleave_scalar(tail, dst + i * 2, frames - i, 2);
+}
+
+void deinterleave_sse2(const float *src, float *const *dst, size_t frames,
+                       size_t channels) {
+  if (channels != 2) return deinterleave_scalar(src, dst, frames, channels);
+  size_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    __m128 a = _mm_loadu_ps(src + i * 2), b = _mm_loadu_ps(src + i * 2 + 4);
+    _mm_storeu_ps(dst[0] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(dst[1] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+  }
+  float *const tail[2] = {dst[0] + i, dst[1] + i};
+  deinterleave_scalar(src + i * 2, tail, frames - i, 2);
+}
+
+float dot_sse2(const float *a, const float *b, size_t count) {
+  // two accumulators hide latency of additions
+  __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4),
+                                       _mm_loadu_ps(b + i + 4)));
+  }
+  alignas(16) float lanes[4];
+  _mm_store_ps(lanes, _mm_add_ps(sum0, sum1));
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+         dot_scalar(a + i, b + i, count - i);
+}
+
+void mix_sse2(float *dst, const float *src, size_t frames, size_t channels,
+              float from, float to) {
+  if (frames == 0) return;
+  if (channels > 2) return mix_scalar(dst, src, frames, channels, from, to);
+  size_t count = frames * channels;
+  size_t i = 0;
+  float step = (to - from) / frames;
+  __m128 index = channels == 1 ? _mm_setr_ps(0, 1, 2, 3)
+                               : _mm_setr_ps(0, 0, 1, 1);
+  const __m128 advance = _mm_set1_ps(4.0f / channels);
+  const __m128 base = _mm_set1_ps(from), slope = _mm_set1_ps(step);
+  for (; i + 4 <= count; i += 4) {
+    __m128 gain = _mm_add_ps(base, _mm_mul_ps(slope, index));
+    __m128 mixed = _mm_add_ps(_mm_loadu_ps(dst + i),
+                              _mm_mul_ps(_mm_loadu_ps(src + i), gain));
+    _mm_storeu_ps(dst + i, mixed);
+    index = _mm_add_ps(index, advance);
+  }
+  size_t done = i / channels;
+  mix_scalar(dst + i, src + i, frames - done, channels, from + step * done,
+             to);
+}
+
+void butterflies_sse2(float *re, float *im, const float *w_re,
+                      const float *w_im, size_t half) {
+  size_t j = 0;
+  for (; j + 4 <= half; j += 4) {
+    __m128 a_re = _mm_loadu_ps(re + j), a_im = _mm_loadu_ps(im + j);
+    __m128 x_re = _mm_loadu_ps(re + j + half);
+    __m128 x_im = _mm_loadu_ps(im + j + half);
+    __m128 t_re = _mm_loadu_ps(w_re + j), t_im = _mm_loadu_ps(w_im + j);
+    __m128 b_re = _mm_sub_ps(_mm_mul_ps(x_re, t_re), _mm_mul_ps(x_im, t_im));
+    __m128 b_im = _mm_add_ps(_mm_mul_ps(x_re, t_im), _mm_mul_ps(x_im, t_re));
+    _mm_storeu_ps(re + j + half, _mm_sub_ps(a_re, b_re));
+    _mm_storeu_ps(im + j + half, _mm_sub_ps(a_im, b_im));
+    _mm_storeu_ps(re + j, _mm_add_ps(a_re, b_re));
+    _mm_storeu_ps(im + j, _mm_add_ps(a_im, b_im));
+  }
+  butterflies_from(re, im, w_re, w_im, half, j);
+}
+
+void biquads_sse2(float *data, size_t frames, size_t channels,
+                  const Biquad *filters, size_t count, float *state) {
+  // up to 4 channels in one register, whole cascade per frame keeps state
+  // in registers
+  for (size_t group = 0; group < channels; group += 4) {
+    const size_t lanes = std::min<size_t>(4, channels - group);
+    __m128 b0[kMaxBiquads], b1[kMaxBiquads], b2[kMaxBiquads],
+        a1[kMaxBiquads], a2[kMaxBiquads], z1[kMaxBiquads], z2[kMaxBiquads];
+    for (size_t i = 0; i < count; i++) {
+      b0[i] = _mm_set1_ps(filters[i].b0);
+      b1[i] = _mm_set1_ps(filters[i].b1);
+      b2[i] = _mm_set1_ps(filters[i].b2);
+      a1[i] = _mm_set1_ps(filters[i].a1);
+      a2[i] = _mm_set1_ps(filters[i].a2);
+      z1[i] = _mm_loadu_ps(state + i * 2 * kBiquadLanes + group);
+      z2[i] = _mm_loadu_ps(state + i * 2 * kBiquadLanes + kBiquadLanes + group);
+    }
+    alignas(16) float frame_lanes[4] = {0};
+    for (size_t frame = 0; frame < frames; frame++) {
+      float *samples = data + frame * channels + group;
+      std::memcpy(frame_lanes, samples, lanes * sizeof(float));
+      __m128 x = _mm_load_ps(frame_lanes);
+      for (size_t i = 0; i < count; i++) {
+        __m128 y = _mm_add_ps(_mm_mul_ps(b0[i], x), z1[i]);
+        z1[i] = _mm_add_ps(
+            _mm_sub_ps(_mm_mul_ps(b1[i], x), _mm_mul_ps(a1[i], y)), z2[i]);
+        z2[i] = _mm_sub_ps(_mm_mul_ps(b2[i], x), _mm_mul_ps(a2[i], y));
+        x = y;
+      }
+      _mm_store_ps(frame_lanes, x);
+      std::memcpy(samples, frame_lanes, lanes * sizeof(float));
+    }
+    for (size_t i = 0; i < count; i++) {
+      _mm_storeu_ps(state + i * 2 * kBiquadLanes + group, z1[i]);
+      _mm_storeu_ps(state + i * 2 * kBiquadLanes + kBiquadLanes + group,
+                    z2[i]);
+    }
+  }
+}
+
+const SampleKernels kSse2Kernels = {
+    "sse2",           float_to_s16_sse2, float_to_s24_sse2,
+    float_to_s32_sse2, s16_to_float_sse2, s24_to_float_scalar,
+    s32_to_float_sse2, apply_gain_sse2,   interleave_sse2,
+    deinterleave_sse2, dot_sse2, mix_sse2,
+    butterflies_sse2,  biquads_sse2};
+
+// ---------------------------------------------------------------------------
+// AVX2 kernels, compiled for AVX2 and used only if CPU supports it
+// ---------------------------------------------------------------------------
+TARGET_AVX2 inline __m256i next_random_avx2(__m256i state) {
+  state = _mm256_xor_si256(state, _mm256_slli_epi32(state, 13));
+  state = _mm256_xor_si256(state, _mm256_srli_epi32(state, 17));
+  return _mm256_xor_si256(state, _mm256_slli_epi32(state, 5));
+}
+
+TARGET_AVX2 inline __m256 tpdf_avx2(__m256i &state) {
+  const __m256i one = _mm256_set1_epi32(0x3f800000);
+  state = next_random_avx2(state);
+  __m256 first = _mm256_castsi256_ps(
+      _mm256_or_si256(_mm256_srli_epi32(state, 9), one));
+  state = next_random_avx2(state);
+  __m256 second = _mm256_castsi256_ps(
+      _mm256_or_si256(_mm256_srli_epi32(state, 9), one));
+  return _mm256_sub_ps(first, second);
+}
+
+TARGET_AVX2 inline __m256i quantize_avx2(__m256 value, __m256 scale,
+                                         __m256 min, __m256 max,
+                                         __m256i &state) {
+  __m256 v = _mm256_add_ps(_mm256_mul_ps(value, scale), tpdf_avx2(state));
+  return _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(v, min), max));
+}
+
+TARGET_AVX2 void float_to_s16_avx2(const float *src, int16_t *dst,
+                                   size_t count, DitherState &dither) {
+  __m256i state = _mm256_loadu_si256((const __m256i *)dither.seed);
+  const __m256 scale = _mm256_set1_ps(kS16Scale);
+  const __m256 min = _mm256_set1_ps(-kS16Scale);
+  const __m256 max = _mm256_set1_ps(kS16Scale - 1);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256i a =
+        quantize_avx2(_mm256_loadu_ps(src + i), scale, min, max, state);
+    __m256i b =
+        quantize_avx2(_mm256_loadu_ps(src + i + 8), scale, min, max, state);
+    // packs works inside 128 bit lanes, put quarters back in order
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b),
+                                              _MM_SHUFFLE(3, 1, 2, 0));
+    _mm256_storeu_si256((__m256i *)(dst + i), packed);
+  }
+  _mm256_storeu_si256((__m256i *)dither.seed, state);
+  float_to_s16_scalar(src + i, dst + i, count - i, dither);
+}
+
+TARGET_AVX2 void float_to_s24_avx2(const float *src, uint8_t *dst,
+                                   size_t count, DitherState &dither) {
+  __m256i state = _mm256_loadu_si256((const __m256i *)dither.seed);
+  const __m256 scale = _mm256_set1_ps(kS24Scale);
+  const __m256 min = _mm256_set1_ps(-kS24Scale);
+  const __m256 max = _mm256_set1_ps(kS24Scale - 1);
+  alignas(32) int32_t values[8];
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    _mm256_store_si256(
+        (__m256i *)values,
+        quantize_avx2(_mm256_loadu_ps(src + i), scale, min, max, state));
+    for (int j = 0; j < 8; j++) store_s24(dst + (i + j) * 3, values[j]);
+  }
+  _mm256_storeu_si256((__m256i *)dither.seed, state);
+  float_to_s24_scalar(src + i, dst + i * 3, count - i, dither);
+}
+
+TARGET_AVX2 void float_to_s32_avx2(const float *src, int32_t *dst,
+                                   size_t count) {
+  const __m256 scale = _mm256_set1_ps(kS32Scale);
+  const __m256 min = _mm256_set1_ps(-kS32Scale);
+  const __m256 max = _mm256_set1_ps(kS32Max);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 v = _mm256_mul_ps(_mm256_loadu_ps(src + i), scale);
+    _mm256_storeu_si256(
+        (__m256i *)(dst + i),
+        _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(v, min), max)));
+  }
+  float_to_s32_scalar(src + i, dst + i, count - i);
+}
+
+TARGET_AVX2 void s16_to_float_avx2(const int16_t *src, float *dst,
+                                   size_t count) {
+  const __m256 scale = _mm256_set1_ps(1.0f / kS16Scale);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i v = _mm256_cvtepi16_epi32(
+        _mm_loadu_si128((const __m128i *)(src + i)));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+  }
+  s16_to_float_scalar(src + i, dst + i, count - i);
+}
+
+TARGET_AVX2 void s32_to_float_avx2(const int32_t *src, float *dst,
+                                   size_t count) {
+  const __m256 scale = _mm256_set1_ps(1.0f / kS32Scale);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+  }
+  s32_to_float_scalar(src + i, dst + i, count - i);
+}
+
+TARGET_AVX2 void apply_gain_avx2(float *data, size_t frames, size_t channels,
+                                 float from, float to) {
+  if (frames == 0) return;
+  size_t count = frames * channels;
+  size_t i = 0;
+  if (from == to) {  // constant gain, layout does not matter
+    const __m256 gain = _mm256_set1_ps(from);
+    for (; i + 8 <= count; i += 8)
+      _mm256_storeu_ps(data + i,
+                       _mm256_mul_ps(_mm256_loadu_ps(data + i), gain));
+    for (; i < count; i++) data[i] *= from;
+    return;
+  }
+  if (channels > 2) return apply_gain_scalar(data, frames, channels, from, to);
+  float step = (to - from) / frames;
+  // frame index of every lane, 8 mono or 4 stereo frames per vector
+  __m256 index = channels == 1 ? _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)
+                               : _mm256_setr_ps(0, 0, 1, 1, 2, 2, 3, 3);
+  const __m256 advance = _mm256_set1_ps(8.0f / channels);
+  const __m256 base = _mm256_set1_ps(from), slope = _mm256_set1_ps(step);
+  for (; i + 8 <= count; i += 8) {
+    __m256 gain = _mm256_add_ps(base, _mm256_mul_ps(slope, index));
+    _mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_loadu_ps(data + i), gain));
+    index = _mm256_add_ps(index, advance);
+  }
+  size_t done = i / channels;
+  apply_gain_scalar(data + i, frames - done, channels, from + step * done, to);
+}
+
+TARGET_AVX2 void interleave_avx2(const float *const *src, float *dst,
+                                 size_t frames, size_t channels) {
+  if (channels != 2) return interleave_scalar(src, dst, frames, channels);
+  size_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    __m256 left = _mm256_loadu_ps(src[0] + i);
+    __m256 right = _mm256_loadu_ps(src[1] + i);
+    __m256 lo = _mm256_unpacklo_ps(left, right);  // L0 R0 L1 R1 | L4 R4 L5 R5
+    __m256 hi = _mm256_unpackhi_ps(left, right);  // L2 R2 L3 R3 | L6 R6 L7 R7
+    _mm256_storeu_ps(dst + i * 2, _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps(dst + i * 2 + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+  }
+  const float *tail[2] = {src[0] + i, src[1] + i};
+  interleave_scalar(tail, dst + i * 2, frames - i, 2);
+}
+
+TARGET_AVX2 void deinterleave_avx2(const float *src, float *const *dst,
+                                   size_t frames, size_t channels) {
+  if (channels != 2) return deinterleave_scalar(src, dst, frames, channels);
+  size_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    __m256 a = _mm256_loadu_ps(src + i * 2);
+    __m256 b = _mm256_loadu_ps(src + i * 2 + 8);
+    __m256 lo = _mm256_permute2f128_ps(a, b, 0x20);  // L0 R0 L1 R1 | L4 ..
+    __m256 hi = _mm256_permute2f128_ps(a, b, 0x31);  // L2 R2 L3 R3 | L6 ..
+    _mm256_storeu_ps(dst[0] + i,
+                     _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm256_storeu_ps(dst[1] + i,
+                     _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+  }
+  float *const tail[2] = {dst[0] + i, dst[1] + i};
+  deinterleave_scalar(src + i * 2, tail, frames - i, 2);
+}
+
+TARGET_AVX2 float dot_avx2(const float *a, const float *b, size_t count) {
+  __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    sum0 = _mm256_add_ps(
+        sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8),
+                                             _mm256_loadu_ps(b + i + 8)));
+  }
+  for (; i + 8 <= count; i += 8)
+    sum0 = _mm256_add_ps(
+        sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+  __m256 sum = _mm256_add_ps(sum0, sum1);
+  __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum),
+                           _mm256_extractf128_ps(sum, 1));
+  alignas(16) float lanes[4];
+  _mm_store_ps(lanes, half);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+         dot_scalar(a + i, b + i, count - i);
+}
+
+TARGET_AVX2 void mix_avx2(float *dst, const float *src, size_t frames,
+                          size_t channels, float from, float to) {
+  if (frames == 0) return;
+  if (channels > 2) return mix_scalar(dst, src, frames, channels, from, to);
+  size_t count = frames * channels;
+  size_t i = 0;
+  float step = (to - from) / frames;
+  __m256 index = channels == 1 ? _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)
+                               : _mm256_setr_ps(0, 0, 1, 1, 2, 2, 3, 3);
+  const __m256 advance = _mm256_set1_ps(8.0f / channels);
+  const __m256 base = _mm256_set1_ps(from), slope = _mm256_set1_ps(step);
+  for (; i + 8 <= count; i += 8) {
+    __m256 gain = _mm256_add_ps(base, _mm256_mul_ps(slope, index));
+    __m256 mixed = _mm256_add_ps(_mm256_loadu_ps(dst + i),
+                                 _mm256_mul_ps(_mm256_loadu_ps(src + i), gain));
+    _mm256_storeu_ps(dst + i, mixed);
+    index = _mm256_add_ps(index, advance);
+  }
+  size_t done = i / channels;
+  mix_scalar(dst + i, src + i, frames - done, channels, from + step * done,
+             to);
+}
+
+TARGET_AVX2 void butterflies_avx2(float *re, float *im, const float *w_re,
+                                  const float *w_im, size_t half) {
+  if (half < 8) return butterflies_sse2(re, im, w_re, w_im, half);
+  size_t j = 0;
+  for (; j + 8 <= half; j += 8) {
+    __m256 a_re = _mm256_loadu_ps(re + j), a_im = _mm256_loadu_ps(im + j);
+    __m256 x_re = _mm256_loadu_ps(re + j + half);
+    __m256 x_im = _mm256_loadu_ps(im + j + half);
+    __m256 t_re = _mm256_loadu_ps(w_re + j), t_im = _mm256_loadu_ps(w_im + j);
+    __m256 b_re =
+        _mm256_sub_ps(_mm256_mul_ps(x_re, t_re), _mm256_mul_ps(x_im, t_im));
+    __m256 b_im =
+        _mm256_add_ps(_mm256_mul_ps(x_re, t_im), _mm256_mul_ps(x_im, t_re));
+    _mm256_storeu_ps(re + j + half, _mm256_sub_ps(a_re, b_re));
+    _mm256_storeu_ps(im + j + half, _mm256_sub_ps(a_im, b_im));
+    _mm256_storeu_ps(re + j, _mm256_add_ps(a_re, b_re));
+    _mm256_storeu_ps(im + j, _mm256_add_ps(a_im, b_im));
+  }
+  butterflies_from(re, im, w_re, w_im, half, j);
+}
+
+TARGET_AVX2 void biquads_avx2(float *data, size_t frames, size_t channels,
+                              const Biquad *filters, size_t count,
+                              float *state) {
+  // wider register helps only surround, stereo has no more lanes to fill
+  if (channels <= 4)
+    return biquads_sse2(data, frames, channels, filters, count, state);
+  __m256 b0[kMaxBiquads], b1[kMaxBiquads], b2[kMaxBiquads], a1[kMaxBiquads],
+      a2[kMaxBiquads], z1[kMaxBiquads], z2[kMaxBiquads];
+  for (size_t i = 0; i < count; i++) {
+    b0[i] = _mm256_set1_ps(filters[i].b0);
+    b1[i] = _mm256_set1_ps(filters[i].b1);
+    b2[i] = _mm256_set1_ps(filters[i].b2);
+    a1[i] = _mm256_set1_ps(filters[i].a1);
+    a2[i] = _mm256_set1_ps(filters[i].a2);
+    z1[i] = _mm256_loadu_ps(state + i * 2 * kBiquadLanes);
+    z2[i] = _mm256_loadu_ps(state + i * 2 * kBiquadLanes + kBiquadLanes);
+  }
+  alignas(32) float frame_lanes[8] = {0};
+  for (size_t frame = 0; frame < frames; frame++) {
+    float *samples = data + frame * channels;
+    std::memcpy(frame_lanes, samples, channels * sizeof(float));
+    __m256 x = _mm256_load_ps(frame_lanes);
+    for (size_t i = 0; i < count; i++) {
+      __m256 y = _mm256_add_ps(_mm256_mul_ps(b0[i], x), z1[i]);
+      z1[i] = _mm256_add_ps(
+          _mm256_sub_ps(_mm256_mul_ps(b1[i], x), _mm256_mul_ps(a1[i], y)),
+          z2[i]);
+      z2[i] = _mm256_sub_ps(_mm256_mul_ps(b2[i], x), _mm256_mul_ps(a2[i], y));
+      x = y;
+    }
+    _mm256_store_ps(frame_lanes, x);
+    std::memcpy(samples, frame_lanes, channels * sizeof(float));
+  }
+  for (size_t i = 0; i < count; i++) {
+    _mm256_storeu_ps(state + i * 2 * kBiquadLanes, z1[i]);
+    _mm256_storeu_ps(state + i * 2 * kBiquadLanes + kBiquadLanes, z2[i]);
+  }
+}
+
+const SampleKernels kAvx2Kernels = {
+    "avx2",           float_to_s16_avx2, float_to_s24_avx2,
+    float_to_s32_avx2, s16_to_float_avx2, s24_to_float_scalar,
+    s32_to_float_avx2, apply_gain_avx2,   interleave_avx2,
+    deinterleave_avx2, dot_avx2, mix_avx2,
+    butterflies_avx2,  biquads_avx2};
+
+bool cpu_has_avx2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+#endif  // KERNELS_X86
+
+#ifdef KERNELS_NEON
+// ---------------------------------------------------------------------------
+// NEON kernels, always available on AArch64
+// ---------------------------------------------------------------------------
+inline uint32x4_t next_random_neon(uint32x4_t state) {
+  state = veorq_u32(state, vshlq_n_u32(state, 13));
+  state = veorq_u32(state, vshrq_n_u32(state, 17));
+  return veorq_u32(state, vshlq_n_u32(state, 5));
+}
+
+inline float32x4_t tpdf_neon(uint32x4_t &state) {
+  const uint32x4_t one = vdupq_n_u32(0x3f800000);
+  state = next_random_neon(state);
+  float32x4_t first =
+      vreinterpretq_f32_u32(vorrq_u32(vshrq_n_u32(state, 9), one));
+  state = next_random_neon(state);
+  float32x4_t second =
+      vreinterpretq_f32_u32(vorrq_u32(vshrq_n_u32(state, 9), one));
+  return vsubq_f32(first, second);
+}
+
+inline int32x4_t quantize_neon(float32x4_t value, float scale, float max,
+                               uint32x4_t &state) {
+  float32x4_t v = vaddq_f32(vmulq_n_f32(value, scale), tpdf_neon(state));
+  v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(-scale)), vdupq_n_f32(max));
+  return vcvtnq_s32_f32(v);
+}
+
+void float_to_s16_neon(const float *src, int16_t *dst, size_t count,
+                       DitherState &dither) {
+  uint32x4_t state0 = vld1q_u32(dither.seed);
+  uint32x4_t state1 = vld1q_u32(dither.seed + 4);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    int32x4_t a =
+        quantize_neon(vld1q_f32(src + i), kS16Scale, kS16Scale - 1, state0);
+    int32x4_t b =
+        quantize_neon(vld1q_f32(src + i + 4), kS16Scale, kS16Scale - 1, state1);
+    vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+  }
+  vst1q_u32(dither.seed, state0);
+  vst1q_u32(dither.seed + 4, state1);
+  float_to_s16_scalar(src + i, dst + i, count - i, dither);
+}
+
+void float_to_s24_neon(const float *src, uint8_t *dst, size_t count,
+                       DitherState &dither) {
+  uint32x4_t state = vld1q_u32(dither.seed);
+  int32_t values[4];
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    vst1q_s32(values,
+              quantize_neon(vld1q_f32(src + i), kS24Scale, kS24Scale - 1, state));
+    for (int j = 0; j < 4; j++) store_s24(dst + (i + j) * 3, values[j]);
+  }
+  vst1q_u32(dither.seed, state);
+  float_to_s24_scalar(src + i, dst + i * 3, count - i, dither);
+}
+
+void float_to_s32_neon(const float *src, int32_t *dst, size_t count) {
+  const float32x4_t min = vdupq_n_f32(-kS32Scale), max = vdupq_n_f32(kS32Max);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    float32x4_t v = vmulq_n_f32(vld1q_f32(src + i), kS32Scale);
+    vst1q_s32(dst + i, vcvtnq_s32_f32(vminq_f32(vmaxq_f32(v, min), max)));
+  }
+  float_to_s32_scalar(src + i, dst + i, count - i);
+}
+
+void s16_to_float_neon(const int16_t *src, float *dst, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    int16x8_t v = vld1q_s16(src + i);
+    vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))),
+                                   1.0f / kS16Scale));
+    vst1q_f32(dst + i + 4,
+              vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))),
+                          1.0f / kS16Scale));
+  }
+  s16_to_float_scalar(src + i, dst + i, count - i);
+}
+
+void s32_to_float_neon(const int32_t *src, float *dst, size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4)
+    vst1q_f32(dst + i,
+              vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(src + i)), 1.0f / kS32Scale));
+  s32_to_float_scalar(src + i, dst + i, count - i);
+}
+
+void apply_gain_neon(float *data, size_t frames, size_t channels, float from,
+                     float to) {
+  if (frames == 0) return;
+  size_t count = frames * channels;
+  size_t i = 0;
+  if (from == to) {  // constant gain, layout does not matter
+    for (; i + 4 <= count; i += 4)
+      vst1q_f32(data + i, vmulq_n_f32(vld1q_f32(data + i), from));
+    for (; i < count; i++) data[i] *= from;
+    return;
+  }
+  if (channels > 2) return apply_gain_scalar(data, frames, channels, from, to);
+  float step = (to - from) / frames;
+  // frame index of every lane, 4 mono or 2 stereo frames per vector
+  const float mono[4] = {0, 1, 2, 3}, stereo[4] = {0, 0, 1, 1};
+  float32x4_t index = vld1q_f32(channels == 1 ? mono : stereo);
+  const float32x4_t advance = vdupq_n_f32(4.0f / channels);
+  const float32x4_t base = vdupq_n_f32(from);
+  for (; i + 4 <= count; i += 4) {
+    float32x4_t gain = vmlaq_n_f32(base, index, step);
+    vst1q_f32(data + i, vmulq_f32(vld1q_f32(data + i), gain));
+    index = vaddq_f32(index, advance);
+  }
+  size_t done = i / channels;
+  apply_gain_scalar(data + i, frames - done, channels, from + step * done, to);
+}
+
+void interleave_neon(const float *const *src, float *dst, size_t frames,
+                     size_t channels) {
+  if (channels != 2) return interleave_scalar(src, dst, frames, channels);
+  size_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    float32x4x2_t v = {{vld1q_f32(src[0] + i), vld1q_f32(src[1] + i)}};
+    vst2q_f32(dst + i * 2, v);
+  }
+  const float *tail[2] = {src[0] + i, src[1] + i};
+  interleave_scalar(tail, dst + i * 2, frames - i, 2);
+}
+
+void deinterleave_neon(const float *src, float *const *dst, size_t frames,
+                       size_t channels) {
+  if (channels != 2) return deinterleave_scalar(src, dst, frames, channels);
+  size_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    float32x4x2_t v = vld2q_f32(src + i * 2);
+    vst1q_f32(dst[0] + i, v.val[0]);
+    vst1q_f32(dst[1] + i, v.val[1]);
+  }
+  float *const tail[2] = {dst[0] + i, dst[1] + i};
+  deinterleave_scalar(src + i * 2, tail, frames - i, 2);
+}
+
+float dot_neon(const float *a, const float *b, size_t count) {
+  float32x4_t sum0 = vdupq_n_f32(0), sum1 = vdupq_n_f32(0);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+    sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+  }
+  return vaddvq_f32(vaddq_f32(sum0, sum1)) +
+         dot_scalar(a + i, b + i, count - i);
+}
+
+void mix_neon(float *dst, const float *src, size_t frames, size_t channels,
+              float from, float to) {
+  if (frames == 0) return;
+  if (channels > 2) return mix_scalar(dst, src, frames, channels, from, to);
+  size_t count = frames * channels;
+  size_t i = 0;
+  float step = (to - from) / frames;
+  const float mono[4] = {0, 1, 2, 3}, stereo[4] = {0, 0, 1, 1};
+  float32x4_t index = vld1q_f32(channels == 1 ? mono : stereo);
+  const float32x4_t advance = vdupq_n_f32(4.0f / channels);
+  const float32x4_t base = vdupq_n_f32(from);
+  for (; i + 4 <= count; i += 4) {
+    float32x4_t gain = vmlaq_n_f32(base, index, step);
+    vst1q_f32(dst + i,
+              vmlaq_f32(vld1q_f32(dst + i), vld1q_f32(src + i), gain));
+    index = vaddq_f32(index, advance);
+  }
+  size_t done = i / channels;
+  mix_scalar(dst + i, src + i, frames - done, channels, from + step * done,
+             to);
+}
+
+void butterflies_neon(float *re, float *im, const float *w_re,
+                      const float *w_im, size_t half) {
+  size_t j = 0;
+  for (; j + 4 <= half; j += 4) {
+    float32x4_t a_re = vld1q_f32(re + j), a_im = vld1q_f32(im + j);
+    float32x4_t x_re = vld1q_f32(re + j + half);
+    float32x4_t x_im = vld1q_f32(im + j + half);
+    float32x4_t t_re = vld1q_f32(w_re + j), t_im = vld1q_f32(w_im + j);
+    float32x4_t b_re = vmlsq_f32(vmulq_f32(x_re, t_re), x_im, t_im);
+    float32x4_t b_im = vmlaq_f32(vmulq_f32(x_re, t_im), x_im, t_re);
+    vst1q_f32(re + j + half, vsubq_f32(a_re, b_re));
+    vst1q_f32(im + j + half, vsubq_f32(a_im, b_im));
+    vst1q_f32(re + j, vaddq_f32(a_re, b_re));
+    vst1q_f32(im + j, vaddq_f32(a_im, b_im));
+  }
+  butterflies_from(re, im, w_re, w_im, half, j);
+}
+
+void biquads_neon(float *data, size_t frames, size_t channels,
+                  const Biquad *filters, size_t count, float *state) {
+  for (size_t group = 0; group < channels; group += 4) {
+    const size_t lanes = std::min<size_t>(4, channels - group);
+    float32x4_t z1[kMaxBiquads], z2[kMaxBiquads];
+    for (size_t i = 0; i < count; i++) {
+      z1[i] = vld1q_f32(state + i * 2 * kBiquadLanes + group);
+      z2[i] = vld1q_f32(state + i * 2 * kBiquadLanes + kBiquadLanes + group);
+    }
+    float frame_lanes[4] = {0};
+    for (size_t frame = 0; frame < frames; frame++) {
+      float *samples = data + frame * channels + group;
+      std::memcpy(frame_lanes, samples, lanes * sizeof(float));
+      float32x4_t x = vld1q_f32(frame_lanes);
+      for (size_t i = 0; i < count; i++) {
+        const Biquad &f = filters[i];
+        float32x4_t y = vmlaq_n_f32(z1[i], x, f.b0);
+        z1[i] = vmlsq_n_f32(vmlaq_n_f32(z2[i], x, f.b1), y, f.a1);
+        z2[i] = vmlsq_n_f32(vmulq_n_f32(x, f.b2), y, f.a2);
+        x = y;
+      }
+      vst1q_f32(frame_lanes, x);
+      std::memcpy(samples, frame_lanes, lanes * sizeof(float));
+    }
+    for (size_t i = 0; i < count; i++) {
+      vst1q_f32(state + i * 2 * kBiquadLanes + group, z1[i]);
+      vst1q_f32(state + i * 2 * kBiquadLanes + kBiquadLanes + group, z2[i]);
+    }
+  }
+}
+
+const SampleKernels kNeonKernels = {
+    "neon",           float_to_s16_neon, float_to_s24_neon,
+    float_to_s32_neon, s16_to_float_neon, s24_to_float_scalar,
+    s32_to_float_neon, apply_gain_neon,   interleave_neon,
+    deinterleave_neon, dot_neon, mix_neon,
+    butterflies_neon,  biquads_neon};
+#endif  // KERNELS_NEON
+
+const SampleKernels &select_kernels() {
+#ifdef KERNELS_X86
+  if (cpu_has_avx2()) return kAvx2Kernels;
+  return kSse2Kernels;
+#elif defined(KERNELS_NEON)
+  return kNeonKernels;
+#else
+  return kScalarKernels;
+#endif
+}
+}  // namespace
+
+const SampleKernels &get_sample_kernels() {
+  static const SampleKernels &kernels = select_kernels();
+  return kernels;
+}
+
+std::vector<const SampleKernels *> get_available_sample_kernels() {
+  std::vector<const SampleKernels *> kernels = {&kScalarKernels};
+#ifdef KERNELS_X86
+  kernels.push_back(&kSse2Kernels);
+  if (cpu_has_avx2()) kernels.push_back(&kAvx2Kernels);
+#elif defined(KERNELS_NEON)
+  kernels.push_back(&kNeonKernels);
+#endif
+  return kernels;
+}
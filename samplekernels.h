@@ -0,0 +1,98 @@
+#ifndef SAMPLEKERNELS_H
+#define SAMPLEKERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * State of TPDF dither noise generator, one xorshift generator per SIMD lane.
+ * Every stream which is dithered must have its own state.
+ */
+struct DitherState {
+  uint32_t seed[8];
+};
+
+/**
+ * Initializes dither generators
+ * @param state - state to initialize (type: DitherState)
+ * @param seed - any number except zero (type: uint32_t)
+ */
+void init_dither(DitherState &state, uint32_t seed = 0x9e3779b9);
+
+/**
+ * Coefficients of biquad filter normalized by a0, for transposed direct form
+ * II: y = b0 * x + z1, z1 = b1 * x - a1 * y + z2, z2 = b2 * x - a2 * y
+ */
+struct Biquad {
+  float b0, b1, b2, a1, a2;
+};
+const size_t kMaxBiquads = 16;  // biquads in one cascade
+const size_t kBiquadLanes = 8;  // channels in state of one biquad
+
+/**
+ * Set of sample processing kernels for one instruction set.
+ * Float samples are in range [-1, 1]. Integer conversions clamp, conversions
+ * into 16 and 24 bit add TPDF dither of one least significant bit. 24 bit
+ * samples are packed little-endian, 3 bytes per sample.
+ */
+struct SampleKernels {
+  const char *name;  // "avx2", "sse2", "neon" or "scalar"
+  void (*float_to_s16)(const float *src, int16_t *dst, size_t count,
+                       DitherState &dither);
+  void (*float_to_s24)(const float *src, uint8_t *dst, size_t count,
+                       DitherState &dither);
+  void (*float_to_s32)(const float *src, int32_t *dst, size_t count);
+  void (*s16_to_float)(const int16_t *src, float *dst, size_t count);
+  void (*s24_to_float)(const uint8_t *src, float *dst, size_t count);
+  void (*s32_to_float)(const int32_t *src, float *dst, size_t count);
+  /**
+   * Multiplies interleaved frames by gain, which changes linearly from
+   * `from` on first frame to `to` after last frame, so volume changes do not
+   * click.
+   */
+  void (*apply_gain)(float *data, size_t frames, size_t channels, float from,
+                     float to);
+  void (*interleave)(const float *const *src, float *dst, size_t frames,
+                     size_t channels);
+  void (*deinterleave)(const float *src, float *const *dst, size_t frames,
+                       size_t channels);
+  /**
+   * Sum of products of two arrays, inner loop of FIR filters
+   */
+  float (*dot)(const float *a, const float *b, size_t count);
+  /**
+   * Adds src multiplied by gain to dst, gain changes linearly like in
+   * apply_gain. Together with apply_gain it crossfades two streams.
+   */
+  void (*mix)(float *dst, const float *src, size_t frames, size_t channels,
+              float from, float to);
+  /**
+   * One radix-2 stage of FFT on split complex arrays: for every j below half
+   * a = x[j] and b = x[j + half] become a + w[j] * b and a - w[j] * b
+   */
+  void (*butterflies)(float *re, float *im, const float *w_re,
+                      const float *w_im, size_t half);
+  /**
+   * Runs interleaved frames through cascade of at most kMaxBiquads biquads,
+   * channels of one frame are processed together in SIMD lanes. State keeps
+   * z1 and z2 of every biquad for kBiquadLanes channels: z1 of biquad i and
+   * channel c is state[i * 2 * kBiquadLanes + c], z2 follows kBiquadLanes
+   * later. At most kBiquadLanes channels.
+   */
+  void (*biquads)(float *data, size_t frames, size_t channels,
+                  const Biquad *filters, size_t count, float *state);
+};
+
+/**
+ * Gets fastest kernels supported by current CPU. Selected once, on first
+ * call.
+ */
+const SampleKernels &get_sample_kernels();
+
+/**
+ * Gets all kernels supported by current CPU, scalar ones first
+ */
+std::vector<const SampleKernels *> get_available_sample_kernels();
+
+#endif  // SAMPLEKERNELS_H
@@ -0,0 +1,251 @@
+#include "searchindex.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace {
+const size_t kCompactRemoved = 4096;  // removed documents before compaction
+
+// Latin-1 letters from U+00C0 to U+00FF without accents, space for signs
+const char kLatin1Base[] =
+    "aaaaaaaceeeeiiiidnooooo ouuuuyts"
+    "aaaaaaaceeeeiiiidnooooo ouuuuyty";
+
+// lower case of code point, letters with accents become ASCII letters
+uint32_t fold(uint32_t code) {
+  if (code >= 0xC0 && code <= 0xFF) return kLatin1Base[code - 0xC0];
+  if (code < 0xC0 || (code >= 0x2000 && code <= 0x206F))
+    return ' ';  // symbols of Latin-1 and general punctuation
+  if (code >= 0x391 && code <= 0x3A9) return code + 0x20;  // Greek
+  if (code == 0x401 || code == 0x451) return 0x435;        // yo as ye
+  if (code >= 0x400 && code <= 0x40F) return code + 0x50;  // Cyrillic
+  if (code >= 0x410 && code <= 0x42F) return code + 0x20;
+  if (code >= 0x490 && code <= 0x4BF) return code | 1;     // ghe with upturn
+  return code;
+}
+
+void append_utf8(std::string &text, uint32_t code) {
+  if (code < 0x80) {
+    text += (char)code;
+  } else if (code < 0x800) {
+    text += (char)(0xC0 | code >> 6);
+    text += (char)(0x80 | (code & 0x3F));
+  } else if (code < 0x10000) {
+    text += (char)(0xE0 | code >> 12);
+    text += (char)(0x80 | (code >> 6 & 0x3F));
+    text += (char)(0x80 | (code & 0x3F));
+  } else {
+    text += (char)(0xF0 | code >> 18);
+    text += (char)(0x80 | (code >> 12 & 0x3F));
+    text += (char)(0x80 | (code >> 6 & 0x3F));
+    text += (char)(0x80 | (code & 0x3F));
+  }
+}
+
+// trigrams inside words of every field, sorted and unique
+std::vector<uint32_t> get_trigrams(const std::string &text) {
+  std::vector<uint32_t> trigrams;
+  for (size_t i = 0; i + 3 <= text.size(); i++) {
+    const unsigned char a = text[i], b = text[i + 1], c = text[i + 2];
+    if (a == ' ' || b == ' ' || c == ' ' || a == '\n' || b == '\n' ||
+        c == '\n')
+      continue;  // queries are split into words
+    trigrams.push_back(a << 16 | b << 8 | c);
+  }
+  std::sort(trigrams.begin(), trigrams.end());
+  trigrams.erase(std::unique(trigrams.begin(), trigrams.end()),
+                 trigrams.end());
+  return trigrams;
+}
+
+// leaves candidates which are also in ascending list
+void intersect(std::vector<uint32_t> &candidates,
+               const std::vector<uint32_t> &list) {
+  size_t kept = 0;
+  if (list.size() / 16 > candidates.size()) {  // few candidates, long list
+    auto from = list.begin();
+    for (uint32_t document : candidates) {
+      from = std::lower_bound(from, list.end(), document);
+      if (from == list.end()) break;
+      if (*from == document) candidates[kept++] = document;
+    }
+  } else {
+    size_t j = 0;
+    for (uint32_t document : candidates) {
+      while (j < list.size() && list[j] < document) j++;
+      if (j == list.size()) break;
+      if (list[j] == document) candidates[kept++] = document;
+    }
+  }
+  candidates.resize(kept);
+}
+}  // namespace
+
+std::string SearchIndex::normalize(const std::string &text) {
+  std::string result;
+  result.reserve(text.size());
+  for (size_t i = 0; i < text.size();) {
+    const unsigned char c = text[i];
+    if (c < 0x80) {
+      result += std::isalnum(c) ? (char)std::tolower(c) : ' ';
+      i++;
+      continue;
+    }
+    // decode UTF-8 sequence, broken one is separator
+    size_t length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 0;
+    uint32_t code = length == 4 ? c & 0x07 : length == 3 ? c & 0x0F : c & 0x1F;
+    bool valid = length != 0 && i + length <= text.size();
+    for (size_t j = 1; valid && j < length; j++) {
+      const unsigned char next = text[i + j];
+      valid = (next & 0xC0) == 0x80;
+      code = code << 6 | (next & 0x3F);
+    }
+    if (!valid) {
+      result += ' ';
+      i++;
+      continue;
+    }
+    i += length;
+    if (code == 0xDF) {  // sharp s
+      result += "ss";
+      continue;
+    }
+    append_utf8(result, fold(code));
+  }
+  return result;
+}
+
+uint32_t SearchIndex::add_document(std::string text) {
+  const uint32_t document = m_texts.size();
+  // documents are added in ascending order, so lists stay sorted
+  for (uint32_t trigram : get_trigrams(text))
+    m_postings[trigram].push_back(document);
+  m_texts.push_back(std::move(text));
+  m_document_track.push_back(-1);
+  return document;
+}
+
+void SearchIndex::splice(int position, int removed,
+                         const std::vector<PlaylistTrack> &added) {
+  std::vector<std::string> texts;  // normalized before locking
+  texts.reserve(added.size());
+  for (const auto &track : added)
+    texts.push_back(normalize(track.title) + '\n' + normalize(track.artist) +
+                    '\n' + normalize(track.album) + '\n' +
+                    normalize(track.filename));
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const int count = m_track_document.size();
+  position = std::max(0, std::min(position, count));
+  removed = std::max(0, std::min(removed, count - position));
+  for (int i = position; i < position + removed; i++) {
+    const uint32_t document = m_track_document[i];
+    m_document_track[document] = -1;  // stays in lists until compaction
+    std::string().swap(m_texts[document]);
+    m_removed++;
+  }
+  std::vector<uint32_t> documents;
+  documents.reserve(texts.size());
+  for (auto &text : texts) documents.push_back(add_document(std::move(text)));
+  m_track_document.erase(m_track_document.begin() + position,
+                         m_track_document.begin() + position + removed);
+  m_track_document.insert(m_track_document.begin() + position,
+                          documents.begin(), documents.end());
+  // following tracks move only if count of tracks changed
+  const int end = removed == (int)documents.size() ? position + removed
+                                                   : m_track_document.size();
+  for (int i = position; i < end; i++)
+    m_document_track[m_track_document[i]] = i;
+  if (m_removed > kCompactRemoved && m_removed * 2 > m_texts.size())
+    compact();
+}
+
+void SearchIndex::compact() {
+  std::vector<std::string> texts;
+  texts.reserve(m_track_document.size());
+  for (uint32_t document : m_track_document)
+    texts.push_back(std::move(m_texts[document]));
+  m_texts.clear();
+  m_document_track.clear();
+  m_track_document.clear();
+  m_postings.clear();
+  m_removed = 0;
+  for (auto &text : texts) {
+    const uint32_t document = add_document(std::move(text));
+    m_document_track[document] = m_track_document.size();
+    m_track_document.push_back(document);
+  }
+}
+
+void SearchIndex::clear() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_texts.clear();
+  m_document_track.clear();
+  m_track_document.clear();
+  m_postings.clear();
+  m_removed = 0;
+}
+
+size_t SearchIndex::size() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_track_document.size();
+}
+
+std::vector<int> SearchIndex::search(const std::string &query, size_t offset,
+                                     size_t limit, size_t &total) const {
+  std::vector<std::string> words;
+  const std::string normalized = normalize(query);
+  for (size_t start = 0; start < normalized.size();) {
+    size_t end = normalized.find(' ', start);
+    if (end == std::string::npos) end = normalized.size();
+    if (end > start) words.push_back(normalized.substr(start, end - start));
+    start = end + 1;
+  }
+  auto matches = [&words](const std::string &text) {
+    for (const auto &word : words)
+      if (text.find(word) == std::string::npos) return false;
+    return true;
+  };
+
+  std::vector<int> results;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<const std::vector<uint32_t> *> lists;
+  for (const auto &word : words) {
+    for (size_t i = 0; i + 3 <= word.size(); i++) {
+      const unsigned char a = word[i], b = word[i + 1], c = word[i + 2];
+      auto list = m_postings.find(a << 16 | b << 8 | c);
+      if (list == m_postings.end()) {  // no track has this trigram
+        total = 0;
+        return results;
+      }
+      lists.push_back(&list->second);
+    }
+  }
+  if (lists.empty()) {  // only short words, check every track
+    for (size_t i = 0; i < m_track_document.size(); i++)
+      if (matches(m_texts[m_track_document[i]])) results.push_back(i);
+  } else {
+    // shortest list first, so candidates only shrink
+    std::sort(lists.begin(), lists.end(),
+              [](const std::vector<uint32_t> *a,
+                 const std::vector<uint32_t> *b) {
+                return a->size() < b->size();
+              });
+    lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+    std::vector<uint32_t> candidates = *lists.front();
+    for (size_t i = 1; i < lists.size() && !candidates.empty(); i++)
+      intersect(candidates, *lists[i]);
+    // trigrams may be in other order or in different fields, so check text
+    for (uint32_t document : candidates)
+      if (m_document_track[document] != -1 && matches(m_texts[document]))
+        results.push_back(m_document_track[document]);
+    if (!std::is_sorted(results.begin(), results.end()))
+      std::sort(results.begin(), results.end());  // replaced tracks
+  }
+  total = results.size();
+  offset = std::min(offset, results.size());
+  size_t end = limit == 0 ? results.size()
+                          : std::min(results.size(), offset + limit);
+  results.erase(results.begin() + end, results.end());
+  results.erase(results.begin(), results.begin() + offset);
+  return results;
+}
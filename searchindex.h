@@ -0,0 +1,75 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "playlistmodel.h"
+
+/**
+ * In-memory trigram index over title, artist, album and path of tracks of
+ * playlist or library index. Text is normalized: lower case, accents of
+ * Latin letters are dropped, punctuation separates words. Every track is
+ * document with list of its trigrams, every trigram has ascending list of
+ * documents, so query is intersection of few short lists and check of
+ * candidates, instead of scan of all tracks. Playlist index is updated with
+ * same splices as playlist view, so imported batches are indexed as they
+ * come. Thread safe.
+ */
+class SearchIndex {
+ public:
+  /**
+   * Replaces tracks: removes tracks starting at position and inserts new
+   * ones there, following tracks move
+   * @param position - index of first changed track (type: int)
+   * @param removed - count of removed tracks (type: int)
+   * @param added - inserted tracks (type: std::vector<PlaylistTrack>)
+   */
+  void splice(int position, int removed,
+              const std::vector<PlaylistTrack> &added);
+  void clear();
+  size_t size() const;
+  /**
+   * Finds tracks, which contain every word of query in title, artist, album
+   * or path. Empty query matches all tracks.
+   * @param query - words to find (type: std::string)
+   * @param offset - count of first results to skip (type: size_t)
+   * @param limit - maximal count of results, 0 for all (type: size_t)
+   * @param total - to save count of all results (type: size_t)
+   * @return indexes of tracks, ascending (type: std::vector<int>)
+   */
+  std::vector<int> search(const std::string &query, size_t offset,
+                          size_t limit, size_t &total) const;
+  /**
+   * Lowercases text, drops accents and replaces punctuation by spaces
+   * @param text - UTF-8 text (type: std::string)
+   * @return normalized text (type: std::string)
+   */
+  static std::string normalize(const std::string &text);
+
+ private:
+  /**
+   * Adds document for track, m_mutex must be locked
+   * @return id of document (type: uint32_t)
+   */
+  uint32_t add_document(std::string text);
+  /**
+   * Renumbers documents by track order and drops removed ones
+   */
+  void compact();
+
+  mutable std::mutex m_mutex;
+  // fields of every document, normalized and separated by '\n'
+  std::vector<std::string> m_texts;
+  std::vector<int> m_document_track;  // index of track, -1 if removed
+  std::vector<uint32_t> m_track_document;  // document of every track
+  // trigram packed into three bytes -> ascending documents which have it
+  std::unordered_map<uint32_t, std::vector<uint32_t>> m_postings;
+  size_t m_removed = 0;  // documents, which are still in postings
+};
+
+#endif  // SEARCHINDEX_H
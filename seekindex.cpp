@@ -0,0 +1,284 @@
+#include "seekindex.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "helper.h"
+
+namespace {
+const int kDecodeFrames = 4096;     // frames decoded by one sf_readf_float
+const uint64_t kMaxDrift = 4608;    // how far decoder may land, 4 MP3 frames
+const float kSilence = 1e-8f;       // energy per sample of silent checkpoint
+const float kMatchError = 1e-3f;    // error to energy of found checkpoint
+const float kExactError = 1e-6f;    // same, but for exactly seeking decoder
+const size_t kExactChecks = 8;      // checkpoints tested after building
+const char kMagic[4] = {'C', 'S', 'I', 'X'};
+const uint32_t kVersion = 1;
+
+// header of cache file, followed by filename and checkpoints
+struct Header {
+  char magic[4];
+  uint32_t version;
+  int64_t mtime, size;
+  uint64_t frames, points, filename_size;
+  uint32_t interval, check_frames;
+  int32_t channels;
+  uint32_t exact;
+};
+
+float squared_error(const float *a, const float *b, size_t count) {
+  float error = 0;
+  for (size_t i = 0; i < count; i++) error += (a[i] - b[i]) * (a[i] - b[i]);
+  return error;
+}
+}  // namespace
+
+bool SeekIndex::is_needed(const SF_INFO &info) {
+  if (!info.seekable) return false;  // sf_seek fails anyway
+  if ((info.format & SF_FORMAT_TYPEMASK) == SF_FORMAT_FLAC) return true;
+  switch (info.format & SF_FORMAT_SUBMASK) {
+    case SF_FORMAT_PCM_S8:
+    case SF_FORMAT_PCM_16:
+    case SF_FORMAT_PCM_24:
+    case SF_FORMAT_PCM_32:
+    case SF_FORMAT_PCM_U8:
+    case SF_FORMAT_FLOAT:
+    case SF_FORMAT_DOUBLE:
+    case SF_FORMAT_ULAW:
+    case SF_FORMAT_ALAW:
+      return false;  // position is computed, not searched
+    default:
+      return true;
+  }
+}
+
+bool SeekIndex::build(const std::string &filename,
+                      const std::atomic_bool &cancel) {
+  MappedFile mapped;
+  SF_INFO info = {0};
+  SNDFILE *file = nullptr;
+  if (mapped.open(filename)) file = mapped.open_sndfile(&info);
+  if (!file) {  // offsets stay 0, only prefetching is lost
+    mapped.close();
+    file = sf_open(filename.c_str(), SFM_READ, &info);
+  }
+  if (!file) return false;
+  if (info.channels <= 0 || !stat_file(filename, m_mtime, m_size)) {
+    sf_close(file);
+    return false;
+  }
+  m_filename = filename;
+  m_channels = info.channels;
+  m_frames = 0;
+  m_points.clear();
+  std::vector<float> buffer(kDecodeFrames * info.channels);
+  while (!cancel) {
+    size_t offset = mapped.position();  // decoder needs data from here on
+    sf_count_t got = sf_readf_float(file, buffer.data(), kDecodeFrames);
+    if (got <= 0) break;
+    for (sf_count_t i = 0; i < got; i++, m_frames++) {
+      uint64_t in_interval = m_frames % kInterval;
+      if (in_interval == 0) {
+        m_points.emplace_back();
+        m_points.back().offset = offset;
+      }
+      if (in_interval < kCheckFrames)
+        m_points.back().samples[in_interval] = buffer[i * info.channels];
+    }
+  }
+  if (cancel) {
+    sf_close(file);
+    return false;
+  }
+  if (!m_points.empty() &&
+      m_frames < (m_points.size() - 1) * kInterval + kCheckFrames)
+    m_points.pop_back();  // file ended before checkpoint was complete
+  for (Checkpoint &point : m_points) {
+    float energy = 0;
+    for (float sample : point.samples) energy += sample * sample;
+    point.energy = energy > kSilence * kCheckFrames ? energy : 0;
+  }
+  m_exact = check_exact(file, buffer);
+  sf_close(file);
+  Helper::get_instance().log(
+      "Built seek index of " + filename + ": " +
+      std::to_string(m_points.size()) + " checkpoints, " +
+      (m_exact ? "decoder seeks exactly" : "decoder seeks imprecisely"));
+  return true;
+}
+
+bool SeekIndex::check_exact(SNDFILE *file, std::vector<float> &buffer) const {
+  std::vector<size_t> tested;
+  for (size_t i = 1; i < m_points.size(); i++)
+    if (m_points[i].energy > 0) tested.push_back(i);
+  size_t step = std::max<size_t>(1, tested.size() / kExactChecks);
+  float samples[kCheckFrames];
+  for (size_t i = 0; i < tested.size(); i += step) {
+    const Checkpoint &point = m_points[tested[i]];
+    sf_count_t frame = (sf_count_t)tested[i] * kInterval;
+    if (sf_seek(file, frame, SEEK_SET) != frame) return false;
+    if (read_first_channel(file, samples, kCheckFrames, buffer) <
+            kCheckFrames ||
+        squared_error(samples, point.samples, kCheckFrames) >
+            point.energy * kExactError)
+      return false;
+  }
+  return true;  // nothing differs, or there was nothing to compare
+}
+
+bool SeekIndex::seek(SNDFILE *file, MappedFile *mapped, uint64_t frame,
+                     std::vector<float> &buffer) const {
+  if (m_points.empty() || frame > m_frames) return false;
+  size_t target = std::min<uint64_t>(frame / kInterval, m_points.size() - 1);
+  size_t point = target;
+  if (!m_exact)  // silence can't be recognized, start from earlier one
+    while (point > 0 && m_points[point].energy == 0) point--;
+  if (mapped) {  // read needed part of file before decoder asks for it
+    size_t from = m_points[point > 0 ? point - 1 : 0].offset;
+    size_t to = target + 2 < m_points.size() ? m_points[target + 2].offset
+                                             : mapped->size();
+    if (to > from) mapped->will_need(from, to - from);
+  }
+  if (m_exact) return sf_seek(file, frame, SEEK_SET) == (sf_count_t)frame;
+
+  uint64_t expected = (uint64_t)point * kInterval;
+  if (point == 0)  // every decoder starts exactly from the beginning
+    return sf_seek(file, 0, SEEK_SET) == 0 && skip(file, frame, buffer);
+  // decoder may land a bit off, find where it is by samples of checkpoint
+  uint64_t start = expected - std::min(expected, kMaxDrift);
+  if (sf_seek(file, start, SEEK_SET) < 0) return false;
+  std::vector<float> window(expected - start + kMaxDrift + kCheckFrames);
+  window.resize(read_first_channel(file, window.data(), window.size(), buffer));
+  int64_t found = find(m_points[point], window, expected - start);
+  if (found < 0) return false;
+  uint64_t position = expected + (window.size() - found);  // of decoder now
+  if (frame >= position) return skip(file, frame - position, buffer);
+  // requested frame was already decoded, decoding again from the same place
+  // lands the same way
+  return sf_seek(file, start, SEEK_SET) >= 0 &&
+         skip(file, found + (frame - expected), buffer);
+}
+
+int64_t SeekIndex::find(const Checkpoint &point,
+                        const std::vector<float> &window, size_t expected) {
+  if (window.size() < kCheckFrames) return -1;
+  const int64_t last = window.size() - kCheckFrames;
+  const int64_t middle = std::min<int64_t>(expected, last);
+  int64_t best = -1;
+  float best_error = 0;
+  // search goes from expected place, so the nearest of equal matches wins,
+  // periodic audio matches in several places
+  const int64_t reach = std::max(middle, last - middle);
+  for (int64_t distance = 0; distance <= reach; distance++) {
+    for (int64_t index : {middle - distance, middle + distance}) {
+      if (index < 0 || index > last) continue;
+      float error =
+          squared_error(window.data() + index, point.samples, kCheckFrames);
+      if (best < 0 || error < best_error) {
+        best = index;
+        best_error = error;
+      }
+    }
+    if (best >= 0 && best_error == 0) break;  // nothing can be better
+  }
+  return best >= 0 && best_error <= point.energy * kMatchError ? best : -1;
+}
+
+size_t SeekIndex::read_first_channel(SNDFILE *file, float *dst, size_t frames,
+                                     std::vector<float> &buffer) const {
+  buffer.resize(std::max<size_t>(buffer.size(), kDecodeFrames * m_channels));
+  const size_t block = buffer.size() / m_channels;
+  size_t done = 0;
+  while (done < frames) {
+    sf_count_t got =
+        sf_readf_float(file, buffer.data(), std::min(block, frames - done));
+    if (got <= 0) break;
+    for (sf_count_t i = 0; i < got; i++)
+      dst[done + i] = buffer[i * m_channels];
+    done += got;
+  }
+  return done;
+}
+
+bool SeekIndex::skip(SNDFILE *file, uint64_t frames,
+                     std::vector<float> &buffer) const {
+  buffer.resize(std::max<size_t>(buffer.size(), kDecodeFrames * m_channels));
+  const uint64_t block = buffer.size() / m_channels;
+  while (frames > 0) {
+    sf_count_t got =
+        sf_readf_float(file, buffer.data(), std::min(block, frames));
+    if (got <= 0) return false;
+    frames -= got;
+  }
+  return true;
+}
+
+bool SeekIndex::stat_file(const std::string &filename, int64_t &mtime,
+                          int64_t &size) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0) return false;
+  mtime = st.st_mtime;
+  size = st.st_size;
+  return true;
+}
+
+std::shared_ptr<const SeekIndex> SeekIndex::load_cached(
+    const std::string &filename) {
+  std::string path =
+      Helper::get_instance().get_cache_file("seek", filename, ".idx");
+  if (path.empty()) return nullptr;
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return nullptr;
+  Header header;
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion || header.interval != kInterval ||
+      header.check_frames != kCheckFrames || header.channels <= 0 ||
+      header.points > header.frames / kInterval + 1)
+    return nullptr;
+  std::string indexed(header.filename_size, '\0');
+  if (!file.read(&indexed[0], indexed.size()) || indexed != filename)
+    return nullptr;  // other file with same hash
+  auto index = std::make_shared<SeekIndex>();
+  if (!stat_file(filename, index->m_mtime, index->m_size) ||
+      index->m_mtime != header.mtime || index->m_size != header.size)
+    return nullptr;  // changed since index was built
+  index->m_points.resize(header.points);
+  if (!file.read(reinterpret_cast<char *>(index->m_points.data()),
+                 header.points * sizeof(Checkpoint)))
+    return nullptr;
+  index->m_filename = filename;
+  index->m_channels = header.channels;
+  index->m_frames = header.frames;
+  index->m_exact = header.exact != 0;
+  return index;
+}
+
+bool SeekIndex::save_cached() const {
+  std::string path =
+      Helper::get_instance().get_cache_file("seek", m_filename, ".idx");
+  if (path.empty()) return false;
+  std::string temp_path = path + ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      Helper::get_instance().log("Can't write " + temp_path);
+      return false;
+    }
+    Header header = {{0}, kVersion, m_mtime, m_size, m_frames,
+                     m_points.size(), m_filename.size(), kInterval,
+                     kCheckFrames, m_channels, m_exact};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(m_filename.data(), m_filename.size());
+    file.write(reinterpret_cast<const char *>(m_points.data()),
+               m_points.size() * sizeof(Checkpoint));
+    if (!file) return false;
+  }
+  // replace old file at once, so it is never half-written
+  return std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
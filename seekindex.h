@@ -0,0 +1,117 @@
+#ifndef SEEKINDEX_H
+#define SEEKINDEX_H
+
+#include <sndfile.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mappedfile.h"
+
+/**
+ * Seek index of compressed audio file.
+ * It is built by decoding whole file once and holds exact length of file and
+ * checkpoints at fixed intervals: offset in file where decoder was at that
+ * frame and first samples decoded there. With index seeking needs decoding of
+ * at most one interval and lands exactly on requested frame, even when
+ * decoder itself seeks imprecisely, e.g. in VBR MP3 without seek table.
+ * Indexes are cached in user's cache directory, keyed by path, modification
+ * time and size of file.
+ */
+class SeekIndex {
+ public:
+  static const uint32_t kInterval = 16384;  // frames between checkpoints
+  static const uint32_t kCheckFrames = 16;  // samples saved at checkpoint
+
+  /**
+   * Whether seeking in file of this format needs index. Seeking in
+   * uncompressed PCM is always exact and fast.
+   * @param info - format of file (type: SF_INFO)
+   */
+  static bool is_needed(const SF_INFO &info);
+  /**
+   * Decodes whole file and builds index
+   * @param filename - path to audio file (type: std::string)
+   * @param cancel - flag for canceling building (type: std::atomic_bool)
+   * @return false if file can't be decoded or building was canceled
+   */
+  bool build(const std::string &filename, const std::atomic_bool &cancel);
+  /**
+   * Loads index of file from cache
+   * @param filename - path to audio file (type: std::string)
+   * @return nullptr if there is no index or file changed since it was built
+   */
+  static std::shared_ptr<const SeekIndex> load_cached(
+      const std::string &filename);
+  /**
+   * Saves index into cache
+   * @return true on success, false otherwise (type: bool)
+   */
+  bool save_cached() const;
+  /**
+   * Seeks decoder to exact frame
+   * @param file - libsndfile handle of indexed file (type: SNDFILE *)
+   * @param mapped - mapping of file for prefetching, may be nullptr
+   * @param frame - new position in frames (type: uint64_t)
+   * @param buffer - buffer for decoded frames (type: std::vector<float>)
+   * @return false if position can't be found with index, position of
+   * decoder is undefined then
+   */
+  bool seek(SNDFILE *file, MappedFile *mapped, uint64_t frame,
+            std::vector<float> &buffer) const;
+
+  const std::string &get_filename() const { return m_filename; }
+  /**
+   * Gets exact length of file in frames
+   */
+  uint64_t get_frames() const { return m_frames; }
+  /**
+   * Whether decoder seeks exactly by itself, so checkpoints are used only
+   * for prefetching
+   */
+  bool is_exact() const { return m_exact; }
+
+ private:
+  struct Checkpoint {
+    uint64_t offset = 0;  // position of decoder in file, bytes
+    float energy = 0;     // energy of samples, 0 if they are silent
+    float samples[kCheckFrames] = {0};  // first channel from checkpoint
+  };
+  static bool stat_file(const std::string &filename, int64_t &mtime,
+                        int64_t &size);
+  /**
+   * Reads first channel of frames from current position of decoder
+   * @return count of frames read
+   */
+  size_t read_first_channel(SNDFILE *file, float *dst, size_t frames,
+                            std::vector<float> &buffer) const;
+  /**
+   * Reads and drops frames
+   * @return false if file ended earlier
+   */
+  bool skip(SNDFILE *file, uint64_t frames, std::vector<float> &buffer) const;
+  /**
+   * Finds samples of checkpoint in decoded window, search starts at
+   * expected place and goes to both sides
+   * @return index of first sample of checkpoint in window or -1
+   */
+  static int64_t find(const Checkpoint &point, const std::vector<float> &window,
+                      size_t expected);
+  /**
+   * Compares samples of some checkpoints with ones decoded right after
+   * sf_seek, to find out whether decoder seeks exactly
+   */
+  bool check_exact(SNDFILE *file, std::vector<float> &buffer) const;
+
+  std::string m_filename;
+  int64_t m_mtime = 0, m_size = 0;  // of file when index was built
+  int m_channels = 0;
+  uint64_t m_frames = 0;
+  bool m_exact = false;
+  std::vector<Checkpoint> m_points;  // checkpoint i is at frame i * kInterval
+};
+
+#endif  // SEEKINDEX_H
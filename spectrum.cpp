@@ -0,0 +1,100 @@
+#include "spectrum.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "samplekernels.h"
+
+SpectrumAnalyzer::SpectrumAnalyzer()
+    : m_window(kFftSize),
+      m_re(kFftSize),
+      m_im(kFftSize),
+      m_twiddle_re(kFftSize - 1),
+      m_twiddle_im(kFftSize - 1),
+      m_reverse(kFftSize),
+      m_frames(kFftSize) {
+  for (size_t i = 0; i < kFftSize; i++)
+    m_window[i] = 0.5 - 0.5 * std::cos(2 * M_PI * i / kFftSize);
+  // stage with half butterflies keeps its twiddles from index half - 1
+  for (size_t half = 1; half < kFftSize; half *= 2) {
+    for (size_t j = 0; j < half; j++) {
+      m_twiddle_re[half - 1 + j] = std::cos(M_PI * j / half);
+      m_twiddle_im[half - 1 + j] = -std::sin(M_PI * j / half);
+    }
+  }
+  size_t bits = 0;
+  while (((size_t)1 << bits) < kFftSize) bits++;
+  for (size_t i = 0; i < kFftSize; i++) {
+    uint32_t reversed = 0;
+    for (size_t bit = 0; bit < bits; bit++)
+      if (i & ((size_t)1 << bit)) reversed |= 1u << (bits - 1 - bit);
+    m_reverse[i] = reversed;
+  }
+}
+
+bool SpectrumAnalyzer::analyze(const AudioTap &tap,
+                               std::vector<float> &bands) {
+  int rate = tap.get_rate();
+  if (rate <= 0) return false;
+  // writer overwrites frames being copied only if reader was preempted for
+  // almost whole tap, so one more try is enough
+  if (!tap.read_latest(m_frames.data(), kFftSize) &&
+      !tap.read_latest(m_frames.data(), kFftSize))
+    return false;
+  analyze(m_frames.data(), rate, bands);
+  return true;
+}
+
+void SpectrumAnalyzer::analyze(const float *frames, int rate,
+                               std::vector<float> &bands) {
+  if (bands.empty()) return;
+  for (size_t i = 0; i < kFftSize; i++) {
+    m_re[m_reverse[i]] = frames[i] * m_window[i];
+    m_im[i] = 0;
+  }
+  transform();
+  if (rate != m_rate || m_band_bins.size() != bands.size() * 2)
+    update_bands(rate, bands.size());
+  // full scale sine windowed by Hann has power 3 * N^2 / 32 in positive bins
+  const double scale = 32.0 / (3.0 * kFftSize * kFftSize);
+  for (size_t band = 0; band < bands.size(); band++) {
+    double power = 0;
+    for (size_t bin = m_band_bins[band * 2]; bin < m_band_bins[band * 2 + 1];
+         bin++)
+      power += m_re[bin] * m_re[bin] + m_im[bin] * m_im[bin];
+    power *= scale;
+    bands[band] = power > 0 ? std::max<float>(kMinLevel, 10 * std::log10(power))
+                            : kMinLevel;
+  }
+}
+
+void SpectrumAnalyzer::transform() {
+  const SampleKernels &kernels = get_sample_kernels();
+  for (size_t half = 1; half < kFftSize; half *= 2)
+    for (size_t block = 0; block < kFftSize; block += half * 2)
+      kernels.butterflies(m_re.data() + block, m_im.data() + block,
+                          m_twiddle_re.data() + half - 1,
+                          m_twiddle_im.data() + half - 1, half);
+}
+
+void SpectrumAnalyzer::update_bands(int rate, size_t count) {
+  m_rate = rate;
+  m_band_bins.resize(count * 2);
+  const size_t last_bin = kFftSize / 2;  // Nyquist frequency
+  const double high = std::min<double>(kHighFrequency, rate / 2.0);
+  const double ratio = high / kLowFrequency;
+  auto to_bin = [&](double frequency) {
+    size_t bin = std::lround(frequency * kFftSize / rate);
+    return std::min(std::max<size_t>(bin, 1), last_bin);
+  };
+  for (size_t band = 0; band < count; band++) {
+    size_t first =
+        to_bin(kLowFrequency * std::pow(ratio, (double)band / count));
+    size_t end =
+        to_bin(kLowFrequency * std::pow(ratio, (double)(band + 1) / count));
+    first = std::min(first, last_bin - 1);
+    // narrow low bands share bins, but every band has at least one
+    m_band_bins[band * 2] = first;
+    m_band_bins[band * 2 + 1] = std::max(end, first + 1);
+  }
+}
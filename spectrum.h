@@ -0,0 +1,55 @@
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "audiotap.h"
+
+/**
+ * Computes levels of logarithmic frequency bands from latest frames of
+ * audio tap. Butterflies of FFT run on SIMD sample kernels. All buffers are
+ * allocated in constructor, so analyzing allocates only when count of bands
+ * changes.
+ */
+class SpectrumAnalyzer {
+ public:
+  static const size_t kFftSize = 2048;  // frames in one transform
+  static constexpr float kMinLevel = -120.0f;  // level of silence, dBFS
+  static constexpr float kLowFrequency = 40.0f;      // start of first band
+  static constexpr float kHighFrequency = 16000.0f;  // end of last band
+
+  SpectrumAnalyzer();
+  /**
+   * Computes band levels from kFftSize latest frames of tap
+   * @param tap - tap of audio output (type: AudioTap)
+   * @param bands - vector to save levels in dBFS, its size is count of bands.
+   * Sine of full scale gives about 0 dBFS in its band (type:
+   * std::vector<float>)
+   * @return false if tap has not enough frames (type: bool)
+   */
+  bool analyze(const AudioTap &tap, std::vector<float> &bands);
+  /**
+   * Computes band levels of mono frames
+   * @param frames - kFftSize frames (type: const float *)
+   * @param rate - sample rate of frames (type: int)
+   * @param bands - vector to save levels, like in analyze
+   */
+  void analyze(const float *frames, int rate, std::vector<float> &bands);
+
+ private:
+  void transform();
+  void update_bands(int rate, size_t count);
+
+  std::vector<float> m_window;                 // Hann window
+  std::vector<float> m_re, m_im;               // transformed frames
+  std::vector<float> m_twiddle_re, m_twiddle_im;  // all stages one by one
+  std::vector<uint32_t> m_reverse;             // bit reversed indexes
+  std::vector<float> m_frames;                 // frames copied from tap
+  // first bin and end bin of every band, computed for m_rate
+  std::vector<size_t> m_band_bins;
+  int m_rate = 0;
+};
+
+#endif  // SPECTRUM_H
@@ -0,0 +1,93 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+namespace {
+// pool and index of worker running on this thread
+thread_local const ThreadPool *current_pool = nullptr;
+thread_local size_t current_index = 0;
+}  // namespace
+
+ThreadPool::ThreadPool(size_t threads) {
+  if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t i = 0; i < threads; i++)
+    m_queues.push_back(std::make_unique<Queue>());
+  for (size_t i = 0; i < threads; i++)
+    m_threads.emplace_back(&ThreadPool::run, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  // workers only finish running tasks, queued ones are never started
+  for (auto &queue : m_queues) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    m_queued -= queue->tasks.size();
+    m_pending -= queue->tasks.size();
+    queue->tasks.clear();
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_work_cv.notify_all();
+    m_idle_cv.notify_all();
+  }
+  for (auto &thread : m_threads) thread.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  if (m_stop) return;  // pool is being destroyed
+  size_t index = current_pool == this
+                     ? current_index
+                     : m_next_queue++ % m_queues.size();
+  m_pending++;
+  {
+    std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+    m_queues[index]->tasks.push_back(std::move(task));
+    m_queued++;
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_work_cv.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_idle_cv.wait(lock, [this] { return m_pending == 0; });
+}
+
+bool ThreadPool::take(size_t index, std::function<void()> &task) {
+  for (size_t i = 0; i < m_queues.size(); i++) {
+    Queue &queue = *m_queues[(index + i) % m_queues.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) continue;
+    if (i == 0) {  // own queue, newest task, its data is still in cache
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {  // steal oldest task
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+    m_queued--;
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::run(size_t index) {
+  current_pool = this;
+  current_index = index;
+  while (!m_stop) {
+    std::function<void()> task;
+    if (take(index, task)) {
+      task();
+      if (--m_pending == 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_idle_cv.notify_all();
+      }
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_work_cv.wait(lock, [this] { return m_stop || m_queued > 0; });
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Work-stealing thread pool.
+ * Every worker has its own task queue. Worker takes newest task from its own
+ * queue and, when it is empty, steals oldest task from queue of other worker,
+ * so long and short tasks are spread over all cores without one shared queue.
+ */
+class ThreadPool {
+ public:
+  /**
+   * Starts workers
+   * @param threads - count of workers, 0 means one per core (type: size_t)
+   */
+  explicit ThreadPool(size_t threads = 0);
+  /**
+   * Drops queued tasks and waits for running ones
+   */
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /**
+   * Queues task. Task submitted from worker goes to queue of that worker.
+   * @param task - function to run (type: std::function<void()>)
+   */
+  void submit(std::function<void()> task);
+  /**
+   * Waits until all submitted tasks are finished
+   */
+  void wait();
+  /**
+   * Count of tasks which are queued or running
+   */
+  size_t pending() const { return m_pending; }
+  size_t size() const { return m_threads.size(); }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void run(size_t index);
+  /**
+   * Takes task from own queue or steals it from others
+   * @return false if all queues are empty
+   */
+  bool take(size_t index, std::function<void()> &task);
+
+  std::vector<std::unique_ptr<Queue>> m_queues;
+  std::vector<std::thread> m_threads;
+  std::mutex m_mutex;  // guards sleeping and waiting
+  std::condition_variable m_work_cv, m_idle_cv;
+  std::atomic<size_t> m_queued{0};   // tasks in queues
+  std::atomic<size_t> m_pending{0};  // tasks queued or running
+  std::atomic<size_t> m_next_queue{0};  // queue for tasks from other threads
+  std::atomic_bool m_stop{false};  // set by destructor, drops queued tasks
+};
+
+#endif  // THREADPOOL_H
@@ -0,0 +1,155 @@
+#include "timestretch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "samplekernels.h"
+
+namespace {
+const double kHopSeconds = 0.015;    // output hop, segment is twice longer
+const double kRangeSeconds = 0.008;  // how far segment may be shifted
+const size_t kCompactFrames = 8192;  // consumed input kept before erasing
+}  // namespace
+
+void TimeStretch::setup(int rate, int channels, double speed) {
+  m_channels = channels;
+  m_speed = std::max(kMinSpeed, std::min(kMaxSpeed, speed));
+  m_hop = std::max<size_t>(16, rate * kHopSeconds);
+  m_range = rate * kRangeSeconds;
+  // periodic Hann, windows shifted by hop sum to one
+  const size_t length = m_hop * 2;
+  m_window.resize(length);
+  for (size_t i = 0; i < length; i++)
+    m_window[i] = 0.5 - 0.5 * std::cos(2 * M_PI * i / length);
+  reset();
+}
+
+void TimeStretch::reset() {
+  m_input.clear();
+  m_mono.clear();
+  m_pos = 0;
+  m_prev = 0;
+  m_first = true;
+  m_draining = false;
+  m_finished = false;
+  m_end = 0;
+  m_overlap.assign(m_hop * m_channels, 0.0f);
+  m_output.clear();
+  m_output_pos = 0;
+}
+
+void TimeStretch::push(const float *in, size_t frames) {
+  const size_t channels = m_channels;
+  m_input.insert(m_input.end(), in, in + frames * channels);
+  const size_t start = m_mono.size();
+  m_mono.resize(start + frames);
+  for (size_t i = 0; i < frames; i++) {
+    float sum = 0;
+    for (size_t c = 0; c < channels; c++) sum += in[i * channels + c];
+    m_mono[start + i] = sum;
+  }
+}
+
+void TimeStretch::drain() {
+  if (m_draining) return;
+  m_end = m_mono.size();
+  // silence after end lets last segments have full windows and search range
+  const size_t padding = m_hop * 2 + m_range * 2;
+  m_input.resize(m_input.size() + padding * m_channels, 0.0f);
+  m_mono.resize(m_mono.size() + padding, 0.0f);
+  m_draining = true;
+}
+
+size_t TimeStretch::pull(float *out, size_t frames) {
+  const size_t channels = m_channels;
+  while ((m_output.size() - m_output_pos) / channels < frames && step()) {
+  }
+  size_t got =
+      std::min(frames, (m_output.size() - m_output_pos) / channels);
+  std::memcpy(out, m_output.data() + m_output_pos,
+              got * channels * sizeof(float));
+  m_output_pos += got * channels;
+  if (m_output_pos == m_output.size()) {
+    m_output.clear();
+    m_output_pos = 0;
+  }
+  compact();
+  return got;
+}
+
+uint64_t TimeStretch::pending_output() const {
+  if (m_finished) return (m_output.size() - m_output_pos) / m_channels;
+  const size_t input_end = m_draining ? m_end : m_mono.size();
+  double input_left = std::max(0.0, input_end - m_pos);
+  return input_left / m_speed + m_hop +
+         (m_output.size() - m_output_pos) / m_channels;
+}
+
+bool TimeStretch::step() {
+  if (m_finished) return false;
+  const size_t channels = m_channels, length = m_hop * 2;
+  const size_t nominal = std::lround(m_pos);
+  if (m_draining && nominal >= m_end) {
+    // tail of last segment fades out
+    m_output.insert(m_output.end(), m_overlap.begin(), m_overlap.end());
+    m_finished = true;
+    return true;
+  }
+  if (nominal + m_range + length > m_mono.size()) return false;
+  const size_t start = m_first ? nominal : search(nominal);
+  const float *segment = m_input.data() + start * channels;
+  const size_t out = m_output.size();
+  m_output.resize(out + m_hop * channels);
+  for (size_t i = 0; i < m_hop; i++) {
+    const float rise = m_window[i], fall = m_window[m_hop + i];
+    for (size_t c = 0; c < channels; c++) {
+      const size_t index = i * channels + c;
+      m_output[out + index] = m_overlap[index] + rise * segment[index];
+      m_overlap[index] = fall * segment[m_hop * channels + index];
+    }
+  }
+  m_prev = start;
+  m_first = false;
+  m_pos += m_hop * m_speed;
+  return true;
+}
+
+size_t TimeStretch::search(size_t nominal) const {
+  const SampleKernels &kernels = get_sample_kernels();
+  // previous segment would continue here, if it was not cut
+  const float *target = m_mono.data() + m_prev + m_hop;
+  const size_t from = nominal > m_range ? nominal - m_range : 0;
+  const size_t to = nominal + m_range;
+  const float *mono = m_mono.data();
+  double energy = kernels.dot(mono + from, mono + from, m_hop);
+  size_t best = nominal;
+  double best_score = -1e30;
+  for (size_t start = from; start <= to; start++) {
+    if (start > from) {  // slide energy of candidate by one frame
+      const double gone = mono[start - 1], added = mono[start + m_hop - 1];
+      energy = std::max(0.0, energy - gone * gone + added * added);
+    }
+    double correlation = kernels.dot(target, mono + start, m_hop);
+    double score = correlation / std::sqrt(energy + 1e-9);
+    if (score > best_score) {
+      best_score = score;
+      best = start;
+    }
+  }
+  return best;
+}
+
+void TimeStretch::compact() {
+  if (m_first) return;
+  const size_t nominal = std::lround(m_pos);
+  // search of next segment needs input from here
+  size_t keep = std::min(nominal > m_range ? nominal - m_range : 0,
+                         m_prev + m_hop);
+  if (keep < kCompactFrames) return;
+  m_input.erase(m_input.begin(), m_input.begin() + keep * m_channels);
+  m_mono.erase(m_mono.begin(), m_mono.begin() + keep);
+  m_pos -= keep;
+  m_prev -= keep;
+  if (m_draining) m_end -= std::min(m_end, keep);
+}
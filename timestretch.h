@@ -0,0 +1,96 @@
+#ifndef TIMESTRETCH_H
+#define TIMESTRETCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Streaming time stretcher for interleaved float audio, changes speed
+ * without changing pitch. Uses WSOLA: input is cut into Hann windowed
+ * segments, which are overlapped with fixed output hop, while analysis hop
+ * is output hop multiplied by speed. Every segment is shifted within search
+ * range to position, where it is most similar to natural continuation of
+ * previous segment, so waveforms match and no phasiness is heard.
+ * Similarity is normalized cross-correlation of mono mix, computed by SIMD
+ * dot kernel. Audio can be pushed in any portions, like into Resampler.
+ */
+class TimeStretch {
+ public:
+  static constexpr double kMinSpeed = 0.5;
+  static constexpr double kMaxSpeed = 3.0;
+
+  /**
+   * Prepares stretcher and drops all buffered audio
+   * @param rate - sample rate (type: int)
+   * @param channels - channels count (type: int)
+   * @param speed - playback speed, from kMinSpeed to kMaxSpeed (type: double)
+   */
+  void setup(int rate, int channels, double speed);
+  /**
+   * Drops buffered audio, so new stream starts, e.g. after seek
+   */
+  void reset();
+  /**
+   * Appends input frames
+   * @param in - interleaved frames (type: float *)
+   * @param frames - count of frames (type: size_t)
+   */
+  void push(const float *in, size_t frames);
+  /**
+   * Marks end of input, so last segments can be pulled
+   */
+  void drain();
+  /**
+   * Takes stretched frames
+   * @param out - buffer for interleaved frames (type: float *)
+   * @param frames - maximal count of frames (type: size_t)
+   * @return count of frames written
+   */
+  size_t pull(float *out, size_t frames);
+  /**
+   * Gets count of output frames, which pushed input will still produce.
+   * Next pushed frame appears in output right after them.
+   */
+  uint64_t pending_output() const;
+
+  double get_speed() const { return m_speed; }
+  bool is_draining() const { return m_draining; }
+
+ private:
+  /**
+   * Overlaps one more segment into output
+   * @return false if there is not enough input for it
+   */
+  bool step();
+  /**
+   * Finds start of segment near nominal position, which continues previous
+   * segment best
+   * @param nominal - position given by analysis hop (type: size_t)
+   */
+  size_t search(size_t nominal) const;
+  /**
+   * Drops input, which is not needed anymore
+   */
+  void compact();
+
+  int m_channels = 0;
+  double m_speed = 1;
+  size_t m_hop = 0;     // output hop, half of segment
+  size_t m_range = 0;   // segment may be shifted by this many frames
+  std::vector<float> m_window;  // Hann window of segment, 2 * m_hop
+
+  std::vector<float> m_input;  // interleaved input
+  std::vector<float> m_mono;   // mono mix of input for similarity search
+  double m_pos = 0;            // nominal position of next segment
+  size_t m_prev = 0;           // start of previous segment
+  bool m_first = true;         // no segment was overlapped yet
+  bool m_draining = false;     // input ended and is padded by silence
+  bool m_finished = false;     // last segment is in output
+  size_t m_end = 0;            // frames of real input, valid when draining
+  std::vector<float> m_overlap;  // windowed second half of previous segment
+  std::vector<float> m_output;   // stretched frames waiting for pull
+  size_t m_output_pos = 0;       // samples of m_output already pulled
+};
+
+#endif  // TIMESTRETCH_H
@@ -0,0 +1,186 @@
+#include "trackprobe.h"
+
+#include <sndfile.h>
+#include <sys/stat.h>
+#include <taglib/fileref.h>
+#include <taglib/tag.h>
+#include <taglib/taglib.h>
+#include <taglib/tfile.h>
+#include <taglib/tpropertymap.h>
+#if TAGLIB_MAJOR_VERSION >= 2
+#include <taglib/tvariant.h>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <unordered_set>
+
+#include "helper.h"
+
+namespace {
+// lowercase extensions of formats which libsndfile can decode
+const std::unordered_set<std::string> &decodable_extensions() {
+  static const std::unordered_set<std::string> extensions = [] {
+    std::unordered_set<std::string> result;
+    int count = 0;
+    sf_command(nullptr, SFC_GET_FORMAT_MAJOR_COUNT, &count, sizeof(count));
+    for (int i = 0; i < count; i++) {
+      SF_FORMAT_INFO info;
+      info.format = i;
+      if (sf_command(nullptr, SFC_GET_FORMAT_MAJOR, &info, sizeof(info)) != 0)
+        continue;
+      if (info.extension) result.insert(info.extension);
+      // libsndfile reports one extension per format, add usual other ones
+      switch (info.format) {
+        case SF_FORMAT_WAV:
+          result.insert("wave");
+          break;
+        case SF_FORMAT_AIFF:
+          result.insert({"aif", "aifc"});
+          break;
+        case SF_FORMAT_OGG:
+          result.insert({"ogg", "opus"});
+          break;
+        case SF_FORMAT_MPEG:
+          result.insert({"mp1", "mp2", "mp3"});
+          break;
+      }
+    }
+    return result;
+  }();
+  return extensions;
+}
+
+void set_tags(const TagLib::FileRef &ref, std::string &title,
+              std::string &artist) {
+  if (!ref.isNull() && ref.tag()) {
+    title = ref.tag()->title().to8Bit(true);
+    artist = ref.tag()->artist().to8Bit(true);
+  }
+}
+
+// first value of tag as number, value looks like "-6.53 dB"
+bool read_number(TagLib::PropertyMap &properties, const char *key,
+                 float &value) {
+  if (!properties.contains(key) || properties[key].isEmpty()) return false;
+  std::string text = properties[key].front().to8Bit(true);
+  char *end;
+  value = std::strtod(text.c_str(), &end);
+  return end != text.c_str();
+}
+
+#if TAGLIB_MAJOR_VERSION >= 2
+// 64-bit FNV-1a
+uint64_t hash_bytes(const char *data, size_t size) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= (unsigned char)data[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+#endif
+
+void set_tags(const TagLib::FileRef &ref, PlaylistTrack &track) {
+  set_tags(ref, track.title, track.artist);
+  if (ref.tag()) track.album = ref.tag()->album().to8Bit(true);
+  if (!ref.file()) return;
+  TagLib::PropertyMap properties = ref.file()->properties();
+  track.has_replaygain =
+      read_number(properties, "REPLAYGAIN_TRACK_GAIN", track.replaygain_gain);
+  if (track.has_replaygain)
+    read_number(properties, "REPLAYGAIN_TRACK_PEAK", track.replaygain_peak);
+#if TAGLIB_MAJOR_VERSION >= 2
+  // pictures are unified only since TagLib 2, older one gives no hash
+  for (const auto &picture : ref.file()->complexProperties("PICTURE")) {
+    TagLib::ByteVector data = picture.value("data").toByteVector();
+    if (!data.isEmpty()) {
+      track.art_hash = hash_bytes(data.data(), data.size());
+      break;
+    }
+  }
+#endif
+}
+}  // namespace
+
+bool TrackProbe::is_decodable(const std::string &filename) {
+  size_t dot = filename.rfind('.');
+  if (dot == std::string::npos || filename.find('/', dot) != std::string::npos)
+    return false;  // no extension
+  std::string extension = filename.substr(dot + 1);
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return decodable_extensions().count(extension) != 0;
+}
+
+bool TrackProbe::stat_file(const std::string &filename, int64_t &mtime,
+                           int64_t &size) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0) return false;
+  mtime = st.st_mtime;
+  size = st.st_size;
+  return true;
+}
+
+bool TrackProbe::probe(const std::string &filename, PlaylistTrack &track) {
+  if (!is_decodable(filename)) return false;  // e.g. cover image
+  track = PlaylistTrack();
+  track.filename = filename;
+  if (!stat_file(filename, track.mtime, track.size)) return false;
+  // fast style reads length from headers, without scanning frames
+  TagLib::FileRef ref(filename.c_str(), true, TagLib::AudioProperties::Fast);
+  if (!ref.isNull() && ref.audioProperties()) {
+    const TagLib::AudioProperties *properties = ref.audioProperties();
+    track.duration = properties->lengthInMilliseconds() / 1000.0;
+    track.sample_rate = properties->sampleRate();
+    track.channels = properties->channels();
+    set_tags(ref, track);
+  } else {  // format which TagLib does not know, e.g. AU or W64
+    SF_INFO info = {0};
+    SNDFILE *file = sf_open(filename.c_str(), SFM_READ, &info);
+    if (!file) {  // not an audio file
+      Helper::get_instance().log("Can't open " + filename + ": " +
+                                 sf_strerror(nullptr));
+      return false;
+    }
+    track.duration =
+        info.samplerate > 0 ? (double)info.frames / info.samplerate : 0;
+    track.sample_rate = info.samplerate;
+    track.channels = info.channels;
+    if (const char *value = sf_get_string(file, SF_STR_TITLE))
+      track.title = value;
+    if (const char *value = sf_get_string(file, SF_STR_ARTIST))
+      track.artist = value;
+    if (const char *value = sf_get_string(file, SF_STR_ALBUM))
+      track.album = value;
+    sf_close(file);
+  }
+  if (track.title.empty() && track.artist.empty()) track.title = filename;
+  return true;
+}
+
+bool TrackProbe::probe(const std::string &filename, std::string &title,
+                       std::string &artist, double &duration) {
+  PlaylistTrack track;
+  if (!probe(filename, track)) return false;
+  title = track.title;
+  artist = track.artist;
+  duration = track.duration;
+  return true;
+}
+
+bool TrackProbe::probe_with_decoder(const std::string &filename,
+                                    std::string &title, std::string &artist,
+                                    double &duration) {
+  SF_INFO info = {0};
+  SNDFILE *file = sf_open(filename.c_str(), SFM_READ, &info);
+  if (!file) return false;  // not an audio file
+  sf_close(file);
+  duration = info.samplerate > 0 ? (double)info.frames / info.samplerate : 0;
+  title.clear();
+  artist.clear();
+  set_tags(TagLib::FileRef(filename.c_str(), false), title, artist);
+  if (title.empty() && artist.empty()) title = filename;
+  return true;
+}
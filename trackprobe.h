@@ -0,0 +1,52 @@
+#ifndef TRACKPROBE_H
+#define TRACKPROBE_H
+
+#include <string>
+
+#include "playlistmodel.h"
+
+/**
+ * Reads title, artist and duration of audio files for playlist without
+ * creating decoder. File is accepted only when its extension belongs to
+ * format, which libsndfile can decode, so other files are rejected without
+ * opening them. Tags and duration are read from headers by TagLib, libsndfile
+ * is opened only for formats which TagLib does not know.
+ */
+class TrackProbe {
+ public:
+  /**
+   * Reads metadata of file: tags, duration, format, ReplayGain and hash of
+   * embedded cover
+   * @param filename - path to audio file (type: std::string)
+   * @param track - struct to save metadata, title is file path if file has
+   * no tags (type: PlaylistTrack)
+   * @return false if file is not audio file supported by libsndfile
+   */
+  static bool probe(const std::string &filename, PlaylistTrack &track);
+  /**
+   * Reads title, artist and duration of file
+   * @return false if file is not audio file supported by libsndfile
+   */
+  static bool probe(const std::string &filename, std::string &title,
+                    std::string &artist, double &duration);
+  /**
+   * Reads metadata like probe did before, by opening file with libsndfile
+   * and then reading tags. Kept for comparison in benchmark.
+   */
+  static bool probe_with_decoder(const std::string &filename,
+                                 std::string &title, std::string &artist,
+                                 double &duration);
+  /**
+   * Checks whether extension of file belongs to format, which libsndfile
+   * can decode
+   */
+  static bool is_decodable(const std::string &filename);
+  /**
+   * Gets modification time and size of file
+   * @return false if file does not exist
+   */
+  static bool stat_file(const std::string &filename, int64_t &mtime,
+                        int64_t &size);
+};
+
+#endif  // TRACKPROBE_H
@@ -0,0 +1,137 @@
+#include "waveform.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "helper.h"
+
+namespace {
+const char kMagic[4] = {'C', 'W', 'A', 'V'};
+const uint32_t kVersion = 1;
+
+// header of cache file, followed by filename and peaks of every level
+struct Header {
+  char magic[4];
+  uint32_t version;
+  int64_t mtime, size;  // of audio file
+  uint64_t frames;
+  uint32_t base_frames, factor, levels, filename_size;
+  uint64_t counts[Waveform::kMaxLevels];   // peaks of level
+  uint64_t offsets[Waveform::kMaxLevels];  // bytes from start of file
+};
+
+bool stat_file(const std::string &filename, int64_t &mtime, int64_t &size) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0) return false;
+  mtime = st.st_mtime;
+  size = st.st_size;
+  return true;
+}
+}  // namespace
+
+Waveform::~Waveform() { close(); }
+
+void Waveform::close() {
+  if (m_data) munmap(m_data, m_size);
+  m_data = nullptr;
+  m_size = 0;
+  m_levels.clear();
+}
+
+bool Waveform::open(const std::string &path, const std::string &filename) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return false;  // not computed yet
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(Header)) {
+    ::close(fd);
+    return false;
+  }
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);  // mapping keeps file open
+  if (data == MAP_FAILED) return false;
+  m_data = static_cast<uint8_t *>(data);
+  m_size = st.st_size;
+
+  const Header *header = reinterpret_cast<const Header *>(m_data);
+  int64_t mtime, size;
+  if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+      header->version != kVersion || header->base_frames != kBaseFrames ||
+      header->factor != kFactor || header->levels > kMaxLevels ||
+      sizeof(Header) + header->filename_size > m_size ||
+      filename.compare(0, std::string::npos,
+                       reinterpret_cast<const char *>(m_data + sizeof(Header)),
+                       header->filename_size) != 0 ||
+      !stat_file(filename, mtime, size) || mtime != header->mtime ||
+      size != header->size) {
+    close();  // other file with same hash, old format or file changed
+    return false;
+  }
+  for (uint32_t i = 0; i < header->levels; i++) {
+    uint64_t offset = header->offsets[i], count = header->counts[i];
+    if (offset > m_size || count > (m_size - offset) / sizeof(WaveformPeak)) {
+      close();  // truncated file
+      return false;
+    }
+    m_levels.push_back(
+        {reinterpret_cast<const WaveformPeak *>(m_data + offset), count});
+  }
+  m_frames = header->frames;
+  return !m_levels.empty();
+}
+
+bool Waveform::save(const std::string &path, const std::string &filename,
+                    uint64_t frames,
+                    const std::vector<std::vector<WaveformPeak>> &levels) {
+  Header header = {{0}};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  if (!stat_file(filename, header.mtime, header.size)) return false;
+  header.frames = frames;
+  header.base_frames = kBaseFrames;
+  header.factor = kFactor;
+  header.levels = std::min<size_t>(levels.size(), kMaxLevels);
+  header.filename_size = filename.size();
+  uint64_t offset = sizeof(Header) + filename.size();
+  for (uint32_t i = 0; i < header.levels; i++) {
+    header.counts[i] = levels[i].size();
+    header.offsets[i] = offset;
+    offset += levels[i].size() * sizeof(WaveformPeak);
+  }
+  std::string temp_path = path + ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      Helper::get_instance().log("Can't write " + temp_path);
+      return false;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(filename.data(), filename.size());
+    for (uint32_t i = 0; i < header.levels; i++)
+      file.write(reinterpret_cast<const char *>(levels[i].data()),
+                 levels[i].size() * sizeof(WaveformPeak));
+    if (!file) return false;
+  }
+  // replace old file at once, so mapped one is never half-written
+  return std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+size_t Waveform::choose_level(size_t width) const {
+  size_t level = 0;
+  while (level + 1 < m_levels.size() && m_levels[level + 1].count >= width)
+    level++;
+  return level;
+}
+
+const WaveformPeak *Waveform::get_level(size_t level, size_t &count) const {
+  if (level >= m_levels.size()) return nullptr;
+  count = m_levels[level].count;
+  return m_levels[level].peaks;
+}
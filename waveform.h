@@ -0,0 +1,81 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Lowest and highest sample of part of track, full scale is 127
+ */
+struct WaveformPeak {
+  int8_t min, max;
+};
+
+/**
+ * Overview of audio file for drawing: peaks at several resolutions, every
+ * next level has kFactor times fewer peaks. It is read straight from memory
+ * mapped cache file, so drawing never decodes audio.
+ */
+class Waveform {
+ public:
+  static const uint32_t kBaseFrames = 512;  // frames of one peak of level 0
+  static const uint32_t kFactor = 4;        // peaks merged into next level
+  static const uint32_t kMinPeaks = 128;    // no level is coarser than this
+  static const uint32_t kMaxLevels = 16;
+
+  Waveform() = default;
+  Waveform(const Waveform &) = delete;
+  Waveform &operator=(const Waveform &) = delete;
+  ~Waveform();
+  /**
+   * Maps cache file of audio file
+   * @param path - path to cache file (type: std::string)
+   * @param filename - path to audio file, it must not be changed since cache
+   * file was written (type: std::string)
+   * @return false if there is no valid cache file
+   */
+  bool open(const std::string &path, const std::string &filename);
+  /**
+   * Writes cache file
+   * @param path - path to cache file (type: std::string)
+   * @param filename - path to audio file (type: std::string)
+   * @param frames - length of audio file in frames (type: uint64_t)
+   * @param levels - peaks of every level, from finest one
+   * @return true on success, false otherwise (type: bool)
+   */
+  static bool save(const std::string &path, const std::string &filename,
+                   uint64_t frames,
+                   const std::vector<std::vector<WaveformPeak>> &levels);
+  /**
+   * Chooses level for drawing
+   * @param width - how many peaks are drawn, e.g. width of widget in pixels
+   * (type: size_t)
+   * @return coarsest level which still has enough peaks, or finest one
+   */
+  size_t choose_level(size_t width) const;
+  /**
+   * Gets peaks of level
+   * @param level - level, 0 is the finest one (type: size_t)
+   * @param count - variable to save count of peaks (type: size_t)
+   * @return peaks or nullptr if there is no such level
+   */
+  const WaveformPeak *get_level(size_t level, size_t &count) const;
+  size_t get_levels() const { return m_levels.size(); }
+  uint64_t get_frames() const { return m_frames; }
+
+ private:
+  struct Level {
+    const WaveformPeak *peaks;
+    size_t count;
+  };
+  void close();
+
+  uint8_t *m_data = nullptr;  // mapped cache file
+  size_t m_size = 0;
+  uint64_t m_frames = 0;
+  std::vector<Level> m_levels;
+};
+
+#endif  // WAVEFORM_H
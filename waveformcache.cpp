@@ -0,0 +1,131 @@
+#include "waveformcache.h"
+
+#include <sndfile.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "helper.h"
+#include "mappedfile.h"
+
+namespace {
+const int kDecodeFrames = 16384;  // frames decoded by one sf_readf_float
+
+int8_t to_peak(float sample) {
+  return (int8_t)std::lround(std::min(1.0f, std::max(-1.0f, sample)) * 127);
+}
+}  // namespace
+
+WaveformCache::~WaveformCache() {
+  m_cancel = true;
+  m_pool.reset();  // running computations stop, queued ones are dropped
+}
+
+void WaveformCache::request(const std::string &filename) {
+  if (get(filename)) return;  // already computed
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_queued.insert(filename).second) return;  // already queued
+  if (!m_pool) m_pool = std::make_unique<ThreadPool>();
+  m_pool->submit([this, filename] { compute_file(filename); });
+}
+
+std::shared_ptr<const Waveform> WaveformCache::get(
+    const std::string &filename) {
+  std::string path = cache_path(filename);
+  if (path.empty()) return nullptr;
+  auto waveform = std::make_shared<Waveform>();
+  if (!waveform->open(path, filename)) return nullptr;
+  return waveform;
+}
+
+void WaveformCache::set_ready_callback(
+    std::function<void(const std::string &)> callback) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_ready_callback = std::move(callback);
+}
+
+std::string WaveformCache::cache_path(const std::string &filename) {
+  return Helper::get_instance().get_cache_file("waveform", filename, ".peaks");
+}
+
+void WaveformCache::compute_file(const std::string &filename) {
+  std::vector<std::vector<WaveformPeak>> levels;
+  uint64_t frames = 0;
+  std::string path = cache_path(filename);
+  bool ok = !path.empty() && compute(filename, levels, frames, m_cancel) &&
+            Waveform::save(path, filename, frames, levels);
+  std::function<void(const std::string &)> callback;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queued.erase(filename);
+    callback = m_ready_callback;
+  }
+  if (!ok) {
+    if (!m_cancel)
+      Helper::get_instance().log("Can't compute waveform of " + filename);
+    return;
+  }
+  if (callback) callback(filename);
+}
+
+bool WaveformCache::compute(const std::string &filename,
+                            std::vector<std::vector<WaveformPeak>> &levels,
+                            uint64_t &frames, const std::atomic_bool &cancel) {
+  MappedFile mapped;
+  SF_INFO info = {0};
+  SNDFILE *file = nullptr;
+  if (mapped.open(filename)) file = mapped.open_sndfile(&info);
+  if (!file) file = sf_open(filename.c_str(), SFM_READ, &info);
+  if (!file) return false;
+  if (info.channels <= 0) {
+    sf_close(file);
+    return false;
+  }
+  const size_t channels = info.channels;
+  levels.assign(1, {});
+  if (info.frames > 0)
+    levels[0].reserve(info.frames / Waveform::kBaseFrames + 1);
+  std::vector<float> buffer(kDecodeFrames * channels);
+  float low = 0, high = 0;  // of current peak
+  uint32_t in_peak = 0;     // frames in current peak
+  frames = 0;
+  sf_count_t got;
+  while (!cancel &&
+         (got = sf_readf_float(file, buffer.data(), kDecodeFrames)) > 0) {
+    for (size_t i = 0; i < (size_t)got * channels; i += channels) {
+      for (size_t c = 0; c < channels; c++) {  // all channels in one peak
+        low = std::min(low, buffer[i + c]);
+        high = std::max(high, buffer[i + c]);
+      }
+      if (++in_peak == Waveform::kBaseFrames) {
+        levels[0].push_back({to_peak(low), to_peak(high)});
+        low = high = 0;
+        in_peak = 0;
+      }
+    }
+    frames += got;
+  }
+  sf_close(file);
+  if (cancel) return false;
+  if (in_peak > 0) levels[0].push_back({to_peak(low), to_peak(high)});
+
+  // every next level merges kFactor peaks of previous one
+  while (levels.back().size() > Waveform::kMinPeaks &&
+         levels.size() < Waveform::kMaxLevels) {
+    const std::vector<WaveformPeak> &finer = levels.back();
+    std::vector<WaveformPeak> coarser;
+    coarser.reserve(finer.size() / Waveform::kFactor + 1);
+    for (size_t i = 0; i < finer.size(); i += Waveform::kFactor) {
+      WaveformPeak peak = finer[i];
+      for (size_t j = i + 1; j < std::min(finer.size(), i + Waveform::kFactor);
+           j++) {
+        peak.min = std::min(peak.min, finer[j].min);
+        peak.max = std::max(peak.max, finer[j].max);
+      }
+      coarser.push_back(peak);
+    }
+    levels.push_back(std::move(coarser));
+  }
+  return true;
+}
@@ -0,0 +1,65 @@
+#ifndef WAVEFORMCACHE_H
+#define WAVEFORMCACHE_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "threadpool.h"
+#include "waveform.h"
+
+/**
+ * Computes waveforms of local files on work-stealing pool and keeps them in
+ * cache files, one per audio file, in user's cache directory. Cache file is
+ * computed again only after audio file changed.
+ */
+class WaveformCache {
+ public:
+  /**
+   * Cancels computing and drops queued files
+   */
+  ~WaveformCache();
+  /**
+   * Queues file for computing, if it has no fresh cache file yet
+   * @param filename - path to audio file (type: std::string)
+   */
+  void request(const std::string &filename);
+  /**
+   * Maps cache file of audio file
+   * @param filename - path to audio file (type: std::string)
+   * @return nullptr if waveform is not computed yet
+   */
+  std::shared_ptr<const Waveform> get(const std::string &filename);
+  /**
+   * Sets function, which is called from worker thread when waveform of file
+   * is computed
+   */
+  void set_ready_callback(std::function<void(const std::string &)> callback);
+  /**
+   * Decodes whole file and computes peaks of every level
+   * @param filename - path to audio file (type: std::string)
+   * @param levels - vector to save peaks, from finest level
+   * @param frames - variable to save length of file in frames
+   * @param cancel - flag for canceling computing (type: std::atomic_bool)
+   * @return false if file can't be decoded or computing was canceled
+   */
+  static bool compute(const std::string &filename,
+                      std::vector<std::vector<WaveformPeak>> &levels,
+                      uint64_t &frames, const std::atomic_bool &cancel);
+
+ private:
+  static std::string cache_path(const std::string &filename);
+  void compute_file(const std::string &filename);
+
+  std::mutex m_mutex;
+  std::unordered_set<std::string> m_queued;  // files queued or computed now
+  std::function<void(const std::string &)> m_ready_callback;
+  std::unique_ptr<ThreadPool> m_pool;  // started on first request
+  std::atomic_bool m_cancel{false};
+};
+
+#endif  // WAVEFORMCACHE_H
@@ -0,0 +1,64 @@
+#include "waveformscale.h"
+
+#include <algorithm>
+
+namespace {
+const int kWaveformHeight = 48;     // height of scale with waveform
+const double kPlayedAlpha = 0.8;    // opacity of played part
+const double kUnplayedAlpha = 0.3;  // opacity of part which is not played
+}  // namespace
+
+WaveformScale::WaveformScale() {
+  // played part of waveform moves together with slider
+  signal_value_changed().connect([this] {
+    if (m_waveform) queue_draw();
+  });
+}
+
+void WaveformScale::set_waveform(std::shared_ptr<const Waveform> waveform) {
+  if (waveform == m_waveform) return;
+  m_waveform = std::move(waveform);
+  set_size_request(-1, m_waveform ? kWaveformHeight : -1);
+  queue_draw();
+}
+
+void WaveformScale::snapshot_vfunc(
+    const Glib::RefPtr<Gtk::Snapshot> &snapshot) {
+  const int width = get_width(), height = get_height();
+  size_t count = 0;
+  const WaveformPeak *peaks =
+      m_waveform && width > 0 && height > 0
+          ? m_waveform->get_level(m_waveform->choose_level(width), count)
+          : nullptr;
+  if (peaks && count > 0) {
+    auto cr = snapshot->append_cairo(Gdk::Rectangle(0, 0, width, height));
+    auto adjustment = get_adjustment();
+    double range = adjustment->get_upper() - adjustment->get_lower();
+    int played =
+        range > 0 ? (get_value() - adjustment->get_lower()) / range * width
+                  : 0;
+    const double middle = height / 2.0, scale = middle / 127;
+    Gdk::RGBA color = get_style_context()->get_color();
+    // one bar per pixel from peaks under it, chosen level has at most
+    // kFactor times more peaks than pixels
+    auto draw_bars = [&](int from, int to, double alpha) {
+      for (int x = from; x < to; x++) {
+        size_t first = (size_t)x * count / width;
+        size_t last = std::max(first + 1, (size_t)(x + 1) * count / width);
+        int low = 0, high = 0;
+        for (size_t i = first; i < std::min(last, count); i++) {
+          low = std::min<int>(low, peaks[i].min);
+          high = std::max<int>(high, peaks[i].max);
+        }
+        cr->rectangle(x, middle - high * scale, 1,
+                      std::max(1.0, (high - low) * scale));
+      }
+      cr->set_source_rgba(color.get_red(), color.get_green(),
+                          color.get_blue(), color.get_alpha() * alpha);
+      cr->fill();
+    };
+    draw_bars(0, std::min(played, width), kPlayedAlpha);
+    draw_bars(std::max(played, 0), width, kUnplayedAlpha);
+  }
+  Gtk::Scale::snapshot_vfunc(snapshot);  // trough and slider over waveform
+}
@@ -0,0 +1,34 @@
+#ifndef WAVEFORMSCALE_H
+#define WAVEFORMSCALE_H
+
+#include <gtkmm/scale.h>
+#include <gtkmm/snapshot.h>
+
+#include <memory>
+
+#include "waveform.h"
+
+/**
+ * Seek bar, which draws waveform of current track under its slider.
+ * Without waveform it looks like plain Gtk::Scale. Value of scale must be
+ * in range of its adjustment, played part of waveform is highlighted.
+ */
+class WaveformScale : public Gtk::Scale {
+ public:
+  WaveformScale();
+  virtual ~WaveformScale() {}
+  /**
+   * Sets waveform to draw
+   * @param waveform - waveform of current track, nullptr to draw plain
+   * scale (type: std::shared_ptr<const Waveform>)
+   */
+  void set_waveform(std::shared_ptr<const Waveform> waveform);
+
+ protected:
+  void snapshot_vfunc(const Glib::RefPtr<Gtk::Snapshot> &snapshot) override;
+
+ private:
+  std::shared_ptr<const Waveform> m_waveform;
+};
+
+#endif  // WAVEFORMSCALE_H